@@ -534,6 +534,53 @@ public:
     return isInsideTriangle(proj_p);
   }
 
+  /// Closest point on the triangle (including edges and vertices) to a point
+  Vector3 closestPoint(const Vector3& p) const {
+    // Voronoi region test (see Ericson, Real-Time Collision Detection, 5.1.5)
+    const Vector3 ab = v2_ - v1_;
+    const Vector3 ac = v3_ - v1_;
+    const Vector3 ap = p - v1_;
+    const FloatType d1 = ab.dot(ap);
+    const FloatType d2 = ac.dot(ap);
+    if (d1 <= 0 && d2 <= 0) {
+      return v1_;
+    }
+    const Vector3 bp = p - v2_;
+    const FloatType d3 = ab.dot(bp);
+    const FloatType d4 = ac.dot(bp);
+    if (d3 >= 0 && d4 <= d3) {
+      return v2_;
+    }
+    const FloatType vc = d1 * d4 - d3 * d2;
+    if (vc <= 0 && d1 >= 0 && d3 <= 0) {
+      return v1_ + d1 / (d1 - d3) * ab;
+    }
+    const Vector3 cp = p - v3_;
+    const FloatType d5 = ab.dot(cp);
+    const FloatType d6 = ac.dot(cp);
+    if (d6 >= 0 && d5 <= d6) {
+      return v3_;
+    }
+    const FloatType vb = d5 * d2 - d1 * d6;
+    if (vb <= 0 && d2 >= 0 && d6 <= 0) {
+      return v1_ + d2 / (d2 - d6) * ac;
+    }
+    const FloatType va = d3 * d6 - d5 * d4;
+    if (va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0) {
+      return v2_ + (d4 - d3) / ((d4 - d3) + (d5 - d6)) * (v3_ - v2_);
+    }
+    const FloatType denom = 1 / (va + vb + vc);
+    return v1_ + ab * (vb * denom) + ac * (vc * denom);
+  }
+
+  FloatType squaredDistanceTo(const Vector3& p) const {
+    return (closestPoint(p) - p).squaredNorm();
+  }
+
+  FloatType distanceTo(const Vector3& p) const {
+    return std::sqrt(squaredDistanceTo(p));
+  }
+
   Triangle getCanonicalTriangle() const {
     const FloatType l1 = (v2_ - v1_).squaredNorm();
     const FloatType l2 = (v3_ - v2_).squaredNorm();
@@ -671,6 +718,52 @@ public:
     }
   }
 
+  /// Exact triangle/box overlap test
+  bool intersects(const BoundingBox3D<FloatT>& bbox) const {
+    return intersectsBox(bbox.getCenter(), bbox.getExtent() / 2);
+  }
+
+  /// Exact triangle/box overlap test with the box given by center and half extents
+  bool intersectsBox(const Vector3& box_center, const Vector3& box_half_extent) const {
+    // Separating axis test
+    // (see Akenine-Moeller, Fast 3D Triangle-Box Overlap Testing)
+    const Vector3 v0 = v1_ - box_center;
+    const Vector3 v1 = v2_ - box_center;
+    const Vector3 v2 = v3_ - box_center;
+    // Box normals
+    for (std::size_t i = 0; i < 3; ++i) {
+      const FloatT min = std::min(v0(i), std::min(v1(i), v2(i)));
+      const FloatT max = std::max(v0(i), std::max(v1(i), v2(i)));
+      if (min > box_half_extent(i) || max < -box_half_extent(i)) {
+        return false;
+      }
+    }
+    // Cross products of triangle edges and box normals
+    const std::array<Vector3, 3> vertices = {{ v0, v1, v2 }};
+    const std::array<Vector3, 3> edges = {{ v1 - v0, v2 - v1, v0 - v2 }};
+    for (const Vector3& edge : edges) {
+      for (std::size_t i = 0; i < 3; ++i) {
+        const Vector3 axis = Vector3::Unit(i).cross(edge);
+        FloatT min = std::numeric_limits<FloatT>::max();
+        FloatT max = std::numeric_limits<FloatT>::lowest();
+        for (const Vector3& vertex : vertices) {
+          const FloatT p = axis.dot(vertex);
+          min = std::min(min, p);
+          max = std::max(max, p);
+        }
+        const FloatT radius = box_half_extent.dot(axis.cwiseAbs());
+        if (min > radius || max < -radius) {
+          return false;
+        }
+      }
+    }
+    // Triangle normal
+    const Vector3 normal = edges[0].cross(edges[1]);
+    const FloatT distance = normal.dot(v0);
+    const FloatT radius = box_half_extent.dot(normal.cwiseAbs());
+    return std::abs(distance) <= radius;
+  }
+
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
 private:
@@ -7,8 +7,16 @@
 //==================================================
 #pragma once
 
+#include <algorithm>
+#include <cstddef>
 #include <memory>
 #include <functional>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <boost/functional/hash.hpp>
+#include "common.h"
 
 namespace bh {
 
@@ -37,6 +45,60 @@ private:
   FactoryType factory_;
 };
 
+/// Pool of objects allocated in large blocks.
+///
+/// Objects cannot be released individually. All objects are destroyed and the memory released at once
+/// with clear() or when the pool is destroyed, which only frees one allocation per block.
+/// Pointers to objects stay valid until then.
+template <typename T>
+class ObjectPool {
+public:
+  static constexpr std::size_t kDefaultBlockSize = 4096;
+
+  explicit ObjectPool(const std::size_t block_size = kDefaultBlockSize);
+
+  ObjectPool(const ObjectPool& other) = delete;
+
+  ObjectPool(ObjectPool&& other);
+
+  ObjectPool& operator=(const ObjectPool& other) = delete;
+
+  ObjectPool& operator=(ObjectPool&& other);
+
+  ~ObjectPool();
+
+  /// Construct a new object in the pool
+  template <typename... Args>
+  T* create(Args&&... args);
+
+  /// Make sure the next num_objects objects can be created without further allocations
+  void reserve(const std::size_t num_objects);
+
+  /// Destroy all objects and release the memory
+  void clear();
+
+  /// Number of objects in the pool
+  std::size_t size() const;
+
+  /// Number of bytes allocated by the pool
+  std::size_t getAllocatedBytes() const;
+
+private:
+  using StorageType = typename std::aligned_storage<sizeof(T), alignof(T)>::type;
+
+  struct Block {
+    std::unique_ptr<StorageType[]> storage;
+    std::size_t capacity;
+    std::size_t size;
+  };
+
+  void allocateBlock(const std::size_t capacity);
+
+  std::size_t block_size_;
+  std::vector<Block> blocks_;
+  std::size_t size_;
+};
+
 // -------------------------
 // Hash function for pairs and tuples
 // -------------------------
@@ -109,6 +171,101 @@ std::unique_ptr<T> reinterpret_cast_ptr(std::unique_ptr<U>&& ptr) {
   return std::move(std::unique_ptr<T>(raw_ptr));
 }
 
+// -------------------------
+// Object pool implementation
+// -------------------------
+
+template <typename T>
+constexpr std::size_t ObjectPool<T>::kDefaultBlockSize;
+
+template <typename T>
+ObjectPool<T>::ObjectPool(const std::size_t block_size)
+: block_size_(block_size), size_(0) {
+  BH_ASSERT(block_size > 0);
+}
+
+template <typename T>
+ObjectPool<T>::ObjectPool(ObjectPool&& other)
+: block_size_(other.block_size_), blocks_(std::move(other.blocks_)), size_(other.size_) {
+  other.blocks_.clear();
+  other.size_ = 0;
+}
+
+template <typename T>
+ObjectPool<T>& ObjectPool<T>::operator=(ObjectPool&& other) {
+  if (this != &other) {
+    clear();
+    block_size_ = other.block_size_;
+    blocks_ = std::move(other.blocks_);
+    size_ = other.size_;
+    other.blocks_.clear();
+    other.size_ = 0;
+  }
+  return *this;
+}
+
+template <typename T>
+ObjectPool<T>::~ObjectPool() {
+  clear();
+}
+
+template <typename T>
+template <typename... Args>
+T* ObjectPool<T>::create(Args&&... args) {
+  if (blocks_.empty() || blocks_.back().size == blocks_.back().capacity) {
+    allocateBlock(block_size_);
+  }
+  Block& block = blocks_.back();
+  T* object = new (&block.storage[block.size]) T(std::forward<Args>(args)...);
+  ++block.size;
+  ++size_;
+  return object;
+}
+
+template <typename T>
+void ObjectPool<T>::reserve(const std::size_t num_objects) {
+  const std::size_t available = blocks_.empty() ? 0 : blocks_.back().capacity - blocks_.back().size;
+  if (num_objects > available) {
+    allocateBlock(num_objects);
+  }
+}
+
+template <typename T>
+void ObjectPool<T>::clear() {
+  if (!std::is_trivially_destructible<T>::value) {
+    for (Block& block : blocks_) {
+      for (std::size_t i = 0; i < block.size; ++i) {
+        reinterpret_cast<T*>(&block.storage[i])->~T();
+      }
+    }
+  }
+  blocks_.clear();
+  size_ = 0;
+}
+
+template <typename T>
+std::size_t ObjectPool<T>::size() const {
+  return size_;
+}
+
+template <typename T>
+std::size_t ObjectPool<T>::getAllocatedBytes() const {
+  std::size_t allocated_bytes = 0;
+  for (const Block& block : blocks_) {
+    allocated_bytes += block.capacity * sizeof(StorageType);
+  }
+  return allocated_bytes;
+}
+
+template <typename T>
+void ObjectPool<T>::allocateBlock(const std::size_t capacity) {
+  Block block;
+  block.storage.reset(new StorageType[capacity]);
+  block.capacity = capacity;
+  block.size = 0;
+  blocks_.push_back(std::move(block));
+}
+
 // -------------------------
 // Cache storage implementation
 // -------------------------
@@ -8,6 +8,7 @@
 
 #include <algorithm>
 #include <forward_list>
+#include <string>
 #include <flann/flann.hpp>
 #include "../common.h"
 #include "../eigen.h"
@@ -50,6 +51,14 @@ public:
 
   void addPoint(const Point& point, FloatType rebuild_threshold = 2);
 
+  /// Save the index structure (without the points) so that it can be restored without rebuilding it
+  void saveIndex(const std::string& filename) const;
+
+  /// Restore an index saved with saveIndex.
+  /// The points have to be the same and in the same order as the points of the saved index.
+  template <typename Iterator>
+  void loadIndex(const std::string& filename, Iterator begin, Iterator end);
+
   Point getPoint(std::size_t point_id) const;
 
   struct SingleResult {
@@ -106,6 +106,36 @@ void ApproximateNearestNeighbor<FloatT, dimension, NormT>::addPoint(
   ++points_size_;
 }
 
+template<typename FloatT, std::size_t dimension, typename NormT>
+void ApproximateNearestNeighbor<FloatT, dimension, NormT>::saveIndex(const std::string& filename) const {
+  BH_ASSERT(initialized_);
+  // FLANN is not supposed to modify anything
+  flann::Index <NormT> &index_const = const_cast<flann::Index <NormT> &>(index_);
+  index_const.save(filename);
+}
+
+template<typename FloatT, std::size_t dimension, typename NormT>
+template<typename Iterator>
+void ApproximateNearestNeighbor<FloatT, dimension, NormT>::loadIndex(
+        const std::string& filename, Iterator begin, Iterator end) {
+  clear();
+  if (begin == end) {
+    return;
+  }
+  // The saved index only references the points so they have to be dense
+  init_points_.reserve(end - begin);
+  for (Iterator it = begin; it != end; ++it) {
+    FlannPointType flann_point;
+    for (std::size_t col = 0; col < dimension; ++col) {
+      flann_point[col] = (*it)(col);
+    }
+    init_points_.push_back(flann_point);
+  }
+  FlannMatrix flann_points(&(init_points_.front())[0], init_points_.size(), dimension);
+  index_ = flann::Index<NormT>(flann_points, flann::SavedIndexParams(filename), norm_);
+  initialized_ = true;
+}
+
 template<typename FloatT, std::size_t dimension, typename NormT>
 auto ApproximateNearestNeighbor<FloatT, dimension, NormT>::getPoint(std::size_t point_id) const -> Point {
   // FLANN is not supposed to modify anything
@@ -8,6 +8,7 @@
 #pragma once
 
 #include <thread>
+#include <map>
 #include <mutex>
 #include <condition_variable>
 #include <atomic>
@@ -248,4 +249,61 @@ private:
   bool verbose_;
 };
 
+/// Bounded queue that hands out items in the order of their index.
+///
+/// Producers can finish items out of order but an item is only accepted if its index is within
+/// capacity items of the next index to be popped. Thus at most capacity items are buffered.
+/// Items must be pushed for every index without gaps.
+template <typename T>
+class OrderedBoundedQueue {
+public:
+  explicit OrderedBoundedQueue(const std::size_t capacity)
+  : capacity_(capacity), next_index_(0) {
+    BH_ASSERT(capacity > 0);
+  }
+
+  OrderedBoundedQueue(const OrderedBoundedQueue& other) = delete;
+
+  /// Blocks until an item with the given index can be pushed without exceeding the capacity.
+  /// Call this before producing the item to also bound the number of items in production.
+  void waitForSlot(const std::size_t index) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    slot_cond_.wait(lock, [&]() {
+      return index < next_index_ + capacity_;
+    });
+  }
+
+  void push(const std::size_t index, T&& item) {
+    waitForSlot(index);
+    std::unique_lock<std::mutex> lock(mutex_);
+    items_.emplace(index, std::move(item));
+    item_cond_.notify_all();
+  }
+
+  /// Blocks until the item with the next index is available
+  T pop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    item_cond_.wait(lock, [&]() {
+      return !items_.empty() && items_.begin()->first == next_index_;
+    });
+    T item = std::move(items_.begin()->second);
+    items_.erase(items_.begin());
+    ++next_index_;
+    slot_cond_.notify_all();
+    return item;
+  }
+
+  std::size_t capacity() const {
+    return capacity_;
+  }
+
+private:
+  const std::size_t capacity_;
+  std::size_t next_index_;
+  std::map<std::size_t, T> items_;
+  std::mutex mutex_;
+  std::condition_variable slot_cond_;
+  std::condition_variable item_cond_;
+};
+
 }
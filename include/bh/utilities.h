@@ -111,6 +111,12 @@ public:
 
 };
 
+/// Current resident set size of the process in bytes (0 if not available)
+std::size_t getResidentSetSize();
+
+/// Peak resident set size of the process in bytes (0 if not available)
+std::size_t getPeakResidentSetSize();
+
 class PaceMaker {
 public:
     using clock = std::chrono::high_resolution_clock;
@@ -7,6 +7,7 @@
 //==================================================
 
 #include <bh/utilities.h>
+#include <fstream>
 #include <iostream>
 
 namespace bh
@@ -124,6 +125,31 @@ uint64_t Timer::printTimingMs(const std::string &name) const
   return elapsed_ms;
 }
 
+namespace {
+
+/// Read a memory entry (e.g. VmRSS) from /proc/self/status in bytes
+std::size_t readProcStatusMemoryEntry(const std::string& entry_name) {
+  std::ifstream ifs("/proc/self/status");
+  std::string line;
+  while (std::getline(ifs, line)) {
+    if (line.compare(0, entry_name.size() + 1, entry_name + ":") == 0) {
+      const std::size_t kilobytes = std::stoull(line.substr(entry_name.size() + 1));
+      return kilobytes * 1024;
+    }
+  }
+  return 0;
+}
+
+}
+
+std::size_t getResidentSetSize() {
+  return readProcStatusMemoryEntry("VmRSS");
+}
+
+std::size_t getPeakResidentSetSize() {
+  return readProcStatusMemoryEntry("VmHWM");
+}
+
 
 #if not WITH_PROFILING
   void ProfilingTimer::start()
@@ -5,7 +5,9 @@
  *      Author: bhepp
  */
 
+#include <atomic>
 #include <iostream>
+#include <thread>
 
 #include <boost/program_options.hpp>
 
@@ -14,6 +16,8 @@
 #include <bh/eigen.h>
 #include <bh/vision/cameras.h>
 #include <bh/string_utils.h>
+#include <bh/thread.h>
+#include <bh/utilities.h>
 #include "../reconstruction/dense_reconstruction.h"
 
 #include <opencv2/core.hpp>
@@ -53,6 +57,11 @@ std::pair<bool, boost::program_options::variables_map> process_commandline(int a
       ("no-display", po::bool_switch()->default_value(false), "Do not show depth maps")
       ("set-all-unknown", po::bool_switch()->default_value(false), "Set all occupied voxels to unknown voxels")
       ("colmap-fusion-file", po::value<string>(), "Colmap MVS fusion.cfg file to specify which depth maps to use")
+      ("truncate-max-range", po::bool_switch()->default_value(false),
+          "Integrate measurements beyond max-range as free space up to max-range instead of dropping them")
+      ("pixel-stride", po::value<size_t>()->default_value(1), "Only integrate every n-th pixel in each direction")
+      ("num-loader-threads", po::value<size_t>()->default_value(2), "Number of threads reading depth maps")
+      ("prefetch-queue-size", po::value<size_t>()->default_value(8), "Maximum number of depth maps kept in memory")
       ;
 
     po::options_description options;
@@ -78,6 +87,65 @@ std::pair<bool, boost::program_options::variables_map> process_commandline(int a
   }
 }
 
+/// Depth map of an image back-projected to world coordinates
+struct FrameData {
+  reconstruction::ImageId image_id = 0;
+  bool valid = false;
+  oct::point3d sensor_origin;
+  oct::Pointcloud pc;
+  /// Only filled if depth maps are displayed
+  cv::Mat depth_img;
+};
+
+FrameData loadFrameData(const DenseReconstruction& reconstruction, const reconstruction::ImageId image_id,
+                        const size_t pixel_stride, const FloatType max_range, const bool truncate_max_range,
+                        const bool keep_depth_image) {
+  const reconstruction::ImageColmap& image = reconstruction.getImages().at(image_id);
+  const reconstruction::PinholeCameraColmap& camera = reconstruction.getCameras().at(image.camera_id());
+  const DenseReconstruction::DepthMap depth_map =
+      reconstruction.readDepthMap(image_id, DenseReconstruction::DenseMapType::GEOMETRIC);
+
+  FrameData frame;
+  frame.image_id = image_id;
+  if (keep_depth_image) {
+    frame.depth_img = cv::Mat(depth_map.height(), depth_map.width(), CV_32F);
+    for (std::size_t y = 0; y < depth_map.height(); ++y) {
+      for (std::size_t x = 0; x < depth_map.width(); ++x) {
+        frame.depth_img.at<float>(y, x) = depth_map(y, x);
+      }
+    }
+  }
+
+  const reconstruction::CameraMatrix& intrinsics = camera.intrinsics();
+  FloatType depth_camera_scale = depth_map.width() / (FloatType)camera.width();
+  const reconstruction::CameraMatrix depth_intrinsics = bh::vision::getScaledIntrinsics(intrinsics, depth_camera_scale);
+  const reconstruction::CameraMatrix inv_depth_intrinsics = depth_intrinsics.inverse();
+  const Matrix3x4 transform_image_to_world = image.pose().getTransformationImageToWorld();
+  const Vector3 sensor_pos = transform_image_to_world.col(3).topRows(3);
+  frame.sensor_origin = oct::point3d(sensor_pos(0), sensor_pos(1), sensor_pos(2));
+
+  frame.pc.reserve((depth_map.width() / pixel_stride + 1) * (depth_map.height() / pixel_stride + 1));
+  for (size_t y = 0; y < depth_map.height(); y += pixel_stride) {
+    for (size_t x = 0; x < depth_map.width(); x += pixel_stride) {
+      DenseReconstruction::DepthMap::ValueType depth = depth_map(y, x);
+      if (depth <= 0 || !std::isfinite(depth)) {
+        continue;
+      }
+      // Measurements beyond the maximum range are either dropped or only contribute free space
+      // (the octree truncates the rays at max_range)
+      if (depth > max_range && !truncate_max_range) {
+        continue;
+      }
+      Vector4 p4d = inv_depth_intrinsics * Vector4(x, y, 1, 1);
+      Vector3 p3d = depth * p4d.topRows(3);
+      p3d = transform_image_to_world * p3d.homogeneous();
+      frame.pc.push_back(oct::point3d(p3d(0), p3d(1), p3d(2)));
+    }
+  }
+  frame.valid = true;
+  return frame;
+}
+
 int main(int argc, char** argv) {
   using OccupancyMapType = OccupancyMap<OccupancyNode>;
 
@@ -148,26 +216,52 @@ int main(int argc, char** argv) {
   }
   std::cout << "Total number of frames to integrate: " << images_to_integrate.size() << std::endl;
 
-  for (auto it = images_to_integrate.begin(); it != images_to_integrate.end(); ++it) {
-    const reconstruction::ImageId image_id = *it;
-    const reconstruction::ImageColmap& image = reconstruction.getImages().at(image_id);
-    const reconstruction::PinholeCameraColmap& camera = reconstruction.getCameras().at(image.camera_id());
-
-    cout << "Integrating frame " << (it - images_to_integrate.begin() + 1) << " of " << images_to_integrate.size()
-         << " (image ID " << image_id << ")" << endl;
+  // Pipeline: Loader threads read and back-project depth maps into a bounded queue while the main thread
+  // integrates the point clouds in image order. The queue bounds the number of depth maps in memory.
+  const size_t pixel_stride = std::max<size_t>(vm["pixel-stride"].as<size_t>(), 1);
+  const bool truncate_max_range = vm["truncate-max-range"].as<bool>();
+  const bool display_depth = !vm["no-display"].as<bool>();
+  const size_t num_loader_threads = std::max<size_t>(vm["num-loader-threads"].as<size_t>(), 1);
+  bh::OrderedBoundedQueue<FrameData> frame_queue(std::max<size_t>(vm["prefetch-queue-size"].as<size_t>(), 1));
+  std::atomic<size_t> next_frame_index(0);
+  std::vector<std::thread> loader_threads;
+  for (size_t i = 0; i < num_loader_threads; ++i) {
+    loader_threads.emplace_back([&]() {
+      while (true) {
+        const size_t frame_index = next_frame_index++;
+        if (frame_index >= images_to_integrate.size()) {
+          break;
+        }
+        frame_queue.waitForSlot(frame_index);
+        FrameData frame;
+        frame.image_id = images_to_integrate[frame_index];
+        try {
+          frame = loadFrameData(reconstruction, frame.image_id, pixel_stride,
+                                max_range, truncate_max_range, display_depth);
+        }
+        catch (const std::exception& err) {
+          std::cerr << "ERROR: Failed to load depth map of image " << frame.image_id << ": " << err.what() << std::endl;
+        }
+        frame_queue.push(frame_index, std::move(frame));
+      }
+    });
+  }
 
-    DenseReconstruction::DepthMap depth_map =
-        reconstruction.readDepthMap(image_id, DenseReconstruction::DenseMapType::GEOMETRIC);
+  bh::Timer timer;
+  double wait_time = 0;
+  size_t num_integrated_points = 0;
+  for (size_t i = 0; i < images_to_integrate.size(); ++i) {
+    bh::Timer wait_timer;
+    const FrameData frame = frame_queue.pop();
+    wait_time += wait_timer.getElapsedTime();
+    if (!frame.valid) {
+      cout << "WARNING: Skipping image " << frame.image_id << endl;
+      continue;
+    }
 
     // Show depth maps for debugging
-    if (!vm["no-display"].as<bool>()) {
-      cv::Mat depth_img(depth_map.height(), depth_map.width(), CV_32F);
-      for (std::size_t y = 0; y < depth_map.height(); ++y) {
-        for (std::size_t x = 0; x < depth_map.width(); ++x) {
-          FloatType depth = depth_map(y, x);
-          depth_img.at<float>(y, x) = depth;
-        }
-      }
+    if (display_depth) {
+      cv::Mat depth_img = frame.depth_img.clone();
       depth_img.setTo(0, depth_img > max_range);
       double min, max;
       cv::minMaxIdx(depth_img, &min, &max);
@@ -177,38 +271,20 @@ int main(int argc, char** argv) {
       cv::waitKey(100);
     }
 
-    const reconstruction::CameraMatrix& intrinsics = camera.intrinsics();
-//    std::cout << "intrinsics=" << intrinsics << std::endl;
-    FloatType depth_camera_scale = depth_map.width() / (FloatType)camera.width();
-    const reconstruction::CameraMatrix depth_intrinsics = bh::vision::getScaledIntrinsics(intrinsics, depth_camera_scale);
-    const reconstruction::CameraMatrix inv_depth_intrinsics = depth_intrinsics.inverse();
-    cout << "depth_intrinsics=" << depth_intrinsics << endl;
-//    cout << "inv_depth_intrinsics=" << inv_depth_intrinsics << endl;
-    const Matrix3x4 transform_image_to_world = image.pose().getTransformationImageToWorld();
-//    std::cout << "transform_image_to_world: " << transform_image_to_world << std::endl;
-
-//    const bh::Pose::Vector3 sensor_pos = image.pose().getWorldPosition();
-    const Vector3 sensor_pos = transform_image_to_world.col(3).topRows(3);
-    oct::point3d sensor_origin(sensor_pos(0), sensor_pos(1), sensor_pos(2));
-    std::cout << "sensor_position=" << sensor_pos.transpose() << std::endl;
-
-    oct::Pointcloud pc;
-    for (size_t y = 0; y < depth_map.height(); ++y) {
-      for (size_t x = 0; x < depth_map.width(); ++x) {
-        DenseReconstruction::DepthMap::ValueType depth = depth_map(y, x);
-        if (depth <= 0 || !std::isfinite(depth) || depth > max_range) {
-          continue;
-        }
-//        cout << "x=" << x << ", y=" << y << ", depth=" << depth << endl;
-        Vector4 p4d = inv_depth_intrinsics * Vector4(x, y, 1, 1);
-        Vector3 p3d = depth * p4d.topRows(3);
-        p3d = transform_image_to_world * p3d.homogeneous();
-        oct::point3d p(p3d(0), p3d(1), p3d(2));
-        pc.push_back(p);
-      }
-    }
-    tree->insertPointCloud(pc, sensor_origin, max_range, vm["lazy-eval"].as<bool>());
+    tree->insertPointCloud(frame.pc, frame.sensor_origin, max_range, vm["lazy-eval"].as<bool>());
+    num_integrated_points += frame.pc.size();
+
+    const double elapsed_time = timer.getElapsedTime();
+    cout << "Integrated frame " << (i + 1) << " of " << images_to_integrate.size()
+         << " (image ID " << frame.image_id << ", " << frame.pc.size() << " points)."
+         << " Throughput: " << (i + 1) / elapsed_time << " frames/s, "
+         << num_integrated_points / elapsed_time / 1e6 << " Mpoints/s,"
+         << " waiting for depth maps " << 100 * wait_time / elapsed_time << "% of the time" << endl;
+  }
+  for (std::thread& thread : loader_threads) {
+    thread.join();
   }
+  timer.printTiming("Integrating frames");
 
   if (vm["set-all-unknown"].as<bool>()) {
     std::cout << "Setting all occupied nodes to unknown nodes" << std::endl;
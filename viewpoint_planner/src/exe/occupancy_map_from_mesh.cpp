@@ -8,6 +8,7 @@
 
 
 #include <iostream>
+#include <vector>
 
 #include <boost/program_options.hpp>
 
@@ -17,6 +18,7 @@
 #include <bh/config_options.h>
 #include <bh/eigen_options.h>
 #include <bh/math/geometry.h>
+#include <bh/utilities.h>
 
 #include "../octree/occupancy_map.h"
 
@@ -33,6 +35,7 @@ using FloatType = float;
 USE_FIXED_EIGEN_TYPES(FloatType)
 
 using BoundingBoxType = bh::BoundingBox3D<FloatType>;
+using TriangleType = bh::Triangle<FloatType>;
 using MeshType = ml::MeshData<FloatType>;
 using MeshIOType = ml::MeshIO<FloatType>;
 using TriMeshType = ml::TriMesh<FloatType>;
@@ -55,6 +58,7 @@ public:
       addOption<FloatType>("resolution", &resolution);
       addOption<bool>("make_dense", &make_dense);
       addOption<bool>("lazy_eval", &lazy_eval);
+      addOption<bool>("parallel_voxelization", &parallel_voxelization);
       addOption<bool>("allow_raycast_from_inside_mesh", &allow_raycast_from_inside_mesh);
       addOption<bool>("fill_to_bottom_as_occupied", &fill_to_bottom_as_occupied);
       addOption<bool>("verbose", &verbose);
@@ -68,6 +72,8 @@ public:
     FloatType mesh_scale = FloatType(1);
     bool make_dense = false;
     bool lazy_eval = false;
+    // Use block-wise parallel voxelization with exact triangle/box tests instead of the mLib binary grid
+    bool parallel_voxelization = true;
     bool allow_raycast_from_inside_mesh = false;
     bool fill_to_bottom_as_occupied = false;
     bool verbose = false;
@@ -133,6 +139,135 @@ public:
     }
   }
 
+  /// Mark all voxels intersecting the mesh surface as occupied.
+  ///
+  /// Triangles are binned into blocks of voxels that coincide with octree subtrees. Each block is voxelized
+  /// independently with an exact triangle/box test. The blocks are processed in Z-order so that the
+  /// concatenated keys are sorted and can be inserted into the octree in bulk.
+  void voxelizeMeshParallel(const OccupancyMapFromMeshCmdline::Options& options,
+                            const MeshType& mesh_data,
+                            OccupancyMapType& tree) {
+    using KeyMortonLess = OccupancyMapType::KeyMortonLess;
+    // Blocks have 2^kBlockDepth voxels along each axis
+    const size_t kBlockDepth = 5;
+    const unsigned short kBlockMask = static_cast<unsigned short>(~((1 << kBlockDepth) - 1));
+
+    bh::Timer timer;
+    const BoundingBoxType clip_bbox(options.clip_bbox_min, options.clip_bbox_max);
+    const FloatType resolution = static_cast<FloatType>(tree.getResolution());
+    const Vector3 voxel_half_extent = Vector3::Constant(resolution / 2);
+
+    std::vector<TriangleType> triangles;
+    triangles.reserve(mesh_data.m_FaceIndicesVertices.size());
+    for (size_t i = 0; i < mesh_data.m_FaceIndicesVertices.size(); ++i) {
+      const MeshType::Indices::Face& face = mesh_data.m_FaceIndicesVertices[i];
+      BH_ASSERT_STR(face.size() == 3, "Mesh faces need to have a valence of 3");
+      const TriangleType triangle(
+          options.mesh_scale * bh::MLibUtilities::convertMlibToEigen(mesh_data.m_Vertices[face[0]]),
+          options.mesh_scale * bh::MLibUtilities::convertMlibToEigen(mesh_data.m_Vertices[face[1]]),
+          options.mesh_scale * bh::MLibUtilities::convertMlibToEigen(mesh_data.m_Vertices[face[2]]));
+      if (triangle.boundingBox().intersects(clip_bbox)) {
+        triangles.push_back(triangle);
+      }
+    }
+    cout << "Voxelizing " << triangles.size() << " triangles inside of clipping box" << endl;
+
+    // Key range of the voxels overlapping the bounding box of a triangle (clipped to the clipping box)
+    const auto compute_key_range_lambda = [&](const TriangleType& triangle, OcTreeKey* key_min, OcTreeKey* key_max) {
+      const BoundingBoxType bbox = triangle.boundingBox();
+      const Vector3 min = bbox.getMinimum().cwiseMax(clip_bbox.getMinimum());
+      const Vector3 max = bbox.getMaximum().cwiseMin(clip_bbox.getMaximum());
+      return tree.coordToKeyChecked(octomap::point3d(min(0), min(1), min(2)), *key_min)
+          && tree.coordToKeyChecked(octomap::point3d(max(0), max(1), max(2)), *key_max);
+    };
+
+    // Bin triangles into blocks
+    using BlockEntry = std::pair<OcTreeKey, uint32_t>;
+    std::vector<BlockEntry> block_entries;
+#pragma omp parallel
+    {
+      std::vector<BlockEntry> local_block_entries;
+#pragma omp for schedule(static) nowait
+      for (size_t i = 0; i < triangles.size(); ++i) {
+        OcTreeKey key_min;
+        OcTreeKey key_max;
+        if (!compute_key_range_lambda(triangles[i], &key_min, &key_max)) {
+          continue;
+        }
+        for (size_t kx = key_min[0] & kBlockMask; kx <= key_max[0]; kx += 1 << kBlockDepth) {
+          for (size_t ky = key_min[1] & kBlockMask; ky <= key_max[1]; ky += 1 << kBlockDepth) {
+            for (size_t kz = key_min[2] & kBlockMask; kz <= key_max[2]; kz += 1 << kBlockDepth) {
+              local_block_entries.emplace_back(OcTreeKey(kx, ky, kz), static_cast<uint32_t>(i));
+            }
+          }
+        }
+      }
+#pragma omp critical
+      block_entries.insert(block_entries.end(), local_block_entries.begin(), local_block_entries.end());
+    }
+    std::sort(block_entries.begin(), block_entries.end(), [](const BlockEntry& a, const BlockEntry& b) {
+      if (a.first == b.first) {
+        return a.second < b.second;
+      }
+      return KeyMortonLess()(a.first, b.first);
+    });
+    std::vector<size_t> block_offsets;
+    for (size_t i = 0; i < block_entries.size(); ++i) {
+      if (i == 0 || !(block_entries[i].first == block_entries[i - 1].first)) {
+        block_offsets.push_back(i);
+      }
+    }
+    block_offsets.push_back(block_entries.size());
+    const size_t num_blocks = block_offsets.size() - 1;
+    cout << "Binned triangles into " << num_blocks << " blocks" << endl;
+
+    // Voxelize blocks
+    std::vector<std::vector<OcTreeKey>> block_keys(num_blocks);
+#pragma omp parallel for schedule(dynamic)
+    for (size_t block = 0; block < num_blocks; ++block) {
+      const OcTreeKey& block_key_min = block_entries[block_offsets[block]].first;
+      std::vector<OcTreeKey>& keys = block_keys[block];
+      for (size_t j = block_offsets[block]; j < block_offsets[block + 1]; ++j) {
+        const TriangleType& triangle = triangles[block_entries[j].second];
+        OcTreeKey key_min;
+        OcTreeKey key_max;
+        compute_key_range_lambda(triangle, &key_min, &key_max);
+        for (size_t i = 0; i < 3; ++i) {
+          key_min[i] = std::max<size_t>(key_min[i], block_key_min[i]);
+          key_max[i] = std::min<size_t>(key_max[i], block_key_min[i] + (1 << kBlockDepth) - 1);
+        }
+        for (size_t kx = key_min[0]; kx <= key_max[0]; ++kx) {
+          for (size_t ky = key_min[1]; ky <= key_max[1]; ++ky) {
+            for (size_t kz = key_min[2]; kz <= key_max[2]; ++kz) {
+              const OcTreeKey key(kx, ky, kz);
+              const octomap::point3d center = tree.keyToCoord(key);
+              if (triangle.intersectsBox(Vector3(center.x(), center.y(), center.z()), voxel_half_extent)) {
+                keys.push_back(key);
+              }
+            }
+          }
+        }
+      }
+      std::sort(keys.begin(), keys.end(), KeyMortonLess());
+      keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    }
+
+    // Blocks are disjoint subtrees in Z-order so the concatenated keys are sorted
+    size_t num_occupied_keys = 0;
+    for (const std::vector<OcTreeKey>& keys : block_keys) {
+      num_occupied_keys += keys.size();
+    }
+    std::vector<OcTreeKey> occupied_keys;
+    occupied_keys.reserve(num_occupied_keys);
+    for (std::vector<OcTreeKey>& keys : block_keys) {
+      occupied_keys.insert(occupied_keys.end(), keys.begin(), keys.end());
+      std::vector<OcTreeKey>().swap(keys);
+    }
+    cout << "Inserting " << occupied_keys.size() << " occupied voxels into octree" << endl;
+    tree.applyUpdate(std::vector<OcTreeKey>(), occupied_keys, options.lazy_eval);
+    timer.printTiming("Voxelizing mesh");
+  }
+
   void sweepAxisAndUpdateOccupiedNodes(size_t sweep_axis_index,
                                        const OccupancyMapFromMeshCmdline::Options& options,
                                        const TriMeshAcceleratorType& tri_mesh_acc,
@@ -360,7 +495,12 @@ public:
 //    sweepAxisAndUpdateOccupiedNodes(0, options_, tri_mesh_acc, tree);
 //    sweepAxisAndUpdateOccupiedNodes(1, options_, tri_mesh_acc, tree);
 
-    voxelizeMesh(options_, tri_mesh, tree);
+    if (options_.parallel_voxelization) {
+      voxelizeMeshParallel(options_, mesh_data, tree);
+    }
+    else {
+      voxelizeMesh(options_, tri_mesh, tree);
+    }
 
     if (options_.lazy_eval) {
       cout << "Updating inner nodes" << endl;
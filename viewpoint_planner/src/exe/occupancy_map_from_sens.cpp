@@ -7,6 +7,8 @@
 //==================================================
 
 #include <iostream>
+#include <fstream>
+#include <future>
 
 #include <boost/program_options.hpp>
 
@@ -15,6 +17,7 @@
 
 #include <octomap/octomap.h>
 
+#include <bh/utilities.h>
 #include "../octree/occupancy_map.h"
 #include "../mLib/mLib.h"
 
@@ -35,6 +38,8 @@ std::pair<bool, boost::program_options::variables_map> process_commandline(int a
       ("help", "Produce help message")
       ("sens-file", po::value<string>()->required(), "Sens-file to integrate into Octomap")
       ("num-frames", po::value<size_t>(), "Number of frames to extract")
+      ("batch-size", po::value<size_t>()->default_value(64), "Number of frames that are processed in parallel")
+      ("show-depth", po::bool_switch()->default_value(false), "Show depth maps for debugging")
       ;
 
     po::options_description octomap_options("Octomap options");
@@ -71,6 +76,81 @@ std::pair<bool, boost::program_options::variables_map> process_commandline(int a
   }
 }
 
+/// Read header of a .sens file (same layout as ml::SensorData::loadFromFile()) and return the number of frames.
+/// The stream is left at the first frame.
+size_t readSensorDataHeader(std::ifstream& in, ml::SensorData* sensor_data) {
+  unsigned int version;
+  in.read((char*)&version, sizeof(unsigned int));
+  if (version != M_SENSOR_DATA_VERSION) {
+    throw MLIB_EXCEPTION("Invalid sensor data version " + std::to_string(version));
+  }
+  uint64_t sensor_name_length = 0;
+  in.read((char*)&sensor_name_length, sizeof(uint64_t));
+  sensor_data->m_sensorName.resize(sensor_name_length);
+  if (sensor_name_length > 0) {
+    in.read((char*)&sensor_data->m_sensorName[0], sensor_name_length);
+  }
+  sensor_data->m_calibrationColor.loadFromFile(in);
+  sensor_data->m_calibrationDepth.loadFromFile(in);
+  in.read((char*)&sensor_data->m_colorCompressionType, sizeof(sensor_data->m_colorCompressionType));
+  in.read((char*)&sensor_data->m_depthCompressionType, sizeof(sensor_data->m_depthCompressionType));
+  in.read((char*)&sensor_data->m_colorWidth, sizeof(sensor_data->m_colorWidth));
+  in.read((char*)&sensor_data->m_colorHeight, sizeof(sensor_data->m_colorHeight));
+  in.read((char*)&sensor_data->m_depthWidth, sizeof(sensor_data->m_depthWidth));
+  in.read((char*)&sensor_data->m_depthHeight, sizeof(sensor_data->m_depthHeight));
+  in.read((char*)&sensor_data->m_depthShift, sizeof(sensor_data->m_depthShift));
+  uint64_t num_frames = 0;
+  in.read((char*)&num_frames, sizeof(uint64_t));
+  return num_frames;
+}
+
+std::vector<float> decompressDepth(const ml::SensorData& sensor_data, const ml::SensorData::RGBDFrame& frame) {
+  std::vector<float> depth_data(sensor_data.m_depthWidth * sensor_data.m_depthHeight);
+  unsigned short* depth_data_uint16 = sensor_data.decompressDepthAlloc(frame);
+  for (size_t i = 0; i < depth_data.size(); ++i) {
+    depth_data[i] = depth_data_uint16[i] / (float)sensor_data.m_depthShift;
+  }
+  std::free(depth_data_uint16);
+  return depth_data;
+}
+
+void showDepth(const ml::SensorData& sensor_data, const std::vector<float>& depth_data) {
+  cv::Mat depth_img(sensor_data.m_depthHeight, sensor_data.m_depthWidth, CV_32F, const_cast<float*>(depth_data.data()));
+  cv::Mat depth_img2;
+  depth_img.copyTo(depth_img2);
+  double min, max;
+  cv::minMaxIdx(depth_img, &min, &max);
+  cout << "min=" << min << ", max=" << max << endl;
+  cv::normalize(depth_img2, depth_img2, 0, 1, CV_MINMAX);
+  cv::imshow("depth", depth_img2);
+  cv::waitKey(100);
+}
+
+oct::Pointcloud backprojectDepth(const ml::SensorData& sensor_data, const ml::SensorData::RGBDFrame& frame,
+                                 const std::vector<float>& depth_data, const ml::mat4f& inv_depth_intrinsics,
+                                 const double max_range) {
+  oct::Pointcloud pc;
+  for (size_t y = 0; y < sensor_data.m_depthHeight; ++y) {
+    for (size_t x = 0; x < sensor_data.m_depthWidth; ++x) {
+      float depth = depth_data[x + sensor_data.m_depthWidth * y];
+      if (depth <= 0 || !std::isfinite(depth) || depth > max_range) {
+        continue;
+      }
+      ml::vec4f p4d = inv_depth_intrinsics * ml::vec4f(x, y, 1, 1);
+      ml::vec3f p3d = depth * p4d.getVec3();
+      p3d = frame.getCameraToWorld() * p3d;
+      oct::point3d p(p3d.x, p3d.y, p3d.z);
+      pc.push_back(p);
+    }
+  }
+  return pc;
+}
+
+struct FrameUpdate {
+  std::vector<OcTreeKey> free_keys;
+  std::vector<OcTreeKey> occupied_keys;
+};
+
 int main(int argc, char** argv)
 {
   using OccupancyMapType = OccupancyMap<OccupancyNode>;
@@ -84,92 +164,77 @@ int main(int argc, char** argv)
   }
   boost::program_options::variables_map vm = std::move(cmdline_result.second);
 
-  cout << "Loading sensor data" << endl;
+  // Frames are streamed from the file so only the header is loaded here
+  cout << "Loading sensor data header" << endl;
+  std::ifstream sens_in(vm["sens-file"].as<string>(), std::ios::binary);
+  if (!sens_in) {
+    std::cerr << "ERROR: Unable to open sens-file " << vm["sens-file"].as<string>() << std::endl;
+    return 1;
+  }
   ml::SensorData sensor_data;
-  sensor_data.loadFromFile(vm["sens-file"].as<string>());
+  const size_t num_frames = readSensorDataHeader(sens_in, &sensor_data);
 
   OccupancyMapType tree (vm["resolution"].as<double>());
 
-
-  // insert some measurements of occupied cells
-
-//  for (int x=-20; x<20; x++) {
-//    for (int y=-20; y<20; y++) {
-//      for (int z=-20; z<20; z++) {
-//        point3d endpoint ((float) x*0.05f, (float) y*0.05f, (float) z*0.05f);
-//        tree.updateNode(endpoint, true); // integrate 'occupied' measurement
-//      }
-//    }
-//  }
-//
-//  // insert some measurements of free cells
-//
-//  for (int x=-30; x<30; x++) {
-//    for (int y=-30; y<30; y++) {
-//      for (int z=-30; z<30; z++) {
-//        point3d endpoint ((float) x*0.02f-1.0f, (float) y*0.02f-1.0f, (float) z*0.02f-1.0f);
-//        tree.updateNode(endpoint, false);  // integrate 'free' measurement
-//      }
-//    }
-//  }
-
-  double max_range = vm["max-range"].as<double>();
-  ml::mat4f inv_depth_intrinsics = sensor_data.m_calibrationDepth.m_intrinsic.getInverse();
+  const double max_range = vm["max-range"].as<double>();
+  const bool lazy_eval = vm["lazy-eval"].as<bool>();
+  const bool show_depth = vm["show-depth"].as<bool>();
+  const size_t batch_size = std::max<size_t>(vm["batch-size"].as<size_t>(), 1);
+  const ml::mat4f inv_depth_intrinsics = sensor_data.m_calibrationDepth.m_intrinsic.getInverse();
   cout << "depth_intrinsics=" << sensor_data.m_calibrationDepth.m_intrinsic << endl;
   cout << "inv_depth_intrinsics=" << inv_depth_intrinsics << endl;
-  float* depth_data = new float[sensor_data.m_depthWidth * sensor_data.m_depthHeight];
-  size_t num_frames_to_extract = sensor_data.m_frames.size();
+  size_t num_frames_to_extract = num_frames;
   if (vm.count("num-frames") > 0) {
     num_frames_to_extract = std::min(num_frames_to_extract, vm["num-frames"].as<size_t>());
   }
   std::cout << "Total number of frames to integrate: " << num_frames_to_extract << std::endl;
-  for (size_t i = 0; i < num_frames_to_extract; ++i) {
-    cout << "Integrating frame " << (i+1) << " of " << sensor_data.m_frames.size() << endl;
-    const ml::SensorData::RGBDFrame& frame = sensor_data.m_frames[i];
-    ml::vec3f sensor_translation = frame.getCameraToWorld().getTranslation();
-    unsigned short* depth_data_uint16 = sensor_data.decompressDepthAlloc(frame);
-    for (size_t i = 0; i < sensor_data.m_depthWidth * sensor_data.m_depthHeight; ++i) {
-      depth_data[i] = depth_data_uint16[i] / (float)sensor_data.m_depthShift;
+
+  // Pipeline: The next batch of compressed frames is read while the current batch is decompressed,
+  // back-projected and raycast in parallel (one frame per thread). The resulting key sets are then
+  // applied to the tree in frame order so that the result does not depend on the number of threads.
+  const auto read_batch_lambda = [&](const size_t first_frame) {
+    std::vector<ml::SensorData::RGBDFrame> frames;
+    const size_t last_frame = std::min(first_frame + batch_size, num_frames_to_extract);
+    frames.resize(last_frame - first_frame);
+    for (ml::SensorData::RGBDFrame& frame : frames) {
+      frame.loadFromFile(sens_in);
     }
-    std::free(depth_data_uint16);
-    // Show depth maps for debugging
-    {
-      cv::Mat depth_img(sensor_data.m_depthHeight, sensor_data.m_depthWidth, CV_32F, depth_data);
-      cv::Mat depth_img2;
-      depth_img.copyTo(depth_img2);
-      double min, max;
-      cv::minMaxIdx(depth_img, &min, &max);
-      cout << "min=" << min << ", max=" << max << endl;
-      cv::normalize(depth_img2, depth_img2, 0, 1, CV_MINMAX);
-      cv::imshow("depth", depth_img2);
-      cv::waitKey(100);
+    return frames;
+  };
+  bh::Timer timer;
+  std::future<std::vector<ml::SensorData::RGBDFrame>> next_batch_future
+      = std::async(std::launch::async, read_batch_lambda, 0);
+  for (size_t first_frame = 0; first_frame < num_frames_to_extract; first_frame += batch_size) {
+    std::vector<ml::SensorData::RGBDFrame> frames = next_batch_future.get();
+    if (first_frame + batch_size < num_frames_to_extract) {
+      next_batch_future = std::async(std::launch::async, read_batch_lambda, first_frame + batch_size);
     }
 
-    const ml::mat4f& transform_image_to_world = frame.getCameraToWorld();
-    std::cout << "transform_image_to_world: " << transform_image_to_world << std::endl;
-    oct::point3d sensor_origin(sensor_translation.x, sensor_translation.y, sensor_translation.z);
-    //          std::cout << "sensor_position=" << sensor_translation << std::endl;
-    oct::Pointcloud pc;
-    for (size_t y = 0; y < sensor_data.m_depthHeight; ++y) {
-      for (size_t x = 0; x < sensor_data.m_depthWidth; ++x) {
-        float depth = depth_data[x + sensor_data.m_depthWidth * y];
-        if (depth <= 0 || !std::isfinite(depth) || depth > max_range) {
-          continue;
-        }
-        //                  cout << "x=" << x << ", y=" << y << ", depth=" << depth << endl;
-        ml::vec4f p4d = inv_depth_intrinsics * ml::vec4f(x, y, 1, 1);
-        //                  cout << "camera p4d=" << p4d << endl;
-        ml::vec3f p3d = depth * p4d.getVec3();
-        //                  cout << "camera p3d=" << p3d << endl;
-        p3d = frame.getCameraToWorld() * p3d;
-        //                  cout << "world p3d=" << p3d << endl;
-        oct::point3d p(p3d.x, p3d.y, p3d.z);
-        pc.push_back(p);
+    std::vector<FrameUpdate> frame_updates(frames.size());
+#pragma omp parallel for schedule(dynamic)
+    for (size_t i = 0; i < frames.size(); ++i) {
+      const std::vector<float> depth_data = decompressDepth(sensor_data, frames[i]);
+      const oct::Pointcloud pc = backprojectDepth(sensor_data, frames[i], depth_data, inv_depth_intrinsics, max_range);
+      const ml::vec3f sensor_translation = frames[i].getCameraToWorld().getTranslation();
+      const oct::point3d sensor_origin(sensor_translation.x, sensor_translation.y, sensor_translation.z);
+      // Nested inside the frame loop the key computation runs single-threaded
+      tree.computeUpdate(pc, sensor_origin, frame_updates[i].free_keys, frame_updates[i].occupied_keys, max_range);
+    }
+
+    for (size_t i = 0; i < frames.size(); ++i) {
+      if (show_depth) {
+        showDepth(sensor_data, decompressDepth(sensor_data, frames[i]));
       }
+      // Same order of updates as OccupancyMap::insertPointCloud()
+      tree.applyUpdate(frame_updates[i].free_keys, frame_updates[i].occupied_keys, lazy_eval);
+      frames[i].free();
     }
-    tree.insertPointCloud(pc, sensor_origin, max_range, vm["lazy-eval"].as<bool>());
+    const size_t num_integrated_frames = std::min(first_frame + batch_size, num_frames_to_extract);
+    const double elapsed_time = timer.getElapsedTime();
+    cout << "Integrated " << num_integrated_frames << " of " << num_frames_to_extract << " frames"
+         << " (" << num_integrated_frames / elapsed_time << " frames/s)" << endl;
   }
-  delete[] depth_data;
+  timer.printTiming("Integrating frames");
 
   if (vm["dense"].as<bool>()) {
     std::cout << "Octree has " << tree.getNumLeafNodes() << " leaf nodes and " << tree.size() << " total nodes" << std::endl;
@@ -0,0 +1,135 @@
+//==================================================
+// occupancy_map_to_snapshot.cpp
+//
+//  Copyright (c) 2017 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: Oct 18, 2017
+//==================================================
+
+#include <iostream>
+#include <memory>
+
+#include <boost/program_options.hpp>
+
+#include <octomap/octomap.h>
+
+#include <bh/common.h>
+#include <bh/utilities.h>
+
+#include "../octree/occupancy_map.h"
+#include "../octree/occupancy_map_snapshot.h"
+
+using std::cout;
+using std::endl;
+using std::string;
+
+using RawOccupancyMapType = OccupancyMap<OccupancyNode>;
+using OccupancyMapType = OccupancyMap<AugmentedOccupancyNode>;
+
+std::pair<bool, boost::program_options::variables_map> process_commandline(int argc, char** argv) {
+  namespace po = boost::program_options;
+
+  po::variables_map vm;
+  try {
+    po::options_description generic_options("Allowed options");
+    generic_options.add_options()
+      ("help", "Produce help message")
+      ("in-map-file", po::value<string>()->required(), "Augmented or raw octomap input file")
+      ("out-snapshot-file", po::value<string>()->required(), "Occupancy map snapshot output file")
+      ("no-verify", po::bool_switch()->default_value(false), "Do not verify the written snapshot")
+      ;
+
+    po::options_description options;
+    options.add(generic_options);
+    po::store(po::command_line_parser(argc, argv).options(options).run(), vm);
+    if (vm.count("help")) {
+      cout << options << endl;
+      return std::make_pair(false, vm);
+    }
+
+    po::notify(vm);
+
+    return std::make_pair(true, vm);
+  }
+  catch (const po::required_option& err) {
+    std::cerr << "Error parsing command line: Required option '" << err.get_option_name() << "' is missing" << std::endl;
+    return std::make_pair(false, vm);
+  }
+  catch (const po::error& err) {
+    std::cerr << "Error parsing command line: " << err.what() << std::endl;
+    return std::make_pair(false, vm);
+  }
+}
+
+/// Compare the snapshot with the pointer-based tree node by node
+bool verifySnapshot(const OccupancyMapType& tree, const OccupancyMapSnapshot& snapshot) {
+  if (tree.size() != snapshot.getNumNodes() || tree.getNumLeafNodes() != snapshot.getNumLeafNodes()) {
+    cout << "ERROR: Snapshot has " << snapshot.getNumNodes() << " nodes and " << snapshot.getNumLeafNodes()
+         << " leaf nodes, expected " << tree.size() << " and " << tree.getNumLeafNodes() << endl;
+    return false;
+  }
+  for (auto it = tree.begin_tree(); it != tree.end_tree(); ++it) {
+    // A search depth of 0 refers to the full tree depth
+    const OccupancyMapSnapshot::NodeIndex index = it.getDepth() == 0 ?
+        snapshot.getRoot() : snapshot.search(it.getKey(), it.getDepth());
+    if (index == OccupancyMapSnapshot::kInvalidNode
+        || snapshot.isLeaf(index) != it.isLeaf()
+        || snapshot.getOccupancy(index) != it->getOccupancy()
+        || snapshot.getObservationCount(index) != it->getObservationCount()
+        || snapshot.getWeight(index) != it->getWeight()) {
+      cout << "ERROR: Snapshot node at depth " << it.getDepth() << " does not match" << endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+int main(int argc, char** argv) {
+  // Handle command line
+  std::pair<bool, boost::program_options::variables_map> cmdline_result = process_commandline(argc, argv);
+  if (!cmdline_result.first) {
+    return 1;
+  }
+  boost::program_options::variables_map vm = std::move(cmdline_result.second);
+
+  const string in_map_file = vm["in-map-file"].as<string>();
+  const string out_snapshot_file = vm["out-snapshot-file"].as<string>();
+
+  bh::Timer timer;
+  std::unique_ptr<octomap::AbstractOcTree> abstract_tree(octomap::AbstractOcTree::read(in_map_file));
+  if (!abstract_tree) {
+    cout << "ERROR: Unable to read octomap file " << in_map_file << endl;
+    return 1;
+  }
+  std::unique_ptr<OccupancyMapType> tree;
+  if (dynamic_cast<OccupancyMapType*>(abstract_tree.get()) != nullptr) {
+    tree.reset(static_cast<OccupancyMapType*>(abstract_tree.release()));
+  }
+  else if (dynamic_cast<RawOccupancyMapType*>(abstract_tree.get()) != nullptr) {
+    cout << "Converting raw occupancy map to augmented occupancy map" << endl;
+    const RawOccupancyMapType* raw_tree = static_cast<RawOccupancyMapType*>(abstract_tree.get());
+    tree.reset(convertToAugmentedMap(raw_tree));
+  }
+  else {
+    cout << "ERROR: Unsupported octree type " << abstract_tree->getTreeType() << endl;
+    return 1;
+  }
+  timer.printTiming("Reading octree");
+  cout << "Octree has " << tree->getNumLeafNodes() << " leaf nodes and " << tree->size() << " total nodes" << endl;
+
+  timer = bh::Timer();
+  OccupancyMapSnapshot::write(*tree, out_snapshot_file);
+  timer.printTiming("Writing snapshot");
+
+  if (!vm["no-verify"].as<bool>()) {
+    timer = bh::Timer();
+    const OccupancyMapSnapshot snapshot(out_snapshot_file);
+    timer.printTiming("Memory mapping snapshot");
+    if (!verifySnapshot(*tree, snapshot)) {
+      return 1;
+    }
+    cout << "Snapshot verified" << endl;
+  }
+
+  return 0;
+}
@@ -81,7 +81,28 @@ public:
 
   void run(const boost::program_options::variables_map& vm) {
     if (vm.count("in-viewpoint-graph-file") > 0) {
-      getPlanner().loadViewpointGraph(vm["in-viewpoint-graph-file"].as<std::string>());
+      const std::string in_viewpoint_graph_filename = vm["in-viewpoint-graph-file"].as<std::string>();
+      if (vm.count("convert-viewpoint-graph-file") > 0) {
+        // Conversion only changes the file format so a legacy graph without a matching key is accepted
+        const bool check_key = false;
+        const bool loaded = getPlanner().loadViewpointGraph(in_viewpoint_graph_filename, check_key);
+        if (!loaded) {
+          std::cout << "ERROR: Unable to load viewpoint graph for conversion" << std::endl;
+          return;
+        }
+        const bool binary_format = true;
+        const std::string convert_viewpoint_graph_filename = vm["convert-viewpoint-graph-file"].as<std::string>();
+        getPlanner().saveViewpointGraph(convert_viewpoint_graph_filename, binary_format);
+        // Keep the key of the input graph so that a stale graph is not marked as up-to-date by the conversion
+        const std::string in_key_filename = PrecomputationKey::getKeyFilename(in_viewpoint_graph_filename);
+        PrecomputationKey::removeForArtifact(convert_viewpoint_graph_filename);
+        if (boost::filesystem::exists(in_key_filename)) {
+          boost::filesystem::copy_file(in_key_filename,
+                                       PrecomputationKey::getKeyFilename(convert_viewpoint_graph_filename));
+        }
+        return;
+      }
+      getPlanner().loadViewpointGraph(in_viewpoint_graph_filename);
     }
 
     if (vm.count("out-viewpoint-graph-file") > 0) {
@@ -90,10 +111,15 @@ public:
       BH_ASSERT(max_num_candidates > 0);
       std::cout << "Sampling viewpoint candidates" << std::endl;
       bool graph_modified = false;
+      const bool incremental_motions = !vm["no-motion-computation"].as<bool>()
+          && getPlanner().getOptions().viewpoint_motion_incremental;
       while (!ctrl_c_pressed && getPlanner().getViewpointGraph().numVertices() < max_num_candidates) {
         const bool result = getPlanner().generateNextViewpointEntry2();
         graph_modified = true;
         std::cout << "Generate next viewpoint result -> " << result << std::endl;
+        if (incremental_motions) {
+          getPlanner().updateViewpointMotions();
+        }
         std::cout << "Sampled " << getPlanner().getViewpointGraph().numVertices()
             << " of " << vm["num-candidates"].as<std::size_t>() << " viewpoints" << std::endl;
         if (getPlanner().getViewpointExplorationFront().empty()
@@ -111,11 +137,31 @@ public:
 
       if (!vm["no-motion-computation"].as<bool>()) {
         std::cout << "Computing motions" << std::endl;
-        getPlanner().computeViewpointMotions();
+        if (incremental_motions) {
+          getPlanner().updateViewpointMotions();
+        }
+        else {
+          getPlanner().computeViewpointMotions();
+        }
         std::cout << "Done" << std::endl;
         getPlanner().saveViewpointGraph(vm["out-viewpoint-graph-file"].as<std::string>());
       }
 
+      if (getPlanner().getOptions().sparse_matching_graph_precompute
+          && getPlanner().getSparseMatchabilityGraph().numVertices() != getPlanner().getViewpointEntries().size()) {
+        std::cout << "Computing sparse matchability graph" << std::endl;
+        getPlanner().computeSparseMatchabilityGraph();
+        std::cout << "Done" << std::endl;
+        // Only the matchability graph has to be written if the viewpoint graph is already up-to-date on disk
+        const std::string out_viewpoint_graph_file = vm["out-viewpoint-graph-file"].as<std::string>();
+        if (boost::filesystem::exists(out_viewpoint_graph_file)) {
+          getPlanner().saveSparseMatchabilityGraphOfViewpointGraph(out_viewpoint_graph_file);
+        }
+        else {
+          getPlanner().saveViewpointGraph(out_viewpoint_graph_file);
+        }
+      }
+
       if (vm["stereo-viewpoint-computation"].as<bool>()) {
         std::cout << "Computing stereo viewpoints" << std::endl;
         getPlanner().computeMatchingStereoViewpoints();
@@ -128,7 +174,15 @@ public:
     if (vm.count("out-viewpoint-path-file") > 0) {
 //      const bool use_manual_drone_start_position = vm.count("drone-start-viewpoint-ids") == 0;
 
-      if (vm.count("drone-start-viewpoint-ids") > 0) {
+      std::size_t num_replayed_checkpoints = 0;
+      if (vm.count("viewpoint-path-journal-file") > 0) {
+        const bool resume = vm["resume-viewpoint-path-journal"].as<bool>();
+        num_replayed_checkpoints = getPlanner().openViewpointPathJournal(
+            vm["viewpoint-path-journal-file"].as<std::string>(), resume);
+      }
+
+      // Initial viewpoints are part of the journal when resuming
+      if (vm.count("drone-start-viewpoint-ids") > 0 && num_replayed_checkpoints == 0) {
         const bool drone_start_viewpoint_mvs = vm["drone-start-viewpoint-mvs"].as<bool>();
         const std::string drone_start_viewpoint_ids_str = vm["drone-start-viewpoint-ids"].as<std::string>();
         std::vector<std::size_t> drone_start_viewpoint_ids;
@@ -183,6 +237,7 @@ public:
         std::cout << "Computing viewpoint tour" << std::endl;
         getPlanner().computeViewpointTour(use_manual_drone_start_position);
       }
+      getPlanner().closeViewpointPathJournal();
 
       const bool augment_viewpoint_paths = !vm["no-viewpoint-path-augmentation"].as<bool>();
       if (augment_viewpoint_paths) {
@@ -243,9 +298,12 @@ std::pair<bool, boost::program_options::variables_map> processOptions(
         ("in-viewpoint-graph-file", po::value<std::string>(), "Viewpoint graph file to load before processing.")
         ("out-viewpoint-graph-file", po::value<std::string>(), "File to save the viewpoint graph to after processing.")
         ("out-viewpoint-path-file", po::value<std::string>(), "File to save the viewpoint path to after processing.")
+        ("convert-viewpoint-graph-file", po::value<std::string>(), "Convert the input viewpoint graph to the binary format, save it to this file and exit.")
         ("no-motion-computation", po::bool_switch()->default_value(false), "Whether to prevent motion computation")
         ("stereo-viewpoint-computation", po::bool_switch()->default_value(false), "Whether to compute stereo viewpoints")
         ("no-tour-computation", po::bool_switch()->default_value(false), "Whether to prevent tour computation")
+        ("viewpoint-path-journal-file", po::value<std::string>(), "Journal file for periodic checkpoints of the viewpoint path computation.")
+        ("resume-viewpoint-path-journal", po::bool_switch()->default_value(false), "Whether to replay an existing viewpoint path journal and continue from its last checkpoint")
         ("no-viewpoint-path-augmentation", po::bool_switch()->default_value(false), "Whether to prevent augmenting viewpoint path with sparse matching viewpoints")
         ("save-conservative-path", po::bool_switch()->default_value(true), "Whether to also save a conservative path")
         ("drone-start-viewpoint-ids", po::value<std::string>(), "Starting viewpoints for viewpoint path")
@@ -308,7 +366,8 @@ int main(int argc, char** argv) {
   }
   boost::program_options::variables_map vm = std::move(cmdline_result.second);
 
-  BH_ASSERT(vm.count("out-viewpoint-graph-file") > 0 || vm.count("out-viewpoint-path-file") > 0);
+  BH_ASSERT(vm.count("out-viewpoint-graph-file") > 0 || vm.count("out-viewpoint-path-file") > 0
+            || vm.count("convert-viewpoint-graph-file") > 0);
 
   ViewpointPlannerCmdline planner_cmdline(config_options);
 
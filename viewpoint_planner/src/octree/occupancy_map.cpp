@@ -24,32 +24,6 @@ std::string OccupancyMap<AugmentedOccupancyNode>::getTreeType() const {
   return "Ait_OccupancyMap_AugmentedOccupancyNode";
 }
 
-template <>
-std::unique_ptr<OccupancyMap<AugmentedOccupancyNode>> OccupancyMap<AugmentedOccupancyNode>::read(const std::string& filename) {
-  std::unique_ptr<OccupancyMap<AugmentedOccupancyNode>> tree(reinterpret_cast<OccupancyMap<AugmentedOccupancyNode>*>(octomap::AbstractOcTree::read(filename)));
-
-  using TreeNavigatorType = OccupancyMap<AugmentedOccupancyNode>::TreeNavigatorType;
-
-  // Update parent pointers
-  std::stack<TreeNavigatorType> node_stack;
-  node_stack.push(TreeNavigatorType(tree.get(), tree->getRootKey(), tree->getRoot(), 0));
-  while (!node_stack.empty()) {
-    TreeNavigatorType nav = node_stack.top();
-    node_stack.pop();
-    if (nav.hasChildren()) {
-      for (size_t i = 0; i < 8; ++i) {
-        if (nav.hasChild(i)) {
-          TreeNavigatorType child_nav = nav.child(i);
-          child_nav->setParent(nav.getNode());
-          node_stack.push(child_nav);
-        }
-      }
-    }
-  }
-
-  return std::move(tree);
-}
-
 OccupancyMap<AugmentedOccupancyNode>* convertToAugmentedMap(const OccupancyMap<OccupancyNode>* input_tree) {
   using OutputTreeNavigatorType = OccupancyMap<AugmentedOccupancyNode>::TreeNavigatorType;
   using InputConstTreeNavigatorType = OccupancyMap<OccupancyNode>::ConstTreeNavigatorType;
@@ -62,7 +36,7 @@ OccupancyMap<AugmentedOccupancyNode>* convertToAugmentedMap(const OccupancyMap<O
   size_t free_count = 0;
   size_t leaf_count = 0;
 
-  // Copy input tree into augmented tree and initialize parent pointer
+  // Copy input tree into augmented tree
   std::stack<std::pair<InputConstTreeNavigatorType, OutputTreeNavigatorType>> node_stack;
   node_stack.push(std::make_pair(
       InputConstTreeNavigatorType::getRootNavigator(input_tree),
@@ -81,7 +55,6 @@ OccupancyMap<AugmentedOccupancyNode>* convertToAugmentedMap(const OccupancyMap<O
           if (input_tree->isNodeOccupied(*input_child_nav) || input_tree->isNodeUnknown(*input_child_nav)) {
             output_tree->allocNodeChild(*output_nav, i);
             OutputTreeNavigatorType output_child_nav = output_nav.child(i);
-            output_child_nav->setParent(*output_nav);
             output_child_nav->setWeight(0);
             node_stack.push(std::make_pair(input_child_nav, output_child_nav));
           }
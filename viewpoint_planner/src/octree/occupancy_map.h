@@ -235,6 +235,9 @@ private:
   template <typename, typename>
   friend class TreeNavigator;
 
+  /// Find the node with the given key at the given depth by descending from the root
+  static NodeT* findNode(TreeT* tree, const OcTreeKey& key, const size_t depth);
+
   TreeT* tree_;
   OcTreeKey key_;
   NodeT* node_;
@@ -561,6 +564,63 @@ public:
                      KeySet& occupied_cells,
                      double maxrange);
 
+  /// Orders keys along the Z-order curve (same order as the child indices of the tree)
+  /// so that the keys of any subtree form a contiguous range.
+  struct KeyMortonLess {
+    bool operator()(const OcTreeKey& a, const OcTreeKey& b) const {
+      // The dimension with the most significant differing bit decides (ties go to z, then y)
+      size_t dim = 2;
+      unsigned int max_diff = a[2] ^ b[2];
+      for (int i = 1; i >= 0; --i) {
+        const unsigned int diff = a[i] ^ b[i];
+        if (max_diff < diff && max_diff < (max_diff ^ diff)) {
+          dim = i;
+          max_diff = diff;
+        }
+      }
+      return a[dim] < b[dim];
+    }
+  };
+
+  /**
+   * Same as computeUpdate() but returns sorted (KeyMortonLess) and disjoint key vectors.
+   * Each thread collects keys into its own buffer without locking. The buffers are sorted,
+   * merged and deduplicated and finally occupied keys are removed from the free keys in bulk.
+   *
+   * @param scan point cloud measurement to be integrated
+   * @param origin origin of the sensor for ray casting
+   * @param free_keys keys of nodes to be cleared
+   * @param occupied_keys keys of nodes to be marked occupied
+   * @param maxrange maximum range for raycasting (-1: unlimited)
+   */
+  void computeUpdate(const Pointcloud& scan, const octomap::point3d& origin,
+                     std::vector<OcTreeKey>& free_keys,
+                     std::vector<OcTreeKey>& occupied_keys,
+                     double maxrange);
+
+  /// Same as computeDiscreteUpdate() but returns sorted and disjoint key vectors (see computeUpdate()).
+  void computeDiscreteUpdate(const Pointcloud& scan, const octomap::point3d& origin,
+                     std::vector<OcTreeKey>& free_keys,
+                     std::vector<OcTreeKey>& occupied_keys,
+                     double maxrange);
+
+  /**
+   * Integrate free and occupied measurements of sorted and disjoint key vectors as returned by computeUpdate().
+   *
+   * With lazy evaluation the keys are partitioned by their subtree at depth kUpdatePartitionDepth
+   * and the subtrees are updated concurrently. The result is the same as calling updateNode() for all
+   * free keys and then for all occupied keys. Without lazy evaluation or with change detection enabled
+   * the updates are applied sequentially.
+   *
+   * @param free_keys keys of nodes to be cleared
+   * @param occupied_keys keys of nodes to be marked occupied
+   * @param lazy_eval whether update of inner nodes is omitted after the update (default: false).
+   *   This speeds up the insertion, but you need to call updateInnerOccupancy() when done.
+   */
+  void applyUpdate(const std::vector<OcTreeKey>& free_keys,
+                   const std::vector<OcTreeKey>& occupied_keys,
+                   bool lazy_eval = false);
+
 
   // -- I/O  -----------------------------------------
 
@@ -624,6 +684,23 @@ protected:
 
   void updateInnerOccupancyRecurs(NodeT* node, unsigned int depth);
 
+  // concurrent updates of disjoint subtrees (see applyUpdate()) ----------------------------
+
+  /// Depth of the subtrees that are updated concurrently (up to 8^depth subtrees)
+  static constexpr unsigned int kUpdatePartitionDepth = 2;
+
+  /// Index of the subtree at depth kUpdatePartitionDepth that contains a key
+  unsigned int computeUpdatePartitionIndex(const OcTreeKey& key) const;
+
+  /// Lazy version of updateNodeRecurs() that does not touch any tree members.
+  /// Created nodes are only counted and have to be added to tree_size by the caller.
+  NodeT* updateNodeLazyUnsynchronized(NodeT* node, bool node_just_created, const OcTreeKey& key,
+                                      unsigned int depth, bool occupied, size_t* num_created_nodes);
+
+  NodeT* createNodeChildUnsynchronized(NodeT* node, unsigned int pos, size_t* num_created_nodes);
+
+  void expandNodeUnsynchronized(NodeT* node, size_t* num_created_nodes);
+
 protected:
   bool use_bbx_limit;  ///< use bounding box for queries (needs to be set)?
   point3d bbx_min;
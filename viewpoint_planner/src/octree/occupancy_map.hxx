@@ -34,6 +34,7 @@
 
 #include <algorithm>
 #include <cmath>
+#include <iterator>
 //#include <octomap/MCTables.h>
 #include <ait/common.h>
 #include <ait/utilities.h>
@@ -81,19 +82,14 @@ typename OccupancyMap<AugmentedOccupancyNode>::StaticMemberInitializer Occupancy
 template <typename NodeT>
 void OccupancyMap<NodeT>::insertPointCloud(const Pointcloud& scan, const octomap::point3d& sensor_origin,
                                            double maxrange, bool lazy_eval, bool discretize) {
-  KeySet free_cells, occupied_cells;
+  std::vector<OcTreeKey> free_keys, occupied_keys;
   if (discretize)
-    computeDiscreteUpdate(scan, sensor_origin, free_cells, occupied_cells, maxrange);
+    computeDiscreteUpdate(scan, sensor_origin, free_keys, occupied_keys, maxrange);
   else
-    computeUpdate(scan, sensor_origin, free_cells, occupied_cells, maxrange);
+    computeUpdate(scan, sensor_origin, free_keys, occupied_keys, maxrange);
 
   // insert data into tree  -----------------------
-  for (KeySet::iterator it = free_cells.begin(); it != free_cells.end(); ++it) {
-    updateNode(*it, false, lazy_eval);
-  }
-  for (KeySet::iterator it = occupied_cells.begin(); it != occupied_cells.end(); ++it) {
-    updateNode(*it, true, lazy_eval);
-  }
+  applyUpdate(free_keys, occupied_keys, lazy_eval);
 }
 
 template <typename NodeT>
@@ -143,6 +139,18 @@ template <typename NodeT>
 void OccupancyMap<NodeT>::computeDiscreteUpdate(const Pointcloud& scan, const octomap::point3d& origin,
                                               KeySet& free_cells, KeySet& occupied_cells,
                                               double maxrange)
+{
+  std::vector<OcTreeKey> free_keys;
+  std::vector<OcTreeKey> occupied_keys;
+  computeDiscreteUpdate(scan, origin, free_keys, occupied_keys, maxrange);
+  free_cells.insert(free_keys.begin(), free_keys.end());
+  occupied_cells.insert(occupied_keys.begin(), occupied_keys.end());
+}
+
+template <typename NodeT>
+void OccupancyMap<NodeT>::computeDiscreteUpdate(const Pointcloud& scan, const octomap::point3d& origin,
+                                              std::vector<OcTreeKey>& free_keys, std::vector<OcTreeKey>& occupied_keys,
+                                              double maxrange)
 {
  Pointcloud discretePC;
  discretePC.reserve(scan.size());
@@ -156,7 +164,7 @@ void OccupancyMap<NodeT>::computeDiscreteUpdate(const Pointcloud& scan, const oc
    }
  }
 
- computeUpdate(discretePC, origin, free_cells, occupied_cells, maxrange);
+ computeUpdate(discretePC, origin, free_keys, occupied_keys, maxrange);
 }
 
 
@@ -164,93 +172,280 @@ template <typename NodeT>
 void OccupancyMap<NodeT>::computeUpdate(const Pointcloud& scan, const octomap::point3d& origin,
                                               KeySet& free_cells, KeySet& occupied_cells,
                                               double maxrange) {
+  std::vector<OcTreeKey> free_keys;
+  std::vector<OcTreeKey> occupied_keys;
+  computeUpdate(scan, origin, free_keys, occupied_keys, maxrange);
+  free_cells.insert(free_keys.begin(), free_keys.end());
+  occupied_cells.insert(occupied_keys.begin(), occupied_keys.end());
+}
+
+template <typename NodeT>
+void OccupancyMap<NodeT>::computeUpdate(const Pointcloud& scan, const octomap::point3d& origin,
+                                              std::vector<OcTreeKey>& free_keys, std::vector<OcTreeKey>& occupied_keys,
+                                              double maxrange) {
+  int num_threads = 1;
 #ifdef _OPENMP
-  omp_set_num_threads(this->keyrays.size());
-  #pragma omp parallel for schedule(guided)
+  num_threads = omp_get_max_threads();
+#endif
+  // per-thread key buffers, each one sorted and unique after the raycasting
+  std::vector<std::vector<OcTreeKey>> thread_free_keys(num_threads);
+  std::vector<std::vector<OcTreeKey>> thread_occupied_keys(num_threads);
+
+#ifdef _OPENMP
+  #pragma omp parallel num_threads(num_threads)
 #endif
-  for (int i = 0; i < (int)scan.size(); ++i) {
-    const point3d& p = scan[i];
+  {
     unsigned threadIdx = 0;
 #ifdef _OPENMP
     threadIdx = omp_get_thread_num();
 #endif
-    KeyRay* keyray = &(this->keyrays.at(threadIdx));
+    KeyRay keyray;
+    std::vector<OcTreeKey>& local_free_keys = thread_free_keys[threadIdx];
+    std::vector<OcTreeKey>& local_occupied_keys = thread_occupied_keys[threadIdx];
 
-
-    if (!use_bbx_limit) { // no BBX specified
-      if ((maxrange < 0.0) || ((p - origin).norm() <= maxrange) ) { // is not maxrange meas.
-        // free cells
-        if (this->computeRayKeys(origin, p, *keyray)){
 #ifdef _OPENMP
-          #pragma omp critical (free_insert)
+    #pragma omp for schedule(guided)
 #endif
-          {
-            free_cells.insert(keyray->begin(), keyray->end());
+    for (int i = 0; i < (int)scan.size(); ++i) {
+      const point3d& p = scan[i];
+
+      if (!use_bbx_limit) { // no BBX specified
+        if ((maxrange < 0.0) || ((p - origin).norm() <= maxrange) ) { // is not maxrange meas.
+          // free cells
+          if (this->computeRayKeys(origin, p, keyray)){
+            local_free_keys.insert(local_free_keys.end(), keyray.begin(), keyray.end());
           }
-        }
-        // occupied endpoint
-        OcTreeKey key;
-        if (this->coordToKeyChecked(p, key)){
-#ifdef _OPENMP
-          #pragma omp critical (occupied_insert)
-#endif
-          {
-            occupied_cells.insert(key);
+          // occupied endpoint
+          OcTreeKey key;
+          if (this->coordToKeyChecked(p, key)){
+            local_occupied_keys.push_back(key);
           }
-        }
-      } else { // user set a maxrange and length is above
-        point3d direction = (p - origin).normalized ();
-        point3d new_end = origin + direction * (float) maxrange;
-        if (this->computeRayKeys(origin, new_end, *keyray)){
-#ifdef _OPENMP
-          #pragma omp critical (free_insert)
-#endif
-          {
-            free_cells.insert(keyray->begin(), keyray->end());
+        } else { // user set a maxrange and length is above
+          point3d direction = (p - origin).normalized ();
+          point3d new_end = origin + direction * (float) maxrange;
+          if (this->computeRayKeys(origin, new_end, keyray)){
+            local_free_keys.insert(local_free_keys.end(), keyray.begin(), keyray.end());
           }
-        }
-      } // end if maxrange
-    } else { // BBX was set
-      // endpoint in bbx and not maxrange?
-      if ( inBBX(p) && ((maxrange < 0.0) || ((p - origin).norm () <= maxrange) ) )  {
-
-        // occupied endpoint
-        OcTreeKey key;
-        if (this->coordToKeyChecked(p, key)){
-#ifdef _OPENMP
-          #pragma omp critical (occupied_insert)
-#endif
-          {
-            occupied_cells.insert(key);
+        } // end if maxrange
+      } else { // BBX was set
+        // endpoint in bbx and not maxrange?
+        if ( inBBX(p) && ((maxrange < 0.0) || ((p - origin).norm () <= maxrange) ) )  {
+
+          // occupied endpoint
+          OcTreeKey key;
+          if (this->coordToKeyChecked(p, key)){
+            local_occupied_keys.push_back(key);
           }
-        }
 
-        // update freespace, break as soon as bbx limit is reached
-        if (this->computeRayKeys(origin, p, *keyray)){
-          for(KeyRay::reverse_iterator rit=keyray->rbegin(); rit != keyray->rend(); rit++) {
-            if (inBBX(*rit)) {
-#ifdef _OPENMP
-              #pragma omp critical (free_insert)
-#endif
-              {
-                free_cells.insert(*rit);
+          // update freespace, break as soon as bbx limit is reached
+          if (this->computeRayKeys(origin, p, keyray)){
+            for(KeyRay::reverse_iterator rit=keyray.rbegin(); rit != keyray.rend(); rit++) {
+              if (inBBX(*rit)) {
+                local_free_keys.push_back(*rit);
               }
+              else break;
             }
-            else break;
-          }
-        } // end if compute ray
-      } // end if in BBX and not maxrange
-    } // end bbx case
+          } // end if compute ray
+        } // end if in BBX and not maxrange
+      } // end bbx case
 
-  } // end for all points, end of parallel OMP loop
+    } // end for all points
+
+    // deduplicate thread-local keys before merging
+    for (std::vector<OcTreeKey>* keys : { &local_free_keys, &local_occupied_keys }) {
+      std::sort(keys->begin(), keys->end(), KeyMortonLess());
+      keys->erase(std::unique(keys->begin(), keys->end()), keys->end());
+    }
+  } // end of parallel OMP region
+
+  const auto merge_lambda = [](std::vector<std::vector<OcTreeKey>>& thread_keys, std::vector<OcTreeKey>* keys) {
+    size_t num_keys = 0;
+    for (const std::vector<OcTreeKey>& local_keys : thread_keys) {
+      num_keys += local_keys.size();
+    }
+    keys->clear();
+    keys->reserve(num_keys);
+    for (std::vector<OcTreeKey>& local_keys : thread_keys) {
+      const auto middle = keys->insert(keys->end(), local_keys.begin(), local_keys.end());
+      std::inplace_merge(keys->begin(), middle, keys->end(), KeyMortonLess());
+      std::vector<OcTreeKey>().swap(local_keys);
+    }
+    keys->erase(std::unique(keys->begin(), keys->end()), keys->end());
+  };
+  std::vector<OcTreeKey> all_free_keys;
+  merge_lambda(thread_free_keys, &all_free_keys);
+  merge_lambda(thread_occupied_keys, &occupied_keys);
 
   // prefer occupied cells over free ones (and make sets disjunct)
-  for(KeySet::iterator it = free_cells.begin(), end=free_cells.end(); it!= end; ){
-    if (occupied_cells.find(*it) != occupied_cells.end()){
-      it = free_cells.erase(it);
-    } else {
-      ++it;
+  free_keys.clear();
+  free_keys.reserve(all_free_keys.size());
+  std::set_difference(all_free_keys.begin(), all_free_keys.end(),
+                      occupied_keys.begin(), occupied_keys.end(),
+                      std::back_inserter(free_keys), KeyMortonLess());
+}
+
+template <typename NodeT>
+void OccupancyMap<NodeT>::applyUpdate(const std::vector<OcTreeKey>& free_keys,
+                                      const std::vector<OcTreeKey>& occupied_keys,
+                                      bool lazy_eval) {
+  if (!lazy_eval || use_change_detection) {
+    for (const OcTreeKey& key : free_keys) {
+      updateNode(key, false, lazy_eval);
+    }
+    for (const OcTreeKey& key : occupied_keys) {
+      updateNode(key, true, lazy_eval);
+    }
+    return;
+  }
+
+  assert(std::is_sorted(free_keys.begin(), free_keys.end(), KeyMortonLess()));
+  assert(std::is_sorted(occupied_keys.begin(), occupied_keys.end(), KeyMortonLess()));
+  // Keys are sorted along the Z-order curve so each partition is a contiguous range
+  struct Partition {
+    size_t free_begin = 0;
+    size_t free_end = 0;
+    size_t occupied_begin = 0;
+    size_t occupied_end = 0;
+    NodeT* node = nullptr;
+    bool node_just_created = false;
+  };
+  const size_t num_partitions = size_t(1) << (3 * kUpdatePartitionDepth);
+  std::vector<Partition> partitions(num_partitions);
+  const auto assign_ranges_lambda = [&](const std::vector<OcTreeKey>& keys,
+                                        size_t Partition::* begin, size_t Partition::* end) {
+    for (size_t i = 0; i < keys.size(); ) {
+      const unsigned int partition_index = computeUpdatePartitionIndex(keys[i]);
+      size_t j = i + 1;
+      while (j < keys.size() && computeUpdatePartitionIndex(keys[j]) == partition_index) {
+        ++j;
+      }
+      partitions[partition_index].*begin = i;
+      partitions[partition_index].*end = j;
+      i = j;
+    }
+  };
+  assign_ranges_lambda(free_keys, &Partition::free_begin, &Partition::free_end);
+  assign_ranges_lambda(occupied_keys, &Partition::occupied_begin, &Partition::occupied_end);
+
+  // Create the path down to each non-empty partition sequentially
+  bool created_root = false;
+  if (this->root == NULL) {
+    this->root = new NodeT();
+    this->tree_size++;
+    created_root = true;
+  }
+  std::vector<size_t> active_partitions;
+  for (size_t partition_index = 0; partition_index < num_partitions; ++partition_index) {
+    Partition& partition = partitions[partition_index];
+    if (partition.free_begin == partition.free_end && partition.occupied_begin == partition.occupied_end) {
+      continue;
+    }
+    const OcTreeKey& key = partition.free_begin != partition.free_end
+        ? free_keys[partition.free_begin] : occupied_keys[partition.occupied_begin];
+    NodeT* node = this->root;
+    bool node_just_created = created_root;
+    for (unsigned int depth = 0; depth < kUpdatePartitionDepth; ++depth) {
+      const unsigned int pos = computeChildIdx(key, this->tree_depth - 1 - depth);
+      bool created_node = false;
+      if (!this->nodeChildExists(node, pos)) {
+        if (!this->nodeHasChildren(node) && !node_just_created) {
+          this->expandNode(node);
+        }
+        else {
+          this->createNodeChild(node, pos);
+          created_node = true;
+        }
+      }
+      node = this->getNodeChild(node, pos);
+      node_just_created = created_node;
+    }
+    created_root = false;
+    partition.node = node;
+    partition.node_just_created = node_just_created;
+    active_partitions.push_back(partition_index);
+  }
+
+  // Partitions are disjoint subtrees and can be updated concurrently
+  size_t num_created_nodes = 0;
+#ifdef _OPENMP
+  #pragma omp parallel for schedule(dynamic) reduction(+:num_created_nodes)
+#endif
+  for (int i = 0; i < (int)active_partitions.size(); ++i) {
+    const Partition& partition = partitions[active_partitions[i]];
+    bool node_just_created = partition.node_just_created;
+    for (size_t j = partition.free_begin; j < partition.free_end; ++j) {
+      updateNodeLazyUnsynchronized(partition.node, node_just_created, free_keys[j],
+                                   kUpdatePartitionDepth, false, &num_created_nodes);
+      node_just_created = false;
+    }
+    for (size_t j = partition.occupied_begin; j < partition.occupied_end; ++j) {
+      updateNodeLazyUnsynchronized(partition.node, node_just_created, occupied_keys[j],
+                                   kUpdatePartitionDepth, true, &num_created_nodes);
+      node_just_created = false;
+    }
+  }
+  if (num_created_nodes > 0) {
+    this->tree_size += num_created_nodes;
+    this->size_changed = true;
+  }
+}
+
+template <typename NodeT>
+unsigned int OccupancyMap<NodeT>::computeUpdatePartitionIndex(const OcTreeKey& key) const {
+  unsigned int partition_index = 0;
+  for (unsigned int depth = 0; depth < kUpdatePartitionDepth; ++depth) {
+    partition_index = 8 * partition_index + computeChildIdx(key, this->tree_depth - 1 - depth);
+  }
+  return partition_index;
+}
+
+template <typename NodeT>
+NodeT* OccupancyMap<NodeT>::updateNodeLazyUnsynchronized(
+    NodeT* node, bool node_just_created, const OcTreeKey& key,
+    unsigned int depth, bool occupied, size_t* num_created_nodes) {
+  assert(node);
+
+  // follow down to last level (same logic as updateNodeRecurs())
+  for (; depth < this->tree_depth; ++depth) {
+    unsigned int pos = computeChildIdx(key, this->tree_depth -1 - depth);
+    bool created_node = false;
+    if (!this->nodeChildExists(node, pos)) {
+      // child does not exist, but maybe it's a pruned node?
+      if (!this->nodeHasChildren(node) && !node_just_created ) {
+        expandNodeUnsynchronized(node, num_created_nodes);
+      }
+      else {
+        createNodeChildUnsynchronized(node, pos, num_created_nodes);
+        created_node = true;
+      }
     }
+    node = this->getNodeChild(node, pos);
+    node_just_created = created_node;
+  }
+
+  updateNode(node, occupied);
+  return node;
+}
+
+template <typename NodeT>
+NodeT* OccupancyMap<NodeT>::createNodeChildUnsynchronized(NodeT* node, unsigned int pos, size_t* num_created_nodes) {
+  assert(pos < 8);
+  if (node->children == nullptr) {
+    allocNodeChildren(node);
+  }
+  assert(node->children[pos] == nullptr);
+  NodeT* child = new NodeT();
+  node->children[pos] = static_cast<octomap::AbstractOcTreeNode*>(child);
+  ++(*num_created_nodes);
+  return child;
+}
+
+template <typename NodeT>
+void OccupancyMap<NodeT>::expandNodeUnsynchronized(NodeT* node, size_t* num_created_nodes) {
+  assert(!this->nodeHasChildren(node));
+  for (unsigned int k = 0; k < 8; ++k) {
+    NodeT* child = createNodeChildUnsynchronized(node, k, num_created_nodes);
+    child->copyData(*node);
   }
 }
 
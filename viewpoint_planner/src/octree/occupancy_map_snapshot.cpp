@@ -0,0 +1,294 @@
+//==================================================
+// occupancy_map_snapshot.cpp
+//
+//  Copyright (c) 2017 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: Oct 18, 2017
+//==================================================
+
+#include <src/octree/occupancy_map_snapshot.h>
+#include <cstring>
+#include <fstream>
+#if !defined(_WIN32)
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
+constexpr OccupancyMapSnapshot::NodeIndex OccupancyMapSnapshot::kInvalidNode;
+constexpr std::size_t OccupancyMapSnapshot::kMaxTreeDepth;
+constexpr char OccupancyMapSnapshot::kMagic[8];
+constexpr uint32_t OccupancyMapSnapshot::kVersion;
+
+namespace {
+
+uint64_t alignOffset(const uint64_t offset) {
+  const uint64_t alignment = 8;
+  return (offset + alignment - 1) / alignment * alignment;
+}
+
+template <typename T>
+void writeArray(std::ofstream& ofs, const std::vector<T>& values, const uint64_t offset) {
+  const uint64_t position = static_cast<uint64_t>(ofs.tellp());
+  BH_ASSERT(position <= offset);
+  const std::vector<char> padding(offset - position, 0);
+  ofs.write(padding.data(), padding.size());
+  ofs.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+}
+
+}
+
+void OccupancyMapSnapshot::write(const OccupancyMapType& tree, const std::string& filename) {
+  using NodeType = AugmentedOccupancyNode;
+  BH_ASSERT(tree.getTreeDepth() <= kMaxTreeDepth);
+
+  Header header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.tree_depth = static_cast<uint32_t>(tree.getTreeDepth());
+  header.resolution = tree.getResolution();
+
+  // Linearize nodes level by level. Children are appended in child index order, so each level is in Morton order.
+  std::vector<uint8_t> child_masks;
+  std::vector<NodeIndex> first_children;
+  std::vector<OccupancyType> occupancies;
+  std::vector<CounterType> observation_counts;
+  std::vector<WeightType> weights;
+  std::vector<CounterSumType> observation_count_sums;
+  std::vector<const NodeType*> level_nodes;
+  if (tree.getRoot() != nullptr) {
+    level_nodes.push_back(tree.getRoot());
+  }
+  std::size_t depth = 0;
+  header.level_offsets[0] = 0;
+  while (!level_nodes.empty()) {
+    BH_ASSERT(depth <= tree.getTreeDepth());
+    std::vector<const NodeType*> next_level_nodes;
+    const NodeIndex next_level_begin = child_masks.size() + level_nodes.size();
+    for (const NodeType* node : level_nodes) {
+      first_children.push_back(next_level_begin + next_level_nodes.size());
+      uint8_t child_mask = 0;
+      for (unsigned int i = 0; i < 8; ++i) {
+        if (tree.nodeChildExists(node, i)) {
+          child_mask |= 1 << i;
+          next_level_nodes.push_back(tree.getNodeChild(node, i));
+        }
+      }
+      child_masks.push_back(child_mask);
+      if (child_mask == 0) {
+        ++header.num_leaf_nodes;
+      }
+      occupancies.push_back(node->getOccupancy());
+      observation_counts.push_back(node->getObservationCount());
+      weights.push_back(node->getWeight());
+      observation_count_sums.push_back(static_cast<CounterSumType>(node->getObservationCountSum()));
+    }
+    ++depth;
+    header.level_offsets[depth] = child_masks.size();
+    level_nodes.swap(next_level_nodes);
+  }
+  header.num_nodes = child_masks.size();
+  for (std::size_t d = depth + 1; d < kMaxTreeDepth + 2; ++d) {
+    header.level_offsets[d] = header.num_nodes;
+  }
+
+  header.child_masks_offset = alignOffset(sizeof(Header));
+  header.first_children_offset = alignOffset(header.child_masks_offset + header.num_nodes * sizeof(uint8_t));
+  header.occupancies_offset = alignOffset(header.first_children_offset + header.num_nodes * sizeof(NodeIndex));
+  header.observation_counts_offset = alignOffset(header.occupancies_offset + header.num_nodes * sizeof(OccupancyType));
+  header.weights_offset = alignOffset(header.observation_counts_offset + header.num_nodes * sizeof(CounterType));
+  header.observation_count_sums_offset = alignOffset(header.weights_offset + header.num_nodes * sizeof(WeightType));
+  header.file_size = header.observation_count_sums_offset + header.num_nodes * sizeof(CounterSumType);
+
+  std::ofstream ofs(filename, std::ios::binary);
+  if (!ofs) {
+    throw Error(std::string("Unable to open file for writing: ") + filename);
+  }
+  ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  writeArray(ofs, child_masks, header.child_masks_offset);
+  writeArray(ofs, first_children, header.first_children_offset);
+  writeArray(ofs, occupancies, header.occupancies_offset);
+  writeArray(ofs, observation_counts, header.observation_counts_offset);
+  writeArray(ofs, weights, header.weights_offset);
+  writeArray(ofs, observation_count_sums, header.observation_count_sums_offset);
+  if (!ofs) {
+    throw Error(std::string("Failed to write occupancy map snapshot: ") + filename);
+  }
+}
+
+OccupancyMapSnapshot::OccupancyMapSnapshot()
+: data_(nullptr), mapped_size_(0), header_(nullptr),
+  child_masks_(nullptr), first_children_(nullptr), occupancies_(nullptr),
+  observation_counts_(nullptr), weights_(nullptr), observation_count_sums_(nullptr) {}
+
+OccupancyMapSnapshot::OccupancyMapSnapshot(const std::string& filename, const bool use_mmap)
+: OccupancyMapSnapshot() {
+  open(filename, use_mmap);
+}
+
+OccupancyMapSnapshot::~OccupancyMapSnapshot() {
+  close();
+}
+
+void OccupancyMapSnapshot::open(const std::string& filename, const bool use_mmap) {
+  close();
+#if !defined(_WIN32)
+  if (use_mmap) {
+    const int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw Error(std::string("Unable to open file for reading: ") + filename);
+    }
+    struct stat file_stat;
+    if (::fstat(fd, &file_stat) != 0 || file_stat.st_size == 0) {
+      ::close(fd);
+      throw Error(std::string("Unable to determine size of file: ") + filename);
+    }
+    const std::size_t size = static_cast<std::size_t>(file_stat.st_size);
+    void* ptr = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping stays valid after closing the file descriptor
+    ::close(fd);
+    if (ptr == MAP_FAILED) {
+      throw Error(std::string("Unable to memory map file: ") + filename);
+    }
+    data_ = static_cast<const char*>(ptr);
+    mapped_size_ = size;
+    try {
+      initFromData(size);
+    }
+    catch (...) {
+      close();
+      throw;
+    }
+    return;
+  }
+#endif
+  std::ifstream ifs(filename, std::ios::binary | std::ios::ate);
+  if (!ifs) {
+    throw Error(std::string("Unable to open file for reading: ") + filename);
+  }
+  const std::size_t size = static_cast<std::size_t>(ifs.tellg());
+  ifs.seekg(0);
+  buffer_.resize(size);
+  ifs.read(buffer_.data(), size);
+  if (!ifs) {
+    throw Error(std::string("Failed to read occupancy map snapshot: ") + filename);
+  }
+  data_ = buffer_.data();
+  try {
+    initFromData(size);
+  }
+  catch (...) {
+    close();
+    throw;
+  }
+}
+
+void OccupancyMapSnapshot::close() {
+#if !defined(_WIN32)
+  if (mapped_size_ > 0) {
+    ::munmap(const_cast<char*>(data_), mapped_size_);
+  }
+#endif
+  buffer_.clear();
+  buffer_.shrink_to_fit();
+  data_ = nullptr;
+  mapped_size_ = 0;
+  header_ = nullptr;
+  child_masks_ = nullptr;
+  first_children_ = nullptr;
+  occupancies_ = nullptr;
+  observation_counts_ = nullptr;
+  weights_ = nullptr;
+  observation_count_sums_ = nullptr;
+}
+
+void OccupancyMapSnapshot::initFromData(const std::size_t size) {
+  if (size < sizeof(Header)) {
+    throw Error("Occupancy map snapshot is too small");
+  }
+  header_ = reinterpret_cast<const Header*>(data_);
+  if (std::memcmp(header_->magic, kMagic, sizeof(kMagic)) != 0) {
+    throw Error("File is not an occupancy map snapshot");
+  }
+  if (header_->version != kVersion) {
+    throw Error("Unsupported occupancy map snapshot version " + std::to_string(header_->version));
+  }
+  if (header_->file_size != size) {
+    throw Error("Occupancy map snapshot is truncated");
+  }
+  if (header_->tree_depth > kMaxTreeDepth) {
+    throw Error("Invalid tree depth in occupancy map snapshot");
+  }
+  const std::size_t num_nodes = header_->num_nodes;
+  child_masks_ = getArray<uint8_t>(header_->child_masks_offset, num_nodes);
+  first_children_ = getArray<NodeIndex>(header_->first_children_offset, num_nodes);
+  occupancies_ = getArray<OccupancyType>(header_->occupancies_offset, num_nodes);
+  observation_counts_ = getArray<CounterType>(header_->observation_counts_offset, num_nodes);
+  weights_ = getArray<WeightType>(header_->weights_offset, num_nodes);
+  observation_count_sums_ = getArray<CounterSumType>(header_->observation_count_sums_offset, num_nodes);
+}
+
+template <typename T>
+const T* OccupancyMapSnapshot::getArray(const uint64_t offset, const std::size_t size) const {
+  if (offset % alignof(T) != 0 || offset + size * sizeof(T) > header_->file_size) {
+    throw Error("Invalid array offset in occupancy map snapshot");
+  }
+  return reinterpret_cast<const T*>(data_ + offset);
+}
+
+OccupancyMapSnapshot::NodeIndex OccupancyMapSnapshot::search(const octomap::OcTreeKey& key, std::size_t depth) const {
+  if (getNumNodes() == 0) {
+    return kInvalidNode;
+  }
+  if (depth == 0) {
+    depth = getTreeDepth();
+  }
+  NodeIndex node = getRoot();
+  for (std::size_t d = 0; d < depth; ++d) {
+    if (isLeaf(node)) {
+      return node;
+    }
+    const unsigned int pos = octomap::computeChildIdx(key, static_cast<int>(getTreeDepth() - d - 1));
+    if (!hasChild(node, pos)) {
+      return kInvalidNode;
+    }
+    node = getChild(node, pos);
+  }
+  return node;
+}
+
+std::unique_ptr<OccupancyMapSnapshot::OccupancyMapType> OccupancyMapSnapshot::toOccupancyMap() const {
+  std::unique_ptr<OccupancyMapType> tree(new OccupancyMapType(getResolution()));
+  if (getNumNodes() == 0) {
+    return std::move(tree);
+  }
+  if (tree->getTreeDepth() != getTreeDepth()) {
+    throw Error("Tree depth of occupancy map snapshot does not match");
+  }
+  tree->createRoot();
+  // Nodes are created in the same level order as they are stored
+  std::vector<AugmentedOccupancyNode*> level_nodes;
+  level_nodes.push_back(tree->getRoot());
+  for (std::size_t depth = 0; !level_nodes.empty(); ++depth) {
+    std::vector<AugmentedOccupancyNode*> next_level_nodes;
+    const NodeIndex level_begin = getLevelBegin(depth);
+    for (std::size_t k = 0; k < level_nodes.size(); ++k) {
+      const NodeIndex index = level_begin + k;
+      AugmentedOccupancyNode* node = level_nodes[k];
+      node->setOccupancy(getOccupancy(index));
+      node->setObservationCount(getObservationCount(index));
+      node->setWeight(getWeight(index));
+      node->setObservationCountSum(getObservationCountSum(index));
+      for (std::size_t i = 0; i < 8; ++i) {
+        if (hasChild(index, i)) {
+          tree->allocNodeChild(node, i);
+          next_level_nodes.push_back(tree->getNodeChild(node, i));
+        }
+      }
+    }
+    level_nodes.swap(next_level_nodes);
+  }
+  return std::move(tree);
+}
@@ -0,0 +1,176 @@
+//==================================================
+// occupancy_map_snapshot.h
+//
+//  Copyright (c) 2017 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: Oct 18, 2017
+//==================================================
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+#include <bh/common.h>
+#include "occupancy_map.h"
+
+/// Flat, pointerless snapshot of an augmented occupancy map.
+///
+/// Nodes are linearized level by level. Within a level the nodes are in Morton order (children are visited in
+/// octomap child index order), so the children of a node are contiguous and are found from the index of the
+/// first child and the child mask. Child masks, first child indices and the node payload are stored as separate
+/// arrays in a single file with a fixed header. The file can be memory mapped and traversed without deserialization.
+class OccupancyMapSnapshot {
+public:
+  using OccupancyMapType = OccupancyMap<AugmentedOccupancyNode>;
+  using NodeIndex = uint64_t;
+  using OccupancyType = AugmentedOccupancyNode::OccupancyType;
+  using CounterType = AugmentedOccupancyNode::CounterType;
+  using WeightType = AugmentedOccupancyNode::WeightType;
+  using CounterSumType = AugmentedOccupancyNode::CounterSumType;
+
+  static constexpr NodeIndex kInvalidNode = std::numeric_limits<NodeIndex>::max();
+  static constexpr std::size_t kMaxTreeDepth = 16;
+
+  class Error : public bh::Error {
+  public:
+    explicit Error(const std::string& what)
+    : bh::Error(what) {}
+  };
+
+  /// Write a snapshot of an occupancy map
+  static void write(const OccupancyMapType& tree, const std::string& filename);
+
+  OccupancyMapSnapshot();
+
+  /// Open a snapshot. If use_mmap is false or memory mapping is not available the file is read into memory.
+  explicit OccupancyMapSnapshot(const std::string& filename, const bool use_mmap = true);
+
+  OccupancyMapSnapshot(const OccupancyMapSnapshot& other) = delete;
+
+  ~OccupancyMapSnapshot();
+
+  void open(const std::string& filename, const bool use_mmap = true);
+
+  void close();
+
+  bool isOpen() const {
+    return data_ != nullptr;
+  }
+
+  bool isMemoryMapped() const {
+    return mapped_size_ > 0;
+  }
+
+  /// Convert the snapshot to a pointer-based occupancy map
+  std::unique_ptr<OccupancyMapType> toOccupancyMap() const;
+
+  double getResolution() const {
+    return header_->resolution;
+  }
+
+  std::size_t getTreeDepth() const {
+    return header_->tree_depth;
+  }
+
+  std::size_t getNumNodes() const {
+    return header_->num_nodes;
+  }
+
+  std::size_t getNumLeafNodes() const {
+    return header_->num_leaf_nodes;
+  }
+
+  /// Index of the first node at the given depth (depth 0 is the root)
+  NodeIndex getLevelBegin(const std::size_t depth) const {
+    return header_->level_offsets[depth];
+  }
+
+  /// Index after the last node at the given depth
+  NodeIndex getLevelEnd(const std::size_t depth) const {
+    return header_->level_offsets[depth + 1];
+  }
+
+  NodeIndex getRoot() const {
+    return getNumNodes() > 0 ? 0 : kInvalidNode;
+  }
+
+  bool isLeaf(const NodeIndex node) const {
+    return child_masks_[node] == 0;
+  }
+
+  uint8_t getChildMask(const NodeIndex node) const {
+    return child_masks_[node];
+  }
+
+  bool hasChild(const NodeIndex node, const std::size_t i) const {
+    return (child_masks_[node] & (1 << i)) != 0;
+  }
+
+  /// Index of the i-th child. The child has to exist.
+  NodeIndex getChild(const NodeIndex node, const std::size_t i) const {
+    const unsigned int preceding_mask = child_masks_[node] & ((1u << i) - 1);
+    return first_children_[node] + __builtin_popcount(preceding_mask);
+  }
+
+  OccupancyType getOccupancy(const NodeIndex node) const {
+    return occupancies_[node];
+  }
+
+  CounterType getObservationCount(const NodeIndex node) const {
+    return observation_counts_[node];
+  }
+
+  WeightType getWeight(const NodeIndex node) const {
+    return weights_[node];
+  }
+
+  CounterSumType getObservationCountSum(const NodeIndex node) const {
+    return observation_count_sums_[node];
+  }
+
+  /// Search the node containing a key down to the given depth (0 means the full tree depth).
+  /// Returns kInvalidNode if the node does not exist. Like octomap's search a leaf above the depth is returned.
+  NodeIndex search(const octomap::OcTreeKey& key, std::size_t depth = 0) const;
+
+private:
+  static constexpr char kMagic[8] = {'O', 'C', 'C', 'S', 'N', 'A', 'P', '1'};
+  static constexpr uint32_t kVersion = 1;
+
+  struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t tree_depth;
+    double resolution;
+    uint64_t num_nodes;
+    uint64_t num_leaf_nodes;
+    uint64_t level_offsets[kMaxTreeDepth + 2];
+    // Byte offsets of the arrays
+    uint64_t child_masks_offset;
+    uint64_t first_children_offset;
+    uint64_t occupancies_offset;
+    uint64_t observation_counts_offset;
+    uint64_t weights_offset;
+    uint64_t observation_count_sums_offset;
+    uint64_t file_size;
+  };
+
+  /// Set up array pointers from the data of an opened file
+  void initFromData(const std::size_t size);
+
+  template <typename T>
+  const T* getArray(const uint64_t offset, const std::size_t size) const;
+
+  const char* data_;
+  std::size_t mapped_size_;
+  std::vector<char> buffer_;
+
+  const Header* header_;
+  const uint8_t* child_masks_;
+  const NodeIndex* first_children_;
+  const OccupancyType* occupancies_;
+  const CounterType* observation_counts_;
+  const WeightType* weights_;
+  const CounterSumType* observation_count_sums_;
+};
@@ -105,8 +105,8 @@ void TreeNavigator<TreeT, NodeT>::gotoChild(size_t i) {
 template <typename TreeT, typename NodeT>
 void TreeNavigator<TreeT, NodeT>::gotoParent() {
   key_ = tree_->getParentKey(key_, depth_);
-  node_ = node_->getParent();
   depth_ = depth_ - 1;
+  node_ = findNode(tree_, key_, depth_);
 }
 
 template <typename TreeT, typename NodeT>
@@ -121,7 +121,18 @@ TreeNavigator<TreeT, NodeT> TreeNavigator<TreeT, NodeT>::child(size_t i) const {
 template <typename TreeT, typename NodeT>
 TreeNavigator<TreeT, NodeT> TreeNavigator<TreeT, NodeT>::parent() const {
   OcTreeKey parent_key = tree_->getParentKey(key_, depth_);
-  NodeT* parent_node = node_->getParent();
   size_t parent_depth = depth_ - 1;
+  NodeT* parent_node = findNode(tree_, parent_key, parent_depth);
   return TreeNavigator(tree_, parent_key, parent_node, parent_depth);
 }
+
+template <typename TreeT, typename NodeT>
+NodeT* TreeNavigator<TreeT, NodeT>::findNode(TreeT* tree, const OcTreeKey& key, const size_t depth) {
+  // Nodes do not store parent pointers so descend from the root instead
+  NodeT* node = tree->getRoot();
+  for (size_t d = 0; d < depth; ++d) {
+    const unsigned int pos = octomap::computeChildIdx(key, tree->getTreeDepth() - d - 1);
+    node = tree->getNodeChild(node, pos);
+  }
+  return node;
+}
@@ -157,7 +157,7 @@ void OccupancyNode::allocChildren() {
 }
 
 AugmentedOccupancyNode::AugmentedOccupancyNode()
-: parent_(nullptr), weight_(0), observation_count_sum_(0) {}
+: weight_(0), observation_count_sum_(0) {}
 
 AugmentedOccupancyNode::AugmentedOccupancyNode(const AugmentedOccupancyNode& rhs) {
   copyData(rhs);
@@ -168,7 +168,6 @@ AugmentedOccupancyNode::AugmentedOccupancyNode(const AugmentedOccupancyNode& rhs
       children[i] = new AugmentedOccupancyNode(*(static_cast<AugmentedOccupancyNode*>(rhs.children[i])));
     }
   }
-  parent_ = nullptr;
   weight_ = rhs.weight_;
   observation_count_sum_ = rhs.observation_count_sum_;
 }
@@ -179,7 +178,6 @@ AugmentedOccupancyNode::~AugmentedOccupancyNode() {}
 /// Opposed to copy ctor, this does not clone the children as well
 void AugmentedOccupancyNode::copyData(const AugmentedOccupancyNode& from) {
   OccupancyNode::copyData(static_cast<const OccupancyNode&>(from));
-  parent_ = nullptr;
   weight_ = from.weight_;
   observation_count_sum_ = from.observation_count_sum_;
 }
@@ -198,16 +196,21 @@ size_t AugmentedOccupancyNode::getSumObservationCount() const {
   return observation_count_sum;
 }
 
+// The observation count sum is stored with 64 bit in files so that existing augmented trees can still be read.
+
 std::istream& AugmentedOccupancyNode::readData(std::istream &s) {
   OccupancyNode::readData(s);
   s.read((char*)&weight_, sizeof(weight_));
-  s.read((char*)&observation_count_sum_, sizeof(observation_count_sum_));
+  uint64_t observation_count_sum;
+  s.read((char*)&observation_count_sum, sizeof(observation_count_sum));
+  observation_count_sum_ = saturateCounterSum(observation_count_sum);
   return s;
 }
 
 std::ostream& AugmentedOccupancyNode::writeData(std::ostream &s) const {
   OccupancyNode::writeData(s);
   s.write((const char*)&weight_, sizeof(weight_));
-  s.write((const char*)&observation_count_sum_, sizeof(observation_count_sum_));
+  const uint64_t observation_count_sum = observation_count_sum_;
+  s.write((const char*)&observation_count_sum, sizeof(observation_count_sum));
   return s;
 }
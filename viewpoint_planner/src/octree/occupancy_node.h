@@ -34,6 +34,8 @@
  * along with this program. If not, see http://www.gnu.org/licenses/.
  */
 
+#include <algorithm>
+#include <cstdint>
 #include <tuple>
 #include <limits>
 #include <cmath>
@@ -193,9 +195,15 @@ protected:
 //  CounterType free_count_;
 };
 
+/// Occupancy node with additional weight and observation count sum.
+///
+/// The node does not store a parent pointer. Parents are found by descending from the root along the node key
+/// (see TreeNavigator::gotoParent()). The observation count sum is stored with 32 bit and saturates.
+/// Together this reduces the node from 40 to 24 bytes on 64 bit platforms.
 class AugmentedOccupancyNode : public OccupancyNode {
 public:
   using WeightType = float;
+  using CounterSumType = uint32_t;
 
   AugmentedOccupancyNode();
 
@@ -215,24 +223,12 @@ public:
     weight_ = weight;
   }
 
-  const AugmentedOccupancyNode* getParent() const {
-    return parent_;
-  }
-
-  AugmentedOccupancyNode* getParent() {
-    return parent_;
-  }
-
-  void setParent(AugmentedOccupancyNode* parent) {
-    parent_ = parent;
-  }
-
   size_t getObservationCountSum() const {
     return observation_count_sum_;
   }
 
   void setObservationCountSum(size_t observation_count_sum) {
-    observation_count_sum_ = observation_count_sum;
+    observation_count_sum_ = saturateCounterSum(observation_count_sum);
   }
 
   size_t getSumObservationCount() const;
@@ -241,7 +237,7 @@ public:
   void updateFromChildren() {
     OccupancyNode::updateFromChildren();
     size_t observation_count_sum = this->getSumObservationCount();
-    observation_count_sum_ = observation_count_sum;
+    observation_count_sum_ = saturateCounterSum(observation_count_sum);
   }
 
   // file IO:
@@ -253,7 +249,11 @@ public:
   std::ostream& writeData(std::ostream &s) const;
 
 private:
-  AugmentedOccupancyNode* parent_;
+  static CounterSumType saturateCounterSum(size_t observation_count_sum) {
+    return static_cast<CounterSumType>(
+        std::min<size_t>(observation_count_sum, std::numeric_limits<CounterSumType>::max()));
+  }
+
   WeightType weight_;
-  size_t observation_count_sum_;
+  CounterSumType observation_count_sum_;
 };
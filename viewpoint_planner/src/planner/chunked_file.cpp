@@ -0,0 +1,205 @@
+//==================================================
+// chunked_file.cpp
+//
+//  Copyright (c) 2017 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: Oct 18, 2017
+//==================================================
+
+#include <src/planner/chunked_file.h>
+#include <cstring>
+#include <iostream>
+#if !defined(_WIN32)
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
+constexpr std::size_t ChunkedFile::kMagicSize;
+constexpr std::size_t ChunkedFile::kIdSize;
+
+namespace {
+
+uint64_t alignOffset(const uint64_t offset) {
+  const uint64_t alignment = 8;
+  return (offset + alignment - 1) / alignment * alignment;
+}
+
+}
+
+void ChunkedFile::copyId(const std::string& id, char* out) {
+  if (id.size() > kIdSize) {
+    throw Error("Chunk id is too long: " + id);
+  }
+  std::memset(out, 0, kIdSize);
+  std::memcpy(out, id.data(), id.size());
+}
+
+ChunkedFileWriter::ChunkedFileWriter(const std::string& filename, const std::string& magic, const uint32_t version)
+: filename_(filename), ofs_(filename, std::ios::binary) {
+  BH_ASSERT(magic.size() == kMagicSize);
+  if (!ofs_) {
+    throw Error(std::string("Unable to open file for writing: ") + filename);
+  }
+  std::memset(&header_, 0, sizeof(header_));
+  std::memcpy(header_.magic, magic.data(), kMagicSize);
+  header_.version = version;
+  // The header is written again with the chunk table offset when the file is closed
+  ofs_.write(reinterpret_cast<const char*>(&header_), sizeof(header_));
+}
+
+ChunkedFileWriter::~ChunkedFileWriter() {
+  if (ofs_.is_open()) {
+    try {
+      close();
+    }
+    catch (const Error& err) {
+      std::cout << "ERROR: " << err.what() << std::endl;
+    }
+  }
+}
+
+void ChunkedFileWriter::writeChunk(const std::string& id, const void* data, const std::size_t size) {
+  ChunkEntry entry;
+  copyId(id, entry.id);
+  const uint64_t position = static_cast<uint64_t>(ofs_.tellp());
+  entry.offset = alignOffset(position);
+  entry.size = size;
+  const std::vector<char> padding(entry.offset - position, 0);
+  ofs_.write(padding.data(), padding.size());
+  ofs_.write(reinterpret_cast<const char*>(data), size);
+  if (!ofs_) {
+    throw Error("Failed to write chunk " + id + " to file " + filename_);
+  }
+  chunk_entries_.push_back(entry);
+}
+
+void ChunkedFileWriter::close() {
+  const uint64_t position = static_cast<uint64_t>(ofs_.tellp());
+  header_.table_offset = alignOffset(position);
+  header_.num_chunks = static_cast<uint32_t>(chunk_entries_.size());
+  const std::vector<char> padding(header_.table_offset - position, 0);
+  ofs_.write(padding.data(), padding.size());
+  ofs_.write(reinterpret_cast<const char*>(chunk_entries_.data()), chunk_entries_.size() * sizeof(ChunkEntry));
+  ofs_.seekp(0);
+  ofs_.write(reinterpret_cast<const char*>(&header_), sizeof(header_));
+  ofs_.close();
+  if (!ofs_) {
+    throw Error(std::string("Failed to write file: ") + filename_);
+  }
+}
+
+ChunkedFileReader::ChunkedFileReader(const std::string& filename, const std::string& magic, const bool use_mmap)
+: data_(nullptr), size_(0), mapped_size_(0), header_(nullptr), chunk_entries_(nullptr) {
+  BH_ASSERT(magic.size() == kMagicSize);
+#if !defined(_WIN32)
+  if (use_mmap) {
+    const int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw Error(std::string("Unable to open file for reading: ") + filename);
+    }
+    struct stat file_stat;
+    if (::fstat(fd, &file_stat) != 0 || file_stat.st_size == 0) {
+      ::close(fd);
+      throw Error(std::string("Unable to determine size of file: ") + filename);
+    }
+    const std::size_t size = static_cast<std::size_t>(file_stat.st_size);
+    void* ptr = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping stays valid after closing the file descriptor
+    ::close(fd);
+    if (ptr == MAP_FAILED) {
+      throw Error(std::string("Unable to memory map file: ") + filename);
+    }
+    data_ = static_cast<const char*>(ptr);
+    size_ = size;
+    mapped_size_ = size;
+    try {
+      initFromData(magic);
+    }
+    catch (...) {
+      close();
+      throw;
+    }
+    return;
+  }
+#endif
+  std::ifstream ifs(filename, std::ios::binary | std::ios::ate);
+  if (!ifs) {
+    throw Error(std::string("Unable to open file for reading: ") + filename);
+  }
+  size_ = static_cast<std::size_t>(ifs.tellg());
+  ifs.seekg(0);
+  buffer_.resize(size_);
+  ifs.read(buffer_.data(), size_);
+  if (!ifs) {
+    throw Error(std::string("Failed to read file: ") + filename);
+  }
+  data_ = buffer_.data();
+  initFromData(magic);
+}
+
+ChunkedFileReader::~ChunkedFileReader() {
+  close();
+}
+
+bool ChunkedFileReader::hasMagic(const std::string& filename, const std::string& magic) {
+  BH_ASSERT(magic.size() == kMagicSize);
+  std::ifstream ifs(filename, std::ios::binary);
+  char file_magic[kMagicSize];
+  ifs.read(file_magic, kMagicSize);
+  return ifs && std::memcmp(file_magic, magic.data(), kMagicSize) == 0;
+}
+
+void ChunkedFileReader::initFromData(const std::string& magic) {
+  if (size_ < sizeof(Header)) {
+    throw Error("Chunked file is too small");
+  }
+  header_ = reinterpret_cast<const Header*>(data_);
+  if (std::memcmp(header_->magic, magic.data(), kMagicSize) != 0) {
+    throw Error("Chunked file has unexpected magic string");
+  }
+  if (header_->table_offset % alignof(ChunkEntry) != 0
+      || header_->table_offset + header_->num_chunks * sizeof(ChunkEntry) > size_) {
+    throw Error("Chunked file is truncated");
+  }
+  chunk_entries_ = reinterpret_cast<const ChunkEntry*>(data_ + header_->table_offset);
+  for (std::size_t i = 0; i < header_->num_chunks; ++i) {
+    if (chunk_entries_[i].offset + chunk_entries_[i].size > header_->table_offset) {
+      throw Error("Invalid chunk offset in chunked file");
+    }
+  }
+}
+
+void ChunkedFileReader::close() {
+#if !defined(_WIN32)
+  if (mapped_size_ > 0) {
+    ::munmap(const_cast<char*>(data_), mapped_size_);
+  }
+#endif
+  buffer_.clear();
+  data_ = nullptr;
+  size_ = 0;
+  mapped_size_ = 0;
+  header_ = nullptr;
+  chunk_entries_ = nullptr;
+}
+
+auto ChunkedFileReader::findChunk(const std::string& id) const -> const ChunkEntry* {
+  char id_buffer[kIdSize];
+  copyId(id, id_buffer);
+  for (std::size_t i = 0; i < header_->num_chunks; ++i) {
+    if (std::memcmp(chunk_entries_[i].id, id_buffer, kIdSize) == 0) {
+      return &chunk_entries_[i];
+    }
+  }
+  return nullptr;
+}
+
+auto ChunkedFileReader::getChunkEntry(const std::string& id) const -> const ChunkEntry* {
+  const ChunkEntry* entry = findChunk(id);
+  if (entry == nullptr) {
+    throw Error("Chunked file has no chunk " + id);
+  }
+  return entry;
+}
@@ -0,0 +1,189 @@
+//==================================================
+// chunked_file.h
+//
+//  Copyright (c) 2017 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: Oct 18, 2017
+//==================================================
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <bh/common.h>
+
+/// Binary file consisting of named chunks of raw arrays.
+///
+/// The file starts with a header (magic, version, chunk table offset). Chunks are written one after another with
+/// 8 byte alignment and the chunk table (id, offset, size) is appended at the end, so chunks can be streamed out
+/// without knowing their number in advance. For reading the file is memory mapped and chunks are accessed in-place.
+/// Values are stored in native byte order.
+class ChunkedFile {
+public:
+  static constexpr std::size_t kMagicSize = 8;
+  static constexpr std::size_t kIdSize = 8;
+
+  class Error : public bh::Error {
+  public:
+    explicit Error(const std::string& what)
+    : bh::Error(what) {}
+  };
+
+  /// View of an array stored in a chunk
+  template <typename T>
+  class Chunk {
+  public:
+    Chunk()
+    : data_(nullptr), size_(0) {}
+
+    Chunk(const T* data, const std::size_t size)
+    : data_(data), size_(size) {}
+
+    const T* begin() const {
+      return data_;
+    }
+
+    const T* end() const {
+      return data_ + size_;
+    }
+
+    const T* data() const {
+      return data_;
+    }
+
+    std::size_t size() const {
+      return size_;
+    }
+
+    bool empty() const {
+      return size_ == 0;
+    }
+
+    const T& operator[](const std::size_t index) const {
+      return data_[index];
+    }
+
+  private:
+    const T* data_;
+    std::size_t size_;
+  };
+
+protected:
+  struct Header {
+    char magic[kMagicSize];
+    uint32_t version;
+    uint32_t num_chunks;
+    uint64_t table_offset;
+  };
+
+  struct ChunkEntry {
+    char id[kIdSize];
+    uint64_t offset;
+    uint64_t size;
+  };
+
+  static void copyId(const std::string& id, char* out);
+};
+
+class ChunkedFileWriter : public ChunkedFile {
+public:
+  /// The magic string identifies the type of file and has to be 8 characters long
+  ChunkedFileWriter(const std::string& filename, const std::string& magic, const uint32_t version);
+
+  ChunkedFileWriter(const ChunkedFileWriter& other) = delete;
+
+  ~ChunkedFileWriter();
+
+  /// Write a chunk. Chunk ids can be up to 8 characters long.
+  void writeChunk(const std::string& id, const void* data, const std::size_t size);
+
+  template <typename T>
+  void writeChunk(const std::string& id, const std::vector<T>& values) {
+    static_assert(std::is_trivially_copyable<T>::value, "Chunks can only contain trivially copyable values");
+    writeChunk(id, values.data(), values.size() * sizeof(T));
+  }
+
+  /// Write a single value as a chunk
+  template <typename T>
+  void writeValueChunk(const std::string& id, const T& value) {
+    static_assert(std::is_trivially_copyable<T>::value, "Chunks can only contain trivially copyable values");
+    writeChunk(id, &value, sizeof(T));
+  }
+
+  /// Write the chunk table and close the file
+  void close();
+
+private:
+  std::string filename_;
+  std::ofstream ofs_;
+  Header header_;
+  std::vector<ChunkEntry> chunk_entries_;
+};
+
+class ChunkedFileReader : public ChunkedFile {
+public:
+  /// Open a chunked file. If use_mmap is false or memory mapping is not available the file is read into memory.
+  ChunkedFileReader(const std::string& filename, const std::string& magic, const bool use_mmap = true);
+
+  ChunkedFileReader(const ChunkedFileReader& other) = delete;
+
+  ~ChunkedFileReader();
+
+  /// Whether a file starts with the given magic string
+  static bool hasMagic(const std::string& filename, const std::string& magic);
+
+  uint32_t getVersion() const {
+    return header_->version;
+  }
+
+  bool hasChunk(const std::string& id) const {
+    return findChunk(id) != nullptr;
+  }
+
+  /// Array of values stored in a chunk. Throws if the chunk does not exist or does not fit the value type.
+  template <typename T>
+  Chunk<T> getChunk(const std::string& id) const {
+    static_assert(std::is_trivially_copyable<T>::value, "Chunks can only contain trivially copyable values");
+    const ChunkEntry* entry = getChunkEntry(id);
+    if (entry->size % sizeof(T) != 0 || entry->offset % alignof(T) != 0) {
+      throw Error("Chunk " + id + " does not match the requested value type");
+    }
+    return Chunk<T>(reinterpret_cast<const T*>(data_ + entry->offset), entry->size / sizeof(T));
+  }
+
+  /// Array of values stored in a chunk with an expected number of values
+  template <typename T>
+  Chunk<T> getChunk(const std::string& id, const std::size_t expected_size) const {
+    const Chunk<T> chunk = getChunk<T>(id);
+    if (chunk.size() != expected_size) {
+      throw Error("Chunk " + id + " has " + std::to_string(chunk.size())
+                  + " values, expected " + std::to_string(expected_size));
+    }
+    return chunk;
+  }
+
+  /// Single value stored in a chunk
+  template <typename T>
+  const T& getValueChunk(const std::string& id) const {
+    return getChunk<T>(id, 1)[0];
+  }
+
+private:
+  const ChunkEntry* findChunk(const std::string& id) const;
+
+  const ChunkEntry* getChunkEntry(const std::string& id) const;
+
+  void initFromData(const std::string& magic);
+
+  void close();
+
+  const char* data_;
+  std::size_t size_;
+  std::size_t mapped_size_;
+  std::vector<char> buffer_;
+
+  const Header* header_;
+  const ChunkEntry* chunk_entries_;
+};
@@ -0,0 +1,141 @@
+//==================================================
+// distance_transform.h
+//
+//  Copyright (c) 2017 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: Oct 18, 2017
+//==================================================
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <bh/common.h>
+
+/// Exact Euclidean distance transform of a dense 3D grid.
+///
+/// Computes D(p) = min_q (f(q) + |p - q|^2) for a sampled function f, i.e. the squared distance to the closest seed
+/// where each seed can carry an additional squared offset (f = 0 at seeds and infinity elsewhere gives the
+/// classic EDT). The transform is separable and is computed with one pass along each axis using the lower envelope
+/// of parabolas (Felzenszwalb and Huttenlocher, Distance Transforms of Sampled Functions) in linear time.
+/// Grid lines of each pass are processed in parallel.
+///
+/// Grid values are stored in x-major order, i.e. index = x + dim_x * (y + dim_y * z).
+template <typename FloatT>
+class EuclideanDistanceTransform {
+public:
+  using FloatType = FloatT;
+
+  static constexpr FloatType kInfinity = std::numeric_limits<FloatType>::infinity();
+
+  /// Transform squared seed values in-place. Cells without a seed have to be set to kInfinity.
+  /// Values are in squared grid units.
+  static void transformSquared(std::vector<FloatType>* values,
+                               const std::size_t dim_x, const std::size_t dim_y, const std::size_t dim_z) {
+    BH_ASSERT(values->size() == dim_x * dim_y * dim_z);
+    transformAxis(values, dim_x, dim_y * dim_z, 1,
+                  [&](const std::size_t line) { return line * dim_x; });
+    transformAxis(values, dim_y, dim_x * dim_z, dim_x,
+                  [&](const std::size_t line) { return (line / dim_x) * dim_x * dim_y + line % dim_x; });
+    transformAxis(values, dim_z, dim_x * dim_y, dim_x * dim_y,
+                  [&](const std::size_t line) { return line; });
+  }
+
+  /// Transform squared seed values (in squared grid units) to Euclidean distances in world units
+  /// clamped to max_distance.
+  static void transform(std::vector<FloatType>* values,
+                        const std::size_t dim_x, const std::size_t dim_y, const std::size_t dim_z,
+                        const FloatType grid_increment, const FloatType max_distance) {
+    transformSquared(values, dim_x, dim_y, dim_z);
+#pragma omp parallel for
+    for (std::size_t i = 0; i < values->size(); ++i) {
+      FloatType& value = (*values)[i];
+      value = std::min(grid_increment * std::sqrt(value), max_distance);
+    }
+  }
+
+  /// Lower envelope transform of a single grid line.
+  /// Buffers are passed in to avoid allocations for every line.
+  static void transformLine(const FloatType* f, FloatType* d, const std::size_t n,
+                            std::vector<std::size_t>* v_buffer, std::vector<FloatType>* z_buffer) {
+    std::vector<std::size_t>& v = *v_buffer;
+    std::vector<FloatType>& z = *z_buffer;
+    v.resize(n);
+    z.resize(n + 1);
+    // Only finite values contribute a parabola
+    std::size_t k = 0;
+    bool has_parabola = false;
+    for (std::size_t q = 0; q < n; ++q) {
+      if (f[q] == kInfinity) {
+        continue;
+      }
+      if (!has_parabola) {
+        v[0] = q;
+        z[0] = -kInfinity;
+        z[1] = kInfinity;
+        has_parabola = true;
+        continue;
+      }
+      FloatType s = computeIntersection(f, q, v[k]);
+      while (s <= z[k]) {
+        --k;
+        s = computeIntersection(f, q, v[k]);
+      }
+      ++k;
+      v[k] = q;
+      z[k] = s;
+      z[k + 1] = kInfinity;
+    }
+    if (!has_parabola) {
+      std::fill(d, d + n, kInfinity);
+      return;
+    }
+    k = 0;
+    for (std::size_t q = 0; q < n; ++q) {
+      while (z[k + 1] < q) {
+        ++k;
+      }
+      const FloatType offset = FloatType(q) - FloatType(v[k]);
+      d[q] = offset * offset + f[v[k]];
+    }
+  }
+
+private:
+  /// Position where the parabolas rooted at q and p intersect
+  static FloatType computeIntersection(const FloatType* f, const std::size_t q, const std::size_t p) {
+    const FloatType fq = f[q] + FloatType(q) * FloatType(q);
+    const FloatType fp = f[p] + FloatType(p) * FloatType(p);
+    return (fq - fp) / (2 * (FloatType(q) - FloatType(p)));
+  }
+
+  /// Transform all lines along one axis. The line function returns the index of the first cell of a line.
+  template <typename LineFunction>
+  static void transformAxis(std::vector<FloatType>* values, const std::size_t n, const std::size_t num_lines,
+                            const std::size_t stride, const LineFunction& line_function) {
+    if (n <= 1) {
+      return;
+    }
+#pragma omp parallel
+    {
+      std::vector<FloatType> f(n);
+      std::vector<FloatType> d(n);
+      std::vector<std::size_t> v;
+      std::vector<FloatType> z;
+#pragma omp for schedule(static)
+      for (std::size_t line = 0; line < num_lines; ++line) {
+        const std::size_t offset = line_function(line);
+        for (std::size_t i = 0; i < n; ++i) {
+          f[i] = (*values)[offset + i * stride];
+        }
+        transformLine(f.data(), d.data(), n, &v, &z);
+        for (std::size_t i = 0; i < n; ++i) {
+          (*values)[offset + i * stride] = d[i];
+        }
+      }
+    }
+  }
+};
+
+template <typename FloatT>
+constexpr FloatT EuclideanDistanceTransform<FloatT>::kInfinity;
@@ -0,0 +1,139 @@
+//==================================================
+// journal_file.cpp
+//
+//  Copyright (c) 2017 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: Oct 18, 2017
+//==================================================
+
+#include <src/planner/journal_file.h>
+#include <iostream>
+#include <boost/filesystem.hpp>
+#include <src/planner/precomputation_key.h>
+
+constexpr std::size_t JournalFile::kMagicSize;
+const uint32_t JournalFile::kCommitRecordType;
+
+uint64_t JournalFile::computeChecksum(const std::string& payload) {
+  PrecomputationKey key;
+  key.addString(payload);
+  return key.getHash();
+}
+
+JournalFileWriter::JournalFileWriter(const std::string& filename, const std::string& magic, const uint32_t version,
+                                     const std::string& header_data)
+: filename_(filename), ofs_(filename, std::ios::binary | std::ios::trunc) {
+  BH_ASSERT(magic.size() == kMagicSize);
+  if (!ofs_) {
+    throw Error(std::string("Unable to open file for writing: ") + filename);
+  }
+  Header header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, magic.data(), kMagicSize);
+  header.version = version;
+  header.header_data_size = header_data.size();
+  ofs_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  ofs_.write(header_data.data(), header_data.size());
+  ofs_.flush();
+  if (!ofs_) {
+    throw Error(std::string("Failed to write journal header: ") + filename);
+  }
+}
+
+JournalFileWriter::JournalFileWriter(const std::string& filename, const uint64_t committed_size)
+: filename_(filename) {
+  boost::system::error_code error_code;
+  boost::filesystem::resize_file(filename, committed_size, error_code);
+  if (error_code) {
+    throw Error(std::string("Unable to truncate journal: ") + filename);
+  }
+  ofs_.open(filename, std::ios::binary | std::ios::app);
+  if (!ofs_) {
+    throw Error(std::string("Unable to open file for appending: ") + filename);
+  }
+}
+
+void JournalFileWriter::writeRecord(const uint32_t type, const std::string& payload) {
+  BH_ASSERT(type != kCommitRecordType);
+  writeRawRecord(type, payload);
+}
+
+void JournalFileWriter::commit() {
+  writeRawRecord(kCommitRecordType, std::string());
+  ofs_.flush();
+  if (!ofs_) {
+    throw Error(std::string("Failed to write journal: ") + filename_);
+  }
+}
+
+void JournalFileWriter::writeRawRecord(const uint32_t type, const std::string& payload) {
+  RecordHeader record_header;
+  std::memset(&record_header, 0, sizeof(record_header));
+  record_header.type = type;
+  record_header.size = payload.size();
+  record_header.checksum = computeChecksum(payload);
+  ofs_.write(reinterpret_cast<const char*>(&record_header), sizeof(record_header));
+  ofs_.write(payload.data(), payload.size());
+  if (!ofs_) {
+    throw Error(std::string("Failed to write journal record: ") + filename_);
+  }
+}
+
+JournalFileReader::JournalFileReader(const std::string& filename, const std::string& magic)
+: filename_(filename), ifs_(filename, std::ios::binary) {
+  BH_ASSERT(magic.size() == kMagicSize);
+  if (!ifs_) {
+    throw Error(std::string("Unable to open file for reading: ") + filename);
+  }
+  Header header;
+  ifs_.read(reinterpret_cast<char*>(&header), sizeof(header));
+  if (!ifs_ || std::memcmp(header.magic, magic.data(), kMagicSize) != 0) {
+    throw Error(std::string("File is not a valid journal: ") + filename);
+  }
+  version_ = header.version;
+  header_data_.resize(header.header_data_size);
+  ifs_.read(&header_data_[0], header_data_.size());
+  if (!ifs_) {
+    throw Error(std::string("Journal header is truncated: ") + filename);
+  }
+  committed_size_ = static_cast<uint64_t>(ifs_.tellg());
+}
+
+bool JournalFileReader::readCheckpoint(std::vector<Record>* records) {
+  records->clear();
+  Record record;
+  while (readRecord(&record)) {
+    if (record.type == kCommitRecordType) {
+      committed_size_ = static_cast<uint64_t>(ifs_.tellg());
+      return true;
+    }
+    records->push_back(std::move(record));
+  }
+  // Incomplete checkpoint at the end of the journal
+  records->clear();
+  return false;
+}
+
+bool JournalFileReader::readRecord(Record* record) {
+  RecordHeader record_header;
+  ifs_.read(reinterpret_cast<char*>(&record_header), sizeof(record_header));
+  if (!ifs_) {
+    return false;
+  }
+  // A garbage size in a partially written record must not lead to a huge allocation
+  const std::streampos position = ifs_.tellg();
+  ifs_.seekg(0, std::ios::end);
+  const uint64_t remaining_size = static_cast<uint64_t>(ifs_.tellg() - position);
+  ifs_.seekg(position);
+  if (record_header.size > remaining_size) {
+    return false;
+  }
+  record->type = record_header.type;
+  record->payload.resize(record_header.size);
+  ifs_.read(&record->payload[0], record->payload.size());
+  if (!ifs_ || computeChecksum(record->payload) != record_header.checksum) {
+    std::cout << "WARNING: Journal " << filename_ << " has a corrupt record" << std::endl;
+    return false;
+  }
+  return true;
+}
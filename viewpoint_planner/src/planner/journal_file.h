@@ -0,0 +1,185 @@
+//==================================================
+// journal_file.h
+//
+//  Copyright (c) 2017 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: Oct 18, 2017
+//==================================================
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <bh/common.h>
+
+/// Append-only binary journal of checkpoints.
+///
+/// The file starts with a header (magic, version, user header data) followed by records. Each record consists of
+/// a type, the payload size, a checksum and the payload. A checkpoint is a sequence of records that is terminated
+/// by a commit record. When reading, only fully committed checkpoints are returned so that a journal that was
+/// interrupted while writing (i.e. by a crash) can still be replayed up to the last complete checkpoint.
+/// Values are stored in native byte order.
+class JournalFile {
+public:
+  static constexpr std::size_t kMagicSize = 8;
+
+  class Error : public bh::Error {
+  public:
+    explicit Error(const std::string& what)
+    : bh::Error(what) {}
+  };
+
+  struct Record {
+    uint32_t type;
+    std::string payload;
+  };
+
+  /// Helper to assemble the payload of a record
+  class PayloadWriter {
+  public:
+    template <typename T>
+    void write(const T& value) {
+      static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable values can be written");
+      payload_.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    /// Write the size of a vector followed by its values
+    template <typename T>
+    void writeVector(const std::vector<T>& values) {
+      static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable values can be written");
+      write<uint64_t>(values.size());
+      payload_.append(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+    }
+
+    const std::string& getPayload() const {
+      return payload_;
+    }
+
+  private:
+    std::string payload_;
+  };
+
+  /// Helper to read the payload of a record. Throws if reading beyond the end of the payload.
+  class PayloadReader {
+  public:
+    explicit PayloadReader(const std::string& payload)
+    : payload_(payload), offset_(0) {}
+
+    template <typename T>
+    T read() {
+      static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable values can be read");
+      T value;
+      readData(&value, sizeof(T));
+      return value;
+    }
+
+    template <typename T>
+    std::vector<T> readVector() {
+      static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable values can be read");
+      const uint64_t size = read<uint64_t>();
+      if (size > (payload_.size() - offset_) / sizeof(T)) {
+        throw Error("Journal record is truncated");
+      }
+      std::vector<T> values(size);
+      readData(values.data(), size * sizeof(T));
+      return values;
+    }
+
+    bool atEnd() const {
+      return offset_ == payload_.size();
+    }
+
+  private:
+    void readData(void* out, const std::size_t size) {
+      if (offset_ + size > payload_.size()) {
+        throw Error("Journal record is truncated");
+      }
+      std::memcpy(out, payload_.data() + offset_, size);
+      offset_ += size;
+    }
+
+    const std::string& payload_;
+    std::size_t offset_;
+  };
+
+protected:
+  // Record type that terminates a checkpoint
+  static const uint32_t kCommitRecordType = 0xFFFFFFFF;
+
+  struct Header {
+    char magic[kMagicSize];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t header_data_size;
+  };
+
+  struct RecordHeader {
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t size;
+    uint64_t checksum;
+  };
+
+  static uint64_t computeChecksum(const std::string& payload);
+};
+
+class JournalFileWriter : public JournalFile {
+public:
+  /// Create a new journal. An existing file is overwritten.
+  /// The magic string identifies the type of journal and has to be 8 characters long.
+  JournalFileWriter(const std::string& filename, const std::string& magic, const uint32_t version,
+                    const std::string& header_data);
+
+  /// Continue an existing journal. Everything after committed_size (i.e. an incomplete checkpoint) is discarded.
+  JournalFileWriter(const std::string& filename, const uint64_t committed_size);
+
+  JournalFileWriter(const JournalFileWriter& other) = delete;
+
+  /// Record types have to be smaller than 0xFFFFFFFF
+  void writeRecord(const uint32_t type, const std::string& payload);
+
+  /// Terminate the current checkpoint and flush it to disk
+  void commit();
+
+private:
+  void writeRawRecord(const uint32_t type, const std::string& payload);
+
+  std::string filename_;
+  std::ofstream ofs_;
+};
+
+class JournalFileReader : public JournalFile {
+public:
+  JournalFileReader(const std::string& filename, const std::string& magic);
+
+  JournalFileReader(const JournalFileReader& other) = delete;
+
+  uint32_t getVersion() const {
+    return version_;
+  }
+
+  const std::string& getHeaderData() const {
+    return header_data_;
+  }
+
+  /// Read the records of the next committed checkpoint.
+  /// Returns false if there is no further complete checkpoint.
+  bool readCheckpoint(std::vector<Record>* records);
+
+  /// Size of the journal up to and including the last checkpoint that was read
+  uint64_t getCommittedSize() const {
+    return committed_size_;
+  }
+
+private:
+  bool readRecord(Record* record);
+
+  std::string filename_;
+  std::ifstream ifs_;
+  uint32_t version_;
+  std::string header_data_;
+  uint64_t committed_size_;
+};
@@ -0,0 +1,381 @@
+//==================================================
+// mesh_rasterizer.h
+//
+//  Copyright (c) 2017 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: Oct 18, 2017
+//==================================================
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include <omp.h>
+#include <bh/common.h>
+#include <bh/eigen.h>
+
+/// Multithreaded tile-based software rasterizer for depth and normal buffers of a triangle mesh.
+///
+/// Produces the same quantities as the depth and normal shaders of the offscreen OpenGL renderer
+/// (camera z-distance and perspective-correct interpolated world normals) without requiring an OpenGL context.
+/// Triangles are clipped at the near plane, transformed and binned into screen tiles.
+/// Tiles are then rasterized in parallel, each with its own z-buffer. Depth ties are resolved by triangle index
+/// so that the output is deterministic independent of the number of threads.
+template <typename FloatT>
+class MeshRasterizer {
+public:
+  using FloatType = FloatT;
+  USE_FIXED_EIGEN_TYPES(FloatType);
+
+  struct Options {
+    // Width and height of the screen tiles in pixels
+    std::size_t tile_size = 32;
+    // Whether to discard triangles facing away from the camera (front faces are counter-clockwise)
+    bool cull_backfaces = false;
+  };
+
+  /// Depth and normal buffers in row-major order. Pixels without any triangle have infinite depth.
+  class Buffers {
+  public:
+    Buffers()
+    : width_(0), height_(0) {}
+
+    Buffers(const std::size_t width, const std::size_t height, const bool with_normals)
+    : width_(width), height_(height),
+      depth_(width * height, std::numeric_limits<FloatType>::infinity()) {
+      if (with_normals) {
+        normals_.resize(3 * width * height, 0);
+      }
+    }
+
+    std::size_t width() const {
+      return width_;
+    }
+
+    std::size_t height() const {
+      return height_;
+    }
+
+    bool hasNormals() const {
+      return !normals_.empty();
+    }
+
+    bool isValid(const std::size_t x, const std::size_t y) const {
+      return std::isfinite(depth(x, y));
+    }
+
+    FloatType depth(const std::size_t x, const std::size_t y) const {
+      return depth_[y * width_ + x];
+    }
+
+    Vector3 normal(const std::size_t x, const std::size_t y) const {
+      const std::size_t index = 3 * (y * width_ + x);
+      return Vector3(normals_[index], normals_[index + 1], normals_[index + 2]);
+    }
+
+    void setDepth(const std::size_t x, const std::size_t y, const FloatType depth) {
+      depth_[y * width_ + x] = depth;
+    }
+
+    void setNormal(const std::size_t x, const std::size_t y, const Vector3& normal) {
+      const std::size_t index = 3 * (y * width_ + x);
+      normals_[index] = normal(0);
+      normals_[index + 1] = normal(1);
+      normals_[index + 2] = normal(2);
+    }
+
+    /// Memory used by the buffers in bytes
+    std::size_t byteSize() const {
+      return sizeof(FloatType) * (depth_.size() + normals_.size());
+    }
+
+  private:
+    friend class MeshRasterizer;
+
+    std::size_t width_;
+    std::size_t height_;
+    std::vector<FloatType> depth_;
+    std::vector<FloatType> normals_;
+  };
+
+  /// Create rasterizer from a triangle soup. Vertices and normals are given as three consecutive entries per triangle.
+  MeshRasterizer(const std::vector<Vector3>& vertices, const std::vector<Vector3>& normals)
+  : MeshRasterizer(Options(), vertices, normals) {}
+
+  MeshRasterizer(const Options& options, const std::vector<Vector3>& vertices, const std::vector<Vector3>& normals)
+  : options_(options), vertices_(vertices), normals_(normals) {
+    BH_ASSERT(options_.tile_size > 0);
+    BH_ASSERT(vertices_.size() % 3 == 0);
+    BH_ASSERT(normals_.size() == vertices_.size());
+  }
+
+  std::size_t numTriangles() const {
+    return vertices_.size() / 3;
+  }
+
+  /// Render depth (and optionally normal) buffers.
+  ///
+  /// @param world_to_camera Transformation from world to camera coordinates (x right, y down, z forward)
+  /// @param intrinsics Pinhole camera matrix
+  Buffers render(const Matrix3x4& world_to_camera, const Matrix3x3& intrinsics,
+                 const std::size_t width, const std::size_t height,
+                 const FloatType near_plane, const FloatType far_plane,
+                 const bool with_normals = true) const {
+    BH_ASSERT(near_plane > 0);
+    BH_ASSERT(far_plane > near_plane);
+    Buffers buffers(width, height, with_normals);
+    if (width == 0 || height == 0) {
+      return buffers;
+    }
+
+    // Transform vertices into camera frame
+    std::vector<Vector3> camera_vertices(vertices_.size());
+#pragma omp parallel for
+    for (std::size_t i = 0; i < vertices_.size(); ++i) {
+      camera_vertices[i] = world_to_camera * vertices_[i].homogeneous();
+    }
+
+    // Clip, project and bin triangles. Each thread keeps its own setup list and bins.
+    const std::size_t tile_size = options_.tile_size;
+    const std::size_t num_tiles_x = (width + tile_size - 1) / tile_size;
+    const std::size_t num_tiles_y = (height + tile_size - 1) / tile_size;
+    const std::size_t num_tiles = num_tiles_x * num_tiles_y;
+    const int num_threads = omp_get_max_threads();
+    std::vector<std::vector<TriangleSetup>> thread_setups(num_threads);
+    std::vector<std::vector<std::vector<uint32_t>>> thread_bins(
+            num_threads, std::vector<std::vector<uint32_t>>(num_tiles));
+#pragma omp parallel
+    {
+      const int thread_id = omp_get_thread_num();
+      std::vector<TriangleSetup>& setups = thread_setups[thread_id];
+      std::vector<std::vector<uint32_t>>& bins = thread_bins[thread_id];
+#pragma omp for schedule(static)
+      for (std::size_t i = 0; i < numTriangles(); ++i) {
+        std::array<ClipVertex, 4> polygon;
+        const std::size_t num_polygon_vertices = clipTriangleAtNearPlane(camera_vertices, i, near_plane, &polygon);
+        for (std::size_t j = 1; j + 1 < num_polygon_vertices; ++j) {
+          TriangleSetup setup;
+          const bool visible = setupTriangle(
+                  polygon[0], polygon[j], polygon[j + 1], intrinsics, width, height, far_plane, &setup);
+          if (!visible) {
+            continue;
+          }
+          setup.triangle_index = static_cast<uint32_t>(i);
+          const uint32_t setup_index = static_cast<uint32_t>(setups.size());
+          setups.push_back(setup);
+          for (std::size_t ty = setup.min_y / tile_size; ty <= setup.max_y / tile_size; ++ty) {
+            for (std::size_t tx = setup.min_x / tile_size; tx <= setup.max_x / tile_size; ++tx) {
+              bins[ty * num_tiles_x + tx].push_back(setup_index);
+            }
+          }
+        }
+      }
+    }
+
+    // Rasterize tiles
+#pragma omp parallel
+    {
+      std::vector<FloatType> tile_depth(tile_size * tile_size);
+      std::vector<uint32_t> tile_triangle(tile_size * tile_size);
+      std::vector<const TriangleSetup*> tile_setup(tile_size * tile_size);
+      std::vector<std::array<FloatType, 3>> tile_weights(tile_size * tile_size);
+#pragma omp for schedule(dynamic)
+      for (std::size_t tile = 0; tile < num_tiles; ++tile) {
+        const std::size_t tile_x0 = (tile % num_tiles_x) * tile_size;
+        const std::size_t tile_y0 = (tile / num_tiles_x) * tile_size;
+        const std::size_t tile_x1 = std::min(tile_x0 + tile_size, width) - 1;
+        const std::size_t tile_y1 = std::min(tile_y0 + tile_size, height) - 1;
+        std::fill(tile_depth.begin(), tile_depth.end(), std::numeric_limits<FloatType>::infinity());
+        std::fill(tile_setup.begin(), tile_setup.end(), nullptr);
+        for (int thread_id = 0; thread_id < num_threads; ++thread_id) {
+          for (const uint32_t setup_index : thread_bins[thread_id][tile]) {
+            const TriangleSetup& setup = thread_setups[thread_id][setup_index];
+            rasterizeTriangleInTile(setup, tile_x0, tile_y0, tile_x1, tile_y1, far_plane,
+                                    &tile_depth, &tile_triangle, &tile_setup, &tile_weights);
+          }
+        }
+        // Resolve tile into output buffers
+        for (std::size_t y = tile_y0; y <= tile_y1; ++y) {
+          for (std::size_t x = tile_x0; x <= tile_x1; ++x) {
+            const std::size_t tile_index = (y - tile_y0) * tile_size + (x - tile_x0);
+            const TriangleSetup* setup = tile_setup[tile_index];
+            if (setup == nullptr) {
+              continue;
+            }
+            const std::size_t index = y * width + x;
+            buffers.depth_[index] = tile_depth[tile_index];
+            if (with_normals) {
+              const std::array<FloatType, 3>& weights = tile_weights[tile_index];
+              Vector3 normal = weights[0] * setup->normals[0]
+                               + weights[1] * setup->normals[1]
+                               + weights[2] * setup->normals[2];
+              normal.normalize();
+              buffers.normals_[3 * index + 0] = normal(0);
+              buffers.normals_[3 * index + 1] = normal(1);
+              buffers.normals_[3 * index + 2] = normal(2);
+            }
+          }
+        }
+      }
+    }
+
+    return buffers;
+  }
+
+private:
+  struct ClipVertex {
+    Vector3 position;
+    Vector3 normal;
+  };
+
+  struct TriangleSetup {
+    // Screen positions of the vertices
+    std::array<double, 3> sx;
+    std::array<double, 3> sy;
+    // Inverse camera depth of the vertices
+    std::array<FloatType, 3> inv_z;
+    // World normals of the vertices
+    std::array<Vector3, 3> normals;
+    double inv_area;
+    std::size_t min_x;
+    std::size_t min_y;
+    std::size_t max_x;
+    std::size_t max_y;
+    uint32_t triangle_index;
+  };
+
+  /// Clip triangle at the near plane (Sutherland-Hodgman). Returns number of polygon vertices (0, 3 or 4).
+  std::size_t clipTriangleAtNearPlane(
+          const std::vector<Vector3>& camera_vertices, const std::size_t triangle_index,
+          const FloatType near_plane, std::array<ClipVertex, 4>* polygon) const {
+    std::size_t num_vertices = 0;
+    for (std::size_t k = 0; k < 3; ++k) {
+      const std::size_t index_a = 3 * triangle_index + k;
+      const std::size_t index_b = 3 * triangle_index + (k + 1) % 3;
+      const Vector3& a = camera_vertices[index_a];
+      const Vector3& b = camera_vertices[index_b];
+      const bool a_inside = a(2) >= near_plane;
+      const bool b_inside = b(2) >= near_plane;
+      if (a_inside) {
+        (*polygon)[num_vertices++] = ClipVertex { a, normals_[index_a] };
+      }
+      if (a_inside != b_inside) {
+        const FloatType t = (near_plane - a(2)) / (b(2) - a(2));
+        ClipVertex vertex;
+        vertex.position = a + t * (b - a);
+        vertex.position(2) = near_plane;
+        vertex.normal = normals_[index_a] + t * (normals_[index_b] - normals_[index_a]);
+        (*polygon)[num_vertices++] = vertex;
+      }
+    }
+    return num_vertices;
+  }
+
+  /// Project triangle and compute edge function setup. Returns false if the triangle does not cover any pixel.
+  bool setupTriangle(const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2,
+                     const Matrix3x3& intrinsics, const std::size_t width, const std::size_t height,
+                     const FloatType far_plane, TriangleSetup* setup) const {
+    if (v0.position(2) > far_plane && v1.position(2) > far_plane && v2.position(2) > far_plane) {
+      return false;
+    }
+    const std::array<const ClipVertex*, 3> vertices = {{ &v0, &v1, &v2 }};
+    double min_sx = std::numeric_limits<double>::max();
+    double min_sy = std::numeric_limits<double>::max();
+    double max_sx = std::numeric_limits<double>::lowest();
+    double max_sy = std::numeric_limits<double>::lowest();
+    for (std::size_t k = 0; k < 3; ++k) {
+      const Vector3& p = vertices[k]->position;
+      const Vector3 image_point = intrinsics * p;
+      setup->sx[k] = image_point(0) / (double)image_point(2);
+      setup->sy[k] = image_point(1) / (double)image_point(2);
+      setup->inv_z[k] = 1 / p(2);
+      setup->normals[k] = vertices[k]->normal;
+      min_sx = std::min(min_sx, setup->sx[k]);
+      min_sy = std::min(min_sy, setup->sy[k]);
+      max_sx = std::max(max_sx, setup->sx[k]);
+      max_sy = std::max(max_sy, setup->sy[k]);
+    }
+    // Twice the signed area. With y pointing down a negative area is counter-clockwise as seen from the camera.
+    const double area = (setup->sx[1] - setup->sx[0]) * (setup->sy[2] - setup->sy[0])
+                        - (setup->sx[2] - setup->sx[0]) * (setup->sy[1] - setup->sy[0]);
+    if (area == 0 || !std::isfinite(area)) {
+      return false;
+    }
+    if (options_.cull_backfaces && area > 0) {
+      return false;
+    }
+    setup->inv_area = 1 / area;
+    // Pixel centers are at (x + 0.5, y + 0.5)
+    const double first_x = std::ceil(min_sx - 0.5);
+    const double first_y = std::ceil(min_sy - 0.5);
+    const double last_x = std::floor(max_sx - 0.5);
+    const double last_y = std::floor(max_sy - 0.5);
+    if (last_x < 0 || last_y < 0 || first_x >= width || first_y >= height || first_x > last_x || first_y > last_y) {
+      return false;
+    }
+    setup->min_x = static_cast<std::size_t>(std::max<double>(first_x, 0));
+    setup->min_y = static_cast<std::size_t>(std::max<double>(first_y, 0));
+    setup->max_x = static_cast<std::size_t>(std::min<double>(last_x, width - 1));
+    setup->max_y = static_cast<std::size_t>(std::min<double>(last_y, height - 1));
+    return true;
+  }
+
+  void rasterizeTriangleInTile(
+          const TriangleSetup& setup,
+          const std::size_t tile_x0, const std::size_t tile_y0,
+          const std::size_t tile_x1, const std::size_t tile_y1,
+          const FloatType far_plane,
+          std::vector<FloatType>* tile_depth,
+          std::vector<uint32_t>* tile_triangle,
+          std::vector<const TriangleSetup*>* tile_setup,
+          std::vector<std::array<FloatType, 3>>* tile_weights) const {
+    const std::size_t tile_size = options_.tile_size;
+    const std::size_t x0 = std::max(setup.min_x, tile_x0);
+    const std::size_t y0 = std::max(setup.min_y, tile_y0);
+    const std::size_t x1 = std::min(setup.max_x, tile_x1);
+    const std::size_t y1 = std::min(setup.max_y, tile_y1);
+    for (std::size_t y = y0; y <= y1; ++y) {
+      const double py = y + 0.5;
+      for (std::size_t x = x0; x <= x1; ++x) {
+        const double px = x + 0.5;
+        // Barycentric coordinates from edge functions (normalized by the signed area so both windings work)
+        const double b0 = ((setup.sx[1] - px) * (setup.sy[2] - py) - (setup.sx[2] - px) * (setup.sy[1] - py))
+                          * setup.inv_area;
+        const double b1 = ((setup.sx[2] - px) * (setup.sy[0] - py) - (setup.sx[0] - px) * (setup.sy[2] - py))
+                          * setup.inv_area;
+        const double b2 = 1 - b0 - b1;
+        if (b0 < 0 || b1 < 0 || b2 < 0) {
+          continue;
+        }
+        // Perspective-correct interpolation
+        const FloatType w0 = static_cast<FloatType>(b0) * setup.inv_z[0];
+        const FloatType w1 = static_cast<FloatType>(b1) * setup.inv_z[1];
+        const FloatType w2 = static_cast<FloatType>(b2) * setup.inv_z[2];
+        const FloatType inv_z = w0 + w1 + w2;
+        const FloatType z = 1 / inv_z;
+        // Triangles are already clipped at the near plane
+        if (z > far_plane) {
+          continue;
+        }
+        const std::size_t tile_index = (y - tile_y0) * tile_size + (x - tile_x0);
+        const FloatType current_z = (*tile_depth)[tile_index];
+        const bool closer = z < current_z
+                            || (z == current_z && setup.triangle_index < (*tile_triangle)[tile_index]);
+        if (!closer) {
+          continue;
+        }
+        (*tile_depth)[tile_index] = z;
+        (*tile_triangle)[tile_index] = setup.triangle_index;
+        (*tile_setup)[tile_index] = &setup;
+        (*tile_weights)[tile_index] = {{ w0 * z, w1 * z, w2 * z }};
+      }
+    }
+  }
+
+  Options options_;
+  std::vector<Vector3> vertices_;
+  std::vector<Vector3> normals_;
+};
@@ -0,0 +1,259 @@
+//==================================================
+// motion_cache.h
+//
+//  Copyright (c) 2017 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: Oct 18, 2017
+//==================================================
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <boost/filesystem.hpp>
+#include <bh/common.h>
+#include <bh/eigen.h>
+
+/// Persistent cache of motion planning results.
+///
+/// Results are keyed by the quantized start and end position and a hash of the scene (occupied space, object
+/// bounding box and planner configuration). Entries are kept in memory and appended to a log file on disk.
+/// When the file is opened all records of the current scene are read into the in-memory index,
+/// records of other scenes are skipped. Only found motions are stored, failed (time-budgeted) searches are retried.
+/// Files of an older version are discarded.
+///
+/// File layout: header (magic, version), followed by records of
+///   [uint64 scene hash][int32 key[6]][uint32 number of positions][float32 positions[3 * n]]
+template <typename FloatT>
+class MotionCache {
+public:
+  using FloatType = FloatT;
+  USE_FIXED_EIGEN_TYPES(FloatType);
+  using Key = std::array<int32_t, 6>;
+
+  struct KeyHash {
+    std::size_t operator()(const Key& key) const {
+      return static_cast<std::size_t>(hashBytes(key.data(), sizeof(int32_t) * key.size()));
+    }
+  };
+
+  struct Entry {
+    std::vector<Vector3> positions;
+  };
+
+  static constexpr uint64_t kFnvOffset = 14695981039346656037ULL;
+  static constexpr uint64_t kFnvPrime = 1099511628211ULL;
+
+  /// Stable 64-bit FNV-1a hash (independent of platform and library versions)
+  static uint64_t hashBytes(const void* data, const std::size_t size, uint64_t hash = kFnvOffset) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+    for (std::size_t i = 0; i < size; ++i) {
+      hash ^= bytes[i];
+      hash *= kFnvPrime;
+    }
+    return hash;
+  }
+
+  template <typename T>
+  static uint64_t hashValue(const T& value, const uint64_t hash) {
+    return hashBytes(&value, sizeof(T), hash);
+  }
+
+  MotionCache(const std::string& filename, const uint64_t scene_hash, const FloatType resolution)
+  : filename_(filename), scene_hash_(scene_hash), resolution_(resolution),
+    num_hits_(0), num_misses_(0) {
+    BH_ASSERT(resolution_ > 0);
+    readFile();
+    file_.open(filename_, std::ios_base::out | std::ios_base::binary | std::ios_base::app);
+    if (!file_) {
+      throw bh::Error("Unable to open motion cache file for writing: " + filename_);
+    }
+    if (boost::filesystem::file_size(filename_) == 0) {
+      writeHeader();
+    }
+  }
+
+  MotionCache(const MotionCache& other) = delete;
+
+  MotionCache& operator=(const MotionCache& other) = delete;
+
+  uint64_t sceneHash() const {
+    return scene_hash_;
+  }
+
+  std::size_t numEntries() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+  }
+
+  std::size_t numHits() const {
+    return num_hits_;
+  }
+
+  std::size_t numMisses() const {
+    return num_misses_;
+  }
+
+  /// Look up a motion. The returned positions run from the start to the end position
+  /// (up to quantization of the end points).
+  std::pair<bool, Entry> lookup(const Vector3& from, const Vector3& to) const {
+    bool reversed;
+    const Key key = computeKey(from, to, &reversed);
+    std::unique_lock<std::mutex> lock(mutex_);
+    const auto it = entries_.find(key);
+    if (it == entries_.end()) {
+      lock.unlock();
+      ++num_misses_;
+      return std::make_pair(false, Entry());
+    }
+    Entry entry = it->second;
+    lock.unlock();
+    ++num_hits_;
+    if (reversed) {
+      std::reverse(entry.positions.begin(), entry.positions.end());
+    }
+    return std::make_pair(true, std::move(entry));
+  }
+
+  /// Insert a found motion and append it to the cache file.
+  void insert(const Vector3& from, const Vector3& to, const std::vector<Vector3>& positions) {
+    bool reversed;
+    const Key key = computeKey(from, to, &reversed);
+    Entry entry;
+    entry.positions = positions;
+    if (reversed) {
+      std::reverse(entry.positions.begin(), entry.positions.end());
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (entries_.count(key) > 0) {
+      return;
+    }
+    writeRecord(key, entry);
+    entries_.emplace(key, std::move(entry));
+  }
+
+private:
+  static constexpr uint32_t kMagic = 0x4d434348;
+  static constexpr uint32_t kVersion = 2;
+
+  /// Quantize both end points. The key is ordered so that a motion and its reverse share an entry.
+  Key computeKey(const Vector3& from, const Vector3& to, bool* reversed) const {
+    std::array<int32_t, 3> from_key;
+    std::array<int32_t, 3> to_key;
+    for (std::size_t i = 0; i < 3; ++i) {
+      from_key[i] = static_cast<int32_t>(std::round(from(i) / resolution_));
+      to_key[i] = static_cast<int32_t>(std::round(to(i) / resolution_));
+    }
+    *reversed = to_key < from_key;
+    if (*reversed) {
+      std::swap(from_key, to_key);
+    }
+    Key key;
+    std::copy(from_key.begin(), from_key.end(), key.begin());
+    std::copy(to_key.begin(), to_key.end(), key.begin() + 3);
+    return key;
+  }
+
+  void writeHeader() {
+    file_.write(reinterpret_cast<const char*>(&kMagic), sizeof(kMagic));
+    file_.write(reinterpret_cast<const char*>(&kVersion), sizeof(kVersion));
+    file_.flush();
+  }
+
+  void writeRecord(const Key& key, const Entry& entry) {
+    const uint32_t num_positions = static_cast<uint32_t>(entry.positions.size());
+    file_.write(reinterpret_cast<const char*>(&scene_hash_), sizeof(scene_hash_));
+    file_.write(reinterpret_cast<const char*>(key.data()), sizeof(int32_t) * key.size());
+    file_.write(reinterpret_cast<const char*>(&num_positions), sizeof(num_positions));
+    for (const Vector3& position : entry.positions) {
+      const std::array<float, 3> values = {{ (float)position(0), (float)position(1), (float)position(2) }};
+      file_.write(reinterpret_cast<const char*>(values.data()), sizeof(float) * values.size());
+    }
+    file_.flush();
+  }
+
+  void readFile() {
+    if (!boost::filesystem::exists(filename_) || boost::filesystem::file_size(filename_) == 0) {
+      return;
+    }
+    std::ifstream ifs(filename_, std::ios_base::in | std::ios_base::binary);
+    uint32_t magic;
+    uint32_t version;
+    ifs.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+    ifs.read(reinterpret_cast<char*>(&version), sizeof(version));
+    if (!ifs || magic != kMagic) {
+      throw bh::Error("Invalid motion cache file: " + filename_);
+    }
+    if (version != kVersion) {
+      std::cout << "WARNING: Motion cache file " << filename_ << " has version " << version
+                << " instead of " << kVersion << ". Discarding it." << std::endl;
+      ifs.close();
+      boost::filesystem::resize_file(filename_, 0);
+      return;
+    }
+    std::size_t num_records = 0;
+    std::streamoff valid_size = ifs.tellg();
+    while (true) {
+      uint64_t scene_hash;
+      Key key;
+      uint32_t num_positions;
+      ifs.read(reinterpret_cast<char*>(&scene_hash), sizeof(scene_hash));
+      ifs.read(reinterpret_cast<char*>(key.data()), sizeof(int32_t) * key.size());
+      ifs.read(reinterpret_cast<char*>(&num_positions), sizeof(num_positions));
+      if (!ifs) {
+        break;
+      }
+      std::vector<float> values(3 * num_positions);
+      ifs.read(reinterpret_cast<char*>(values.data()), sizeof(float) * values.size());
+      if (!ifs) {
+        break;
+      }
+      valid_size = ifs.tellg();
+      ++num_records;
+      if (scene_hash != scene_hash_) {
+        continue;
+      }
+      Entry entry;
+      for (std::size_t i = 0; i < num_positions; ++i) {
+        entry.positions.push_back(Vector3(values[3 * i], values[3 * i + 1], values[3 * i + 2]));
+      }
+      entries_.emplace(key, std::move(entry));
+    }
+    ifs.close();
+    // Drop an incomplete trailing record (i.e. from an interrupted run) so that new records stay readable
+    if (valid_size < static_cast<std::streamoff>(boost::filesystem::file_size(filename_))) {
+      std::cout << "WARNING: Truncating incomplete record at the end of motion cache file " << filename_ << std::endl;
+      boost::filesystem::resize_file(filename_, valid_size);
+    }
+    std::cout << "Loaded " << entries_.size() << " of " << num_records
+              << " motion cache entries from " << filename_ << std::endl;
+  }
+
+  const std::string filename_;
+  const uint64_t scene_hash_;
+  const FloatType resolution_;
+
+  mutable std::mutex mutex_;
+  std::unordered_map<Key, Entry, KeyHash> entries_;
+  std::ofstream file_;
+
+  mutable std::atomic<std::size_t> num_hits_;
+  mutable std::atomic<std::size_t> num_misses_;
+};
+
+template <typename FloatT>
+constexpr uint64_t MotionCache<FloatT>::kFnvOffset;
+template <typename FloatT>
+constexpr uint64_t MotionCache<FloatT>::kFnvPrime;
+template <typename FloatT>
+constexpr uint32_t MotionCache<FloatT>::kMagic;
+template <typename FloatT>
+constexpr uint32_t MotionCache<FloatT>::kVersion;
@@ -8,8 +8,12 @@
 
 #include <memory>
 #include <functional>
+#include <atomic>
 #include <mutex>
 #include <condition_variable>
+#include <fstream>
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
 #include <boost/serialization/access.hpp>
 #include <ompl/base/SpaceInformation.h>
 #include <ompl/base/OptimizationObjective.h>
@@ -22,6 +26,8 @@
 #include <bh/math/utilities.h>
 #include <bh/config_options.h>
 #include "viewpoint_planner_data.h"
+#include "motion_roadmap.h"
+#include "motion_cache.h"
 
 namespace ob = ::ompl::base;
 namespace og = ::ompl::geometric;
@@ -45,9 +51,20 @@ public:
     : bh::ConfigOptions("motion_planner", "MotionPlanner options") {
       addOption<bool>("enable_straight", &enable_straight);
       addOption<bool>("enable_rrt", &enable_rrt);
+      addOption<bool>("enable_swept_validation", &enable_swept_validation);
       addOption<FloatType>("max_motion_range", &max_motion_range);
       addOption<FloatType>("max_time_per_solve", &max_time_per_solve);
       addOption<std::size_t>("max_iterations_per_solve", &max_iterations_per_solve);
+      addOption<bool>("enable_roadmap", &enable_roadmap);
+      addOption<std::size_t>("roadmap_num_samples", &roadmap_num_samples);
+      addOption<std::size_t>("roadmap_num_neighbors", &roadmap_num_neighbors);
+      addOption<FloatType>("roadmap_max_edge_length", &roadmap_max_edge_length);
+      addOption<std::size_t>("roadmap_num_connection_neighbors", &roadmap_num_connection_neighbors);
+      addOption<std::size_t>("roadmap_max_lazy_iterations", &roadmap_max_lazy_iterations);
+      addOption<bool>("roadmap_shortcut_path", &roadmap_shortcut_path);
+      addOption<std::size_t>("roadmap_rng_seed", &roadmap_rng_seed);
+      addOption<std::string>("motion_cache_filename", &motion_cache_filename);
+      addOption<FloatType>("motion_cache_resolution", &motion_cache_resolution);
     }
 
     ~Options() override {}
@@ -56,14 +73,40 @@ public:
     bool enable_straight = true;
     // Whether to enable RRT motion planning
     bool enable_rrt = true;
+    // Whether to validate straight segments by sweeping the object bounding box through the BVH
+    // (otherwise the segment is sampled)
+    bool enable_swept_validation = true;
     // Maximum length of a motion segment
     FloatType max_motion_range = 5;
     // Maximum time that a solve is allowed to take (-1 for not limit)
     FloatType max_time_per_solve = 0.01f;
     // Maximum number of iterations that a solve is allowed to take (0 for no limit)
     std::size_t max_iterations_per_solve = 1000;
+    // Whether to enable motion planning on a persistent lazy roadmap (tried before RRT)
+    bool enable_roadmap = false;
+    // Number of positions sampled for the roadmap
+    std::size_t roadmap_num_samples = 5000;
+    // Number of nearest milestones each roadmap milestone is connected to
+    std::size_t roadmap_num_neighbors = 15;
+    // Maximum length of a roadmap edge
+    FloatType roadmap_max_edge_length = 5;
+    // Number of milestones considered when connecting a query pose to the roadmap
+    std::size_t roadmap_num_connection_neighbors = 10;
+    // Maximum number of lazy path invalidations per roadmap query
+    std::size_t roadmap_max_lazy_iterations = 50;
+    // Whether to shortcut roadmap paths with straight segments
+    bool roadmap_shortcut_path = true;
+    // Seed for sampling roadmap milestones
+    std::size_t roadmap_rng_seed = 0;
+    // File of the persistent motion cache (empty to disable)
+    std::string motion_cache_filename = "";
+    // Quantization of motion end points for the motion cache
+    FloatType motion_cache_resolution = 0.01f;
   };
 
+  using Roadmap = MotionRoadmap<FloatType>;
+  using Cache = MotionCache<FloatType>;
+
   class Motion {
   public:
     using PoseVector = EIGEN_ALIGNED_VECTOR(Pose);
@@ -216,12 +259,19 @@ public:
   };
 
   MotionPlanner(const Options* options, ViewpointPlannerData* data)
-  : options_(*options), data_(data), initialized_(false), num_planner_data_in_use_(0) {}
+  : options_(*options), data_(data), initialized_(false), num_planner_data_in_use_(0) {
+    initRoadmapOptions();
+  }
 
   MotionPlanner(const Options* options, ViewpointPlannerData* data, const std::string& log_filename)
   : options_(*options), data_(data), initialized_(false), num_planner_data_in_use_(0) {
     ompl_output_handler_ = std::make_shared<ompl::msg::OutputHandlerFile>(log_filename.c_str());
     ompl::msg::useOutputHandler(ompl_output_handler_.get());
+    initRoadmapOptions();
+  }
+
+  const Options& options() const {
+    return options_;
   }
 
   void setSpaceBoundingBox(const BoundingBoxType& space_bbox) {
@@ -235,19 +285,29 @@ public:
   void initialize(const std::size_t planner_data_pool_size = std::thread::hardware_concurrency()) const {
     std::lock_guard<std::mutex> lock(pool_mutex_);
 
-    if (initialized_) {
+    if (initialized_.load(std::memory_order_relaxed)) {
       return;
     }
 
     BH_ASSERT(!object_bbox_.isEmpty());
     BH_ASSERT(!space_bbox_.isEmpty());
 
-    initialized_ = true;
-
     for (std::size_t i = 0; i < planner_data_pool_size; ++i) {
       PlannerData planner_data = createPlannerData();
       planner_data_pool_.push_back(std::move(planner_data));
     }
+
+    if (!options_.motion_cache_filename.empty()) {
+      motion_cache_.reset(new Cache(options_.motion_cache_filename, computeSceneHash(), options_.motion_cache_resolution));
+    }
+
+    // Publish the flag last. Callers that see it without holding the pool mutex can use the motion cache.
+    initialized_.store(true, std::memory_order_release);
+  }
+
+  /// Persistent motion cache (nullptr if disabled)
+  const Cache* getMotionCache() const {
+    return motion_cache_.get();
   }
 
   class SE3DistanceOptimizationObjective : public ob::OptimizationObjective {
@@ -278,14 +338,64 @@ public:
     std::shared_ptr<const ob::RealVectorStateSpace> re3_space_;
   };
 
+  bool isStraightMotionEnabled() const {
+    return options_.enable_straight || (!options_.enable_rrt);
+  }
+
   std::pair<Motion, bool> findMotion(const Pose& from, const Pose& to) const {
-    const bool enable_straight = options_.enable_straight || (!options_.enable_rrt);
-    if (enable_straight) {
+    if (isStraightMotionEnabled()) {
       const std::pair<Motion, bool> straight_result = findMotionStraight(from, to);
       if (straight_result.second) {
         return straight_result;
       }
     }
+    return findMotionWithoutStraight(from, to);
+  }
+
+  /// Find a motion with the roadmap or RRT planner only (i.e. if a straight motion is already known to be invalid).
+  std::pair<Motion, bool> findMotionWithoutStraight(const Pose& from, const Pose& to) const {
+    if (!initialized_.load(std::memory_order_acquire)) {
+      initialize();
+    }
+    if (motion_cache_) {
+      const std::pair<bool, typename Cache::Entry> cache_result =
+          motion_cache_->lookup(from.getWorldPosition(), to.getWorldPosition());
+      // The cached path was found for end points in the same quantization cell. The first and last segment
+      // are replaced by the actual end points and have to be checked again.
+      if (cache_result.first && isValidCachedPath(from, to, cache_result.second.positions)) {
+        return std::make_pair(createMotionFromPositions(from, to, cache_result.second.positions), true);
+      }
+    }
+    const std::pair<Motion, bool> result = findMotionWithoutStraightAndCache(from, to);
+    // The roadmap and RRT searches are time-budgeted so a failed search is not persisted and retried next time
+    if (motion_cache_ && result.second) {
+      std::vector<Vector3> positions;
+      for (const Pose& pose : result.first.poses()) {
+        positions.push_back(pose.getWorldPosition());
+      }
+      motion_cache_->insert(from.getWorldPosition(), to.getWorldPosition(), positions);
+    }
+    return result;
+  }
+
+  bool isValidCachedPath(const Pose& from, const Pose& to, const std::vector<Vector3>& positions) const {
+    if (positions.size() < 2) {
+      return false;
+    }
+    if (positions.size() == 2) {
+      return isValidStraightSegment(from.getWorldPosition(), to.getWorldPosition());
+    }
+    return isValidStraightSegment(from.getWorldPosition(), positions[1])
+        && isValidStraightSegment(positions[positions.size() - 2], to.getWorldPosition());
+  }
+
+  std::pair<Motion, bool> findMotionWithoutStraightAndCache(const Pose& from, const Pose& to) const {
+    if (options_.enable_roadmap) {
+      const std::pair<Motion, bool> roadmap_result = findMotionRoadmap(from, to);
+      if (roadmap_result.second) {
+        return roadmap_result;
+      }
+    }
     if (options_.enable_rrt) {
       const std::pair<Motion, bool> rrt_result = findMotionRRT(from, to);
       return rrt_result;
@@ -318,22 +428,66 @@ public:
     return true;
   }
 
-  std::pair<Motion, bool> findMotionStraight(const Pose& from, const Pose& to) const {
+  bool isValidStraightSegment(const Vector3& from, const Vector3& to) const {
     const bool ignore_no_fly_zones = true;
-    const FloatT distance = from.getPositionDistanceTo(to);
+    if (options_.enable_swept_validation) {
+      return data_->isValidObjectSegment(from, to, object_bbox_, ignore_no_fly_zones);
+    }
+    const FloatT distance = (to - from).norm();
     const FloatT step_distance = object_bbox_.getMinExtent() / FloatT(2.0);
-    const Vector3 direction = (to.getWorldPosition() - from.getWorldPosition()).normalized();
+    const Vector3 direction = (to - from).normalized();
     FloatT accumulated_distance = 0;
     while (accumulated_distance < distance) {
-      const Vector3 position = from.getWorldPosition() + accumulated_distance * direction;
+      const Vector3 position = from + accumulated_distance * direction;
       if (!data_->isValidObjectPosition(position, object_bbox_, ignore_no_fly_zones)) {
-        return std::make_pair(Motion(), false);
+        return false;
       }
       accumulated_distance += step_distance;
       if (accumulated_distance > distance) {
         accumulated_distance = distance;
       }
     }
+    return true;
+  }
+
+  /// Check straight segments from one position to multiple positions (i.e. all neighbors of a viewpoint).
+  std::vector<bool> areValidStraightSegments(const Vector3& from, const std::vector<Vector3>& to_positions) const {
+    const bool ignore_no_fly_zones = true;
+    if (options_.enable_swept_validation) {
+      return data_->areValidObjectSegments(from, to_positions, object_bbox_, ignore_no_fly_zones);
+    }
+    std::vector<bool> valid_flags(to_positions.size());
+    for (std::size_t i = 0; i < to_positions.size(); ++i) {
+      valid_flags[i] = isValidStraightSegment(from, to_positions[i]);
+    }
+    return valid_flags;
+  }
+
+  /// Find straight motions from one pose to multiple poses with a single validation pass.
+  std::vector<std::pair<Motion, bool>> findMotionsStraight(const Pose& from, const typename Motion::PoseVector& to_poses) const {
+    std::vector<Vector3> to_positions;
+    to_positions.reserve(to_poses.size());
+    for (const Pose& to : to_poses) {
+      to_positions.push_back(to.getWorldPosition());
+    }
+    const std::vector<bool> valid_flags = areValidStraightSegments(from.getWorldPosition(), to_positions);
+    std::vector<std::pair<Motion, bool>> results;
+    results.reserve(to_poses.size());
+    for (std::size_t i = 0; i < to_poses.size(); ++i) {
+      if (valid_flags[i]) {
+        results.push_back(std::make_pair(Motion(from, to_poses[i]), true));
+      }
+      else {
+        results.push_back(std::make_pair(Motion(), false));
+      }
+    }
+    return results;
+  }
+
+  std::pair<Motion, bool> findMotionStraight(const Pose& from, const Pose& to) const {
+    if (!isValidStraightSegment(from.getWorldPosition(), to.getWorldPosition())) {
+      return std::make_pair(Motion(), false);
+    }
     Motion motion(from, to);
     BH_ASSERT(motion.se3Distance()>= motion.distance());
 #if !BH_RELEASE
@@ -343,13 +497,113 @@ public:
     return std::make_pair(motion, true);
   };
 
+  /// Build the persistent roadmap if it has not been built or loaded yet.
+  void buildRoadmap() const {
+    BH_ASSERT(!object_bbox_.isEmpty());
+    BH_ASSERT(!space_bbox_.isEmpty());
+    const bool ignore_no_fly_zones = true;
+    roadmap_.buildIfNecessary(space_bbox_, object_bbox_, [&](const Vector3& position) {
+      return data_->isValidObjectPosition(position, object_bbox_, ignore_no_fly_zones);
+    });
+  }
+
+  const Roadmap& getRoadmap() const {
+    return roadmap_;
+  }
+
+  void clearRoadmap() {
+    roadmap_.clear();
+  }
+
+  /// Key of the inputs of the roadmap. Cached edge validity depends on the occupied space and the planner options.
+  PrecomputationKey computeRoadmapKey() const {
+    PrecomputationKey key("motion_roadmap");
+    key.addKey(data_->getCacheKey())
+        .addValue(computeSceneHash());
+    return key;
+  }
+
+  void saveRoadmap(const std::string& filename) const {
+    std::cout << "Writing motion roadmap to " << filename << std::endl;
+    computeRoadmapKey().writeArtifact(filename, [&]() {
+      std::ofstream ofs(filename, std::ios::binary);
+      boost::archive::binary_oarchive oa(ofs);
+      oa << roadmap_;
+    });
+  }
+
+  /// Load a roadmap. Returns false if the roadmap was built for a different scene, different planner options or a
+  /// different space or object bounding box.
+  bool loadRoadmap(const std::string& filename) {
+    if (!computeRoadmapKey().matchesArtifact(filename)) {
+      std::cout << "WARNING: Motion roadmap " << filename << " was built for a different scene. Discarding it."
+                << std::endl;
+      return false;
+    }
+    std::cout << "Loading motion roadmap from " << filename << std::endl;
+    std::ifstream ifs(filename, std::ios::binary);
+    boost::archive::binary_iarchive ia(ifs);
+    ia >> roadmap_;
+    if (!(roadmap_.spaceBoundingBox() == space_bbox_) || !(roadmap_.objectBoundingBox() == object_bbox_)) {
+      std::cout << "WARNING: Motion roadmap was built for different bounding boxes. Discarding it." << std::endl;
+      roadmap_.clear();
+      return false;
+    }
+    std::cout << "Loaded motion roadmap with " << roadmap_.numMilestones() << " milestones and "
+              << roadmap_.numEdges() << " edges" << std::endl;
+    return true;
+  }
+
+  std::pair<Motion, bool> findMotionRoadmap(const Pose& from, const Pose& to) const {
+    if (!roadmap_.isBuilt()) {
+      buildRoadmap();
+    }
+    std::vector<Vector3> positions;
+    bool found;
+    std::tie(positions, found) = roadmap_.findPath(from.getWorldPosition(), to.getWorldPosition(),
+        [&](const Vector3& segment_from, const Vector3& segment_to) {
+      return isValidStraightSegment(segment_from, segment_to);
+    });
+    if (!found) {
+      return std::make_pair(Motion(), false);
+    }
+    return std::make_pair(createMotionFromPositions(from, to, positions), true);
+  }
+
+  /// Create a motion along a list of positions. The first and last position are replaced by the start and goal pose
+  /// and orientations are interpolated along the path.
+  Motion createMotionFromPositions(const Pose& from, const Pose& to, const std::vector<Vector3>& positions) const {
+    BH_ASSERT(positions.size() >= 2);
+    FloatType motion_distance = 0;
+    for (std::size_t i = 1; i < positions.size(); ++i) {
+      motion_distance += (positions[i] - positions[i - 1]).norm();
+    }
+    typename Motion::PoseVector motion_poses;
+    motion_poses.push_back(from);
+    FloatType accumulated_motion_distance = 0;
+    for (std::size_t i = 1; i < positions.size() - 1; ++i) {
+      accumulated_motion_distance += (positions[i] - positions[i - 1]).norm();
+      const FloatType fraction = motion_distance > 0 ? accumulated_motion_distance / motion_distance : 0;
+      const Quaternion quat = from.quaternion().slerp(fraction, to.quaternion());
+      motion_poses.push_back(Pose::createFromImageToWorldTransformation(positions[i], quat));
+    }
+    motion_poses.push_back(to);
+    Motion motion(motion_poses);
+#if !BH_RELEASE
+    BH_ASSERT(motion.se3Distance() >= motion.distance());
+    BH_ASSERT(motion.poses().front() == from);
+    BH_ASSERT(motion.poses().back() == to);
+#endif
+    return motion;
+  }
+
   std::pair<Motion, bool> findMotionRRT(const Pose& from, const Pose& to) const {
     const std::pair<Motion, bool> straight_result = findMotionStraight(from, to);
     if (straight_result.second) {
       return straight_result;
     }
 
-    if (!initialized_) {
+    if (!initialized_.load(std::memory_order_acquire)) {
       initialize();
     }
 //    bh::Timer timer;
@@ -489,6 +743,46 @@ public:
   }
 
 private:
+  void initRoadmapOptions() {
+    typename Roadmap::Options roadmap_options;
+    roadmap_options.num_samples = options_.roadmap_num_samples;
+    roadmap_options.num_neighbors = options_.roadmap_num_neighbors;
+    roadmap_options.max_edge_length = options_.roadmap_max_edge_length;
+    roadmap_options.num_connection_neighbors = options_.roadmap_num_connection_neighbors;
+    roadmap_options.max_lazy_iterations = options_.roadmap_max_lazy_iterations;
+    roadmap_options.shortcut_path = options_.roadmap_shortcut_path;
+    roadmap_options.rng_seed = options_.roadmap_rng_seed;
+    roadmap_.setOptions(roadmap_options);
+  }
+
+  /// Hash of everything that influences motion planning results (occupied space, object and planner configuration)
+  uint64_t computeSceneHash() const {
+    uint64_t hash = Cache::kFnvOffset;
+    for (auto it = data_->occupied_bvh_.begin(); it != data_->occupied_bvh_.end(); ++it) {
+      if (it->isLeaf()) {
+        hash = Cache::hashBytes(it->getBoundingBox().getMinimum().data(), 3 * sizeof(FloatType), hash);
+        hash = Cache::hashBytes(it->getBoundingBox().getMaximum().data(), 3 * sizeof(FloatType), hash);
+      }
+    }
+    hash = Cache::hashBytes(object_bbox_.getMinimum().data(), 3 * sizeof(FloatType), hash);
+    hash = Cache::hashBytes(object_bbox_.getMaximum().data(), 3 * sizeof(FloatType), hash);
+    hash = Cache::hashBytes(space_bbox_.getMinimum().data(), 3 * sizeof(FloatType), hash);
+    hash = Cache::hashBytes(space_bbox_.getMaximum().data(), 3 * sizeof(FloatType), hash);
+    hash = Cache::hashValue(data_->options_.obstacle_free_height, hash);
+    hash = Cache::hashValue(options_.enable_rrt, hash);
+    hash = Cache::hashValue(options_.enable_roadmap, hash);
+    hash = Cache::hashValue(options_.enable_swept_validation, hash);
+    hash = Cache::hashValue(options_.max_motion_range, hash);
+    hash = Cache::hashValue(options_.max_time_per_solve, hash);
+    hash = Cache::hashValue(options_.max_iterations_per_solve, hash);
+    hash = Cache::hashValue(options_.roadmap_num_samples, hash);
+    hash = Cache::hashValue(options_.roadmap_num_neighbors, hash);
+    hash = Cache::hashValue(options_.roadmap_max_edge_length, hash);
+    hash = Cache::hashValue(options_.roadmap_rng_seed, hash);
+    hash = Cache::hashValue(options_.motion_cache_resolution, hash);
+    return hash;
+  }
+
   bool isStateValid(const ob::State *state) const {
     const bool ignore_no_fly_zones = true;
     const StateSpaceType::StateType* state_tmp = static_cast<const StateSpaceType::StateType*>(state);
@@ -640,11 +934,17 @@ private:
 
   ViewpointPlannerData* data_;
 
-  mutable bool initialized_;
+  mutable std::atomic<bool> initialized_;
   mutable std::mutex pool_mutex_;
   mutable std::condition_variable pool_condition_;
   mutable std::size_t num_planner_data_in_use_;
   mutable std::vector<PlannerData> planner_data_pool_;
+
+  // Persistent roadmap shared by all queries (built lazily on first use)
+  mutable Roadmap roadmap_;
+
+  // Persistent motion cache
+  mutable std::unique_ptr<Cache> motion_cache_;
 };
 
 BOOST_CLASS_VERSION(typename MotionPlanner<double>::Motion, 2);
@@ -0,0 +1,504 @@
+//==================================================
+// motion_roadmap.h
+//
+//  Copyright (c) 2017 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: Oct 18, 2017
+//==================================================
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <vector>
+#include <boost/serialization/access.hpp>
+#include <boost/serialization/split_member.hpp>
+#include <boost/serialization/utility.hpp>
+#include <boost/serialization/vector.hpp>
+#include <bh/common.h>
+#include <bh/eigen.h>
+#include <bh/eigen_serialization.h>
+#include <bh/utilities.h>
+#include <bh/math/geometry.h>
+#include <bh/nn/approximate_nearest_neighbor.h>
+
+/// Lazily validated probabilistic roadmap (PRM*-like) that persists across motion queries.
+///
+/// Milestones are only checked for validity when the roadmap is built. Edges are validated
+/// on demand when they are part of a candidate shortest path and the result is cached
+/// in the roadmap. The milestones and the adjacency structure are immutable after building so that
+/// the roadmap can be queried concurrently from multiple threads. Edge states are atomic.
+template <typename FloatT>
+class MotionRoadmap {
+public:
+  using FloatType = FloatT;
+  USE_FIXED_EIGEN_TYPES(FloatType);
+  using BoundingBoxType = bh::BoundingBox3D<FloatType>;
+  using IndexType = std::size_t;
+  using PositionValidator = std::function<bool(const Vector3&)>;
+  using SegmentValidator = std::function<bool(const Vector3&, const Vector3&)>;
+
+  struct Options {
+    // Number of positions that are sampled when building the roadmap
+    std::size_t num_samples = 5000;
+    // Number of nearest milestones that each milestone is connected to
+    std::size_t num_neighbors = 15;
+    // Maximum length of a roadmap edge
+    FloatType max_edge_length = 5;
+    // Number of milestones considered when connecting the start and goal position
+    std::size_t num_connection_neighbors = 10;
+    // Maximum number of lazy A* iterations (i.e. path invalidations) per query
+    std::size_t max_lazy_iterations = 50;
+    // Whether to shortcut the resulting milestone path with straight segments
+    bool shortcut_path = true;
+    // Seed of the random number generator used for sampling milestones
+    std::size_t rng_seed = 0;
+  };
+
+  struct Statistics {
+    std::size_t num_queries;
+    std::size_t num_successful_queries;
+    std::size_t num_edge_validations;
+    std::size_t num_invalid_edges;
+  };
+
+  MotionRoadmap()
+  : built_(false) {
+    resetStatistics();
+  }
+
+  MotionRoadmap(const MotionRoadmap& other) = delete;
+
+  MotionRoadmap& operator=(const MotionRoadmap& other) = delete;
+
+  void setOptions(const Options& options) {
+    options_ = options;
+  }
+
+  const Options& options() const {
+    return options_;
+  }
+
+  bool isBuilt() const {
+    return built_;
+  }
+
+  std::size_t numMilestones() const {
+    return milestones_.size();
+  }
+
+  std::size_t numEdges() const {
+    return edge_endpoints_.size();
+  }
+
+  const BoundingBoxType& spaceBoundingBox() const {
+    return space_bbox_;
+  }
+
+  const BoundingBoxType& objectBoundingBox() const {
+    return object_bbox_;
+  }
+
+  void clear() {
+    std::lock_guard<std::mutex> lock(build_mutex_);
+    clearWithoutLock();
+  }
+
+  /// Build the roadmap if it has not been built yet. Thread-safe.
+  void buildIfNecessary(const BoundingBoxType& space_bbox, const BoundingBoxType& object_bbox,
+                        const PositionValidator& position_validator) {
+    if (built_) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(build_mutex_);
+    if (built_) {
+      return;
+    }
+    buildWithoutLock(space_bbox, object_bbox, position_validator);
+  }
+
+  /// Find a path of positions from one position to another.
+  ///
+  /// The direct straight segment is not tested here. The returned path includes the start and goal position.
+  /// Returns false if no path could be found on the roadmap.
+  std::pair<std::vector<Vector3>, bool> findPath(const Vector3& from, const Vector3& to,
+                                                 const SegmentValidator& segment_validator) const {
+    BH_ASSERT(built_);
+    ++num_queries_;
+    std::vector<Connection> start_connections = computeConnections(from, segment_validator);
+    if (start_connections.empty()) {
+      return std::make_pair(std::vector<Vector3>(), false);
+    }
+    std::vector<Connection> goal_connections = computeConnections(to, segment_validator);
+    if (goal_connections.empty()) {
+      return std::make_pair(std::vector<Vector3>(), false);
+    }
+    std::vector<FloatType> goal_connection_costs(milestones_.size(), std::numeric_limits<FloatType>::infinity());
+    for (const Connection& connection : goal_connections) {
+      goal_connection_costs[connection.milestone] = connection.cost;
+    }
+
+    for (std::size_t iteration = 0; iteration < options_.max_lazy_iterations; ++iteration) {
+      std::vector<IndexType> milestone_path;
+      bool found;
+      std::tie(milestone_path, found) = findShortestMilestonePath(
+          to, start_connections, goal_connection_costs);
+      if (!found) {
+        return std::make_pair(std::vector<Vector3>(), false);
+      }
+      if (validateMilestonePath(milestone_path, segment_validator)) {
+        std::vector<Vector3> path;
+        path.reserve(milestone_path.size() + 2);
+        path.push_back(from);
+        for (const IndexType milestone : milestone_path) {
+          path.push_back(milestones_[milestone]);
+        }
+        path.push_back(to);
+        if (options_.shortcut_path) {
+          path = shortcutPath(path, segment_validator);
+        }
+        ++num_successful_queries_;
+        return std::make_pair(std::move(path), true);
+      }
+    }
+    return std::make_pair(std::vector<Vector3>(), false);
+  }
+
+  Statistics getStatistics() const {
+    Statistics stats;
+    stats.num_queries = num_queries_;
+    stats.num_successful_queries = num_successful_queries_;
+    stats.num_edge_validations = num_edge_validations_;
+    stats.num_invalid_edges = num_invalid_edges_;
+    return stats;
+  }
+
+  void resetStatistics() {
+    num_queries_ = 0;
+    num_successful_queries_ = 0;
+    num_edge_validations_ = 0;
+    num_invalid_edges_ = 0;
+  }
+
+private:
+  enum EdgeState : uint8_t {
+    UNKNOWN = 0,
+    VALID = 1,
+    INVALID = 2,
+  };
+
+  struct Connection {
+    IndexType milestone;
+    FloatType cost;
+  };
+
+  struct Neighbor {
+    IndexType milestone;
+    IndexType edge;
+    FloatType cost;
+  };
+
+  using ANN = bh::ApproximateNearestNeighbor<FloatType, 3>;
+
+  void clearWithoutLock() {
+    built_ = false;
+    milestones_.clear();
+    neighbor_offsets_.clear();
+    neighbors_.clear();
+    edge_endpoints_.clear();
+    edge_states_.reset();
+    ann_.clear();
+  }
+
+  void buildWithoutLock(const BoundingBoxType& space_bbox, const BoundingBoxType& object_bbox,
+                        const PositionValidator& position_validator) {
+    const bool verbose = true;
+    clearWithoutLock();
+    space_bbox_ = space_bbox;
+    object_bbox_ = object_bbox;
+
+    bh::Timer timer;
+    // Sample candidates sequentially so that the roadmap is deterministic and validate them in parallel
+    std::mt19937_64 rng(options_.rng_seed);
+    std::uniform_real_distribution<FloatType> uniform_dist(0, 1);
+    std::vector<Vector3> candidates(options_.num_samples);
+    for (Vector3& candidate : candidates) {
+      for (std::size_t i = 0; i < 3; ++i) {
+        candidate(i) = space_bbox_.getMinimum(i) + uniform_dist(rng) * space_bbox_.getExtent(i);
+      }
+    }
+    std::vector<uint8_t> candidate_valid(candidates.size(), 0);
+#pragma omp parallel for schedule(dynamic, 64)
+    for (std::size_t i = 0; i < candidates.size(); ++i) {
+      candidate_valid[i] = position_validator(candidates[i]) ? 1 : 0;
+    }
+    for (std::size_t i = 0; i < candidates.size(); ++i) {
+      if (candidate_valid[i] != 0) {
+        milestones_.push_back(candidates[i]);
+      }
+    }
+    if (milestones_.empty()) {
+      std::cout << "WARNING: No valid milestones could be sampled for the motion roadmap" << std::endl;
+      built_ = true;
+      return;
+    }
+
+    ann_.initIndex(milestones_.begin(), milestones_.end());
+    const std::size_t knn = std::min(options_.num_neighbors + 1, milestones_.size());
+    const FloatType max_edge_length_square = options_.max_edge_length * options_.max_edge_length;
+    std::vector<std::vector<std::pair<IndexType, IndexType>>> milestone_edge_endpoints(milestones_.size());
+#pragma omp parallel for schedule(dynamic, 64)
+    for (IndexType i = 0; i < milestones_.size(); ++i) {
+      std::vector<typename ANN::IndexType> knn_indices(knn);
+      std::vector<typename ANN::DistanceType> knn_distances(knn);
+      ann_.knnSearch(milestones_[i], knn, &knn_indices, &knn_distances);
+      for (std::size_t j = 0; j < knn_indices.size(); ++j) {
+        const IndexType other = knn_indices[j];
+        if (other == i || knn_distances[j] > max_edge_length_square) {
+          continue;
+        }
+        milestone_edge_endpoints[i].push_back(std::make_pair(std::min(i, other), std::max(i, other)));
+      }
+    }
+    std::vector<std::pair<IndexType, IndexType>> edge_endpoints;
+    for (const auto& endpoints : milestone_edge_endpoints) {
+      edge_endpoints.insert(edge_endpoints.end(), endpoints.begin(), endpoints.end());
+    }
+    std::sort(edge_endpoints.begin(), edge_endpoints.end());
+    edge_endpoints.erase(std::unique(edge_endpoints.begin(), edge_endpoints.end()), edge_endpoints.end());
+    edge_endpoints_ = std::move(edge_endpoints);
+    edge_states_.reset(new std::atomic<uint8_t>[edge_endpoints_.size()]);
+    for (std::size_t i = 0; i < edge_endpoints_.size(); ++i) {
+      edge_states_[i] = UNKNOWN;
+    }
+    buildAdjacency();
+    built_ = true;
+
+    if (verbose) {
+      std::cout << "Built motion roadmap with " << milestones_.size() << " milestones and "
+                << edge_endpoints_.size() << " edges in " << timer.getElapsedTime() << " s" << std::endl;
+    }
+  }
+
+  void buildAdjacency() {
+    // Compressed adjacency lists (each undirected edge appears in the list of both endpoints)
+    neighbor_offsets_.assign(milestones_.size() + 1, 0);
+    for (const auto& endpoints : edge_endpoints_) {
+      ++neighbor_offsets_[endpoints.first + 1];
+      ++neighbor_offsets_[endpoints.second + 1];
+    }
+    for (std::size_t i = 1; i < neighbor_offsets_.size(); ++i) {
+      neighbor_offsets_[i] += neighbor_offsets_[i - 1];
+    }
+    neighbors_.resize(neighbor_offsets_.back());
+    std::vector<IndexType> fill_counts(milestones_.size(), 0);
+    for (IndexType edge = 0; edge < edge_endpoints_.size(); ++edge) {
+      const IndexType a = edge_endpoints_[edge].first;
+      const IndexType b = edge_endpoints_[edge].second;
+      const FloatType cost = (milestones_[a] - milestones_[b]).norm();
+      neighbors_[neighbor_offsets_[a] + fill_counts[a]++] = Neighbor { b, edge, cost };
+      neighbors_[neighbor_offsets_[b] + fill_counts[b]++] = Neighbor { a, edge, cost };
+    }
+  }
+
+  std::vector<Connection> computeConnections(const Vector3& position, const SegmentValidator& segment_validator) const {
+    std::vector<Connection> connections;
+    const std::size_t knn = std::min(options_.num_connection_neighbors, milestones_.size());
+    if (knn == 0) {
+      return connections;
+    }
+    std::vector<typename ANN::IndexType> knn_indices(knn);
+    std::vector<typename ANN::DistanceType> knn_distances(knn);
+    ann_.knnSearch(position, knn, &knn_indices, &knn_distances);
+    const FloatType max_edge_length_square = options_.max_edge_length * options_.max_edge_length;
+    for (std::size_t i = 0; i < knn_indices.size(); ++i) {
+      if (knn_distances[i] > max_edge_length_square) {
+        continue;
+      }
+      const IndexType milestone = knn_indices[i];
+      if (segment_validator(position, milestones_[milestone])) {
+        connections.push_back(Connection { milestone, (milestones_[milestone] - position).norm() });
+      }
+    }
+    return connections;
+  }
+
+  /// A* search over milestones that are not known to be invalid.
+  /// The goal is a virtual node connected to all milestones with a finite goal connection cost.
+  std::pair<std::vector<IndexType>, bool> findShortestMilestonePath(
+      const Vector3& to,
+      const std::vector<Connection>& start_connections,
+      const std::vector<FloatType>& goal_connection_costs) const {
+    const IndexType goal_node = milestones_.size();
+    const IndexType invalid_node = std::numeric_limits<IndexType>::max();
+    std::vector<FloatType> costs(milestones_.size() + 1, std::numeric_limits<FloatType>::infinity());
+    std::vector<IndexType> predecessors(milestones_.size() + 1, invalid_node);
+    std::vector<bool> closed(milestones_.size() + 1, false);
+    using QueueEntry = std::pair<FloatType, IndexType>;
+    std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<QueueEntry>> queue;
+    const auto heuristic = [&](const IndexType node) -> FloatType {
+      return node == goal_node ? 0 : (milestones_[node] - to).norm();
+    };
+    for (const Connection& connection : start_connections) {
+      if (connection.cost < costs[connection.milestone]) {
+        costs[connection.milestone] = connection.cost;
+        queue.push(std::make_pair(connection.cost + heuristic(connection.milestone), connection.milestone));
+      }
+    }
+    while (!queue.empty()) {
+      const IndexType node = queue.top().second;
+      queue.pop();
+      if (closed[node]) {
+        continue;
+      }
+      closed[node] = true;
+      if (node == goal_node) {
+        break;
+      }
+      const FloatType node_cost = costs[node];
+      if (goal_connection_costs[node] < std::numeric_limits<FloatType>::infinity()) {
+        const FloatType new_cost = node_cost + goal_connection_costs[node];
+        if (new_cost < costs[goal_node]) {
+          costs[goal_node] = new_cost;
+          predecessors[goal_node] = node;
+          queue.push(std::make_pair(new_cost, goal_node));
+        }
+      }
+      for (IndexType i = neighbor_offsets_[node]; i < neighbor_offsets_[node + 1]; ++i) {
+        const Neighbor& neighbor = neighbors_[i];
+        if (closed[neighbor.milestone] || edge_states_[neighbor.edge] == INVALID) {
+          continue;
+        }
+        const FloatType new_cost = node_cost + neighbor.cost;
+        if (new_cost < costs[neighbor.milestone]) {
+          costs[neighbor.milestone] = new_cost;
+          predecessors[neighbor.milestone] = node;
+          queue.push(std::make_pair(new_cost + heuristic(neighbor.milestone), neighbor.milestone));
+        }
+      }
+    }
+    if (!closed[goal_node]) {
+      return std::make_pair(std::vector<IndexType>(), false);
+    }
+    std::vector<IndexType> milestone_path;
+    for (IndexType node = predecessors[goal_node]; node != invalid_node; node = predecessors[node]) {
+      milestone_path.push_back(node);
+    }
+    std::reverse(milestone_path.begin(), milestone_path.end());
+    return std::make_pair(std::move(milestone_path), true);
+  }
+
+  /// Validate all unknown edges along a milestone path. Returns false if any edge is invalid.
+  bool validateMilestonePath(const std::vector<IndexType>& milestone_path,
+                             const SegmentValidator& segment_validator) const {
+    bool path_valid = true;
+    for (std::size_t i = 1; i < milestone_path.size(); ++i) {
+      const IndexType edge = findEdge(milestone_path[i - 1], milestone_path[i]);
+      BH_ASSERT(edge != std::numeric_limits<IndexType>::max());
+      const uint8_t state = edge_states_[edge];
+      if (state == VALID) {
+        continue;
+      }
+      else if (state == INVALID) {
+        path_valid = false;
+        break;
+      }
+      ++num_edge_validations_;
+      const bool edge_valid = segment_validator(milestones_[milestone_path[i - 1]], milestones_[milestone_path[i]]);
+      edge_states_[edge] = edge_valid ? VALID : INVALID;
+      if (!edge_valid) {
+        ++num_invalid_edges_;
+        path_valid = false;
+        break;
+      }
+    }
+    return path_valid;
+  }
+
+  IndexType findEdge(const IndexType from, const IndexType to) const {
+    for (IndexType i = neighbor_offsets_[from]; i < neighbor_offsets_[from + 1]; ++i) {
+      if (neighbors_[i].milestone == to) {
+        return neighbors_[i].edge;
+      }
+    }
+    return std::numeric_limits<IndexType>::max();
+  }
+
+  std::vector<Vector3> shortcutPath(const std::vector<Vector3>& path, const SegmentValidator& segment_validator) const {
+    std::vector<Vector3> shortcut_path;
+    shortcut_path.push_back(path.front());
+    std::size_t i = 0;
+    while (i < path.size() - 1) {
+      std::size_t j = path.size() - 1;
+      while (j > i + 1 && !segment_validator(path[i], path[j])) {
+        --j;
+      }
+      shortcut_path.push_back(path[j]);
+      i = j;
+    }
+    return shortcut_path;
+  }
+
+  Options options_;
+
+  BoundingBoxType space_bbox_;
+  BoundingBoxType object_bbox_;
+
+  std::atomic<bool> built_;
+  std::mutex build_mutex_;
+
+  std::vector<Vector3> milestones_;
+  std::vector<IndexType> neighbor_offsets_;
+  std::vector<Neighbor> neighbors_;
+  std::vector<std::pair<IndexType, IndexType>> edge_endpoints_;
+  std::unique_ptr<std::atomic<uint8_t>[]> edge_states_;
+  ANN ann_;
+
+  mutable std::atomic<std::size_t> num_queries_;
+  mutable std::atomic<std::size_t> num_successful_queries_;
+  mutable std::atomic<std::size_t> num_edge_validations_;
+  mutable std::atomic<std::size_t> num_invalid_edges_;
+
+  // Boost serialization
+  friend class boost::serialization::access;
+
+  template <typename Archive>
+  void save(Archive& ar, const unsigned int version) const {
+    ar & space_bbox_;
+    ar & object_bbox_;
+    ar & milestones_;
+    ar & edge_endpoints_;
+    std::vector<uint8_t> edge_states(edge_endpoints_.size());
+    for (std::size_t i = 0; i < edge_states.size(); ++i) {
+      edge_states[i] = edge_states_[i];
+    }
+    ar & edge_states;
+  }
+
+  template <typename Archive>
+  void load(Archive& ar, const unsigned int version) {
+    std::lock_guard<std::mutex> lock(build_mutex_);
+    clearWithoutLock();
+    ar & space_bbox_;
+    ar & object_bbox_;
+    ar & milestones_;
+    ar & edge_endpoints_;
+    std::vector<uint8_t> edge_states;
+    ar & edge_states;
+    BH_ASSERT(edge_states.size() == edge_endpoints_.size());
+    edge_states_.reset(new std::atomic<uint8_t>[edge_endpoints_.size()]);
+    for (std::size_t i = 0; i < edge_states.size(); ++i) {
+      edge_states_[i] = edge_states[i];
+    }
+    buildAdjacency();
+    if (!milestones_.empty()) {
+      ann_.initIndex(milestones_.begin(), milestones_.end());
+    }
+    built_ = true;
+  }
+
+  BOOST_SERIALIZATION_SPLIT_MEMBER()
+};
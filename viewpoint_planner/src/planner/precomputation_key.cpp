@@ -0,0 +1,125 @@
+//==================================================
+// precomputation_key.cpp
+//
+//  Copyright (c) 2017 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: Oct 18, 2017
+//==================================================
+
+#include <src/planner/precomputation_key.h>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+#include <boost/filesystem.hpp>
+
+namespace {
+
+// 64 bit FNV-1a parameters
+const uint64_t kFnvOffsetBasis = 14695981039346656037ULL;
+const uint64_t kFnvPrime = 1099511628211ULL;
+
+}
+
+PrecomputationKey::PrecomputationKey(const std::string& name)
+: hash_(kFnvOffsetBasis) {
+  addString(name);
+}
+
+PrecomputationKey& PrecomputationKey::addFile(const std::string& filename) {
+  std::ifstream ifs(filename, std::ios::binary);
+  if (!ifs) {
+    throw Error(std::string("Unable to open file for hashing: ") + filename);
+  }
+  // The chunk size has to be a multiple of the word size so that the hash does not depend on chunk boundaries
+  std::vector<char> buffer(1 << 20);
+  uint64_t file_size = 0;
+  while (ifs) {
+    ifs.read(buffer.data(), buffer.size());
+    const std::size_t num_read = static_cast<std::size_t>(ifs.gcount());
+    addData(buffer.data(), num_read);
+    file_size += num_read;
+  }
+  if (!ifs.eof()) {
+    throw Error(std::string("Failed to read file for hashing: ") + filename);
+  }
+  return addValue(file_size);
+}
+
+PrecomputationKey& PrecomputationKey::addDirectoryMetadata(const std::string& path) {
+  if (!boost::filesystem::is_directory(path)) {
+    throw Error(std::string("Unable to open directory for hashing: ") + path);
+  }
+  // Directory iteration order is unspecified so the entries are sorted first
+  std::vector<std::pair<std::string, boost::filesystem::path>> files;
+  const boost::filesystem::path root(path);
+  for (boost::filesystem::recursive_directory_iterator it(root);
+       it != boost::filesystem::recursive_directory_iterator(); ++it) {
+    if (boost::filesystem::is_regular_file(it->status())) {
+      const std::string relative_path = it->path().string().substr(root.string().size());
+      files.emplace_back(relative_path, it->path());
+    }
+  }
+  std::sort(files.begin(), files.end());
+  for (const auto& file : files) {
+    addString(file.first);
+    addValue(static_cast<uint64_t>(boost::filesystem::file_size(file.second)));
+    addValue(static_cast<int64_t>(boost::filesystem::last_write_time(file.second)));
+  }
+  return addValue(static_cast<uint64_t>(files.size()));
+}
+
+PrecomputationKey& PrecomputationKey::addString(const std::string& str) {
+  addData(str.data(), str.size());
+  return addValue(static_cast<uint64_t>(str.size()));
+}
+
+void PrecomputationKey::addData(const char* data, const std::size_t size) {
+  // FNV-1a on 64 bit words with an additional shift to mix the high bits into the low bits.
+  // Not cryptographic, only meant to detect changed inputs.
+  const std::size_t num_words = size / sizeof(uint64_t);
+  for (std::size_t i = 0; i < num_words; ++i) {
+    uint64_t word;
+    std::memcpy(&word, data + i * sizeof(uint64_t), sizeof(uint64_t));
+    hash_ ^= word;
+    hash_ *= kFnvPrime;
+    hash_ ^= hash_ >> 31;
+  }
+  for (std::size_t i = num_words * sizeof(uint64_t); i < size; ++i) {
+    hash_ ^= static_cast<uint8_t>(data[i]);
+    hash_ *= kFnvPrime;
+  }
+}
+
+std::string PrecomputationKey::toString() const {
+  std::ostringstream out;
+  out << std::hex << std::setw(16) << std::setfill('0') << hash_;
+  return out.str();
+}
+
+bool PrecomputationKey::matchesArtifact(const std::string& artifact_filename, const std::string& key_suffix) const {
+  const std::string key_filename = getKeyFilename(artifact_filename, key_suffix);
+  if (!boost::filesystem::exists(artifact_filename) || !boost::filesystem::exists(key_filename)) {
+    return false;
+  }
+  std::ifstream ifs(key_filename);
+  std::string stored_key;
+  ifs >> stored_key;
+  return ifs && stored_key == toString();
+}
+
+void PrecomputationKey::writeForArtifact(const std::string& artifact_filename, const std::string& key_suffix) const {
+  const std::string key_filename = getKeyFilename(artifact_filename, key_suffix);
+  std::ofstream ofs(key_filename);
+  if (!ofs) {
+    throw Error(std::string("Unable to open file for writing: ") + key_filename);
+  }
+  ofs << toString() << std::endl;
+}
+
+void PrecomputationKey::removeForArtifact(const std::string& artifact_filename, const std::string& key_suffix) {
+  boost::system::error_code error_code;
+  boost::filesystem::remove(getKeyFilename(artifact_filename, key_suffix), error_code);
+}
@@ -0,0 +1,95 @@
+//==================================================
+// precomputation_key.h
+//
+//  Copyright (c) 2017 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: Oct 18, 2017
+//==================================================
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <bh/common.h>
+
+/// Content hash of the inputs of a cached precomputation (i.e. augmented octree, BVH tree, distance field).
+///
+/// A key is built from input files, option values and the keys of other precomputations that an artifact depends on.
+/// The key of an artifact is stored in a small file next to it (<artifact>.key) and the artifact is only regenerated
+/// if the key of the current inputs differs from the stored one.
+class PrecomputationKey {
+public:
+  using HashType = uint64_t;
+
+  class Error : public bh::Error {
+  public:
+    explicit Error(const std::string& what)
+    : bh::Error(what) {}
+  };
+
+  /// The name separates keys of different kinds of artifacts with otherwise identical inputs
+  explicit PrecomputationKey(const std::string& name = "");
+
+  /// Add the content of a file
+  PrecomputationKey& addFile(const std::string& filename);
+
+  PrecomputationKey& addString(const std::string& str);
+
+  /// Add the relative paths, sizes and modification times of all files in a directory tree.
+  /// Used for large inputs (i.e. dense reconstruction workspaces) where hashing the content is too expensive.
+  PrecomputationKey& addDirectoryMetadata(const std::string& path);
+
+  /// Add the key of another precomputation
+  PrecomputationKey& addKey(const PrecomputationKey& key) {
+    return addValue(key.hash_);
+  }
+
+  template <typename T>
+  PrecomputationKey& addValue(const T& value) {
+    static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable values can be added to a key");
+    addData(reinterpret_cast<const char*>(&value), sizeof(value));
+    return *this;
+  }
+
+  HashType getHash() const {
+    return hash_;
+  }
+
+  /// Hexadecimal representation of the hash
+  std::string toString() const;
+
+  bool operator==(const PrecomputationKey& other) const {
+    return hash_ == other.hash_;
+  }
+
+  bool operator!=(const PrecomputationKey& other) const {
+    return !(*this == other);
+  }
+
+  static std::string getKeyFilename(const std::string& artifact_filename, const std::string& key_suffix = ".key") {
+    return artifact_filename + key_suffix;
+  }
+
+  /// Whether an artifact exists and the stored key is equal to this key
+  bool matchesArtifact(const std::string& artifact_filename, const std::string& key_suffix = ".key") const;
+
+  /// Store this key for an artifact
+  void writeForArtifact(const std::string& artifact_filename, const std::string& key_suffix = ".key") const;
+
+  /// Remove the stored key of an artifact (if any)
+  static void removeForArtifact(const std::string& artifact_filename, const std::string& key_suffix = ".key");
+
+  /// Write an artifact and store this key for it. The stored key is removed before writing so that
+  /// a partially written artifact is never considered up-to-date.
+  template <typename WriteFunction>
+  void writeArtifact(const std::string& artifact_filename, const WriteFunction& write_function) const {
+    removeForArtifact(artifact_filename);
+    write_function();
+    writeForArtifact(artifact_filename);
+  }
+
+private:
+  void addData(const char* data, const std::size_t size);
+
+  HashType hash_;
+};
@@ -0,0 +1,220 @@
+//==================================================
+// render_buffer_cache.h
+//
+//  Copyright (c) 2017 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: Oct 18, 2017
+//==================================================
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <boost/functional/hash.hpp>
+#include <bh/common.h>
+#include <bh/eigen.h>
+#include <bh/pose.h>
+
+/// Memory-bounded LRU cache of rendered buffers keyed by camera pose and image size.
+///
+/// Poses are quantized so that approximately equal poses share an entry. Entries are distributed over
+/// independently locked shards with their own LRU lists. The memory budget is global: when it is exceeded
+/// the least recently used entries of the shards are evicted in round-robin order (approximate LRU).
+/// Buffers larger than the whole budget are not cached. BufferT has to provide byteSize().
+template <typename FloatT, typename BufferT>
+class RenderBufferCache {
+public:
+  using FloatType = FloatT;
+  USE_FIXED_EIGEN_TYPES(FloatType);
+  using Pose = bh::Pose<FloatType>;
+  using BufferPtr = std::shared_ptr<const BufferT>;
+
+  struct Options {
+    // Maximum memory used by cached buffers in bytes
+    std::size_t max_memory = 512 * 1024 * 1024;
+    // Number of independently locked shards
+    std::size_t num_shards = 16;
+    // Quantization of the position
+    FloatType position_resolution = FloatType(1e-4);
+    // Quantization of the quaternion coefficients
+    FloatType rotation_resolution = FloatType(1e-5);
+  };
+
+  RenderBufferCache()
+  : RenderBufferCache(Options()) {}
+
+  explicit RenderBufferCache(const Options& options)
+  : options_(options), shards_(std::max<std::size_t>(options.num_shards, 1)),
+    memory_(0), eviction_shard_index_(0), rejection_logged_(false),
+    num_hits_(0), num_misses_(0), num_evictions_(0) {
+    BH_ASSERT(options_.position_resolution > 0);
+    BH_ASSERT(options_.rotation_resolution > 0);
+  }
+
+  RenderBufferCache(const RenderBufferCache& other) = delete;
+
+  RenderBufferCache& operator=(const RenderBufferCache& other) = delete;
+
+  /// Return cached buffer or a null pointer
+  BufferPtr lookup(const Pose& pose, const std::size_t width, const std::size_t height) const {
+    const Key key = computeKey(pose, width, height);
+    Shard& shard = getShard(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    const auto it = shard.map.find(key);
+    if (it == shard.map.end()) {
+      ++num_misses_;
+      return BufferPtr();
+    }
+    // Move to front of LRU list
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    ++num_hits_;
+    return it->second->buffer;
+  }
+
+  /// Insert buffer. An existing entry for the same key is replaced.
+  void insert(const Pose& pose, const std::size_t width, const std::size_t height, const BufferPtr& buffer) {
+    const Key key = computeKey(pose, width, height);
+    const std::size_t byte_size = buffer->byteSize();
+    if (byte_size > options_.max_memory) {
+      if (options_.max_memory > 0 && !rejection_logged_.exchange(true)) {
+        std::cout << "WARNING: Render buffer of " << byte_size << " bytes exceeds the cache budget of "
+                  << options_.max_memory << " bytes and is not cached" << std::endl;
+      }
+      return;
+    }
+    {
+      Shard& shard = getShard(key);
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      const auto it = shard.map.find(key);
+      if (it != shard.map.end()) {
+        shard.memory -= it->second->byte_size;
+        memory_ -= it->second->byte_size;
+        shard.lru.erase(it->second);
+        shard.map.erase(it);
+      }
+      shard.lru.push_front(Entry { key, buffer, byte_size });
+      shard.map.emplace(key, shard.lru.begin());
+      shard.memory += byte_size;
+      memory_ += byte_size;
+    }
+    evictUntilWithinBudget(key);
+  }
+
+  void clear() {
+    for (Shard& shard : shards_) {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      shard.lru.clear();
+      shard.map.clear();
+      memory_ -= shard.memory;
+      shard.memory = 0;
+    }
+  }
+
+  std::size_t numEntries() const {
+    std::size_t num_entries = 0;
+    for (const Shard& shard : shards_) {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      num_entries += shard.map.size();
+    }
+    return num_entries;
+  }
+
+  std::size_t memoryUsage() const {
+    return memory_;
+  }
+
+  std::size_t numHits() const {
+    return num_hits_;
+  }
+
+  std::size_t numMisses() const {
+    return num_misses_;
+  }
+
+  std::size_t numEvictions() const {
+    return num_evictions_;
+  }
+
+private:
+  using Key = std::array<int64_t, 9>;
+
+  struct KeyHash {
+    std::size_t operator()(const Key& key) const {
+      return boost::hash_range(key.begin(), key.end());
+    }
+  };
+
+  struct Entry {
+    Key key;
+    BufferPtr buffer;
+    std::size_t byte_size;
+  };
+
+  struct Shard {
+    Shard()
+    : memory(0) {}
+
+    mutable std::mutex mutex;
+    std::list<Entry> lru;
+    std::unordered_map<Key, typename std::list<Entry>::iterator, KeyHash> map;
+    std::size_t memory;
+  };
+
+  Key computeKey(const Pose& pose, const std::size_t width, const std::size_t height) const {
+    Key key;
+    const Vector3& position = pose.getWorldPosition();
+    for (std::size_t i = 0; i < 3; ++i) {
+      key[i] = static_cast<int64_t>(std::round(position(i) / options_.position_resolution));
+    }
+    // q and -q represent the same rotation
+    const FloatType sign = pose.quaternion().w() < 0 ? -1 : 1;
+    for (std::size_t i = 0; i < 4; ++i) {
+      key[3 + i] = static_cast<int64_t>(std::round(sign * pose.quaternion().coeffs()(i) / options_.rotation_resolution));
+    }
+    key[7] = static_cast<int64_t>(width);
+    key[8] = static_cast<int64_t>(height);
+    return key;
+  }
+
+  Shard& getShard(const Key& key) const {
+    return shards_[KeyHash()(key) % shards_.size()];
+  }
+
+  /// Evict the least recently used entry of one shard after the other until the memory budget is met.
+  /// Only one shard is locked at a time. The entry with the given key (i.e. just inserted) is kept.
+  void evictUntilWithinBudget(const Key& keep_key) {
+    std::size_t num_shards_without_eviction = 0;
+    while (memory_ > options_.max_memory && num_shards_without_eviction < shards_.size()) {
+      Shard& shard = shards_[eviction_shard_index_++ % shards_.size()];
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      if (shard.lru.empty() || shard.lru.back().key == keep_key) {
+        ++num_shards_without_eviction;
+        continue;
+      }
+      num_shards_without_eviction = 0;
+      const Entry& last = shard.lru.back();
+      shard.memory -= last.byte_size;
+      memory_ -= last.byte_size;
+      shard.map.erase(last.key);
+      shard.lru.pop_back();
+      ++num_evictions_;
+    }
+  }
+
+  const Options options_;
+  mutable std::vector<Shard> shards_;
+  std::atomic<std::size_t> memory_;
+  std::atomic<std::size_t> eviction_shard_index_;
+  std::atomic<bool> rejection_logged_;
+
+  mutable std::atomic<std::size_t> num_hits_;
+  mutable std::atomic<std::size_t> num_misses_;
+  std::atomic<std::size_t> num_evictions_;
+};
@@ -0,0 +1,228 @@
+//==================================================
+// sparse_matchability_graph.h
+//
+//  Copyright (c) 2017 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: Oct 18, 2017
+//==================================================
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <tuple>
+#include <vector>
+#include <boost/serialization/access.hpp>
+#include <boost/serialization/split_member.hpp>
+#include <boost/serialization/vector.hpp>
+#include <bh/common.h>
+
+/// Precomputed sparse matching scores of all candidate viewpoint pairs.
+///
+/// Undirected pairs are stored in a compressed adjacency structure (sorted neighbors and scores per vertex)
+/// and in an open addressing hash table for constant time lookups. A pair that was not a candidate
+/// (i.e. not within the matching limits or not computed) is not found and has to be evaluated on demand.
+/// The graph is immutable after building and can be queried concurrently.
+template <typename FloatT>
+class SparseMatchabilityGraph {
+public:
+  using FloatType = FloatT;
+  using IndexType = std::size_t;
+  using ScoreType = float;
+
+  struct Edge {
+    IndexType index1;
+    IndexType index2;
+    ScoreType score;
+  };
+
+  SparseMatchabilityGraph()
+  : num_vertices_(0) {}
+
+  /// Build graph from a list of undirected edges (of duplicate edges the one with the highest score is kept)
+  void build(const std::size_t num_vertices, std::vector<Edge> edges) {
+    clear();
+    BH_ASSERT(num_vertices < std::numeric_limits<uint32_t>::max());
+    num_vertices_ = num_vertices;
+    for (Edge& edge : edges) {
+      BH_ASSERT(edge.index1 < num_vertices && edge.index2 < num_vertices);
+      if (edge.index1 > edge.index2) {
+        std::swap(edge.index1, edge.index2);
+      }
+    }
+    // Duplicates are ordered by descending score so that std::unique keeps the highest score
+    std::sort(edges.begin(), edges.end(), [](const Edge& a, const Edge& b) {
+      return std::tie(a.index1, a.index2, b.score) < std::tie(b.index1, b.index2, a.score);
+    });
+    edges.erase(std::unique(edges.begin(), edges.end(), [](const Edge& a, const Edge& b) {
+      return a.index1 == b.index1 && a.index2 == b.index2;
+    }), edges.end());
+    edges_.reserve(edges.size());
+    for (const Edge& edge : edges) {
+      edges_.push_back(PackedEdge { static_cast<uint32_t>(edge.index1), static_cast<uint32_t>(edge.index2), edge.score });
+    }
+    buildAdjacency();
+    buildHashTable();
+  }
+
+  void clear() {
+    num_vertices_ = 0;
+    edges_.clear();
+    offsets_.clear();
+    neighbors_.clear();
+    neighbor_scores_.clear();
+    hash_keys_.clear();
+    hash_scores_.clear();
+  }
+
+  bool empty() const {
+    return edges_.empty();
+  }
+
+  /// Number of viewpoints that the graph was computed for
+  std::size_t numVertices() const {
+    return num_vertices_;
+  }
+
+  std::size_t numEdges() const {
+    return edges_.size();
+  }
+
+  /// Lookup score of a viewpoint pair. Returns false if the pair is not in the graph.
+  bool find(const IndexType index1, const IndexType index2, ScoreType* score) const {
+    if (hash_keys_.empty() || index1 >= num_vertices_ || index2 >= num_vertices_) {
+      return false;
+    }
+    const uint64_t key = makeKey(index1, index2);
+    const std::size_t mask = hash_keys_.size() - 1;
+    for (std::size_t slot = hashKey(key) & mask; ; slot = (slot + 1) & mask) {
+      if (hash_keys_[slot] == key) {
+        *score = hash_scores_[slot];
+        return true;
+      }
+      if (hash_keys_[slot] == kEmptyKey) {
+        return false;
+      }
+    }
+  }
+
+  std::size_t numNeighbors(const IndexType index) const {
+    return offsets_[index + 1] - offsets_[index];
+  }
+
+  /// Neighbors of a viewpoint sorted by index
+  const uint32_t* neighborsBegin(const IndexType index) const {
+    return neighbors_.data() + offsets_[index];
+  }
+
+  const uint32_t* neighborsEnd(const IndexType index) const {
+    return neighbors_.data() + offsets_[index + 1];
+  }
+
+  /// Scores in the same order as the neighbors
+  const ScoreType* neighborScoresBegin(const IndexType index) const {
+    return neighbor_scores_.data() + offsets_[index];
+  }
+
+private:
+  struct PackedEdge {
+    uint32_t index1;
+    uint32_t index2;
+    ScoreType score;
+
+    template <typename Archive>
+    void serialize(Archive& ar, const unsigned int version) {
+      ar & index1;
+      ar & index2;
+      ar & score;
+    }
+  };
+
+  static constexpr uint64_t kEmptyKey = std::numeric_limits<uint64_t>::max();
+
+  static uint64_t makeKey(const IndexType index1, const IndexType index2) {
+    const uint64_t low = std::min(index1, index2);
+    const uint64_t high = std::max(index1, index2);
+    return (low << 32) | high;
+  }
+
+  static std::size_t hashKey(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return static_cast<std::size_t>(x ^ (x >> 31));
+  }
+
+  void buildAdjacency() {
+    offsets_.assign(num_vertices_ + 1, 0);
+    for (const PackedEdge& edge : edges_) {
+      ++offsets_[edge.index1 + 1];
+      ++offsets_[edge.index2 + 1];
+    }
+    for (std::size_t i = 0; i < num_vertices_; ++i) {
+      offsets_[i + 1] += offsets_[i];
+    }
+    neighbors_.resize(2 * edges_.size());
+    neighbor_scores_.resize(2 * edges_.size());
+    std::vector<std::size_t> fill(offsets_.begin(), offsets_.end() - 1);
+    // Edges are sorted so the neighbors of each vertex are sorted as well
+    for (const PackedEdge& edge : edges_) {
+      neighbors_[fill[edge.index2]] = edge.index1;
+      neighbor_scores_[fill[edge.index2]++] = edge.score;
+    }
+    for (const PackedEdge& edge : edges_) {
+      neighbors_[fill[edge.index1]] = edge.index2;
+      neighbor_scores_[fill[edge.index1]++] = edge.score;
+    }
+  }
+
+  void buildHashTable() {
+    // Keep load factor below 0.5
+    std::size_t capacity = 16;
+    while (capacity < 2 * edges_.size()) {
+      capacity *= 2;
+    }
+    hash_keys_.assign(capacity, kEmptyKey);
+    hash_scores_.assign(capacity, 0);
+    const std::size_t mask = capacity - 1;
+    for (const PackedEdge& edge : edges_) {
+      const uint64_t key = makeKey(edge.index1, edge.index2);
+      std::size_t slot = hashKey(key) & mask;
+      while (hash_keys_[slot] != kEmptyKey) {
+        slot = (slot + 1) & mask;
+      }
+      hash_keys_[slot] = key;
+      hash_scores_[slot] = edge.score;
+    }
+  }
+
+  std::size_t num_vertices_;
+  std::vector<PackedEdge> edges_;
+  std::vector<std::size_t> offsets_;
+  std::vector<uint32_t> neighbors_;
+  std::vector<ScoreType> neighbor_scores_;
+  std::vector<uint64_t> hash_keys_;
+  std::vector<ScoreType> hash_scores_;
+
+  // Boost serialization. Only the edges are stored, the lookup structures are rebuilt.
+  friend class boost::serialization::access;
+
+  template <typename Archive>
+  void save(Archive& ar, const unsigned int version) const {
+    ar & num_vertices_;
+    ar & edges_;
+  }
+
+  template <typename Archive>
+  void load(Archive& ar, const unsigned int version) {
+    clear();
+    ar & num_vertices_;
+    ar & edges_;
+    buildAdjacency();
+    buildHashTable();
+  }
+
+  BOOST_SERIALIZATION_SPLIT_MEMBER()
+};
+
+template <typename FloatT>
+constexpr uint64_t SparseMatchabilityGraph<FloatT>::kEmptyKey;
@@ -0,0 +1,461 @@
+//==================================================
+// tour_improver.h
+//
+//  Copyright (c) 2017 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: Oct 18, 2017
+//==================================================
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <random>
+#include <limits>
+#include <algorithm>
+#include <numeric>
+#include <bh/common.h>
+#include <bh/utilities.h>
+
+namespace viewpoint_planner {
+
+/// Local search engine to improve a closed tour (i.e. a TSP solution) on a symmetric cost matrix.
+///
+/// Each trial runs a chained Lin-Kernighan style search: 2-Opt and Or-Opt moves (segments of up to
+/// max_segment_length nodes, inserted in both orientations) are evaluated on candidate neighbor lists
+/// with don't-look bits until a local optimum is reached. The local optimum is then perturbed with
+/// a random double-bridge kick and the search is restarted. Trials run in parallel with different
+/// random seeds and the best tour over all trials is returned.
+template <typename FloatT>
+class TourImprover {
+public:
+  using FloatType = FloatT;
+  using Tour = std::vector<std::size_t>;
+
+  struct Options {
+    // Number of nearest neighbors to consider for each node when searching for improving moves
+    std::size_t num_candidate_neighbors = 10;
+    // Maximum length of a segment that is moved by Or-Opt
+    std::size_t max_segment_length = 3;
+    // Number of independent randomized trials
+    std::size_t num_trials = 8;
+    // Maximum number of double-bridge kicks per trial
+    std::size_t max_kicks_per_trial = 1000;
+    // Time budget for all trials in seconds (0 for no limit)
+    double max_time = 1.0;
+    // Seed for the random kicks (each trial uses seed + trial index)
+    std::size_t rng_seed = 0;
+    // Minimum improvement for a move to be accepted
+    FloatType epsilon = FloatType(1e-6);
+  };
+
+  struct Result {
+    Tour tour;
+    FloatType initial_cost = 0;
+    FloatType cost = 0;
+    std::size_t num_trials = 0;
+    std::size_t num_kicks = 0;
+    std::size_t num_improving_moves = 0;
+    double elapsed_time = 0;
+  };
+
+  /// Cost matrix is expected in row-major order with num_nodes * num_nodes entries and is copied.
+  TourImprover(const Options& options, const std::size_t num_nodes, const std::vector<FloatType>& cost_matrix)
+  : options_(options), num_nodes_(num_nodes), cost_matrix_(cost_matrix) {
+    BH_ASSERT(cost_matrix_.size() == num_nodes_ * num_nodes_);
+    computeCandidateNeighbors();
+  }
+
+  FloatType cost(const std::size_t node1, const std::size_t node2) const {
+    return cost_matrix_[node1 * num_nodes_ + node2];
+  }
+
+  FloatType computeTourCost(const Tour& tour) const {
+    if (tour.size() <= 1) {
+      return 0;
+    }
+    FloatType tour_cost = 0;
+    for (std::size_t i = 0; i < tour.size(); ++i) {
+      const std::size_t next_i = i + 1 < tour.size() ? i + 1 : 0;
+      tour_cost += cost(tour[i], tour[next_i]);
+    }
+    return tour_cost;
+  }
+
+  const std::vector<std::vector<std::size_t>>& getCandidateNeighbors() const {
+    return candidate_neighbors_;
+  }
+
+  /// Improve the initial tour. The initial tour has to be a permutation of [0, num_nodes).
+  Result improve(const Tour& initial_tour) const {
+    BH_ASSERT(initial_tour.size() == num_nodes_);
+    bh::Timer timer;
+    Result result;
+    result.tour = initial_tour;
+    result.initial_cost = computeTourCost(initial_tour);
+    result.cost = result.initial_cost;
+    if (num_nodes_ < 5) {
+      // Every tour with less than 5 nodes is optimal for a symmetric cost matrix
+      result.elapsed_time = timer.getElapsedTime();
+      return result;
+    }
+
+    const std::size_t num_trials = std::max<std::size_t>(options_.num_trials, 1);
+    std::vector<TrialResult> trial_results(num_trials);
+#pragma omp parallel for schedule(dynamic)
+    for (std::size_t trial = 0; trial < num_trials; ++trial) {
+      trial_results[trial] = runTrial(initial_tour, trial, timer);
+    }
+
+    // Select the best trial (lowest index on ties to stay deterministic)
+    for (std::size_t trial = 0; trial < num_trials; ++trial) {
+      const TrialResult& trial_result = trial_results[trial];
+      result.num_kicks += trial_result.num_kicks;
+      result.num_improving_moves += trial_result.num_improving_moves;
+      if (trial_result.cost < result.cost - options_.epsilon) {
+        result.cost = trial_result.cost;
+        result.tour = trial_result.tour;
+      }
+    }
+    result.num_trials = num_trials;
+    result.elapsed_time = timer.getElapsedTime();
+    return result;
+  }
+
+private:
+  struct TrialResult {
+    Tour tour;
+    FloatType cost = std::numeric_limits<FloatType>::max();
+    std::size_t num_kicks = 0;
+    std::size_t num_improving_moves = 0;
+  };
+
+  /// Tour with position lookup and a queue of active nodes (i.e. nodes without don't-look bit)
+  class TourState {
+  public:
+    explicit TourState(const Tour& tour)
+    : tour_(tour), positions_(tour.size()), in_queue_(tour.size(), false) {
+      updatePositions();
+    }
+
+    std::size_t size() const {
+      return tour_.size();
+    }
+
+    const Tour& tour() const {
+      return tour_;
+    }
+
+    std::size_t next(const std::size_t node) const {
+      const std::size_t pos = positions_[node] + 1;
+      return tour_[pos < tour_.size() ? pos : 0];
+    }
+
+    std::size_t prev(const std::size_t node) const {
+      const std::size_t pos = positions_[node];
+      return tour_[pos > 0 ? pos - 1 : tour_.size() - 1];
+    }
+
+    /// Number of nodes when walking forward from node1 to node2 (including both)
+    std::size_t segmentLength(const std::size_t node1, const std::size_t node2) const {
+      return (positions_[node2] + tour_.size() - positions_[node1]) % tour_.size() + 1;
+    }
+
+    /// Reverse the path from node1 to node2 (walking forward).
+    /// For a symmetric cost matrix reversing the complement is equivalent so the shorter one is reversed.
+    void reverse(const std::size_t node1, const std::size_t node2) {
+      const std::size_t n = tour_.size();
+      std::size_t i = positions_[node1];
+      std::size_t j = positions_[node2];
+      std::size_t length = segmentLength(node1, node2);
+      if (2 * length > n) {
+        const std::size_t tmp = i;
+        i = j + 1 < n ? j + 1 : 0;
+        j = tmp > 0 ? tmp - 1 : n - 1;
+        length = n - length;
+      }
+      for (std::size_t k = 0; k < length / 2; ++k) {
+        std::swap(tour_[i], tour_[j]);
+        positions_[tour_[i]] = i;
+        positions_[tour_[j]] = j;
+        i = i + 1 < n ? i + 1 : 0;
+        j = j > 0 ? j - 1 : n - 1;
+      }
+    }
+
+    /// Move the segment [seg_first, seg_last] (walking forward) between node and next(node).
+    void moveSegment(const std::size_t seg_first, const std::size_t seg_last,
+                     const std::size_t node, const bool reversed) {
+      const std::size_t length = segmentLength(seg_first, seg_last);
+      Tour segment;
+      segment.reserve(length);
+      std::size_t pos = positions_[seg_first];
+      for (std::size_t k = 0; k < length; ++k) {
+        segment.push_back(tour_[pos]);
+        pos = pos + 1 < tour_.size() ? pos + 1 : 0;
+      }
+      if (reversed) {
+        std::reverse(segment.begin(), segment.end());
+      }
+      Tour new_tour;
+      new_tour.reserve(tour_.size());
+      // Start walking after the segment so that it is never split
+      pos = positions_[seg_last] + 1 < tour_.size() ? positions_[seg_last] + 1 : 0;
+      for (std::size_t k = 0; k < tour_.size() - length; ++k) {
+        new_tour.push_back(tour_[pos]);
+        if (tour_[pos] == node) {
+          new_tour.insert(new_tour.end(), segment.begin(), segment.end());
+        }
+        pos = pos + 1 < tour_.size() ? pos + 1 : 0;
+      }
+      tour_ = std::move(new_tour);
+      updatePositions();
+    }
+
+    void setTour(Tour&& tour) {
+      tour_ = std::move(tour);
+      updatePositions();
+    }
+
+    void push(const std::size_t node) {
+      if (!in_queue_[node]) {
+        in_queue_[node] = true;
+        queue_.push_back(node);
+      }
+    }
+
+    bool isQueueEmpty() const {
+      return queue_.empty();
+    }
+
+    std::size_t pop() {
+      const std::size_t node = queue_.front();
+      queue_.pop_front();
+      in_queue_[node] = false;
+      return node;
+    }
+
+  private:
+    void updatePositions() {
+      for (std::size_t i = 0; i < tour_.size(); ++i) {
+        positions_[tour_[i]] = i;
+      }
+    }
+
+    Tour tour_;
+    std::vector<std::size_t> positions_;
+    std::vector<bool> in_queue_;
+    std::deque<std::size_t> queue_;
+  };
+
+  void computeCandidateNeighbors() {
+    const std::size_t num_neighbors = std::min(options_.num_candidate_neighbors, num_nodes_ > 0 ? num_nodes_ - 1 : 0);
+    candidate_neighbors_.resize(num_nodes_);
+    for (std::size_t node = 0; node < num_nodes_; ++node) {
+      std::vector<std::size_t> others;
+      others.reserve(num_nodes_);
+      for (std::size_t other = 0; other < num_nodes_; ++other) {
+        if (other != node) {
+          others.push_back(other);
+        }
+      }
+      std::partial_sort(others.begin(), others.begin() + num_neighbors, others.end(),
+                        [&](const std::size_t a, const std::size_t b) {
+                          return cost(node, a) < cost(node, b);
+                        });
+      others.resize(num_neighbors);
+      candidate_neighbors_[node] = std::move(others);
+    }
+  }
+
+  bool isTimeBudgetExceeded(const bh::Timer& timer) const {
+    return options_.max_time > 0 && timer.getElapsedTime() >= options_.max_time;
+  }
+
+  /// Try a 2-Opt move that adds an edge from node a to one of its candidate neighbors.
+  bool tryImprove2Opt(TourState* state, const std::size_t a) const {
+    for (const bool forward : { true, false }) {
+      const std::size_t b = forward ? state->next(a) : state->prev(a);
+      const FloatType cost_ab = cost(a, b);
+      for (const std::size_t c : candidate_neighbors_[a]) {
+        const FloatType cost_ac = cost(a, c);
+        // Neighbors are sorted so no further gain is possible
+        if (cost_ac >= cost_ab) {
+          break;
+        }
+        const std::size_t d = forward ? state->next(c) : state->prev(c);
+        if (c == b || d == a) {
+          continue;
+        }
+        const FloatType delta = cost_ac + cost(b, d) - cost_ab - cost(c, d);
+        if (delta < -options_.epsilon) {
+          if (forward) {
+            // ... a b ... c d ... -> ... a c ... b d ...
+            state->reverse(b, c);
+          }
+          else {
+            // ... b a ... d c ... -> ... b d ... a c ...
+            state->reverse(a, d);
+          }
+          state->push(a);
+          state->push(b);
+          state->push(c);
+          state->push(d);
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  /// Try an Or-Opt move of a segment starting or ending at node a next to one of its candidate neighbors.
+  bool tryImproveOrOpt(TourState* state, const std::size_t a) const {
+    const std::size_t max_segment_length = std::min(options_.max_segment_length, num_nodes_ - 3);
+    for (std::size_t segment_length = 1; segment_length <= max_segment_length; ++segment_length) {
+      for (const bool a_is_first : { true, false }) {
+        // Determine segment [s1, s2] in forward direction
+        std::size_t s1 = a;
+        std::size_t s2 = a;
+        for (std::size_t k = 1; k < segment_length; ++k) {
+          if (a_is_first) {
+            s2 = state->next(s2);
+          }
+          else {
+            s1 = state->prev(s1);
+          }
+        }
+        const std::size_t p = state->prev(s1);
+        const std::size_t n = state->next(s2);
+        const FloatType removal_gain = cost(p, s1) + cost(s2, n) - cost(p, n);
+        if (removal_gain <= options_.epsilon) {
+          continue;
+        }
+        for (const std::size_t c : candidate_neighbors_[a]) {
+          if (cost(a, c) >= removal_gain) {
+            break;
+          }
+          // Insert next to c, either between (c, next(c)) or (prev(c), c)
+          for (const bool c_is_before : { true, false }) {
+            const std::size_t u = c_is_before ? c : state->prev(c);
+            const std::size_t v = state->next(u);
+            if (state->segmentLength(s1, u) <= segment_length || state->segmentLength(s1, v) <= segment_length) {
+              // Edge (u, v) touches the segment
+              continue;
+            }
+            if (u == p) {
+              continue;
+            }
+            // Forward insertion: u s1 ... s2 v, reversed insertion: u s2 ... s1 v
+            const FloatType forward_cost = cost(u, s1) + cost(s2, v);
+            const FloatType reversed_cost = cost(u, s2) + cost(s1, v);
+            const bool reversed = reversed_cost < forward_cost;
+            const FloatType delta = std::min(forward_cost, reversed_cost) - cost(u, v) - removal_gain;
+            if (delta < -options_.epsilon) {
+              state->moveSegment(s1, s2, u, reversed);
+              state->push(p);
+              state->push(n);
+              state->push(s1);
+              state->push(s2);
+              state->push(u);
+              state->push(v);
+              return true;
+            }
+          }
+        }
+      }
+    }
+    return false;
+  }
+
+  /// Run local search until no more improving moves are found. Returns the number of improving moves.
+  std::size_t runLocalSearch(TourState* state, const bh::Timer& timer) const {
+    std::size_t num_improving_moves = 0;
+    std::size_t num_pops = 0;
+    while (!state->isQueueEmpty()) {
+      // Each pop evaluates all candidate moves of a node so the timer is checked on pops and not on improvements
+      if ((num_pops & 0x3f) == 0 && isTimeBudgetExceeded(timer)) {
+        break;
+      }
+      ++num_pops;
+      const std::size_t a = state->pop();
+      bool improved = true;
+      while (improved) {
+        improved = tryImprove2Opt(state, a);
+        if (!improved) {
+          improved = tryImproveOrOpt(state, a);
+        }
+        if (improved) {
+          ++num_improving_moves;
+        }
+      }
+    }
+    return num_improving_moves;
+  }
+
+  /// Apply a random double-bridge kick (segments A B C D -> A C B D)
+  Tour applyDoubleBridgeKick(const Tour& tour, std::mt19937_64* rng, std::vector<std::size_t>* touched_nodes) const {
+    const std::size_t n = tour.size();
+    std::uniform_int_distribution<std::size_t> dist(1, n - 1);
+    std::size_t cuts[3];
+    do {
+      cuts[0] = dist(*rng);
+      cuts[1] = dist(*rng);
+      cuts[2] = dist(*rng);
+      std::sort(cuts, cuts + 3);
+    } while (cuts[0] == cuts[1] || cuts[1] == cuts[2]);
+    Tour new_tour;
+    new_tour.reserve(n);
+    new_tour.insert(new_tour.end(), tour.begin(), tour.begin() + cuts[0]);
+    new_tour.insert(new_tour.end(), tour.begin() + cuts[1], tour.begin() + cuts[2]);
+    new_tour.insert(new_tour.end(), tour.begin() + cuts[0], tour.begin() + cuts[1]);
+    new_tour.insert(new_tour.end(), tour.begin() + cuts[2], tour.end());
+    touched_nodes->clear();
+    for (const std::size_t cut : cuts) {
+      touched_nodes->push_back(tour[cut - 1]);
+      touched_nodes->push_back(tour[cut]);
+    }
+    touched_nodes->push_back(tour.front());
+    touched_nodes->push_back(tour.back());
+    return new_tour;
+  }
+
+  TrialResult runTrial(const Tour& initial_tour, const std::size_t trial, const bh::Timer& timer) const {
+    std::mt19937_64 rng(options_.rng_seed + trial);
+    TrialResult result;
+
+    TourState state(initial_tour);
+    std::vector<std::size_t> touched_nodes;
+    if (trial > 0) {
+      // Randomized restart: Start from a perturbed initial tour
+      state.setTour(applyDoubleBridgeKick(initial_tour, &rng, &touched_nodes));
+    }
+    for (std::size_t node = 0; node < num_nodes_; ++node) {
+      state.push(node);
+    }
+    result.num_improving_moves += runLocalSearch(&state, timer);
+    result.tour = state.tour();
+    result.cost = computeTourCost(result.tour);
+
+    const bool can_kick = num_nodes_ >= 8;
+    while (can_kick && result.num_kicks < options_.max_kicks_per_trial && !isTimeBudgetExceeded(timer)) {
+      state.setTour(applyDoubleBridgeKick(result.tour, &rng, &touched_nodes));
+      for (const std::size_t node : touched_nodes) {
+        state.push(node);
+      }
+      result.num_improving_moves += runLocalSearch(&state, timer);
+      ++result.num_kicks;
+      const FloatType new_cost = computeTourCost(state.tour());
+      if (new_cost < result.cost - options_.epsilon) {
+        result.cost = new_cost;
+        result.tour = state.tour();
+      }
+    }
+    return result;
+  }
+
+  Options options_;
+  std::size_t num_nodes_;
+  std::vector<FloatType> cost_matrix_;
+  std::vector<std::vector<std::size_t>> candidate_neighbors_;
+};
+
+}
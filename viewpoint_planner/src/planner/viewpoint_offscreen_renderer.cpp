@@ -17,6 +17,7 @@ ViewpointOffscreenRenderer::ViewpointOffscreenRenderer(const PinholeCamera& came
       poisson_mesh_drawer_(nullptr),
       antialiasing_(false),
       clear_color_(1, 1, 1, 1),
+      poisson_mesh_cache_(getPoissonMeshCacheOptions(options_)),
       camera_(camera),
       near_plane_(0.5),
       far_plane_(1e5),
@@ -31,15 +32,65 @@ ViewpointOffscreenRenderer::ViewpointOffscreenRenderer(
       poisson_mesh_drawer_(nullptr),
       antialiasing_(false),
       clear_color_(1, 1, 1, 1),
+      poisson_mesh_cache_(getPoissonMeshCacheOptions(options_)),
       camera_(camera),
       near_plane_(0.5),
       far_plane_(1e5),
-      poisson_mesh_(poisson_mesh) {}
+      poisson_mesh_(poisson_mesh) {
+  if (options_.poisson_mesh_cpu_rasterizer) {
+    initializeCpuRasterizer();
+  }
+}
 
 ViewpointOffscreenRenderer::~ViewpointOffscreenRenderer() {
   clearOpenGL();
 }
 
+ViewpointOffscreenRenderer::PoissonMeshCache::Options ViewpointOffscreenRenderer::getPoissonMeshCacheOptions(
+        const Options& options) {
+  PoissonMeshCache::Options cache_options;
+  cache_options.max_memory = options.poisson_mesh_cache_max_memory_mb * 1024 * 1024;
+  cache_options.num_shards = options.poisson_mesh_cache_num_shards;
+  return cache_options;
+}
+
+void ViewpointOffscreenRenderer::initializeCpuRasterizer() {
+  std::vector<Vector3> vertices;
+  std::vector<Vector3> normals;
+  vertices.reserve(3 * poisson_mesh_->m_FaceIndicesVertices.size());
+  normals.reserve(3 * poisson_mesh_->m_FaceIndicesVertices.size());
+  for (size_t i = 0; i < poisson_mesh_->m_FaceIndicesVertices.size(); ++i) {
+    const MeshType::Indices::Face& vertex_indices = poisson_mesh_->m_FaceIndicesVertices[i];
+    BH_ASSERT_STR(vertex_indices.size() == 3, "Mesh face vertex indices need to have a valence of 3");
+    const ml::vec3f& v1 = poisson_mesh_->m_Vertices[vertex_indices[0]];
+    const ml::vec3f& v2 = poisson_mesh_->m_Vertices[vertex_indices[1]];
+    const ml::vec3f& v3 = poisson_mesh_->m_Vertices[vertex_indices[2]];
+    vertices.push_back(Vector3(v1.x, v1.y, v1.z));
+    vertices.push_back(Vector3(v2.x, v2.y, v2.z));
+    vertices.push_back(Vector3(v3.x, v3.y, v3.z));
+    // Same normals as uploaded for OpenGL rendering
+    if (poisson_mesh_->hasNormalIndices() && poisson_mesh_->hasNormals()) {
+      const MeshType::Indices::Face& normal_indices = poisson_mesh_->m_FaceIndicesNormals[i];
+      BH_ASSERT_STR(normal_indices.size() == 3, "Mesh face normal indices need to have a valence of 3");
+      for (size_t j = 0; j < 3; ++j) {
+        const ml::vec3f n = ml::vec3f::normalize(poisson_mesh_->m_Normals[normal_indices[j]]);
+        normals.push_back(Vector3(n.x, n.y, n.z));
+      }
+    } else {
+      const ml::vec3f n = ml::vec3f::normalize(ml::vec3f::cross(v2 - v1, v3 - v2));
+      for (size_t j = 0; j < 3; ++j) {
+        normals.push_back(Vector3(n.x, n.y, n.z));
+      }
+    }
+  }
+  MeshRasterizerType::Options rasterizer_options;
+  rasterizer_options.tile_size = options_.poisson_mesh_cpu_rasterizer_tile_size;
+  rasterizer_options.cull_backfaces = options_.poisson_mesh_cpu_rasterizer_cull_backfaces;
+  poisson_mesh_rasterizer_.reset(new MeshRasterizerType(rasterizer_options, vertices, normals));
+  std::cout << "Initialized CPU rasterizer with " << poisson_mesh_rasterizer_->numTriangles()
+            << " triangles" << std::endl;
+}
+
 void ViewpointOffscreenRenderer::setClearColor(const bh::Color4<FloatType>& color) {
   clear_color_ = color;
 }
@@ -55,6 +106,10 @@ void ViewpointOffscreenRenderer::setAntialiasing(const bool antialiasing) {
 }
 
 void ViewpointOffscreenRenderer::setCamera(const PinholeCamera& camera) {
+  if (camera != camera_) {
+    // Cached buffers are only keyed by pose and image size
+    clearPoissonMeshCache();
+  }
   camera_ = camera;
   if (isInitialized()) {
     const bool framebuffer_update_required = camera_.width() != (size_t)opengl_fbo_->width()
@@ -74,6 +129,9 @@ qreal ViewpointOffscreenRenderer::getFarPlane() const {
 }
 
 void ViewpointOffscreenRenderer::setNearFarPlane(const qreal near_plane, const qreal far_plane) {
+  if (near_plane != near_plane_ || far_plane != far_plane_) {
+    clearPoissonMeshCache();
+  }
   near_plane_ = near_plane;
   far_plane_ = far_plane;
 }
@@ -359,11 +417,17 @@ QImage ViewpointOffscreenRenderer::drawPoissonMesh(const QMatrix4x4& pvm_matrix,
 }
 
 QImage ViewpointOffscreenRenderer::drawPoissonMeshNormals(const Viewpoint& viewpoint, const bool clear_viewport) const {
+  if (isCpuRasterizerEnabled()) {
+    return convertRasterBuffersToNormalsImage(rasterizePoissonMesh(viewpoint));
+  }
   const QMatrix4x4 pvm_matrix = getPvmMatrixFromViewpoint(viewpoint);
   return drawPoissonMeshNormals(pvm_matrix, clear_viewport);
 }
 
 QImage ViewpointOffscreenRenderer::drawPoissonMeshNormals(const Pose& pose, const bool clear_viewport) const {
+  if (isCpuRasterizerEnabled()) {
+    return drawPoissonMeshNormals(Viewpoint(&camera_, pose), clear_viewport);
+  }
   const QMatrix4x4 pvm_matrix = getPvmMatrixFromPose(pose);
   return drawPoissonMeshNormals(pvm_matrix, clear_viewport);
 }
@@ -397,12 +461,19 @@ QImage ViewpointOffscreenRenderer::drawPoissonMeshNormals(const QMatrix4x4& pvm_
 }
 
 QImage ViewpointOffscreenRenderer::drawPoissonMeshDepth(const Viewpoint& viewpoint, const bool clear_viewport) const {
+  if (isCpuRasterizerEnabled()) {
+    const bool with_normals = false;
+    return convertRasterBuffersToDepthImage(rasterizePoissonMesh(viewpoint, with_normals));
+  }
   const QMatrix4x4 pvm_matrix = getPvmMatrixFromViewpoint(viewpoint);
   const QMatrix4x4 vm_matrix = getVmMatrixFromViewpoint(viewpoint);
   return drawPoissonMeshDepth(pvm_matrix, vm_matrix, clear_viewport);
 }
 
 QImage ViewpointOffscreenRenderer::drawPoissonMeshDepth(const Pose& pose, const bool clear_viewport) const {
+  if (isCpuRasterizerEnabled()) {
+    return drawPoissonMeshDepth(Viewpoint(&camera_, pose), clear_viewport);
+  }
   const QMatrix4x4 pvm_matrix = getPvmMatrixFromPose(pose);
   const QMatrix4x4 vm_matrix = getVmMatrixFromPose(pose);
   return drawPoissonMeshDepth(pvm_matrix, vm_matrix, clear_viewport);
@@ -499,31 +570,15 @@ Vector3 ViewpointOffscreenRenderer::computePoissonMeshNormalVector(
 Vector3 ViewpointOffscreenRenderer::computePoissonMeshNormalVector(
         const Viewpoint& viewpoint,
         const std::size_t x, const std::size_t y) const {
-  const Pose& pose = viewpoint.pose();
-  std::unique_lock<std::mutex> cache_lock(poisson_mesh_cache_mutex_);
-  if (!pose.isApprox(cached_poisson_mesh_normals_pose_) || cached_poisson_mesh_normals_image_.width() == 0) {
-//    std::cout << "Recomputing poisson mesh normals" << std::endl;
-    cached_poisson_mesh_normals_pose_ = pose;
-    cached_poisson_mesh_normals_image_ = drawPoissonMeshNormals(pose);
-//    BH_PRINT_VALUE(cached_poisson_mesh_normals_image_.width());
-//    BH_PRINT_VALUE(cached_poisson_mesh_normals_image_.height());
-    if (options_.dump_poisson_mesh_normals_image) {
-      cached_poisson_mesh_normals_image_.save("dump_poisson_mesh_normals_image.png");
-    }
-  }
-  cache_lock.unlock();
+  const std::shared_ptr<const RasterBuffers> buffers = getPoissonMeshBuffers(viewpoint);
 #if !BH_RELEASE
-  BH_ASSERT(x >= 0 && x < (std::size_t)cached_poisson_mesh_normals_image_.width());
-  BH_ASSERT(y >= 0 && y < (std::size_t)cached_poisson_mesh_normals_image_.height());
+  BH_ASSERT(x >= 0 && x < buffers->width());
+  BH_ASSERT(y >= 0 && y < buffers->height());
 #endif
-  QColor pixel = QColor(cached_poisson_mesh_normals_image_.pixel(x, y));
-  Vector3 normal_vector = Vector3(pixel.red(), pixel.green(), pixel.blue()) / 255.f;
-  normal_vector = 2 * (normal_vector - Vector3(0.5f, 0.5f, 0.5f));
-  if (normal_vector.squaredNorm() < 0.5f) {
-    normal_vector = Vector3::Zero();
+  if (!buffers->isValid(x, y)) {
+    return getBackgroundNormalVector();
   }
-  normal_vector.normalize();
-  return normal_vector;
+  return buffers->normal(x, y);
 }
 
 FloatType ViewpointOffscreenRenderer::computePoissonMeshDepth(
@@ -541,29 +596,189 @@ FloatType ViewpointOffscreenRenderer::computePoissonMeshDepth(
 FloatType ViewpointOffscreenRenderer::computePoissonMeshDepth(
         const Viewpoint& viewpoint,
         const std::size_t x, const std::size_t y) const {
-  const Pose& pose = viewpoint.pose();
-  std::unique_lock<std::mutex> cache_lock(poisson_mesh_cache_mutex_);
-  if (!pose.isApprox(cached_poisson_mesh_depth_pose_) || cached_poisson_mesh_depth_image_.width() == 0) {
-//    std::cout << "Recomputing poisson mesh depth" << std::endl;
-    cached_poisson_mesh_depth_pose_ = pose;
-    cached_poisson_mesh_depth_image_ = drawPoissonMeshDepth(pose);
-    if (options_.dump_poisson_mesh_depth_image) {
-      cached_poisson_mesh_depth_image_.save("dump_poisson_mesh_depth_image.png");
-      QImage rgb_depth_image = convertEncodedDepthImageToRGB(cached_poisson_mesh_depth_image_, 0, 100);
-      rgb_depth_image.save("dump_poisson_mesh_depth_rgb_image.png");
-    }
+  const std::shared_ptr<const RasterBuffers> buffers = getPoissonMeshBuffers(viewpoint);
 #if !BH_RELEASE
-    BH_ASSERT(cached_poisson_mesh_depth_image_.width() != 0);
-    BH_ASSERT(cached_poisson_mesh_depth_image_.height() != 0);
+  BH_ASSERT(x >= 0 && x < buffers->width());
+  BH_ASSERT(y >= 0 && y < buffers->height());
 #endif
+  if (!buffers->isValid(x, y)) {
+    return getBackgroundDepth();
+  }
+  return buffers->depth(x, y);
+}
+
+void ViewpointOffscreenRenderer::computePoissonMeshDepthsAndNormalVectors(
+        const Viewpoint& viewpoint,
+        const std::vector<Eigen::Vector2i>& image_points,
+        std::vector<FloatType>* depths,
+        std::vector<Vector3>* normal_vectors) const {
+  const std::shared_ptr<const RasterBuffers> buffers = getPoissonMeshBuffers(viewpoint);
+  const FloatType background_depth = getBackgroundDepth();
+  const Vector3 background_normal_vector = getBackgroundNormalVector();
+  depths->resize(image_points.size());
+  if (normal_vectors != nullptr) {
+    normal_vectors->resize(image_points.size());
   }
-  cache_lock.unlock();
+  for (size_t i = 0; i < image_points.size(); ++i) {
+    const size_t x = image_points[i](0);
+    const size_t y = image_points[i](1);
 #if !BH_RELEASE
-  BH_ASSERT(x >= 0 && x < (std::size_t)cached_poisson_mesh_depth_image_.width());
-  BH_ASSERT(y >= 0 && y < (std::size_t)cached_poisson_mesh_depth_image_.height());
+    BH_ASSERT(x < buffers->width());
+    BH_ASSERT(y < buffers->height());
 #endif
-  QColor pixel = QColor(cached_poisson_mesh_depth_image_.pixel(x, y));
-  return decodeDepthValue(pixel);
+    const bool valid = buffers->isValid(x, y);
+    (*depths)[i] = valid ? buffers->depth(x, y) : background_depth;
+    if (normal_vectors != nullptr) {
+      (*normal_vectors)[i] = valid ? buffers->normal(x, y) : background_normal_vector;
+    }
+  }
+}
+
+bool ViewpointOffscreenRenderer::isCpuRasterizerEnabled() const {
+  return static_cast<bool>(poisson_mesh_rasterizer_);
+}
+
+ViewpointOffscreenRenderer::RasterBuffers ViewpointOffscreenRenderer::rasterizePoissonMesh(
+        const Viewpoint& viewpoint, const bool with_normals) const {
+  BH_ASSERT(isCpuRasterizerEnabled());
+  return poisson_mesh_rasterizer_->render(
+          viewpoint.pose().getTransformationWorldToImage(), viewpoint.camera().intrinsics().topLeftCorner<3, 3>(),
+          viewpoint.camera().width(), viewpoint.camera().height(),
+          near_plane_, far_plane_, with_normals);
+}
+
+const ViewpointOffscreenRenderer::PoissonMeshCache& ViewpointOffscreenRenderer::getPoissonMeshCache() const {
+  return poisson_mesh_cache_;
+}
+
+void ViewpointOffscreenRenderer::clearPoissonMeshCache() {
+  poisson_mesh_cache_.clear();
+}
+
+std::shared_ptr<const ViewpointOffscreenRenderer::RasterBuffers> ViewpointOffscreenRenderer::getPoissonMeshBuffers(
+        const Viewpoint& viewpoint) const {
+  const Pose& pose = viewpoint.pose();
+  const size_t width = viewpoint.camera().width();
+  const size_t height = viewpoint.camera().height();
+  std::shared_ptr<const RasterBuffers> buffers = poisson_mesh_cache_.lookup(pose, width, height);
+  if (buffers) {
+    return buffers;
+  }
+  // Render without holding a cache lock. Concurrent misses for the same pose may render twice.
+  if (isCpuRasterizerEnabled()) {
+    buffers = std::make_shared<const RasterBuffers>(rasterizePoissonMesh(viewpoint));
+  }
+  else {
+    buffers = std::make_shared<const RasterBuffers>(renderPoissonMeshBuffersWithOpenGL(viewpoint));
+  }
+  if (options_.dump_poisson_mesh_normals_image) {
+    convertRasterBuffersToNormalsImage(*buffers).save("dump_poisson_mesh_normals_image.png");
+  }
+  if (options_.dump_poisson_mesh_depth_image) {
+    const QImage depth_image = convertRasterBuffersToDepthImage(*buffers);
+    depth_image.save("dump_poisson_mesh_depth_image.png");
+    convertEncodedDepthImageToRGB(depth_image, 0, 100).save("dump_poisson_mesh_depth_rgb_image.png");
+  }
+  poisson_mesh_cache_.insert(pose, width, height, buffers);
+  return buffers;
+}
+
+ViewpointOffscreenRenderer::RasterBuffers ViewpointOffscreenRenderer::renderPoissonMeshBuffersWithOpenGL(
+        const Viewpoint& viewpoint) const {
+  const QImage normals_image = drawPoissonMeshNormals(viewpoint.pose());
+  const QImage depth_image = drawPoissonMeshDepth(viewpoint.pose());
+#if !BH_RELEASE
+  BH_ASSERT(depth_image.width() != 0);
+  BH_ASSERT(depth_image.height() != 0);
+  BH_ASSERT(normals_image.width() == depth_image.width());
+  BH_ASSERT(normals_image.height() == depth_image.height());
+#endif
+  // Decode once into float buffers. Cleared pixels are kept with their decoded values.
+  const bool with_normals = true;
+  RasterBuffers buffers(depth_image.width(), depth_image.height(), with_normals);
+  for (int y = 0; y < depth_image.height(); ++y) {
+    const QRgb* depth_line = reinterpret_cast<const QRgb*>(depth_image.constScanLine(y));
+    const QRgb* normals_line = reinterpret_cast<const QRgb*>(normals_image.constScanLine(y));
+    for (int x = 0; x < depth_image.width(); ++x) {
+      const QRgb depth_pixel = depth_line[x];
+      const QRgb normal_pixel = normals_line[x];
+      buffers.setDepth(x, y, decodeDepthValue(bh::Color4<uint8_t>(
+              qRed(depth_pixel), qGreen(depth_pixel), qBlue(depth_pixel), qAlpha(depth_pixel))));
+      const Vector3 normal_color = Vector3(qRed(normal_pixel), qGreen(normal_pixel), qBlue(normal_pixel)) / 255.f;
+      buffers.setNormal(x, y, decodeNormalVector(normal_color));
+    }
+  }
+  return buffers;
+}
+
+QImage ViewpointOffscreenRenderer::convertRasterBuffersToNormalsImage(const RasterBuffers& buffers) const {
+  QImage image(buffers.width(), buffers.height(), QImage::Format_ARGB32);
+  const QColor background_pixel(
+          bh::clamp<int>(255 * clear_color_.r(), 0, 255),
+          bh::clamp<int>(255 * clear_color_.g(), 0, 255),
+          bh::clamp<int>(255 * clear_color_.b(), 0, 255));
+  for (size_t y = 0; y < buffers.height(); ++y) {
+    for (size_t x = 0; x < buffers.width(); ++x) {
+      if (!buffers.isValid(x, y)) {
+        image.setPixel(x, y, background_pixel.rgba());
+        continue;
+      }
+      // Same encoding as the normals shader
+      const Vector3 color = FloatType(0.5) * buffers.normal(x, y) + Vector3(0.5f, 0.5f, 0.5f);
+      const QColor pixel(
+              bh::clamp<int>(255 * color(0), 0, 255),
+              bh::clamp<int>(255 * color(1), 0, 255),
+              bh::clamp<int>(255 * color(2), 0, 255));
+      image.setPixel(x, y, pixel.rgba());
+    }
+  }
+  return image;
+}
+
+QImage ViewpointOffscreenRenderer::convertRasterBuffersToDepthImage(const RasterBuffers& buffers) const {
+  QImage image(buffers.width(), buffers.height(), QImage::Format_ARGB32);
+  const QColor background_pixel(
+          bh::clamp<int>(255 * clear_color_.r(), 0, 255),
+          bh::clamp<int>(255 * clear_color_.g(), 0, 255),
+          bh::clamp<int>(255 * clear_color_.b(), 0, 255));
+  for (size_t y = 0; y < buffers.height(); ++y) {
+    for (size_t x = 0; x < buffers.width(); ++x) {
+      if (!buffers.isValid(x, y)) {
+        image.setPixel(x, y, background_pixel.rgba());
+        continue;
+      }
+      const bh::Color4<uint8_t> color = encodeDepthValue(buffers.depth(x, y));
+      image.setPixel(x, y, QColor(color.r(), color.g(), color.b(), color.a()).rgba());
+    }
+  }
+  return image;
+}
+
+Vector3 ViewpointOffscreenRenderer::decodeNormalVector(const Vector3& color) const {
+  Vector3 normal_vector = 2 * (color - Vector3(0.5f, 0.5f, 0.5f));
+  if (normal_vector.squaredNorm() < 0.5f) {
+    normal_vector = Vector3::Zero();
+  }
+  normal_vector.normalize();
+  return normal_vector;
+}
+
+Vector3 ViewpointOffscreenRenderer::getBackgroundNormalVector() const {
+  // Equivalent to decoding a pixel of the cleared OpenGL normals image
+  const Vector3 color(
+          bh::clamp<int>(255 * clear_color_.r(), 0, 255) / 255.f,
+          bh::clamp<int>(255 * clear_color_.g(), 0, 255) / 255.f,
+          bh::clamp<int>(255 * clear_color_.b(), 0, 255) / 255.f);
+  return decodeNormalVector(color);
+}
+
+FloatType ViewpointOffscreenRenderer::getBackgroundDepth() const {
+  // Equivalent to decoding a pixel of the cleared OpenGL depth image
+  const bh::Color4<uint8_t> color(
+          static_cast<uint8_t>(bh::clamp<int>(255 * clear_color_.r(), 0, 255)),
+          static_cast<uint8_t>(bh::clamp<int>(255 * clear_color_.g(), 0, 255)),
+          static_cast<uint8_t>(bh::clamp<int>(255 * clear_color_.b(), 0, 255)), 255);
+  return decodeDepthValue(color);
 }
 
 bh::Color4<uint8_t> ViewpointOffscreenRenderer::encodeDepthValue(const FloatType depth) const {
@@ -9,9 +9,12 @@
 #pragma once
 
 #include <bh/color.h>
+#include <memory>
 #include <mutex>
 #include "viewpoint_planner_types.h"
 #include "viewpoint.h"
+#include "mesh_rasterizer.h"
+#include "render_buffer_cache.h"
 
 #if WITH_OPENGL_OFFSCREEN
 #include <QOpenGLContext>
@@ -31,11 +34,19 @@ namespace viewpoint_planner {
 class ViewpointOffscreenRenderer {
 public:
   using MeshType = ml::MeshData<FloatType>;
+  using MeshRasterizerType = MeshRasterizer<FloatType>;
+  using RasterBuffers = MeshRasterizerType::Buffers;
+  using PoissonMeshCache = RenderBufferCache<FloatType, RasterBuffers>;
 
   struct Options : bh::ConfigOptions {
     Options() {
       addOption<bool>("dump_poisson_mesh_normals_image", &dump_poisson_mesh_normals_image);
       addOption<bool>("dump_poisson_mesh_depth_image", &dump_poisson_mesh_depth_image);
+      addOption<bool>("poisson_mesh_cpu_rasterizer", &poisson_mesh_cpu_rasterizer);
+      addOption<size_t>("poisson_mesh_cpu_rasterizer_tile_size", &poisson_mesh_cpu_rasterizer_tile_size);
+      addOption<bool>("poisson_mesh_cpu_rasterizer_cull_backfaces", &poisson_mesh_cpu_rasterizer_cull_backfaces);
+      addOption<size_t>("poisson_mesh_cache_max_memory_mb", &poisson_mesh_cache_max_memory_mb);
+      addOption<size_t>("poisson_mesh_cache_num_shards", &poisson_mesh_cache_num_shards);
     }
 
     ~Options() override {}
@@ -44,6 +55,16 @@ public:
     bool dump_poisson_mesh_normals_image = false;
     // Whether to dump the poisson mesh depth image after rendering
     bool dump_poisson_mesh_depth_image = false;
+    // Whether to compute poisson mesh depth and normals with the CPU rasterizer instead of OpenGL
+    bool poisson_mesh_cpu_rasterizer = false;
+    // Tile size in pixels of the CPU rasterizer
+    size_t poisson_mesh_cpu_rasterizer_tile_size = 32;
+    // Whether the CPU rasterizer discards back-facing triangles (the OpenGL path renders both sides)
+    bool poisson_mesh_cpu_rasterizer_cull_backfaces = false;
+    // Memory budget of the cache of rendered poisson mesh depth and normal buffers (in MB)
+    size_t poisson_mesh_cache_max_memory_mb = 512;
+    // Number of independently locked shards of the poisson mesh buffer cache
+    size_t poisson_mesh_cache_num_shards = 16;
   };
 
   explicit ViewpointOffscreenRenderer(const PinholeCamera& camera, const MeshType* poisson_mesh);
@@ -137,6 +158,13 @@ public:
           const Viewpoint& viewpoint,
           const std::size_t x, const std::size_t y) const;
 
+  /// Look up poisson mesh depths and normal vectors for a batch of pixels with a single render or cache lookup
+  void computePoissonMeshDepthsAndNormalVectors(
+          const Viewpoint& viewpoint,
+          const std::vector<Eigen::Vector2i>& image_points,
+          std::vector<FloatType>* depths,
+          std::vector<Vector3>* normal_vectors) const;
+
   bh::Color4<uint8_t> encodeDepthValue(const FloatType depth) const;
 
   FloatType decodeDepthValue(const QImage& depth_image, const Vector2& image_point) const;
@@ -153,13 +181,42 @@ public:
 
   std::unordered_set<size_t> getVisibleTriangles(const QImage& mesh_indices_image) const;
 
+  bool isCpuRasterizerEnabled() const;
+
+  /// Render poisson mesh depth and normals with the CPU rasterizer (thread-safe, no OpenGL context needed)
+  RasterBuffers rasterizePoissonMesh(const Viewpoint& viewpoint, const bool with_normals = true) const;
+
+  /// Return depth and normal buffers of the poisson mesh for a viewpoint. Buffers are rendered on a cache miss.
+  std::shared_ptr<const RasterBuffers> getPoissonMeshBuffers(const Viewpoint& viewpoint) const;
+
+  const PoissonMeshCache& getPoissonMeshCache() const;
+
+  void clearPoissonMeshCache();
+
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
 private:
+  static PoissonMeshCache::Options getPoissonMeshCacheOptions(const Options& options);
+
+  void initializeCpuRasterizer();
+
+  /// Render normals and depth with OpenGL and decode them into float buffers
+  RasterBuffers renderPoissonMeshBuffersWithOpenGL(const Viewpoint& viewpoint) const;
+
+  QImage convertRasterBuffersToNormalsImage(const RasterBuffers& buffers) const;
+
+  QImage convertRasterBuffersToDepthImage(const RasterBuffers& buffers) const;
+
+  /// Normal vector corresponding to a pixel color of the normals image (components in [0, 1])
+  Vector3 decodeNormalVector(const Vector3& color) const;
+
+  Vector3 getBackgroundNormalVector() const;
+
+  FloatType getBackgroundDepth() const;
+
   Options options_;
 
   mutable std::mutex opengl_mutex_;
-  mutable std::mutex poisson_mesh_cache_mutex_;
 
   mutable QOpenGLContext* opengl_context_;
   mutable QOffscreenSurface* opengl_surface_;
@@ -169,10 +226,8 @@ private:
   bool antialiasing_;
   bh::Color4<FloatType> clear_color_;
 
-  mutable Pose cached_poisson_mesh_normals_pose_;
-  mutable QImage cached_poisson_mesh_normals_image_;
-  mutable Pose cached_poisson_mesh_depth_pose_;
-  mutable QImage cached_poisson_mesh_depth_image_;
+  std::unique_ptr<MeshRasterizerType> poisson_mesh_rasterizer_;
+  mutable PoissonMeshCache poisson_mesh_cache_;
 
   PinholeCamera camera_;
   qreal near_plane_;
@@ -129,11 +129,14 @@ void ViewpointPlanner::reset() {
   viewpoint_graph_components_.first.clear();
   viewpoint_graph_components_valid_ = false;
   viewpoint_graph_motions_.clear();
+  viewpoint_motion_dirty_set_.clear();
   viewpoint_count_grid_.setAllValues(0);
   grid_cell_probabilities_ = std::vector<FloatType>(viewpoint_count_grid_.getNumElements());
   std::fill(grid_cell_probabilities_.begin(), grid_cell_probabilities_.end(), 1 / FloatType(grid_cell_probabilities_.size()));
   cached_visible_sparse_points_.clear();
   cached_visible_voxels_.clear();
+  cached_visible_voxel_sketches_.clear();
+  sparse_matchability_graph_.clear();
   viewpoint_paths_initialized_ = false;
   viewpoint_paths_.clear();
   viewpoint_paths_.resize(options_.viewpoint_path_branches);
@@ -183,6 +186,11 @@ void ViewpointPlanner::resetViewpointPaths() {
   viewpoint_paths_.resize(options_.viewpoint_path_branches);
   viewpoint_paths_data_.clear();
   viewpoint_paths_data_.resize(options_.viewpoint_path_branches);
+  if (viewpoint_path_journal_) {
+    // The journal only records changes so it cannot continue after the paths were reset
+    std::cout << "WARNING: Closing viewpoint path journal because the viewpoint paths were reset" << std::endl;
+    viewpoint_path_journal_.reset();
+  }
   lock.unlock();
 }
 
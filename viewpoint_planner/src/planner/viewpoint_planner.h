@@ -10,6 +10,8 @@
 #include <bh/eigen.h>
 #include <bh/eigen_serialization.h>
 #include <memory>
+#include <mutex>
+#include <set>
 #include <unordered_set>
 #include <boost/functional/hash.hpp>
 #include <boost/archive/binary_iarchive.hpp>
@@ -22,6 +24,7 @@
 #include <bh/config_options.h>
 #include <bh/eigen_options.h>
 #include <bh/random.h>
+#include <bh/utilities.h>
 #include <bh/eigen_utils.h>
 #include <bh/graph_boost.h>
 #include <bh/math/continuous_grid3d.h>
@@ -38,6 +41,10 @@
 #include "viewpoint_score.h"
 #include "viewpoint_offscreen_renderer.h"
 #include "motion_planner.h"
+#include "voxel_set_sketch.h"
+#include "voxel_index_raycaster.h"
+#include "journal_file.h"
+#include "sparse_matchability_graph.h"
 
 using reconstruction::CameraId;
 using reconstruction::PinholeCameraColmap;
@@ -72,6 +79,11 @@ public:
       addOption<bool>("enable_opengl", &enable_opengl);
       addOption<bool>("dump_poisson_mesh_normals_image", &dump_poisson_mesh_normals_image);
       addOption<bool>("dump_poisson_mesh_depth_image", &dump_poisson_mesh_depth_image);
+      addOption<bool>("poisson_mesh_cpu_rasterizer", &poisson_mesh_cpu_rasterizer);
+      addOption<size_t>("poisson_mesh_cpu_rasterizer_tile_size", &poisson_mesh_cpu_rasterizer_tile_size);
+      addOption<bool>("poisson_mesh_cpu_rasterizer_cull_backfaces", &poisson_mesh_cpu_rasterizer_cull_backfaces);
+      addOption<size_t>("poisson_mesh_cache_max_memory_mb", &poisson_mesh_cache_max_memory_mb);
+      addOption<size_t>("poisson_mesh_cache_num_shards", &poisson_mesh_cache_num_shards);
       addOption<bool>("dump_stereo_matching_images", &dump_stereo_matching_images);
       addOption<size_t>("rng_seed", &rng_seed);
       addOption<FloatType>("virtual_camera_scale", &virtual_camera_scale);
@@ -130,6 +142,7 @@ public:
       addOption<FloatType>("viewpoint_motion_max_dist_square", &viewpoint_motion_max_dist_square);
       addOption<size_t>("viewpoint_motion_densification_max_depth", &viewpoint_motion_densification_max_depth);
       addOption<FloatType>("viewpoint_motion_penalty_per_graph_vertex", &viewpoint_motion_penalty_per_graph_vertex);
+      addOption<bool>("viewpoint_motion_incremental", &viewpoint_motion_incremental);
       addOption<size_t>("viewpoint_path_branches", &viewpoint_path_branches);
       addOption<FloatType>("viewpoint_path_initial_distance", &viewpoint_path_initial_distance);
       addOption<bool>("viewpoint_path_compute_connections_incremental", &viewpoint_path_compute_connections_incremental);
@@ -162,10 +175,25 @@ public:
       addOption<size_t>("sparse_matching_observation_count_threshold", &sparse_matching_observation_count_threshold);
       addOption<size_t>("sparse_matching_render_tree_depth", &sparse_matching_render_tree_depth);
       addOption<bool>("sparse_matching_dump_voxel_images", &sparse_matching_dump_voxel_images);
+      addOption<size_t>("sparse_matching_voxels_sketch_size", &sparse_matching_voxels_sketch_size);
+      addOption<FloatType>("sparse_matching_voxels_sketch_margin", &sparse_matching_voxels_sketch_margin);
+      addOption<bool>("sparse_matching_cpu_visible_voxels", &sparse_matching_cpu_visible_voxels);
+      addOption<bool>("sparse_matching_graph_precompute", &sparse_matching_graph_precompute);
       addOption<bool>("viewpoint_path_2opt_enable", &viewpoint_path_2opt_enable);
       addOption<size_t>("viewpoint_path_2opt_max_k_length", &viewpoint_path_2opt_max_k_length);
       addOption<bool>("viewpoint_path_2opt_check_sparse_matching", &viewpoint_path_2opt_check_sparse_matching);
+      addOption<bool>("viewpoint_path_lk_enable", &viewpoint_path_lk_enable);
+      addOption<size_t>("viewpoint_path_lk_num_candidate_neighbors", &viewpoint_path_lk_num_candidate_neighbors);
+      addOption<size_t>("viewpoint_path_lk_max_segment_length", &viewpoint_path_lk_max_segment_length);
+      addOption<size_t>("viewpoint_path_lk_num_trials", &viewpoint_path_lk_num_trials);
+      addOption<size_t>("viewpoint_path_lk_max_kicks_per_trial", &viewpoint_path_lk_max_kicks_per_trial);
+      addOption<FloatType>("viewpoint_path_lk_max_time", &viewpoint_path_lk_max_time);
+      addOption<bool>("viewpoint_path_lk_check_sparse_matching", &viewpoint_path_lk_check_sparse_matching);
+      addOption<bool>("viewpoint_path_lk_compare_with_2opt", &viewpoint_path_lk_compare_with_2opt);
       addOption<std::string>("viewpoint_graph_filename", &viewpoint_graph_filename);
+      addOption<bool>("viewpoint_graph_check_key", &viewpoint_graph_check_key);
+      addOption<bool>("viewpoint_graph_binary_format", &viewpoint_graph_binary_format);
+      addOption<FloatType>("viewpoint_path_journal_interval", &viewpoint_path_journal_interval);
       // TODO:
       addOption<size_t>("num_sampled_poses", &num_sampled_poses);
       addOption<size_t>("num_planned_viewpoints", &num_planned_viewpoints);
@@ -184,6 +212,16 @@ public:
     bool dump_poisson_mesh_normals_image = false;
     // Whether to dump the poisson mesh depth image after rendering
     bool dump_poisson_mesh_depth_image = false;
+    // Whether to compute poisson mesh depth and normals with the CPU rasterizer instead of OpenGL
+    bool poisson_mesh_cpu_rasterizer = false;
+    // Tile size in pixels of the CPU rasterizer
+    size_t poisson_mesh_cpu_rasterizer_tile_size = 32;
+    // Whether the CPU rasterizer discards back-facing triangles (the OpenGL path renders both sides)
+    bool poisson_mesh_cpu_rasterizer_cull_backfaces = false;
+    // Memory budget of the cache of rendered poisson mesh depth and normal buffers (in MB)
+    size_t poisson_mesh_cache_max_memory_mb = 512;
+    // Number of independently locked shards of the poisson mesh buffer cache
+    size_t poisson_mesh_cache_num_shards = 16;
     // Whether to write out stereo matching image pairs when generating viewpoint path
     bool dump_stereo_matching_images = false;
 
@@ -299,6 +337,8 @@ public:
     size_t viewpoint_motion_densification_max_depth = 5;
     // Motion penalty for each viewpoint graph vertex on a motion path
     FloatType viewpoint_motion_penalty_per_graph_vertex = 0;
+    // Whether to compute motions incrementally (only for new viewpoints against their nearest neighbors)
+    bool viewpoint_motion_incremental = false;
 
     // Number of viewpoint path branches to explore in parallel
     size_t viewpoint_path_branches = 10;
@@ -362,6 +402,18 @@ public:
     size_t sparse_matching_observation_count_threshold = 0;
     size_t sparse_matching_render_tree_depth = 14;
     bool sparse_matching_dump_voxel_images = false;
+    // Number of bins of the MinHash sketches of visible voxels (0 disables the approximate IOU filter).
+    // With sketches, pairs whose estimated IOU is further than sparse_matching_voxels_sketch_margin from the
+    // threshold are decided without the exact IOU, so a pair can be misclassified with a small probability
+    // (the standard error of the Jaccard estimate is about sqrt(J * (1 - J) / sketch_size)).
+    size_t sparse_matching_voxels_sketch_size = 0;
+    // Pairs with an estimated IOU within this margin of the threshold are checked exactly
+    FloatType sparse_matching_voxels_sketch_margin = FloatType(0.15);
+    // Compute visible voxels by raycasting on the CPU instead of OpenGL index rendering (no OpenGL context needed)
+    bool sparse_matching_cpu_visible_voxels = false;
+    // Precompute the sparse matching scores of all viewpoint pairs within the sparse matching limits
+    // (when loading a viewpoint graph without a stored matchability graph)
+    bool sparse_matching_graph_precompute = false;
 
     // Whether to enable 2 Opt
     bool viewpoint_path_2opt_enable = true;
@@ -370,8 +422,32 @@ public:
     // Whether sparse matchability is checked for 2 Opt
     bool viewpoint_path_2opt_check_sparse_matching = true;
 
+    // Whether to improve the viewpoint tour with chained Lin-Kernighan style local search (replaces 2 Opt)
+    bool viewpoint_path_lk_enable = false;
+    // Number of nearest neighbors (in motion distance) considered for improving moves
+    size_t viewpoint_path_lk_num_candidate_neighbors = 10;
+    // Maximum segment length that is moved by Or-Opt
+    size_t viewpoint_path_lk_max_segment_length = 3;
+    // Number of randomized trials (run in parallel)
+    size_t viewpoint_path_lk_num_trials = 8;
+    // Maximum number of double-bridge kicks per trial
+    size_t viewpoint_path_lk_max_kicks_per_trial = 1000;
+    // Time budget for tour improvement in seconds (0 for no limit)
+    FloatType viewpoint_path_lk_max_time = 1;
+    // Whether connections that are not sparse matchable are penalized
+    bool viewpoint_path_lk_check_sparse_matching = true;
+    // Whether to also run 2 Opt on the same tour and report tour lengths and runtimes of both
+    bool viewpoint_path_lk_compare_with_2opt = false;
+
     // Filename of serialized viewpoint graph
     std::string viewpoint_graph_filename = "";
+    // Whether to discard a loaded viewpoint graph that was computed from different precomputations or options
+    bool viewpoint_graph_check_key = true;
+    // Whether to save the viewpoint graph in the chunked binary format instead of a boost archive.
+    // Both formats are detected on load. Existing graph files can be converted with --convert-viewpoint-graph-file.
+    bool viewpoint_graph_binary_format = false;
+    // Minimum time in seconds between two checkpoints in the viewpoint path journal
+    FloatType viewpoint_path_journal_interval = 60;
 
     // TODO: Needed?
     size_t num_sampled_poses = 100;
@@ -757,6 +833,8 @@ public:
 
   using ViewpointGraph = bh::Graph<ViewpointEntryIndex, FloatType>;
   using ViewpointANN = bh::ApproximateNearestNeighbor<FloatType, 3>;
+  using VoxelSetSketchType = VoxelSetSketch<FloatType>;
+  using SparseMatchabilityGraphType = SparseMatchabilityGraph<FloatType>;
   using FeatureViewpointMap = std::unordered_map<size_t, std::vector<const Viewpoint*>>;
 
 
@@ -812,14 +890,40 @@ public:
 
   void setViewpointPathTimeConstraint(const FloatType time_constraint);
 
+  /// Key of the inputs of the viewpoint graph (precomputations of the planner data and the relevant options)
+  PrecomputationKey computeViewpointGraphKey() const;
+
   void saveViewpointGraph(const std::string& filename) const;
 
-  void loadViewpointGraph(const std::string& filename);
+  /// Save the viewpoint graph in the chunked binary format (binary_format = true) or as a boost archive
+  void saveViewpointGraph(const std::string& filename, const bool binary_format) const;
+
+  /// Load a viewpoint graph. Returns false if the graph was discarded because its key does not match.
+  bool loadViewpointGraph(const std::string& filename);
+
+  /// Load a viewpoint graph and only discard it on a key mismatch if check_key is true
+  bool loadViewpointGraph(const std::string& filename, const bool check_key);
+
+  /// Save only the sparse matchability graph that is stored alongside a viewpoint graph
+  void saveSparseMatchabilityGraphOfViewpointGraph(const std::string& viewpoint_graph_filename) const;
 
   void saveViewpointPath(const std::string& filename) const;
 
   void loadViewpointPath(const std::string& filename);
 
+  /// Start journaling the viewpoint path computation. Checkpoints only contain the changes since the previous
+  /// checkpoint (new path entries, observed voxel information, new motions and viewpoints).
+  /// If resume is true and the journal exists, its complete checkpoints are replayed first and new checkpoints
+  /// are appended. Returns the number of replayed checkpoints.
+  std::size_t openViewpointPathJournal(const std::string& filename, const bool resume);
+
+  /// Write a checkpoint to the viewpoint path journal (if one is open).
+  /// Unless force is true a checkpoint is only written every viewpoint_path_journal_interval seconds.
+  void writeViewpointPathCheckpoint(const bool force = false);
+
+  /// Write a final checkpoint and close the viewpoint path journal
+  void closeViewpointPathJournal();
+
   rapidjson::Document getViewpointPathAsJson(const ViewpointPath& viewpoint_path) const;
 
   std::string getViewpointPathAsJsonString(const ViewpointPath& viewpoint_path) const;
@@ -832,6 +936,10 @@ public:
 
   bool isSparsePointVisible(const Viewpoint& viewpoint, const Point3D& point3d) const;
 
+  /// Project a sparse point into the image. Returns false if it is behind the camera or outside of the viewport.
+  bool projectSparsePoint(const Viewpoint& viewpoint, const Point3D& point3d,
+                          Eigen::Vector2i* image_point, FloatType* point_depth) const;
+
 //  bool isSparsePointMatchable(const Viewpoint& viewpoint1, const Viewpoint& viewpoint2, const Point3D& point3d) const;
 
   bool isSparsePointMatchable(const Viewpoint& viewpoint1, const Viewpoint& viewpoint2,
@@ -893,6 +1001,21 @@ public:
 
   const std::unordered_set<size_t>& getCachedVisibleVoxels(const ViewpointEntryIndex viewpoint_index) const;
 
+  // Compute and cache visible voxels for multiple viewpoint entries (in parallel with the CPU backend)
+  void cacheVisibleVoxels(const std::vector<ViewpointEntryIndex>& viewpoint_indices) const;
+
+  // Return MinHash sketch of the visible voxels of a viewpoint entry (computes them if not already cached)
+  const VoxelSetSketchType& getCachedVisibleVoxelSketch(const ViewpointEntryIndex viewpoint_index) const;
+
+  /// Compute overlap score of two visible voxel sets that is compared to the sparse matching IOU thresholds
+  static FloatType computeSparseMatchingVoxelsIoU(
+          const std::unordered_set<size_t>& visible_voxels1, const std::unordered_set<size_t>& visible_voxels2);
+
+  /// Compute sparse matching scores of all viewpoint pairs within the sparse matching limits
+  void computeSparseMatchabilityGraph();
+
+  const SparseMatchabilityGraphType& getSparseMatchabilityGraph() const;
+
 //  FloatType computeSparseMatchingScore(
 //          const Viewpoint& ref_viewpoint, const Viewpoint& other_viewpoint,
 //          const std::unordered_set<Point3DId>& ref_visible_points,
@@ -976,6 +1099,13 @@ public:
           const std::unordered_set<size_t>& visible_voxels2,
           const FloatType iou_threshold) const;
 
+  /// Same as above but uses the precomputed sketch of viewpoint2 to skip the exact intersection for clear cases
+  bool isSparseMatchable2(
+          const ViewpointEntryIndex viewpoint_index1,
+          const Viewpoint& viewpoint2,
+          const std::unordered_set<size_t>& visible_voxels2,
+          const VoxelSetSketchType& visible_voxels_sketch2) const;
+
   void augmentViewpointPathWithSparseMatchingViewpoints(ViewpointPath* viewpoint_path);
 
   void makeViewpointMotionsSparseMatchable(ViewpointPath* viewpoint_path);
@@ -1217,6 +1347,13 @@ public:
   /// Compute motions from a viewpoint to other viewpoint and update the graph with their cost.
   size_t computeViewpointMotions(const ViewpointEntryIndex from_index, const bool verbose = false);
 
+  /// Compute motions only for viewpoints that were added since the last motion computation.
+  /// Motions to neighbors that are already connected are not recomputed. Returns the number of new motions.
+  size_t updateViewpointMotions(const bool verbose = false);
+
+  /// Number of viewpoints that still need motions to be computed
+  size_t getNumOfViewpointsWithoutMotions() const;
+
   bool connectViewpoints(
           const ViewpointEntryIndex from_viewpoint_index,
           const ViewpointEntryIndex to_viewpoint_index,
@@ -1363,6 +1500,12 @@ public:
 
   std::unordered_set<size_t> getVisibleVoxels(const Viewpoint& viewpoint) const;
 
+  std::unordered_set<size_t> getVisibleVoxelsOpenGL(const Viewpoint& viewpoint) const;
+
+  std::unordered_set<size_t> getVisibleVoxelsCpu(const Viewpoint& viewpoint) const;
+
+  void ensureVisibleVoxelRaycasterIsInitialized() const;
+
   // Raycasting and information computation
 
   /// Return viewpoint with virtual camera
@@ -1501,7 +1644,57 @@ public:
   FloatType computePoissonMeshDepth(const Viewpoint& viewpoint,
                                          const size_t x, const size_t y) const;
 
+  /// Look up poisson mesh depths and normal vectors of many pixels with a single render (normals are optional)
+  void computePoissonMeshDepthsAndNormalVectors(const Viewpoint& viewpoint,
+                                                const std::vector<Eigen::Vector2i>& image_points,
+                                                std::vector<FloatType>* depths,
+                                                std::vector<Vector3>* normal_vectors) const;
+
 private:
+  /// Try to decide sparse matchability from the visible voxel sketches alone.
+  /// Returns false if the estimate is too close to the threshold and the exact intersection is needed.
+  bool decideSparseMatchableWithSketches(
+          const VoxelSetSketchType& sketch1, const VoxelSetSketchType& sketch2,
+          const FloatType iou_threshold, bool* matchable) const;
+
+  /// Filename of the motion roadmap that is stored alongside a viewpoint graph
+  static std::string getMotionRoadmapFilename(const std::string& viewpoint_graph_filename);
+
+  /// Filename of the sparse matchability graph that is stored alongside a viewpoint graph
+  static std::string getSparseMatchabilityGraphFilename(const std::string& viewpoint_graph_filename);
+
+  /// Filename of the approximate nearest neighbor index that is stored alongside a binary viewpoint graph
+  static std::string getViewpointAnnFilename(const std::string& viewpoint_graph_filename);
+
+  /// Whether a viewpoint graph file is in the chunked binary format
+  static bool isBinaryViewpointGraphFile(const std::string& filename);
+
+  void saveViewpointGraphArchive(const std::string& filename) const;
+
+  /// Save the viewpoint graph as a chunked binary file with one array per attribute
+  void saveViewpointGraphBinary(const std::string& filename) const;
+
+  void loadViewpointGraphArchive(const std::string& filename);
+
+  /// Load a chunked binary viewpoint graph. Entries and motions are reconstructed in parallel and the
+  /// nearest neighbor index and viewpoint count grid are restored instead of being rebuilt.
+  void loadViewpointGraphBinary(const std::string& filename);
+
+  /// Header of a viewpoint path journal describing the state that the journal starts from
+  std::string getViewpointPathJournalHeader() const;
+
+  /// Apply the records of a checkpoint from the viewpoint path journal
+  void applyViewpointPathCheckpoint(const std::vector<JournalFile::Record>& records,
+                                    const std::vector<const VoxelType*>& voxels);
+
+  /// Key of the inputs of the sparse matchability graph (viewpoint graph inputs, viewpoint poses and
+  /// sparse matching parameters) to detect stale files
+  PrecomputationKey computeSparseMatchabilityGraphKey() const;
+
+  void saveSparseMatchabilityGraph(const std::string& filename) const;
+
+  bool loadSparseMatchabilityGraph(const std::string& filename);
+
   /// Remove invalid hit voxels from raycast results
   void removeInvalidRaycastHitVoxels(
           std::vector<OccupiedTreeType::IntersectionResult>* raycast_results) const;
@@ -1601,12 +1794,23 @@ private:
       const bool ignore_sparse_matching = false,
       const bool ignore_graph_component = false);
 
+  /// Validate straight motions to all neighbors (within the maximum motion distance) in one batch.
+  std::vector<bool> validateStraightViewpointMotions(
+          const Vector3& from_position,
+          const std::vector<ViewpointANN::IndexType>& to_indices,
+          const std::vector<ViewpointANN::DistanceType>& to_dist_squares) const;
+
+  /// Find a motion. If the straight motion has already been validated only the fallback planners are used.
+  std::pair<SE3Motion, bool> findMotionWithStraightValidation(
+          const Pose& from, const Pose& to, const bool straight_valid) const;
+
   std::vector<std::pair<ViewpointEntryIndex, SE3Motion>> findSE3Motions(
           const Pose& from_pose);
 
   /// Find motion paths from provided viewpoint to neighbors in the viewpoint graph.
   std::vector<ViewpointMotion> findViewpointMotions(
-          const ViewpointEntryIndex from_index, const bool verbose = false);
+          const ViewpointEntryIndex from_index, const bool verbose = false,
+          const bool skip_existing_motions = false);
 
   /// Checks whether a voxel can be triangulated on the viewpoint path
   std::pair<bool, ViewpointEntryIndex> canVoxelBeTriangulated(const ViewpointPath& viewpoint_path, const ViewpointPathComputationData& comp_data,
@@ -1654,9 +1858,27 @@ private:
   /// Reorders the viewpoint path to an approx. shortest cycle covering all viewpoints (i.e. TSP solution)
   bool solveApproximateTSP(ViewpointPath* viewpoint_path, ViewpointPathComputationData* comp_data);
 
+  /// Improve the viewpoint tour with the enabled methods (2 Opt and/or Lin-Kernighan style local search)
+  void improveViewpointTour(ViewpointPath* viewpoint_path, ViewpointPathComputationData* comp_data);
+
   /// Uses 2 Opt to improve the viewpoint tour
   void improveViewpointTourWith2Opt(ViewpointPath* viewpoint_path, ViewpointPathComputationData* comp_data);
 
+  /// Uses chained Lin-Kernighan style local search (2 Opt and Or-Opt moves) on the motion distances
+  /// to improve the viewpoint tour
+  void improveViewpointTourWithLK(ViewpointPath* viewpoint_path);
+
+  /// Same as above with a cost matrix from computeViewpointPathCostMatrix()
+  void improveViewpointTourWithLK(ViewpointPath* viewpoint_path, const std::vector<FloatType>& cost_matrix);
+
+  /// Compute matrix of motion distances between all entries of a viewpoint path (row-major).
+  /// Connections without a motion or without sparse matchability (if enabled) are penalized.
+  std::vector<FloatType> computeViewpointPathCostMatrix(
+      const ViewpointPath& viewpoint_path, const bool penalize_non_sparse_matchable) const;
+
+  /// Cost of a closed tour on a cost matrix from computeViewpointPathCostMatrix()
+  FloatType computeTourCost(const std::vector<FloatType>& cost_matrix, const std::vector<size_t>& order) const;
+
   /// Find shortest motion between two viewpoints using A-Star on the viewpoint graph.
   ViewpointMotion findShortestMotionAStar(const ViewpointEntryIndex from_index, const ViewpointEntryIndex to_index) const;
 
@@ -1705,8 +1927,11 @@ private:
 
   mutable std::unique_ptr<bh::opengl::OffscreenOpenGL<FloatType>> offscreen_opengl_;
   mutable std::unique_ptr<rendering::OcTreeDrawer> octree_drawer_;
+  // CPU raycaster over the voxels that the octree drawer renders (same indices)
+  mutable std::unique_ptr<VoxelIndexRaycaster<FloatType>> visible_voxel_raycaster_;
+  mutable std::once_flag visible_voxel_raycaster_once_flag_;
 
-  std::mutex mutex_;
+  mutable std::mutex mutex_;
 
   MotionPlannerType motion_planner_;
 
@@ -1724,8 +1949,12 @@ private:
   mutable std::mutex cached_visible_sparse_points_mutex_;
   // Cached visible voxels
   mutable std::unordered_map<ViewpointEntryIndex, std::unordered_set<size_t>> cached_visible_voxels_;
+  // Cached MinHash sketches of the visible voxels (protected by cached_visible_voxels_mutex_)
+  mutable std::unordered_map<ViewpointEntryIndex, VoxelSetSketchType> cached_visible_voxel_sketches_;
   // Mutex for cached visible sparse points
   mutable std::mutex cached_visible_voxels_mutex_;
+  // Precomputed sparse matching scores of viewpoint pairs
+  SparseMatchabilityGraphType sparse_matchability_graph_;
   // Number of real viewpoints at the beginning of the viewpoint_entries_ vector
   // These need to be distinguished because they could be in non-free space of the map
   size_t num_real_viewpoints_;
@@ -1747,12 +1976,27 @@ private:
   mutable bool viewpoint_graph_components_valid_;
   // Motion description of the connections in the viewpoint graph (indexed by viewpoint id pair)
   std::unordered_map<ViewpointIndexPair, ViewpointMotion, ViewpointIndexPair::Hash> viewpoint_graph_motions_;
+  // Viewpoints that were added since the last motion computation
+  std::set<ViewpointEntryIndex> viewpoint_motion_dirty_set_;
   /// Flag indicating whether viewpoint paths have been initialized
   bool viewpoint_paths_initialized_;
   // Current viewpoint paths
   std::vector<ViewpointPath> viewpoint_paths_;
   // Data used for computation of viewpoint paths
   std::vector<ViewpointPathComputationData> viewpoint_paths_data_;
+  // State of the viewpoint path journal (what has already been written)
+  struct ViewpointPathJournalState {
+    std::unique_ptr<JournalFileWriter> writer;
+    // Time since the last checkpoint
+    bh::Timer timer;
+    size_t num_viewpoint_entries;
+    std::vector<size_t> num_path_entries;
+    // Motions that are part of the viewpoint graph or have been written
+    std::unordered_set<ViewpointIndexPair, ViewpointIndexPair::Hash> motions;
+    // Consistent ordering of BVH nodes for voxel references
+    std::unordered_map<const VoxelType*, uint32_t> voxel_indices;
+  };
+  std::unique_ptr<ViewpointPathJournalState> viewpoint_path_journal_;
   // Map from triangle index to viewpoints that project features into it
   FeatureViewpointMap feature_viewpoint_map_;
 
@@ -10,13 +10,24 @@
 #include <boost/archive/binary_oarchive.hpp>
 #include <boost/property_tree/json_parser.hpp>
 #include <boost/assign/list_of.hpp>
+#include <array>
+#include <atomic>
+#include <future>
+#include <mutex>
+#include <numeric>
+#include <thread>
+#include <unordered_map>
 #include <bh/common.h>
 #include <bh/eigen.h>
 #include <bh/gps.h>
 #include <bh/math/geometry.h>
 #include <bh/nn/approximate_nearest_neighbor.h>
+#include <bh/thread.h>
+#include <bh/utilities.h>
 #include <bh/vision/cameras.h>
 #include "viewpoint_planner_data.h"
+#include "../octree/occupancy_map_snapshot.h"
+#include "distance_transform.h"
 #include "viewpoint.h"
 #include "viewpoint_raycast.h"
 #include "viewpoint_score.h"
@@ -122,27 +133,54 @@ ViewpointPlannerData::ViewpointPlannerData(const Options* options)
     df_filename = mesh_filename + ".df.bs";
   }
 
+  // Artifacts are only regenerated if the content hash of their inputs changed
+  bh::Timer key_timer;
+  const CacheKeys keys = computeCacheKeys(raw_octree_filename, mesh_filename);
+  key_timer.printTimingMs("Computing precomputation keys");
+  const bool df_up_to_date = options_.use_distance_field && !options_.regenerate_distance_field
+      && keys.distance_field.matchesArtifact(df_filename);
+  const std::string weights_key_suffix = ".weights.key";
+  bool update_weights = options_.force_weights_update
+      || !keys.weights.matchesArtifact(octree_filename, weights_key_suffix);
+  if (update_weights) {
+    // Any regenerated artifact has to go through the weight update before the weights are valid
+    PrecomputationKey::removeForArtifact(octree_filename, weights_key_suffix);
+  }
+
+  // Input files and cached artifacts that do not depend on each other are read in parallel.
+  // The BVH tree needs the octree and the mesh, a regenerated distance field needs the grid of the BVH tree.
+  const std::launch launch_policy = options_.parallel_startup ? std::launch::async : std::launch::deferred;
+  std::future<void> dense_points_future;
   if (!dense_points_filename.empty()) {
-    readDensePoints(dense_points_filename);
+    dense_points_future = std::async(launch_policy, [&]() {
+      readDensePoints(dense_points_filename);
+    });
+  }
+  std::future<void> mesh_future = std::async(launch_policy, [&]() {
+    readPoissonMesh(mesh_filename);
+  });
+  std::future<bool> df_future;
+  if (df_up_to_date) {
+    df_future = std::async(launch_policy, [&]() {
+      return readMeshDistanceField(df_filename, keys.distance_field);
+    });
   }
-  readPoissonMesh(mesh_filename);
-  bool augmented_octree_generated = readAndAugmentOctree(octree_filename, raw_octree_filename);
-  bool bvh_generated = readBVHTree(bvh_filename, octree_filename);
+  const bool augmented_octree_generated = readAndAugmentOctree(octree_filename, raw_octree_filename, keys.octree);
+  mesh_future.get();
+  const bool bvh_generated = readBVHTree(bvh_filename, keys.bvh);
   generateWeightGrid();
   bool df_generated = false;
-  if (options_.use_distance_field) {
-    df_generated = readMeshDistanceField(df_filename, mesh_filename);
+  if (df_future.valid()) {
+    df_generated = df_future.get();
   }
-  bool update_weights = augmented_octree_generated || bvh_generated || df_generated
-      || options_.force_weights_update;
-  if (!options_.regions_json_filename.empty()) {
-    if (getLastWriteTime(options_.regions_json_filename) > getLastWriteTime(bvh_filename)) {
-      update_weights = true;
-    }
-    else if (getLastWriteTime(options_.regions_json_filename) > getLastWriteTime(octree_filename)) {
-      update_weights = true;
-    }
+  else if (options_.use_distance_field) {
+    df_generated = readMeshDistanceField(df_filename, keys.distance_field);
   }
+  if (dense_points_future.valid()) {
+    dense_points_future.get();
+  }
+
+  update_weights = update_weights || augmented_octree_generated || bvh_generated || df_generated;
   if (update_weights) {
     std::cout << "Updating weights" << std::endl;
     updateWeights();
@@ -150,10 +188,92 @@ ViewpointPlannerData::ViewpointPlannerData(const Options* options)
       updateWeightsWithRealViewpoints();
     }
     std::cout << "Writing updated augmented octree" << std::endl;
-    octree_->write(octree_filename);
+    keys.octree.writeArtifact(octree_filename, [&]() {
+      octree_->write(octree_filename);
+    });
     std::cout << "Writing updated BVH tree" << std::endl;
-    writeBVHTree(bvh_filename);
+    keys.bvh.writeArtifact(bvh_filename, [&]() {
+      writeBVHTree(bvh_filename);
+    });
+    keys.weights.writeForArtifact(octree_filename, weights_key_suffix);
+  }
+  // The snapshot is written only once the weights are final
+  const std::string snapshot_filename = octree_filename + ".snapshot";
+  if (options_.use_octree_snapshot && (update_weights || !keys.octree.matchesArtifact(snapshot_filename))) {
+    std::cout << "Writing augmented tree snapshot [" << snapshot_filename << "]" << std::endl;
+    keys.octree.writeArtifact(snapshot_filename, [&]() {
+      OccupancyMapSnapshot::write(*octree_, snapshot_filename);
+    });
+  }
+  cache_key_ = keys.weights;
+  std::cout << "Precomputation key: " << cache_key_.toString() << std::endl;
+}
+
+ViewpointPlannerData::CacheKeys ViewpointPlannerData::computeCacheKeys(
+    const std::string& raw_octree_filename, const std::string& mesh_filename) const {
+  // Hashing the large input files dominates, so the mesh is hashed in the background
+  const std::launch launch_policy = options_.parallel_startup ? std::launch::async : std::launch::deferred;
+  std::future<PrecomputationKey> mesh_key_future = std::async(launch_policy, [&]() {
+    PrecomputationKey mesh_key("poisson_mesh");
+    mesh_key.addFile(mesh_filename);
+    return mesh_key;
+  });
+  PrecomputationKey raw_octree_key("raw_octree");
+  raw_octree_key.addFile(raw_octree_filename);
+  const PrecomputationKey mesh_key = mesh_key_future.get();
+
+  CacheKeys keys{
+    PrecomputationKey("augmented_octree"),
+    PrecomputationKey("bvh_tree"),
+    PrecomputationKey("distance_field"),
+    PrecomputationKey("weights")};
+  keys.octree.addKey(raw_octree_key)
+      .addValue(options_.obstacle_free_height)
+      .addValue(bvh_bbox_.getMinimum(0))
+      .addValue(bvh_bbox_.getMinimum(1))
+      .addValue(bvh_bbox_.getMinimum(2))
+      .addValue(bvh_bbox_.getMaximum(0))
+      .addValue(bvh_bbox_.getMaximum(1))
+      .addValue(bvh_bbox_.getMaximum(2));
+
+  keys.bvh.addKey(keys.octree)
+      .addKey(mesh_key)
+      .addValue(options_.bvh_normal_mesh_knn)
+      .addValue(options_.bvh_normal_mesh_max_dist)
+      .addValue(options_.enable_opengl);
+
+  // The distance field grid is spanned by the bounding box of the BVH tree
+  keys.distance_field.addKey(keys.bvh)
+      .addKey(mesh_key)
+      .addValue(options_.grid_dimension)
+      .addValue(options_.distance_field_cutoff)
+      .addValue(options_.distance_field_exact_transform)
+      .addValue(options_.distance_field_exact_seeding);
+
+  keys.weights.addKey(keys.bvh)
+      .addValue(options_.use_distance_field)
+      .addValue(options_.grid_dimension)
+      .addValue(options_.roi_falloff_distance)
+      .addValue(options_.weight_falloff_quadratic)
+      .addValue(options_.weight_falloff_distance_start)
+      .addValue(options_.voxel_information_lambda)
+      .addValue(options_.ignore_real_observed_voxels)
+      .addValue(options_.invalid_pixel_observation_factor)
+      .addValue(options_.real_observed_voxels_raycast_min_range)
+      .addValue(options_.real_observed_voxels_raycast_max_range);
+  // The observed voxels depend on the poses and depth maps of the dense reconstruction
+  const std::string reconstruction_path = options_.getValue<std::string>("dense_reconstruction_path");
+  if (!reconstruction_path.empty()) {
+    keys.weights.addDirectoryMetadata(reconstruction_path)
+        .addValue(options_.getValue<bool>("dense_reconstruction_has_gps"));
+  }
+  if (options_.use_distance_field) {
+    keys.weights.addKey(keys.distance_field);
+  }
+  if (!options_.regions_json_filename.empty()) {
+    keys.weights.addFile(options_.regions_json_filename);
   }
+  return keys;
 }
 
 ViewpointPlannerData::RegionType ViewpointPlannerData::convertGpsRegionToEnuRegion(const boost::property_tree::ptree& pt) const {
@@ -234,6 +354,113 @@ bool ViewpointPlannerData::isValidObjectPosition(const Vector3& position, const
   }
 }
 
+bool ViewpointPlannerData::isValidObjectSegmentRegion(const Vector3& from, const Vector3& to,
+                                                      const BoundingBoxType& object_bbox,
+                                                      const bool ignore_no_fly_zones,
+                                                      std::pair<Vector3, Vector3>* lower_segment,
+                                                      bool* has_lower_segment) const {
+  *has_lower_segment = false;
+  if (!ignore_no_fly_zones && !no_fly_zones_.empty()) {
+    const FloatType distance = (to - from).norm();
+    const FloatType step_distance = object_bbox.getMinExtent() / FloatType(2.0);
+    const std::size_t num_steps = static_cast<std::size_t>(std::ceil(distance / step_distance));
+    for (std::size_t i = 0; i <= num_steps; ++i) {
+      const FloatType fraction = num_steps > 0 ? i / FloatType(num_steps) : 0;
+      const Vector3 position = from + fraction * (to - from);
+      for (const RegionType &no_fly_zone : no_fly_zones_) {
+        if (no_fly_zone.isPointInside(position)) {
+          return false;
+        }
+      }
+    }
+  }
+  // Bounding boxes are convex so it is enough to check the end points of the parts
+  // above and below the obstacle free height.
+  const FloatType obstacle_free_height = options_.obstacle_free_height;
+  const BoundingBoxType& bvh_root_bbox = occupied_bvh_.getRoot()->getBoundingBox();
+  const bool from_above = from(2) >= obstacle_free_height;
+  const bool to_above = to(2) >= obstacle_free_height;
+  if (from_above && to_above) {
+    return bvh_bbox_.isInside(from) && bvh_bbox_.isInside(to);
+  }
+  else if (!from_above && !to_above) {
+    if (!bvh_root_bbox.isInside(from) || !bvh_root_bbox.isInside(to)) {
+      return false;
+    }
+    *lower_segment = std::make_pair(from, to);
+    *has_lower_segment = true;
+    return true;
+  }
+  const Vector3& lower_position = from_above ? to : from;
+  const Vector3& upper_position = from_above ? from : to;
+  const FloatType t = (obstacle_free_height - lower_position(2)) / (upper_position(2) - lower_position(2));
+  Vector3 crossing_position = lower_position + t * (upper_position - lower_position);
+  crossing_position(2) = obstacle_free_height;
+  if (!bvh_bbox_.isInside(upper_position) || !bvh_bbox_.isInside(crossing_position)) {
+    return false;
+  }
+  if (!bvh_root_bbox.isInside(lower_position) || !bvh_root_bbox.isInside(crossing_position)) {
+    return false;
+  }
+  *lower_segment = std::make_pair(lower_position, crossing_position);
+  *has_lower_segment = true;
+  return true;
+}
+
+ViewpointPlannerData::BoundingBoxType ViewpointPlannerData::getObstacleClipBoundingBox() const {
+  const BoundingBoxType& bvh_root_bbox = occupied_bvh_.getRoot()->getBoundingBox();
+  Vector3 clip_maximum = bvh_root_bbox.getMaximum();
+  clip_maximum(2) = std::min(clip_maximum(2), options_.obstacle_free_height);
+  return BoundingBoxType(bvh_root_bbox.getMinimum(), clip_maximum);
+}
+
+bool ViewpointPlannerData::isValidObjectSegment(const Vector3& from, const Vector3& to,
+                                                const BoundingBoxType& object_bbox,
+                                                const bool ignore_no_fly_zones) const {
+  std::pair<Vector3, Vector3> lower_segment;
+  bool has_lower_segment;
+  if (!isValidObjectSegmentRegion(from, to, object_bbox, ignore_no_fly_zones, &lower_segment, &has_lower_segment)) {
+    return false;
+  }
+  if (!has_lower_segment) {
+    return true;
+  }
+  return !occupied_bvh_.intersectsSweptBBox(
+      object_bbox, lower_segment.first, lower_segment.second, getObstacleClipBoundingBox());
+}
+
+std::vector<bool> ViewpointPlannerData::areValidObjectSegments(const Vector3& from,
+                                                               const std::vector<Vector3>& to_positions,
+                                                               const BoundingBoxType& object_bbox,
+                                                               const bool ignore_no_fly_zones) const {
+  std::vector<bool> valid_flags(to_positions.size(), false);
+  std::vector<std::pair<Vector3, Vector3>> lower_segments;
+  std::vector<std::size_t> lower_segment_indices;
+  for (std::size_t i = 0; i < to_positions.size(); ++i) {
+    std::pair<Vector3, Vector3> lower_segment;
+    bool has_lower_segment;
+    if (!isValidObjectSegmentRegion(from, to_positions[i], object_bbox, ignore_no_fly_zones,
+                                    &lower_segment, &has_lower_segment)) {
+      continue;
+    }
+    if (has_lower_segment) {
+      lower_segments.push_back(lower_segment);
+      lower_segment_indices.push_back(i);
+    }
+    else {
+      valid_flags[i] = true;
+    }
+  }
+  if (!lower_segments.empty()) {
+    const std::vector<bool> intersect_flags = occupied_bvh_.intersectsSweptBBox(
+        object_bbox, lower_segments, getObstacleClipBoundingBox());
+    for (std::size_t i = 0; i < lower_segments.size(); ++i) {
+      valid_flags[lower_segment_indices[i]] = !intersect_flags[i];
+    }
+  }
+  return valid_flags;
+}
+
 const reconstruction::DenseReconstruction& ViewpointPlannerData::getReconstruction() const {
   return *reconstruction_;
 }
@@ -323,7 +550,7 @@ void ViewpointPlannerData::readPoissonMesh(const std::string& mesh_filename) {
   std::cout << "Number of normals in mesh: " << poisson_mesh_->m_Normals.size() << std::endl;
 }
 
-bool ViewpointPlannerData::readBVHTree(std::string bvh_filename, const std::string& octree_filename) {
+bool ViewpointPlannerData::readBVHTree(std::string bvh_filename, const PrecomputationKey& key) {
 #if WITH_CUDA
   if (options_.enable_cuda) {
     std::cout << "Selecting CUDA device " << options_.cuda_gpu_id << std::endl;
@@ -338,7 +565,7 @@ bool ViewpointPlannerData::readBVHTree(std::string bvh_filename, const std::stri
   // Read cached BVH tree (if up-to-date) or generate it
   bool read_cached_tree = false;
   if (!options_.regenerate_bvh_tree && boost::filesystem::exists(bvh_filename)) {
-    if (boost::filesystem::last_write_time(bvh_filename) > boost::filesystem::last_write_time(octree_filename)) {
+    if (key.matchesArtifact(bvh_filename)) {
       std::cout << "Loading up-to-date cached BVH tree." << std::endl;
       readCachedBVHTree(bvh_filename);
       read_cached_tree = true;
@@ -350,17 +577,19 @@ bool ViewpointPlannerData::readBVHTree(std::string bvh_filename, const std::stri
   if (!read_cached_tree) {
     std::cout << "Generating BVH tree." << std::endl;
     generateBVHTree(octree_.get());
-    writeBVHTree(bvh_filename);
+    key.writeArtifact(bvh_filename, [&]() {
+      writeBVHTree(bvh_filename);
+    });
   }
   std::cout << "BVH tree bounding box: " << occupied_bvh_.getRoot()->getBoundingBox() << std::endl;
   return !read_cached_tree;
 }
 
-bool ViewpointPlannerData::readMeshDistanceField(std::string df_filename, const std::string& mesh_filename) {
+bool ViewpointPlannerData::readMeshDistanceField(std::string df_filename, const PrecomputationKey& key) {
   // Read cached distance field (if up-to-date) or generate it.
   bool read_cached_df = false;
   if (!options_.regenerate_distance_field && boost::filesystem::exists(df_filename)) {
-    if (boost::filesystem::last_write_time(df_filename) > boost::filesystem::last_write_time(mesh_filename)) {
+    if (key.matchesArtifact(df_filename)) {
       std::cout << "Loading up-to-date cached distance field." << std::endl;
       // TODO: Remove
 //      ml::BinaryDataStreamFile file_stream(df_filename, false);
@@ -370,7 +599,7 @@ bool ViewpointPlannerData::readMeshDistanceField(std::string df_filename, const
       std::cout << "Done" << std::endl;
     }
     else {
-      std::cout << "Found cached BVH tree to be old. Ignoring it." << std::endl;
+      std::cout << "Found cached distance field to be old. Ignoring it." << std::endl;
     }
   }
   if (!read_cached_df) {
@@ -380,9 +609,10 @@ bool ViewpointPlannerData::readMeshDistanceField(std::string df_filename, const
     // TODO: Remove
 //    ml::BinaryDataStreamFile file_stream(df_filename, true);
 //    file_stream << distance_field_;
-    _writeMeshDistanceField(df_filename, distance_field_);
+    key.writeArtifact(df_filename, [&]() {
+      _writeMeshDistanceField(df_filename, distance_field_);
+    });
   }
-  std::cout << "BVH tree bounding box: " << occupied_bvh_.getRoot()->getBoundingBox() << std::endl;
   return !read_cached_df;
 }
 
@@ -415,21 +645,15 @@ void ViewpointPlannerData::_writeMeshDistanceField(const std::string& filename,
 }
 
 void ViewpointPlannerData::updateWeights() {
+  if (options_.parallel_weight_update) {
+    updateWeightsParallel();
+    return;
+  }
+
   for (auto it = octree_->begin_tree(); it != octree_->end_tree(); ++it) {
     it->setWeight(0);
   }
-//  FloatType min_distance = std::numeric_limits<FloatType>::max();
-  FloatType max_distance = std::numeric_limits<FloatType>::lowest();
-  if (options_.use_distance_field) {
-    for (int x = 0; x < grid_dim_(0); ++x) {
-      for (int y = 0; y < grid_dim_(1); ++y) {
-        for (int z = 0; z < grid_dim_(2); ++z) {
-//          min_distance = std::min(min_distance, distance_field_(x, y, z));
-          max_distance = std::max(max_distance, distance_field_(x, y, z));
-        }
-      }
-    }
-  }
+  const FloatType max_distance = computeMaxGridDistance();
 //  std::cout << "min_distance: " << min_distance << std::endl;
 //  std::cout << "max_distance: " << max_distance << std::endl;
 //  FloatType max_weight = std::numeric_limits<FloatType>::lowest();
@@ -439,39 +663,7 @@ void ViewpointPlannerData::updateWeights() {
     for (int iy = 0; iy < grid_dim_(1); ++iy) {
       for (int iz = 0; iz < grid_dim_(2); ++iz) {
         const BoundingBoxType::Vector3 xyz = getGridPosition(ix, iy, iz);
-//        std::cout << "roi_distance=" << roi_distance << ", roi_weight=" << roi_weight << std::endl;
-        FloatType roi_weight = 1;
-//        if (roi_.isPointOutside(xyz) != roi_bbox.isOutside(xyz)) {
-//          BH_PRINT_VAR(roi_.isPointOutside(xyz));
-//          BH_PRINT_VAR(roi_bbox.isOutside(xyz));
-//          BH_PRINT_VAR(xyz);
-//        }
-        if (roi_.isPointOutside(xyz)) {
-//        if (roi_bbox.isOutside(xyz)) {
-          FloatType roi_distance = roi_.distanceToPoint(xyz);
-//          FloatType roi_distance = roi_bbox.distanceTo(xyz);
-          roi_distance = std::min(roi_distance, options_.roi_falloff_distance);
-          roi_weight = (options_.roi_falloff_distance - roi_distance) / options_.roi_falloff_distance;
-        }
-        WeightType weight;
-        if (options_.use_distance_field) {
-          const FloatType distance = distance_field_(ix, iy, iz);
-          if (distance <= options_.weight_falloff_distance_start) {
-            weight = roi_weight;
-          }
-          else {
-            const FloatType inv_distance = (max_distance - distance) / (max_distance - options_.weight_falloff_distance_start);
-            if (options_.weight_falloff_quadratic) {
-              weight = roi_weight * inv_distance * inv_distance;
-            }
-            else {
-              weight = roi_weight * inv_distance;
-            }
-          }
-        }
-        else {
-          weight = roi_weight;
-        }
+        const WeightType weight = computeGridCellWeight(ix, iy, iz, max_distance);
         const BoundingBoxType bbox(xyz, grid_increment_);
         const std::vector<OccupiedTreeType::BBoxIntersectionResult> results =
             occupied_bvh_.intersects(bbox);
@@ -495,7 +687,139 @@ void ViewpointPlannerData::updateWeights() {
   octree_->updateInnerOccupancy();
 }
 
+ViewpointPlannerData::FloatType ViewpointPlannerData::computeMaxGridDistance() const {
+  FloatType max_distance = std::numeric_limits<FloatType>::lowest();
+  if (options_.use_distance_field) {
+    for (int x = 0; x < grid_dim_(0); ++x) {
+      for (int y = 0; y < grid_dim_(1); ++y) {
+        for (int z = 0; z < grid_dim_(2); ++z) {
+          max_distance = std::max(max_distance, distance_field_(x, y, z));
+        }
+      }
+    }
+  }
+  return max_distance;
+}
+
+ViewpointPlannerData::WeightType ViewpointPlannerData::computeGridCellWeight(
+    const int ix, const int iy, const int iz, const FloatType max_distance) const {
+  const BoundingBoxType::Vector3 xyz = getGridPosition(ix, iy, iz);
+//  std::cout << "roi_distance=" << roi_distance << ", roi_weight=" << roi_weight << std::endl;
+  FloatType roi_weight = 1;
+//  if (roi_.isPointOutside(xyz) != roi_bbox.isOutside(xyz)) {
+//    BH_PRINT_VAR(roi_.isPointOutside(xyz));
+//    BH_PRINT_VAR(roi_bbox.isOutside(xyz));
+//    BH_PRINT_VAR(xyz);
+//  }
+  if (roi_.isPointOutside(xyz)) {
+//  if (roi_bbox.isOutside(xyz)) {
+    FloatType roi_distance = roi_.distanceToPoint(xyz);
+//    FloatType roi_distance = roi_bbox.distanceTo(xyz);
+    roi_distance = std::min(roi_distance, options_.roi_falloff_distance);
+    roi_weight = (options_.roi_falloff_distance - roi_distance) / options_.roi_falloff_distance;
+  }
+  WeightType weight;
+  if (options_.use_distance_field) {
+    const FloatType distance = distance_field_(ix, iy, iz);
+    if (distance <= options_.weight_falloff_distance_start) {
+      weight = roi_weight;
+    }
+    else {
+      const FloatType inv_distance = (max_distance - distance) / (max_distance - options_.weight_falloff_distance_start);
+      if (options_.weight_falloff_quadratic) {
+        weight = roi_weight * inv_distance * inv_distance;
+      }
+      else {
+        weight = roi_weight * inv_distance;
+      }
+    }
+  }
+  else {
+    weight = roi_weight;
+  }
+  return weight;
+}
+
+void ViewpointPlannerData::updateWeightsParallel() {
+  bh::Timer timer;
+  const FloatType max_distance = computeMaxGridDistance();
+
+  // Weights of all grid cells. Slabs along x are computed in parallel.
+  const std::size_t dim_x = grid_dim_(0);
+  const std::size_t dim_y = grid_dim_(1);
+  const std::size_t dim_z = grid_dim_(2);
+  std::vector<WeightType> cell_weights(dim_x * dim_y * dim_z);
+#pragma omp parallel for schedule(dynamic)
+  for (int ix = 0; ix < grid_dim_(0); ++ix) {
+    for (int iy = 0; iy < grid_dim_(1); ++iy) {
+      for (int iz = 0; iz < grid_dim_(2); ++iz) {
+        cell_weights[(ix * dim_y + iy) * dim_z + iz] = computeGridCellWeight(ix, iy, iz, max_distance);
+      }
+    }
+  }
+
+  // The serial version visits the grid cells in order and overwrites the weight of each overlapping voxel.
+  // A voxel thus gets the weight of the last overlapping cell, i.e. the one with the largest index along each axis.
+  const auto get_last_overlapping_cell_weight_lambda = [&](const BoundingBoxType& bbox, WeightType* weight) {
+    std::array<int, 3> index;
+    for (std::size_t i = 0; i < 3; ++i) {
+      const int index_min = std::max(
+          static_cast<int>(std::ceil((bbox.getMinimum(i) - grid_origin_(i)) / grid_increment_ - FloatType(0.5))), 0);
+      const int index_max = std::min(
+          static_cast<int>(std::floor((bbox.getMaximum(i) - grid_origin_(i)) / grid_increment_ + FloatType(0.5))),
+          grid_dim_(i) - 1);
+      if (index_max < index_min) {
+        return false;
+      }
+      index[i] = index_max;
+    }
+    *weight = cell_weights[(index[0] * dim_y + index[1]) * dim_z + index[2]];
+    return true;
+  };
+
+  // Each voxel only writes its own weight so there is no shared mutable state
+  std::vector<OccupiedTreeType::NodeType*> bvh_leaves;
+  bvh_leaves.reserve(occupied_bvh_.getNumOfLeafNodes());
+  for (OccupiedTreeType::NodeType& node : occupied_bvh_) {
+    if (node.isLeaf() && node.getObject() != nullptr) {
+      bvh_leaves.push_back(&node);
+    }
+  }
+#pragma omp parallel for schedule(static)
+  for (std::size_t i = 0; i < bvh_leaves.size(); ++i) {
+    WeightType weight;
+    if (get_last_overlapping_cell_weight_lambda(bvh_leaves[i]->getBoundingBox(), &weight)) {
+      NodeObjectType* object = bvh_leaves[i]->getObject();
+      object->weight = weight * computeObservationCountFactor(object->observation_count);
+    }
+  }
+
+  std::vector<std::pair<OccupancyMapType::NodeType*, BoundingBoxType>> octree_leaves;
+  for (auto it = octree_->begin_leafs(); it != octree_->end_leafs(); ++it) {
+    const Vector3 position(it.getX(), it.getY(), it.getZ());
+    octree_leaves.emplace_back(&(*it), BoundingBoxType(position, it.getSize()));
+  }
+#pragma omp parallel for schedule(static)
+  for (std::size_t i = 0; i < octree_leaves.size(); ++i) {
+    OccupancyMapType::NodeType* node = octree_leaves[i].first;
+    WeightType weight;
+    if (get_last_overlapping_cell_weight_lambda(octree_leaves[i].second, &weight)) {
+      node->setWeight(weight * computeObservationCountFactor(node->getObservationCount()));
+    }
+    else {
+      node->setWeight(0);
+    }
+  }
+  octree_->updateInnerOccupancy();
+  timer.printTiming("Updating weights");
+}
+
 void ViewpointPlannerData::updateWeightsWithRealViewpoints() {
+  if (!options_.ignore_real_observed_voxels && options_.invalid_pixel_observation_factor > 0
+      && options_.real_viewpoint_pipelined_update) {
+    updateWeightsWithRealViewpointsPipelined();
+    return;
+  }
   if (!options_.ignore_real_observed_voxels && options_.invalid_pixel_observation_factor > 0) {
     std::cout << "Computing observed voxels for " << reconstruction_->getImages().size()
               << " previous camera viewpoints" << std::endl;
@@ -510,6 +834,7 @@ void ViewpointPlannerData::updateWeightsWithRealViewpoints() {
         viewpoint_planner::ViewpointOffscreenRenderer::Options offscreen_renderer_options;
 //        offscreen_renderer_options.dump_poisson_mesh_depth_image = true;
 //        offscreen_renderer_options.dump_poisson_mesh_normals_image = true;
+        offscreen_renderer_options.poisson_mesh_cpu_rasterizer = options_.poisson_mesh_cpu_rasterizer;
         offscreen_renderer.reset(new viewpoint_planner::ViewpointOffscreenRenderer(
                 offscreen_renderer_options, depth_camera, poisson_mesh_.get()));
       }
@@ -570,6 +895,212 @@ void ViewpointPlannerData::updateWeightsWithRealViewpoints() {
   }
 }
 
+namespace {
+
+/// Depth map of a real viewpoint prefetched by a loader thread
+struct RealViewpointFrame {
+  reconstruction::ImageId image_id = 0;
+  bool valid = false;
+  reconstruction::DenseReconstruction::DepthMap depth_map;
+};
+
+}
+
+void ViewpointPlannerData::updateWeightsWithRealViewpointsPipelined() {
+  std::cout << "Computing observed voxels for " << reconstruction_->getImages().size()
+            << " previous camera viewpoints" << std::endl;
+  bh::Timer timer;
+  std::vector<reconstruction::ImageId> image_ids;
+  image_ids.reserve(reconstruction_->getImages().size());
+  for (const auto& entry : reconstruction_->getImages()) {
+    image_ids.push_back(entry.first);
+  }
+
+  // Loader threads read the depth maps in the background. The queue bounds the number of depth maps in memory.
+  bh::OrderedBoundedQueue<RealViewpointFrame> frame_queue(
+      std::max<std::size_t>(options_.real_viewpoint_prefetch_queue_size, 1));
+  std::atomic<std::size_t> next_load_index(0);
+  std::mutex load_time_mutex;
+  double load_time = 0;
+  std::vector<std::thread> loader_threads;
+  for (std::size_t i = 0; i < std::max<std::size_t>(options_.real_viewpoint_num_loader_threads, 1); ++i) {
+    loader_threads.emplace_back([&]() {
+      double local_load_time = 0;
+      while (true) {
+        const std::size_t index = next_load_index++;
+        if (index >= image_ids.size()) {
+          break;
+        }
+        frame_queue.waitForSlot(index);
+        bh::Timer load_timer;
+        RealViewpointFrame frame;
+        frame.image_id = image_ids[index];
+        try {
+          frame.depth_map = reconstruction_->readDepthMap(
+              frame.image_id, reconstruction::DenseReconstruction::DenseMapType::GEOMETRIC);
+          frame.valid = true;
+        }
+        catch (const std::exception& err) {
+          std::cout << "ERROR: Failed to load depth map of image " << frame.image_id << ": " << err.what() << std::endl;
+        }
+        local_load_time += load_timer.getElapsedTime();
+        frame_queue.push(index, std::move(frame));
+      }
+      std::unique_lock<std::mutex> lock(load_time_mutex);
+      load_time += local_load_time;
+    });
+  }
+
+  // The OpenGL context and the CUDA state are bound to the calling thread.
+  // Images are only processed in parallel if neither is used. The CPU rasterizer of the poisson mesh does not need
+  // an OpenGL context and each thread uses its own renderer.
+  bool parallel_processing = !options_.enable_opengl || options_.poisson_mesh_cpu_rasterizer;
+#if WITH_CUDA
+  parallel_processing = parallel_processing && !options_.enable_cuda;
+#endif
+  const int num_threads = parallel_processing ? omp_get_max_threads() : 1;
+
+  // Each observation through an invalid pixel scales the weight of a voxel by max(0, 1 - factor * observation_factor)
+  // (the observation score is proportional to the current weight). Each thread accumulates the product of these
+  // scale factors per voxel so that applying the product once at the end gives the same weights as updating the
+  // weights image by image.
+  using WeightScaleMapType = std::unordered_map<viewpoint_planner::VoxelType*, WeightType>;
+  std::vector<WeightScaleMapType> thread_weight_scale(num_threads);
+  std::vector<double> thread_wait_time(num_threads, 0);
+  std::vector<double> thread_raycast_time(num_threads, 0);
+  std::vector<double> thread_score_time(num_threads, 0);
+  std::atomic<std::size_t> next_process_index(0);
+  const FloatType min_range = options_.real_observed_voxels_raycast_min_range;
+  const FloatType max_range = options_.real_observed_voxels_raycast_max_range > 0 ?
+                              options_.real_observed_voxels_raycast_max_range :
+                              std::numeric_limits<FloatType>::max();
+  const viewpoint_planner::ViewpointScore::Options score_options =
+      options_.getOptionsAs<viewpoint_planner::ViewpointScore::Options>();
+#pragma omp parallel num_threads(num_threads)
+  {
+    const int thread_index = omp_get_thread_num();
+    WeightScaleMapType& weight_scale_map = thread_weight_scale[thread_index];
+    std::unique_ptr<viewpoint_planner::ViewpointOffscreenRenderer> offscreen_renderer;
+    viewpoint_planner::ViewpointRaycast raycaster(&occupied_bvh_, min_range, max_range);
+#if WITH_CUDA
+    raycaster.setEnableCuda(options_.enable_cuda);
+#endif
+    while (next_process_index++ < image_ids.size()) {
+      bh::Timer wait_timer;
+      const RealViewpointFrame frame = frame_queue.pop();
+      thread_wait_time[thread_index] += wait_timer.getElapsedTime();
+      if (!frame.valid) {
+        std::cout << "WARNING: Skipping image " << frame.image_id << std::endl;
+        continue;
+      }
+      const reconstruction::DenseReconstruction::DepthMap& depth_map = frame.depth_map;
+      const auto& image = reconstruction_->getImages().at(frame.image_id);
+      const reconstruction::PinholeCamera &real_camera = reconstruction_->getCameras().at(image.camera_id());
+      const FloatType depth_camera_scale_factor = depth_map.width() / FloatType(real_camera.width());
+      const reconstruction::PinholeCamera depth_camera = real_camera.getScaledCamera(depth_camera_scale_factor);
+      if (options_.enable_opengl) {
+        if (!offscreen_renderer) {
+          viewpoint_planner::ViewpointOffscreenRenderer::Options offscreen_renderer_options;
+          offscreen_renderer_options.poisson_mesh_cpu_rasterizer = options_.poisson_mesh_cpu_rasterizer;
+          // Every image is rendered only once so the buffers are not cached
+          offscreen_renderer_options.poisson_mesh_cache_max_memory_mb = 0;
+          offscreen_renderer.reset(new viewpoint_planner::ViewpointOffscreenRenderer(
+                  offscreen_renderer_options, depth_camera, poisson_mesh_.get()));
+        }
+        else {
+          offscreen_renderer->setCamera(depth_camera);
+        }
+      }
+      const Viewpoint viewpoint(&depth_camera, image.pose());
+      bh::Timer raycast_timer;
+      const bool remove_duplicates = false;
+      const std::vector<OccupiedTreeType::IntersectionResultWithScreenCoordinates> raycast_results =
+              raycaster.getRaycastHitVoxelsWithScreenCoordinates(viewpoint, remove_duplicates);
+      thread_raycast_time[thread_index] += raycast_timer.getElapsedTime();
+      bh::Timer score_timer;
+      std::vector<const OccupiedTreeType::IntersectionResultWithScreenCoordinates*> invalid_pixel_hits;
+      for (const OccupiedTreeType::IntersectionResultWithScreenCoordinates& ir : raycast_results) {
+        const FloatType depth = depth_map(ir.screen_coordinates(1), ir.screen_coordinates(0));
+        if (depth <= 0 || std::isinf(depth)) {
+          invalid_pixel_hits.push_back(&ir);
+        }
+      }
+      // Look up the normal vectors of all hits with a single render of the poisson mesh
+      std::vector<Vector3> normal_vectors;
+      if (options_.enable_opengl && !invalid_pixel_hits.empty()) {
+        std::vector<Eigen::Vector2i> image_points;
+        image_points.reserve(invalid_pixel_hits.size());
+        for (const OccupiedTreeType::IntersectionResultWithScreenCoordinates* ir : invalid_pixel_hits) {
+          image_points.emplace_back(static_cast<int>(ir->screen_coordinates(0)),
+                                    static_cast<int>(ir->screen_coordinates(1)));
+        }
+        std::vector<FloatType> depths;
+        offscreen_renderer->computePoissonMeshDepthsAndNormalVectors(viewpoint, image_points, &depths, &normal_vectors);
+      }
+      std::size_t hit_index = 0;
+      viewpoint_planner::ViewpointScore scorer(
+              score_options,
+              [&](const Viewpoint& viewpoint,
+                  const viewpoint_planner::VoxelType* node,
+                  const viewpoint_planner::Vector2& image_coordinates) -> Vector3 {
+                if (options_.enable_opengl) {
+                  return normal_vectors[hit_index];
+                }
+                return node->getObject()->normal;
+              });
+      for (hit_index = 0; hit_index < invalid_pixel_hits.size(); ++hit_index) {
+        const OccupiedTreeType::IntersectionResultWithScreenCoordinates& ir = *invalid_pixel_hits[hit_index];
+        const WeightType observation_factor = scorer.computeViewpointObservationFactor(
+                viewpoint, ir.intersection_result.node, ir.screen_coordinates);
+        const WeightType weight_scale = std::max<WeightType>(
+                0, 1 - options_.invalid_pixel_observation_factor * observation_factor);
+        auto it = weight_scale_map.emplace(ir.intersection_result.node, 1).first;
+        it->second *= weight_scale;
+      }
+      thread_score_time[thread_index] += score_timer.getElapsedTime();
+    }
+  }
+  for (std::thread& thread : loader_threads) {
+    thread.join();
+  }
+
+  bh::Timer merge_timer;
+  WeightScaleMapType& weight_scale_map = thread_weight_scale.front();
+  for (std::size_t i = 1; i < thread_weight_scale.size(); ++i) {
+    for (const auto& entry : thread_weight_scale[i]) {
+      auto it = weight_scale_map.emplace(entry.first, 1).first;
+      it->second *= entry.second;
+    }
+  }
+  for (const auto& entry : weight_scale_map) {
+    viewpoint_planner::VoxelType* voxel = entry.first;
+    const WeightType new_weight = voxel->getObject()->weight * entry.second;
+    voxel->getObject()->weight = new_weight;
+    BH_ASSERT(voxel->getObject()->weight >= 0);
+    const BoundingBoxType& bbox = voxel->getBoundingBox();
+    const octomap::point3d oct_min(bbox.getMinimum(0), bbox.getMinimum(1), bbox.getMinimum(2));
+    const octomap::point3d oct_max(bbox.getMaximum(0), bbox.getMaximum(1), bbox.getMaximum(2));
+    for (auto it = octree_->begin_leafs_bbx(oct_min, oct_max); it != octree_->end_leafs_bbx(); ++it) {
+      it->setWeight(new_weight);
+    }
+  }
+  const double merge_time = merge_timer.getElapsedTime();
+
+  // Per-stage times are summed over all threads
+  const double total_time = timer.getElapsedTime();
+  std::cout << "Updated weights of " << weight_scale_map.size() << " voxels with "
+            << image_ids.size() << " real viewpoints using " << num_threads << " threads" << std::endl;
+  std::cout << "  Loading depth maps: " << load_time << " s" << std::endl;
+  std::cout << "  Waiting for depth maps: "
+            << std::accumulate(thread_wait_time.begin(), thread_wait_time.end(), 0.0) << " s" << std::endl;
+  std::cout << "  Raycasting: "
+            << std::accumulate(thread_raycast_time.begin(), thread_raycast_time.end(), 0.0) << " s" << std::endl;
+  std::cout << "  Scoring: "
+            << std::accumulate(thread_score_time.begin(), thread_score_time.end(), 0.0) << " s" << std::endl;
+  std::cout << "  Merging: " << merge_time << " s" << std::endl;
+  std::cout << "  Total: " << total_time << " s" << std::endl;
+}
+
 ViewpointPlannerData::WeightType ViewpointPlannerData::computeObservationCountFactor(CounterType observation_count) const {
   const FloatType information_factor = std::exp(- options_.voxel_information_lambda * observation_count);
   return information_factor;
@@ -577,11 +1108,29 @@ ViewpointPlannerData::WeightType ViewpointPlannerData::computeObservationCountFa
 }
 
 bool ViewpointPlannerData::readAndAugmentOctree(
-    std::string octree_filename, const std::string& raw_octree_filename, bool binary) {
+    std::string octree_filename, const std::string& raw_octree_filename,
+    const PrecomputationKey& key, bool binary) {
   // Read cached augmented tree (if up-to-date) or generate it
   bool read_cached_tree = false;
-  if (!options_.regenerate_augmented_octree && boost::filesystem::exists(octree_filename)) {
-    if (boost::filesystem::last_write_time(octree_filename) > boost::filesystem::last_write_time(raw_octree_filename)) {
+  const std::string snapshot_filename = octree_filename + ".snapshot";
+  if (options_.use_octree_snapshot && !options_.regenerate_augmented_octree
+      && key.matchesArtifact(snapshot_filename)) {
+    std::cout << "Loading up-to-date augmented tree snapshot [" << snapshot_filename << "]" << std::endl;
+    bh::Timer timer;
+    try {
+      const OccupancyMapSnapshot snapshot(snapshot_filename);
+      octree_ = snapshot.toOccupancyMap();
+      read_cached_tree = true;
+      timer.printTiming("Loading augmented tree snapshot");
+    }
+    catch (const OccupancyMapSnapshot::Error& err) {
+      std::cout << "WARNING: Failed to load augmented tree snapshot: " << err.what() << std::endl;
+      // Make sure that the broken snapshot is rewritten
+      PrecomputationKey::removeForArtifact(snapshot_filename);
+    }
+  }
+  if (!read_cached_tree && !options_.regenerate_augmented_octree && boost::filesystem::exists(octree_filename)) {
+    if (key.matchesArtifact(octree_filename)) {
       std::cout << "Loading up-to-date cached augmented tree [" << octree_filename << "]" << std::endl;
       octree_ = OccupancyMapType::read(octree_filename);
       read_cached_tree = true;
@@ -594,8 +1143,8 @@ bool ViewpointPlannerData::readAndAugmentOctree(
     std::cout << "Reading non-augmented input tree [" << raw_octree_filename << "]" << std::endl;
     std::unique_ptr<RawOccupancyMapType> raw_octree = readRawOctree(raw_octree_filename, binary);
     std::cout << "Generating augmented tree." << std::endl;
+    // The generated tree is written once its weights have been updated
     octree_ = generateAugmentedOctree(std::move(raw_octree));
-    octree_->write(octree_filename);
   }
   std::cout << "Octree resolution: " << octree_->getResolution() << std::endl;
   return !read_cached_tree;
@@ -782,6 +1331,7 @@ bool ViewpointPlannerData::isTreeConsistent(const TreeT& tree) {
 }
 
 void ViewpointPlannerData::generateBVHTree(const OccupancyMapType* octree) {
+  bh::Timer total_timer;
   // Initialize nearest neighbor index for mesh faces
   using MeshAnn = bh::ApproximateNearestNeighbor<FloatType, 3>;
   MeshAnn mesh_ann;
@@ -803,6 +1353,8 @@ void ViewpointPlannerData::generateBVHTree(const OccupancyMapType* octree) {
   const std::size_t mesh_knn = options_.bvh_normal_mesh_knn;
   const FloatType max_dist_square = options_.bvh_normal_mesh_max_dist * options_.bvh_normal_mesh_max_dist;
 
+  // Node objects are allocated in a pool that is handed over to the BVH tree
+  typename OccupiedTreeType::ObjectPoolType object_pool;
   std::vector<std::vector<typename OccupiedTreeType::ObjectWithBoundingBox>> objects_vector;
 //#pragma omp parallel
   {
@@ -858,7 +1410,7 @@ void ViewpointPlannerData::generateBVHTree(const OccupancyMapType* octree) {
         }
 
 //        BH_ASSERT(object_with_bbox.bounding_box.isValid());
-        object_with_bbox.object = new NodeObjectType();
+        object_with_bbox.object = object_pool.create();
         object_with_bbox.object->occupancy = it->getOccupancy();
         object_with_bbox.object->observation_count = it->getObservationCount();
         object_with_bbox.object->weight = it->getWeight();
@@ -905,8 +1457,16 @@ void ViewpointPlannerData::generateBVHTree(const OccupancyMapType* octree) {
   }
   std::cout << "Building BVH tree with " << objects.size() << " objects" << std::endl;
   bh::Timer timer;
-  occupied_bvh_.build(std::move(objects));
+  occupied_bvh_.build(std::move(objects), std::move(object_pool));
   timer.printTimingMs("Building BVH tree");
+  total_timer.printTimingMs("Generating BVH tree");
+  printBVHTreeMemoryUsage();
+}
+
+void ViewpointPlannerData::printBVHTreeMemoryUsage() const {
+  std::cout << "BVH tree allocated " << occupied_bvh_.getAllocatedBytes() / (1024.0 * 1024.0) << " MB. "
+            << "Resident set size: " << bh::getResidentSetSize() / (1024.0 * 1024.0) << " MB, "
+            << "peak: " << bh::getPeakResidentSetSize() / (1024.0 * 1024.0) << " MB" << std::endl;
 }
 
 void ViewpointPlannerData::writeBVHTree(const std::string& filename) const {
@@ -923,8 +1483,11 @@ void ViewpointPlannerData::readCachedBVHTree(const std::string& filename) {
   if (!ifs) {
     throw BH_EXCEPTION(std::string("Unable to open file for reading: ") + filename);
   }
+  bh::Timer timer;
   boost::archive::binary_iarchive ia(ifs);
   ia >> occupied_bvh_;
+  timer.printTimingMs("Reading BVH tree");
+  printBVHTreeMemoryUsage();
 }
 
 void ViewpointPlannerData::generateWeightGrid() {
@@ -946,23 +1509,15 @@ void ViewpointPlannerData::generateWeightGrid() {
 void ViewpointPlannerData::generateDistanceField() {
   ml::Grid3f seed_grid(options_.grid_dimension, options_.grid_dimension, options_.grid_dimension);
   seed_grid.setValues(std::numeric_limits<float>::max());
-  for (size_t i = 0; i < poisson_mesh_->m_FaceIndicesVertices.size(); ++i) {
-    const MeshType::Indices::Face& face = poisson_mesh_->m_FaceIndicesVertices[i];
-    BH_ASSERT_STR(face.size() == 3, "Mesh faces need to have a valence of 3");
-    const ml::vec3f& vertex1 = poisson_mesh_->m_Vertices[face[0]];
-    const ml::vec3f& vertex2 = poisson_mesh_->m_Vertices[face[1]];
-    const ml::vec3f& vertex3 = poisson_mesh_->m_Vertices[face[2]];
-    const ml::vec3f ml_tri_xyz = (vertex1 + vertex2 + vertex3) / 3;
-    const Vector3 tri_xyz(ml_tri_xyz.x, ml_tri_xyz.y, ml_tri_xyz.z);
-    if (isInsideGrid(tri_xyz)) {
-      const Vector3i indices = getGridIndices(tri_xyz);
-      const Vector3 xyz = getGridPosition(indices);
-      const float cur_dist = seed_grid(indices(0), indices(1), indices(2));
-      const float new_dist = (xyz - tri_xyz).norm() / grid_increment_;
-      if (new_dist < cur_dist) {
-        seed_grid(indices(0), indices(1), indices(2)) = new_dist;
-      }
-    }
+  if (options_.distance_field_exact_seeding) {
+    seedDistanceFieldWithTriangles(&seed_grid);
+  }
+  else {
+    seedDistanceFieldWithTriangleCentroids(&seed_grid);
+  }
+  if (options_.distance_field_exact_transform) {
+    generateDistanceFieldWithExactTransform(seed_grid);
+    return;
   }
   distance_field_ = DistanceFieldType(seed_grid.getDimX(), seed_grid.getDimY(), seed_grid.getDimZ());
   for (int ix = 0; ix < grid_dim_(0); ++ix) {
@@ -1015,6 +1570,119 @@ void ViewpointPlannerData::generateDistanceField() {
   }
 }
 
+void ViewpointPlannerData::seedDistanceFieldWithTriangleCentroids(ml::Grid3f* seed_grid) const {
+  for (size_t i = 0; i < poisson_mesh_->m_FaceIndicesVertices.size(); ++i) {
+    const MeshType::Indices::Face& face = poisson_mesh_->m_FaceIndicesVertices[i];
+    BH_ASSERT_STR(face.size() == 3, "Mesh faces need to have a valence of 3");
+    const ml::vec3f& vertex1 = poisson_mesh_->m_Vertices[face[0]];
+    const ml::vec3f& vertex2 = poisson_mesh_->m_Vertices[face[1]];
+    const ml::vec3f& vertex3 = poisson_mesh_->m_Vertices[face[2]];
+    const ml::vec3f ml_tri_xyz = (vertex1 + vertex2 + vertex3) / 3;
+    const Vector3 tri_xyz(ml_tri_xyz.x, ml_tri_xyz.y, ml_tri_xyz.z);
+    if (isInsideGrid(tri_xyz)) {
+      const Vector3i indices = getGridIndices(tri_xyz);
+      const Vector3 xyz = getGridPosition(indices);
+      const float cur_dist = (*seed_grid)(indices(0), indices(1), indices(2));
+      const float new_dist = (xyz - tri_xyz).norm() / grid_increment_;
+      if (new_dist < cur_dist) {
+        (*seed_grid)(indices(0), indices(1), indices(2)) = new_dist;
+      }
+    }
+  }
+}
+
+void ViewpointPlannerData::seedDistanceFieldWithTriangles(ml::Grid3f* seed_grid) const {
+  bh::Timer timer;
+  const std::size_t num_triangles = poisson_mesh_->m_FaceIndicesVertices.size();
+  const Vector3i grid_dim(static_cast<int>(seed_grid->getDimX()),
+                          static_cast<int>(seed_grid->getDimY()),
+                          static_cast<int>(seed_grid->getDimZ()));
+  // Cells are centered on the grid positions. Enlarge them slightly so that the rasterization is conservative.
+  const Vector3 cell_half_extent = Vector3::Constant(FloatType(0.5 + 1e-3) * grid_increment_);
+  const std::size_t kTriangleBatchSize = 1024;
+  const std::size_t num_batches = (num_triangles + kTriangleBatchSize - 1) / kTriangleBatchSize;
+  std::vector<std::vector<std::pair<std::size_t, float>>> batch_seeds(num_batches);
+#pragma omp parallel for schedule(dynamic)
+  for (std::size_t batch = 0; batch < num_batches; ++batch) {
+    std::vector<std::pair<std::size_t, float>>& seeds = batch_seeds[batch];
+    const std::size_t batch_end = std::min((batch + 1) * kTriangleBatchSize, num_triangles);
+    for (std::size_t i = batch * kTriangleBatchSize; i < batch_end; ++i) {
+      const MeshType::Indices::Face& face = poisson_mesh_->m_FaceIndicesVertices[i];
+      BH_ASSERT_STR(face.size() == 3, "Mesh faces need to have a valence of 3");
+      const ml::vec3f& vertex1 = poisson_mesh_->m_Vertices[face[0]];
+      const ml::vec3f& vertex2 = poisson_mesh_->m_Vertices[face[1]];
+      const ml::vec3f& vertex3 = poisson_mesh_->m_Vertices[face[2]];
+      const bh::Triangle<FloatType> triangle(
+          Vector3(vertex1.x, vertex1.y, vertex1.z),
+          Vector3(vertex2.x, vertex2.y, vertex2.z),
+          Vector3(vertex3.x, vertex3.y, vertex3.z));
+      const BoundingBoxType tri_bbox = triangle.boundingBox();
+      if (!tri_bbox.intersects(grid_bbox_)) {
+        continue;
+      }
+      // Range of cells overlapping the triangle bounding box
+      const Vector3 index_min_float = (tri_bbox.getMinimum() - grid_origin_) / grid_increment_;
+      const Vector3 index_max_float = (tri_bbox.getMaximum() - grid_origin_) / grid_increment_;
+      Vector3i index_min;
+      Vector3i index_max;
+      for (int j = 0; j < 3; ++j) {
+        index_min(j) = std::max(static_cast<int>(std::floor(index_min_float(j))), 0);
+        index_max(j) = std::min(static_cast<int>(std::ceil(index_max_float(j))), grid_dim(j) - 1);
+      }
+      for (int iz = index_min(2); iz <= index_max(2); ++iz) {
+        for (int iy = index_min(1); iy <= index_max(1); ++iy) {
+          for (int ix = index_min(0); ix <= index_max(0); ++ix) {
+            const Vector3 xyz = getGridPosition(ix, iy, iz);
+            if (triangle.intersectsBox(xyz, cell_half_extent)) {
+              const std::size_t index = ix + grid_dim(0) * (iy + grid_dim(1) * static_cast<std::size_t>(iz));
+              seeds.emplace_back(index, triangle.distanceTo(xyz) / grid_increment_);
+            }
+          }
+        }
+      }
+    }
+  }
+  for (const std::vector<std::pair<std::size_t, float>>& seeds : batch_seeds) {
+    for (const std::pair<std::size_t, float>& seed : seeds) {
+      const std::size_t ix = seed.first % grid_dim(0);
+      const std::size_t iy = (seed.first / grid_dim(0)) % grid_dim(1);
+      const std::size_t iz = seed.first / (grid_dim(0) * grid_dim(1));
+      float& cur_dist = (*seed_grid)(ix, iy, iz);
+      cur_dist = std::min(cur_dist, seed.second);
+    }
+  }
+  timer.printTiming("Seeding distance field with triangles");
+}
+
+void ViewpointPlannerData::generateDistanceFieldWithExactTransform(const ml::Grid3f& seed_grid) {
+  bh::Timer timer;
+  using DistanceTransformType = EuclideanDistanceTransform<FloatType>;
+  const std::size_t dim_x = seed_grid.getDimX();
+  const std::size_t dim_y = seed_grid.getDimY();
+  const std::size_t dim_z = seed_grid.getDimZ();
+  // Seeds are distances in grid units, unseeded cells have the maximum float value
+  std::vector<FloatType> values(dim_x * dim_y * dim_z);
+  for (std::size_t z = 0; z < dim_z; ++z) {
+    for (std::size_t y = 0; y < dim_y; ++y) {
+      for (std::size_t x = 0; x < dim_x; ++x) {
+        const FloatType seed = seed_grid(x, y, z);
+        values[x + dim_x * (y + dim_y * z)] =
+            seed == std::numeric_limits<float>::max() ? DistanceTransformType::kInfinity : seed * seed;
+      }
+    }
+  }
+  DistanceTransformType::transform(&values, dim_x, dim_y, dim_z, grid_increment_, options_.distance_field_cutoff);
+  distance_field_ = DistanceFieldType(dim_x, dim_y, dim_z);
+  for (std::size_t z = 0; z < dim_z; ++z) {
+    for (std::size_t y = 0; y < dim_y; ++y) {
+      for (std::size_t x = 0; x < dim_x; ++x) {
+        distance_field_(x, y, z) = values[x + dim_x * (y + dim_y * z)];
+      }
+    }
+  }
+  timer.printTiming("Computing exact distance transform");
+}
+
 bool ViewpointPlannerData::isInsideGrid(const Vector3& xyz) const {
   return grid_bbox_.isInside(xyz);
 }
@@ -20,6 +20,7 @@
 #include <bh/eigen_options.h>
 #include <bh/math/geometry.h>
 #include "occupied_tree.h"
+#include "precomputation_key.h"
 #include "../octree/occupancy_map.h"
 #include "../reconstruction/dense_reconstruction.h"
 #include "../bvh/bvh.h"
@@ -51,8 +52,10 @@ public:
       addOption<bool>("use_distance_field", &use_distance_field);
       addOption<bool>("force_weights_update", &force_weights_update);
       addOption<bool>("regenerate_augmented_octree", &regenerate_augmented_octree);
+      addOption<bool>("use_octree_snapshot", &use_octree_snapshot);
       addOption<bool>("regenerate_bvh_tree", &regenerate_bvh_tree);
       addOption<bool>("regenerate_distance_field", &regenerate_distance_field);
+      addOption<bool>("parallel_startup", &parallel_startup);
       addOption<std::string>("regions_json_filename", &regions_json_filename);
       addOption<FloatType>("obstacle_free_height", &obstacle_free_height);
       addOption<FloatType>("bvh_bbox_min_x", -1000);
@@ -77,15 +80,22 @@ public:
       addOption<FloatType>("bvh_normal_mesh_max_dist", &bvh_normal_mesh_max_dist);
       addOption<size_t>("grid_dimension", &grid_dimension);
       addOption<FloatType>("distance_field_cutoff", &distance_field_cutoff);
+      addOption<bool>("distance_field_exact_transform", &distance_field_exact_transform);
+      addOption<bool>("distance_field_exact_seeding", &distance_field_exact_seeding);
       addOption<FloatType>("roi_falloff_distance", &roi_falloff_distance);
       addOption<bool>("weight_falloff_quadratic", &weight_falloff_quadratic);
       addOption<FloatType>("weight_falloff_distance_start", &weight_falloff_distance_start);
+      addOption<bool>("parallel_weight_update", &parallel_weight_update);
       addOption<FloatType>("voxel_information_lambda", &voxel_information_lambda);
       addOption<bool>("ignore_real_observed_voxels", &ignore_real_observed_voxels);
       addOption<FloatType>("invalid_pixel_observation_factor", &invalid_pixel_observation_factor);
+      addOption<bool>("real_viewpoint_pipelined_update", &real_viewpoint_pipelined_update);
+      addOption<size_t>("real_viewpoint_num_loader_threads", &real_viewpoint_num_loader_threads);
+      addOption<size_t>("real_viewpoint_prefetch_queue_size", &real_viewpoint_prefetch_queue_size);
       addOption<FloatType>("real_observed_voxels_raycast_min_range", &real_observed_voxels_raycast_min_range);
       addOption<FloatType>("real_observed_voxels_raycast_max_range", &real_observed_voxels_raycast_max_range);
       addOption<bool>("enable_opengl", &enable_opengl);
+      addOption<bool>("poisson_mesh_cpu_rasterizer", &poisson_mesh_cpu_rasterizer);
 #if WITH_CUDA
       addOption<bool>("enable_cuda", &enable_cuda);
       addOption<size_t>("cuda_stack_size", &cuda_stack_size);
@@ -98,8 +108,12 @@ public:
     bool use_distance_field = true;
     bool force_weights_update = false;
     bool regenerate_augmented_octree = false;
+    // Whether to cache the augmented octree as a flat snapshot and load it from there
+    bool use_octree_snapshot = true;
     bool regenerate_bvh_tree = false;
     bool regenerate_distance_field = false;
+    // Whether to read input files and cached precomputations in parallel at startup
+    bool parallel_startup = true;
     std::string regions_json_filename = "";
     FloatType obstacle_free_height = std::numeric_limits<FloatType>::max();
     size_t bvh_normal_mesh_knn = 10;
@@ -107,15 +121,33 @@ public:
     size_t grid_dimension = 128;
     FloatType roi_falloff_distance = 10;
     FloatType distance_field_cutoff = 5;
+    // Whether to compute the distance field with an exact Euclidean distance transform instead of iterative relaxation.
+    // Note that the relaxation does not use the seeded distances and yields a distance field of zeros, so enabling
+    // this option changes the distance field and therefore the voxel weights.
+    bool distance_field_exact_transform = false;
+    // Whether to seed the distance field with exact distances to all triangles overlapping a cell
+    // instead of the distances to the triangle centroids inside a cell
+    bool distance_field_exact_seeding = true;
     bool weight_falloff_quadratic = true;
     FloatType weight_falloff_distance_start = 0;
+    // Whether to compute voxel weights in parallel by looking up the grid cell of each voxel
+    // instead of querying the voxels of each grid cell
+    bool parallel_weight_update = true;
     // Factor in the exponential of the voxel information
     FloatType voxel_information_lambda = FloatType(0.1);
     bool ignore_real_observed_voxels = false;
     FloatType invalid_pixel_observation_factor = FloatType(0.5);
+    // Whether to prefetch depth maps of real viewpoints in the background and process the images in parallel
+    bool real_viewpoint_pipelined_update = true;
+    // Number of threads reading depth maps of real viewpoints
+    size_t real_viewpoint_num_loader_threads = 2;
+    // Maximum number of prefetched depth maps
+    size_t real_viewpoint_prefetch_queue_size = 8;
     FloatType real_observed_voxels_raycast_min_range = FloatType(5);
     FloatType real_observed_voxels_raycast_max_range = std::numeric_limits<FloatType>::max();
     bool enable_opengl = true;
+    // Whether to compute poisson mesh normals with the CPU rasterizer instead of OpenGL
+    bool poisson_mesh_cpu_rasterizer = false;
 #if WITH_CUDA
     bool enable_cuda = true;
     size_t cuda_stack_size = 32 * 1024;
@@ -153,6 +185,11 @@ public:
     return options_;
   }
 
+  /// Key of all precomputations including the voxel weights
+  const PrecomputationKey& getCacheKey() const {
+    return cache_key_;
+  }
+
   const OccupancyMapType& getOctree() const {
     return *octree_;
   }
@@ -174,6 +211,15 @@ public:
   bool isValidObjectPosition(
           const Vector3& position, const BoundingBoxType& object_bbox, const bool ignore_no_fly_zones = false) const;
 
+  /// Check if an object can be moved along a straight segment.
+  /// The object bounding box is swept along the segment and tested against the occupied BVH in one traversal.
+  bool isValidObjectSegment(const Vector3& from, const Vector3& to,
+          const BoundingBoxType& object_bbox, const bool ignore_no_fly_zones = false) const;
+
+  /// Check straight segments from one position to multiple positions with a single BVH traversal.
+  std::vector<bool> areValidObjectSegments(const Vector3& from, const std::vector<Vector3>& to_positions,
+          const BoundingBoxType& object_bbox, const bool ignore_no_fly_zones = false) const;
+
   const reconstruction::DenseReconstruction& getReconstruction() const;
 
   const DistanceFieldType& getDistanceField() const;
@@ -189,29 +235,56 @@ private:
   template <typename FloatT>
   friend class MotionPlanner;
 
-  std::time_t getLastWriteTime(const std::string& filename) const {
-    return boost::filesystem::last_write_time(filename);
-  }
-
   RegionType convertGpsRegionToEnuRegion(const boost::property_tree::ptree& pt) const;
 
+  /// Check the parts of a segment that do not require an obstacle test (bounding boxes, no-fly zones).
+  /// If the segment has a part below the obstacle free height it is returned in lower_segment.
+  bool isValidObjectSegmentRegion(const Vector3& from, const Vector3& to,
+          const BoundingBoxType& object_bbox, const bool ignore_no_fly_zones,
+          std::pair<Vector3, Vector3>* lower_segment, bool* has_lower_segment) const;
+
+  /// Part of the occupied BVH that can obstruct objects (i.e. below the obstacle free height)
+  BoundingBoxType getObstacleClipBoundingBox() const;
+
+  /// Keys of the cached precomputations. Keys of dependent precomputations include the keys of their inputs.
+  struct CacheKeys {
+    PrecomputationKey octree;
+    PrecomputationKey bvh;
+    PrecomputationKey distance_field;
+    PrecomputationKey weights;
+  };
+
+  /// Compute the keys of the cached precomputations from the content of the input files and the relevant options
+  CacheKeys computeCacheKeys(const std::string& raw_octree_filename, const std::string& mesh_filename) const;
+
   void readDenseReconstruction(const std::string& path);
+  /// Read the cached augmented tree or generate it. Returns true if it was generated.
+  /// A generated tree is not written here because its weights still have to be updated.
   bool readAndAugmentOctree(
-      std::string octree_filename, const std::string& raw_octree_filename, bool binary=false);
+      std::string octree_filename, const std::string& raw_octree_filename,
+      const PrecomputationKey& key, bool binary=false);
   void readDensePoints(const std::string& dense_points_filename);
   void readPoissonMesh(const std::string& mesh_filename);
-  bool readBVHTree(std::string bvh_filename, const std::string& octree_filename);
+  bool readBVHTree(std::string bvh_filename, const PrecomputationKey& key);
   /// Distance field to poisson mesh based on overall bounding box volume
-  bool readMeshDistanceField(std::string df_filename, const std::string& mesh_filename);
+  bool readMeshDistanceField(std::string df_filename, const PrecomputationKey& key);
 
   void _readMeshDistanceField(const std::string& df_filename, DistanceFieldType* distance_field);
   void _writeMeshDistanceField(const std::string& df_filename, const DistanceFieldType& distance_field);
 
   void updateWeights();
+  void updateWeightsParallel();
   void updateWeightsWithRealViewpoints();
+  void updateWeightsWithRealViewpointsPipelined();
 
   WeightType computeObservationCountFactor(CounterType observation_count) const;
 
+  /// Maximum value of the distance field (lowest float if the distance field is not used)
+  FloatType computeMaxGridDistance() const;
+
+  /// Weight of a grid cell given by the region of interest and the distance field
+  WeightType computeGridCellWeight(const int ix, const int iy, const int iz, const FloatType max_distance) const;
+
   std::unique_ptr<RawOccupancyMapType>
   readRawOctree(const std::string& filename, bool binary=false) const;
 
@@ -220,6 +293,8 @@ private:
 
   void generateBVHTree(const OccupancyMapType* octree);
 
+  void printBVHTreeMemoryUsage() const;
+
   void readCachedBVHTree(const std::string& filename);
 
   void writeBVHTree(const std::string& filename) const;
@@ -228,6 +303,12 @@ private:
 
   void generateDistanceField();
 
+  void seedDistanceFieldWithTriangleCentroids(ml::Grid3f* seed_grid) const;
+
+  void seedDistanceFieldWithTriangles(ml::Grid3f* seed_grid) const;
+
+  void generateDistanceFieldWithExactTransform(const ml::Grid3f& seed_grid);
+
   template <typename TreeT>
   static bool isTreeConsistent(const TreeT& tree);
 
@@ -236,6 +317,7 @@ private:
 //      const Eigen::Vector3f& query_pos, FloatType dist_cutoff_sq, const ConstTreeNavigatorType& nav);
 
   Options options_;
+  PrecomputationKey cache_key_;
 
   BoundingBoxType bvh_bbox_;
   RegionType roi_;
@@ -100,6 +100,7 @@ ViewpointPlanner::ViewpointEntryIndex ViewpointPlanner::addViewpointEntryWithout
 //  std::cout << "Adding node to viewpoint graph" << std::endl;
   viewpoint_graph_.addNode(viewpoint_index);
   viewpoint_graph_components_valid_ = false;
+  viewpoint_motion_dirty_set_.insert(viewpoint_index);
   // TODO
 //#if !BH_RELEASE
 //  if (!ignore_viewpoint_count_grid && viewpoint_entries_.size() > num_real_viewpoints_) {
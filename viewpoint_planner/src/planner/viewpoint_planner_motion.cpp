@@ -97,6 +97,9 @@ void ViewpointPlanner::removeViewpointMotions(const ViewpointEntryIndex index) {
 
 void ViewpointPlanner::computeViewpointMotions() {
   std::cout << "Computing motions on viewpoint graph" << std::endl;
+  std::unique_lock<std::mutex> dirty_lock(mutex_);
+  viewpoint_motion_dirty_set_.clear();
+  dirty_lock.unlock();
   for (auto it = viewpoint_graph_.begin(); it != viewpoint_graph_.end(); ++it) {
     const ViewpointEntryIndex from_index = it.node();
 //    if (from_index < num_real_viewpoints_) {
@@ -161,6 +164,17 @@ void ViewpointPlanner::computeViewpointMotions() {
 //  for (const auto& index : viewpoint_graph_) {
 //    std::cout << "Node " << index << " has " << viewpoint_graph_.getEdgesByNode(index).size() << " edges" << std::endl;
 //  }
+  if (motion_planner_.getRoadmap().isBuilt()) {
+    const MotionPlannerType::Roadmap::Statistics stats = motion_planner_.getRoadmap().getStatistics();
+    std::cout << "Motion roadmap: " << stats.num_successful_queries << " of " << stats.num_queries
+              << " queries successful, " << stats.num_edge_validations << " lazy edge validations, "
+              << stats.num_invalid_edges << " invalid edges" << std::endl;
+  }
+  if (motion_planner_.getMotionCache() != nullptr) {
+    const MotionPlannerType::Cache* motion_cache = motion_planner_.getMotionCache();
+    std::cout << "Motion cache: " << motion_cache->numHits() << " hits, " << motion_cache->numMisses()
+              << " misses, " << motion_cache->numEntries() << " entries" << std::endl;
+  }
   std::cout << "Done" << std::endl;
 }
 
@@ -174,11 +188,83 @@ size_t ViewpointPlanner::computeViewpointMotions(const ViewpointEntryIndex from_
   for (ViewpointMotion& motion : motions) {
     addViewpointMotion(std::move(motion));
   }
+  viewpoint_motion_dirty_set_.erase(from_index);
   lock.unlock();
 
   return motions.size();
 }
 
+size_t ViewpointPlanner::updateViewpointMotions(const bool verbose /*= false*/) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  const std::vector<ViewpointEntryIndex> dirty_indices(
+      viewpoint_motion_dirty_set_.begin(), viewpoint_motion_dirty_set_.end());
+  viewpoint_motion_dirty_set_.clear();
+  lock.unlock();
+
+  if (dirty_indices.empty()) {
+    return 0;
+  }
+  bh::Timer timer;
+  const bool skip_existing_motions = true;
+  size_t num_new_motions = 0;
+  for (const ViewpointEntryIndex from_index : dirty_indices) {
+    std::vector<ViewpointMotion> motions = findViewpointMotions(from_index, verbose, skip_existing_motions);
+    // Stream new motions into the graph so that the next dirty viewpoint sees them
+    lock.lock();
+    for (ViewpointMotion& motion : motions) {
+      addViewpointMotion(std::move(motion));
+    }
+    lock.unlock();
+    num_new_motions += motions.size();
+  }
+  std::cout << "Computed " << num_new_motions << " new motions for " << dirty_indices.size()
+            << " new viewpoints in " << timer.getElapsedTime() << " s" << std::endl;
+  return num_new_motions;
+}
+
+size_t ViewpointPlanner::getNumOfViewpointsWithoutMotions() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return viewpoint_motion_dirty_set_.size();
+}
+
+std::vector<bool> ViewpointPlanner::validateStraightViewpointMotions(
+        const Vector3& from_position,
+        const std::vector<ViewpointANN::IndexType>& to_indices,
+        const std::vector<ViewpointANN::DistanceType>& to_dist_squares) const {
+  std::vector<bool> straight_valid_flags(to_indices.size(), false);
+  if (!motion_planner_.isStraightMotionEnabled()) {
+    return straight_valid_flags;
+  }
+  // Only validate neighbors within the maximum motion distance
+  const FloatType max_dist_square = options_.viewpoint_motion_max_dist_square;
+  std::vector<Vector3> to_positions;
+  std::vector<std::size_t> to_position_indices;
+  for (std::size_t i = 0; i < to_indices.size(); ++i) {
+    if (to_dist_squares[i] > max_dist_square) {
+      continue;
+    }
+    to_positions.push_back(viewpoint_entries_[to_indices[i]].viewpoint.pose().getWorldPosition());
+    to_position_indices.push_back(i);
+  }
+  const std::vector<bool> valid_flags = motion_planner_.areValidStraightSegments(from_position, to_positions);
+  for (std::size_t i = 0; i < to_position_indices.size(); ++i) {
+    straight_valid_flags[to_position_indices[i]] = valid_flags[i];
+  }
+  return straight_valid_flags;
+}
+
+std::pair<ViewpointPlanner::SE3Motion, bool> ViewpointPlanner::findMotionWithStraightValidation(
+        const Pose& from, const Pose& to, const bool straight_valid) const {
+  if (straight_valid) {
+    return std::make_pair(SE3Motion(from, to), true);
+  }
+  else if (motion_planner_.isStraightMotionEnabled()) {
+    // Straight motion was already validated
+    return motion_planner_.findMotionWithoutStraight(from, to);
+  }
+  return motion_planner_.findMotion(from, to);
+}
+
 std::vector<std::pair<ViewpointPlanner::ViewpointEntryIndex, ViewpointPlanner::SE3Motion>>
 ViewpointPlanner::findSE3Motions(const Pose& from_pose) {
   const bool ignore_no_fly_zones = true;
@@ -196,16 +282,23 @@ ViewpointPlanner::findSE3Motions(const Pose& from_pose) {
   viewpoint_ann_.knnSearch(from_pose.getWorldPosition(), dist_knn, &knn_indices, &knn_distances);
   std::size_t num_connections = 0;
   std::vector<std::pair<ViewpointEntryIndex, SE3Motion>> se3_motions;
+  const std::vector<bool> straight_valid_flags = validateStraightViewpointMotions(
+      from_pose.getWorldPosition(), knn_indices, knn_distances);
 #if !BH_DEBUG
   // We run in multiple threads so make sure that the visible sparse points are cached.
   // Otherwise the OpenGL context and poisson mesh has to be initialized again and again in each thread.
 //  getCachedVisibleSparsePoints(from_index);
   const Viewpoint from_viewpoint = getVirtualViewpoint(from_pose);
   const std::unordered_set<size_t> from_visible_voxels = getVisibleVoxels(from_viewpoint);
+  const VoxelSetSketchType from_visible_voxels_sketch = options_.sparse_matching_voxels_sketch_size > 0 ?
+      VoxelSetSketchType(from_visible_voxels, options_.sparse_matching_voxels_sketch_size) : VoxelSetSketchType();
+  cacheVisibleVoxels(std::vector<ViewpointEntryIndex>(knn_indices.begin(), knn_indices.end()));
   for (std::size_t i = 0; i < knn_indices.size(); ++i) {
     const ViewpointANN::IndexType to_index = knn_indices[i];
 //    getCachedVisibleSparsePoints(to_index);
-    getCachedVisibleVoxels(to_index);
+    if (options_.sparse_matching_voxels_sketch_size > 0) {
+      getCachedVisibleVoxelSketch(to_index);
+    }
   }
 #pragma omp parallel for
 #endif
@@ -221,7 +314,8 @@ ViewpointPlanner::findSE3Motions(const Pose& from_pose) {
 //      continue;
 //    }
 //    const bool matchable = isSparseMatchable(from_index, to_index);
-    const bool matchable = isSparseMatchable2(to_index, from_viewpoint, from_visible_voxels);
+    const bool matchable = isSparseMatchable2(
+        to_index, from_viewpoint, from_visible_voxels, from_visible_voxels_sketch);
     if (!matchable) {
       continue;
     }
@@ -231,7 +325,8 @@ ViewpointPlanner::findSE3Motions(const Pose& from_pose) {
     if (!isValidObjectPosition(to_viewpoint_entry.viewpoint.pose().getWorldPosition(), drone_bbox_, ignore_no_fly_zones)) {
       continue;
     }
-    std::tie(se3_motion, found_motion) = motion_planner_.findMotion(from_pose, to_viewpoint_entry.viewpoint.pose());
+    std::tie(se3_motion, found_motion) = findMotionWithStraightValidation(
+        from_pose, to_viewpoint_entry.viewpoint.pose(), straight_valid_flags[i]);
     // TODO
     if (found_motion) {
 #if !BH_DEBUG
@@ -279,7 +374,8 @@ ViewpointPlanner::findSE3Motions(const Pose& from_pose) {
 }
 
 std::vector<ViewpointPlanner::ViewpointMotion>
-ViewpointPlanner::findViewpointMotions(const ViewpointEntryIndex from_index,const bool verbose /*= false*/) {
+ViewpointPlanner::findViewpointMotions(const ViewpointEntryIndex from_index, const bool verbose /*= false*/,
+                                       const bool skip_existing_motions /*= false*/) {
   const bool ignore_no_fly_zones = true;
 //  bh::Timer timer;
   const ViewpointEntry& from_viewpoint = viewpoint_entries_[from_index];
@@ -296,17 +392,35 @@ ViewpointPlanner::findViewpointMotions(const ViewpointEntryIndex from_index,cons
   viewpoint_ann_.knnSearch(from_viewpoint.viewpoint.pose().getWorldPosition(), dist_knn, &knn_indices, &knn_distances);
   std::size_t num_connections = 0;
   std::vector<ViewpointMotion> motions;
+  if (skip_existing_motions) {
+    // Remove neighbors that are already connected so that no motion search is done for them
+    std::size_t num_remaining = 0;
+    for (std::size_t i = 0; i < knn_indices.size(); ++i) {
+      if (!hasViewpointMotion(from_index, knn_indices[i])) {
+        knn_indices[num_remaining] = knn_indices[i];
+        knn_distances[num_remaining] = knn_distances[i];
+        ++num_remaining;
+      }
+    }
+    knn_indices.resize(num_remaining);
+    knn_distances.resize(num_remaining);
+  }
+  const std::vector<bool> straight_valid_flags = validateStraightViewpointMotions(
+      from_viewpoint.viewpoint.pose().getWorldPosition(), knn_indices, knn_distances);
 #if !BH_DEBUG
   // We run in multiple threads so make sure that the visible sparse points are cached.
   // Otherwise the OpenGL context and poisson mesh has to be initialized again and again in each thread.
 //  getCachedVisibleSparsePoints(from_index);
   bh::Timer timer;
-  getCachedVisibleVoxels(from_index);
+  std::vector<ViewpointEntryIndex> visible_voxels_indices;
+  visible_voxels_indices.reserve(knn_indices.size() + 1);
+  visible_voxels_indices.push_back(from_index);
   for (std::size_t i = 0; i < knn_indices.size(); ++i) {
     const ViewpointANN::IndexType to_index = knn_indices[i];
 //    getCachedVisibleSparsePoints(to_index);
-    getCachedVisibleVoxels(to_index);
+    visible_voxels_indices.push_back(to_index);
   }
+  cacheVisibleVoxels(visible_voxels_indices);
   const FloatType visible_voxels_time = timer.getElapsedTimeMs();
   timer.reset();
 #pragma omp parallel for
@@ -345,7 +459,8 @@ ViewpointPlanner::findViewpointMotions(const ViewpointEntryIndex from_index,cons
     }
     SE3Motion se3_motion;
     bool found_motion;
-    std::tie(se3_motion, found_motion) = motion_planner_.findMotion(from_viewpoint.viewpoint.pose(), to_viewpoint.viewpoint.pose());
+    std::tie(se3_motion, found_motion) = findMotionWithStraightValidation(
+        from_viewpoint.viewpoint.pose(), to_viewpoint.viewpoint.pose(), straight_valid_flags[i]);
     // TODO
     if (found_motion) {
 #if !BH_DEBUG
@@ -46,3 +46,11 @@ ViewpointPlanner::FloatType ViewpointPlanner::computePoissonMeshDepth(
     const std::size_t x, const std::size_t y) const {
   return offscreen_renderer_->computePoissonMeshDepth(viewpoint, x, y);
 }
+
+void ViewpointPlanner::computePoissonMeshDepthsAndNormalVectors(
+    const Viewpoint& viewpoint,
+    const std::vector<Eigen::Vector2i>& image_points,
+    std::vector<FloatType>* depths,
+    std::vector<Vector3>* normal_vectors) const {
+  offscreen_renderer_->computePoissonMeshDepthsAndNormalVectors(viewpoint, image_points, depths, normal_vectors);
+}
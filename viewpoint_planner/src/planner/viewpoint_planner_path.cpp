@@ -660,6 +660,7 @@ ViewpointPlanner::NextViewpointPathEntryStatus ViewpointPlanner::findNextViewpoi
     }
   }
   reportViewpointPathsStats();
+  writeViewpointPathCheckpoint();
 
   std::cout << "changes=" << changes << ", alpha=" << alpha << ", beta=" << beta << std::endl;
   return status;
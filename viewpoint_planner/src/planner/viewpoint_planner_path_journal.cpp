@@ -0,0 +1,360 @@
+//==================================================
+// viewpoint_planner_path_journal.cpp
+//
+//  Copyright (c) 2017 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: Oct 18, 2017
+//==================================================
+
+#include "viewpoint_planner.h"
+#include <cstring>
+#include <limits>
+#include <boost/filesystem.hpp>
+
+namespace {
+
+const std::string kViewpointPathJournalMagic = "VPJOURNL";
+const uint32_t kViewpointPathJournalVersion = 1;
+
+enum ViewpointPathJournalRecordType : uint32_t {
+  // Viewpoint entries that were added to the viewpoint graph
+  VIEWPOINT_ENTRIES_RECORD = 1,
+  // Motions that were added to the viewpoint graph
+  MOTIONS_RECORD = 2,
+  // New entries, tour and observed voxel information of a viewpoint path
+  PATH_RECORD = 3,
+};
+
+/// State of the planner that a journal starts from
+struct ViewpointPathJournalHeader {
+  uint64_t viewpoint_graph_hash;
+  uint64_t num_viewpoint_entries;
+  uint64_t num_paths;
+  uint64_t num_voxels;
+};
+
+using PayloadWriter = JournalFile::PayloadWriter;
+using PayloadReader = JournalFile::PayloadReader;
+
+template <typename PoseT>
+void writePose(const PoseT& pose, PayloadWriter* writer) {
+  using FloatType = typename PoseT::FloatType;
+  for (std::size_t i = 0; i < 3; ++i) {
+    writer->write<FloatType>(pose.translation()(i));
+  }
+  for (std::size_t i = 0; i < 4; ++i) {
+    writer->write<FloatType>(pose.quaternion().coeffs()(i));
+  }
+}
+
+template <typename PoseT>
+PoseT readPose(PayloadReader* reader) {
+  using FloatType = typename PoseT::FloatType;
+  using Vector3 = typename PoseT::Vector3;
+  using Quaternion = typename PoseT::Quaternion;
+  FloatType values[7];
+  for (std::size_t i = 0; i < 7; ++i) {
+    values[i] = reader->read<FloatType>();
+  }
+  return PoseT(Vector3(values[0], values[1], values[2]), Quaternion(values[6], values[3], values[4], values[5]));
+}
+
+}
+
+std::string ViewpointPlanner::getViewpointPathJournalHeader() const {
+  ViewpointPathJournalHeader header;
+  std::memset(&header, 0, sizeof(header));
+  header.viewpoint_graph_hash = computeViewpointGraphKey().getHash();
+  header.num_viewpoint_entries = viewpoint_entries_.size();
+  header.num_paths = viewpoint_paths_.size();
+  for (auto it = data_->occupied_bvh_.begin(); it != data_->occupied_bvh_.end(); ++it) {
+    ++header.num_voxels;
+  }
+  return std::string(reinterpret_cast<const char*>(&header), sizeof(header));
+}
+
+std::size_t ViewpointPlanner::openViewpointPathJournal(const std::string& filename, const bool resume) {
+  if (!viewpoint_paths_initialized_) {
+    initializeViewpointPathEntries(options_.objective_parameter_alpha, options_.objective_parameter_beta);
+  }
+  std::unique_ptr<ViewpointPathJournalState> journal(new ViewpointPathJournalState());
+  std::vector<const VoxelType*> voxels;
+  for (const VoxelType& node : data_->occupied_bvh_) {
+    journal->voxel_indices.emplace(&node, static_cast<uint32_t>(voxels.size()));
+    voxels.push_back(&node);
+  }
+  BH_ASSERT(voxels.size() < std::numeric_limits<uint32_t>::max());
+
+  std::size_t num_checkpoints = 0;
+  if (resume && boost::filesystem::exists(filename)) {
+    std::cout << "Replaying viewpoint path journal " << filename << std::endl;
+    bh::Timer timer;
+    JournalFileReader reader(filename, kViewpointPathJournalMagic);
+    if (reader.getVersion() != kViewpointPathJournalVersion) {
+      throw BH_EXCEPTION("Unsupported viewpoint path journal version " + std::to_string(reader.getVersion()));
+    }
+    if (reader.getHeaderData() != getViewpointPathJournalHeader()) {
+      throw BH_EXCEPTION("Viewpoint path journal was written for a different viewpoint graph or number of paths");
+    }
+    for (const ViewpointPath& viewpoint_path : viewpoint_paths_) {
+      if (!viewpoint_path.entries.empty()) {
+        throw BH_EXCEPTION("Viewpoint paths have to be empty to replay a viewpoint path journal");
+      }
+    }
+    std::vector<JournalFile::Record> records;
+    while (reader.readCheckpoint(&records)) {
+      applyViewpointPathCheckpoint(records, voxels);
+      ++num_checkpoints;
+    }
+    journal->writer.reset(new JournalFileWriter(filename, reader.getCommittedSize()));
+    timer.printTimingMs("Replaying viewpoint path journal");
+    std::cout << "Replayed " << num_checkpoints << " checkpoints" << std::endl;
+    reportViewpointPathsStats();
+  }
+  else {
+    journal->writer.reset(new JournalFileWriter(
+        filename, kViewpointPathJournalMagic, kViewpointPathJournalVersion, getViewpointPathJournalHeader()));
+  }
+
+  journal->num_viewpoint_entries = viewpoint_entries_.size();
+  for (const ViewpointPath& viewpoint_path : viewpoint_paths_) {
+    journal->num_path_entries.push_back(viewpoint_path.entries.size());
+  }
+  journal->motions.reserve(viewpoint_graph_motions_.size());
+  for (const auto& entry : viewpoint_graph_motions_) {
+    journal->motions.insert(entry.first);
+  }
+  viewpoint_path_journal_ = std::move(journal);
+  return num_checkpoints;
+}
+
+void ViewpointPlanner::closeViewpointPathJournal() {
+  if (!viewpoint_path_journal_) {
+    return;
+  }
+  const bool force = true;
+  writeViewpointPathCheckpoint(force);
+  viewpoint_path_journal_.reset();
+}
+
+void ViewpointPlanner::writeViewpointPathCheckpoint(const bool force /*= false*/) {
+  if (!viewpoint_path_journal_) {
+    return;
+  }
+  ViewpointPathJournalState& journal = *viewpoint_path_journal_;
+  if (!force && journal.timer.getElapsedTime() < options_.viewpoint_path_journal_interval) {
+    return;
+  }
+  bh::Timer timer;
+
+  // Viewpoint entries that were added since the last checkpoint (i.e. sparse matching viewpoints)
+  if (viewpoint_entries_.size() > journal.num_viewpoint_entries) {
+    PayloadWriter writer;
+    writer.write<uint64_t>(journal.num_viewpoint_entries);
+    writer.write<uint64_t>(viewpoint_entries_.size() - journal.num_viewpoint_entries);
+    for (std::size_t i = journal.num_viewpoint_entries; i < viewpoint_entries_.size(); ++i) {
+      const ViewpointEntry& viewpoint_entry = viewpoint_entries_[i];
+      writePose(viewpoint_entry.viewpoint.pose(), &writer);
+      writer.write<FloatType>(viewpoint_entry.total_information);
+      writer.write<uint64_t>(viewpoint_entry.voxel_set.size());
+      for (const VoxelWithInformation& voxel_with_information : viewpoint_entry.voxel_set) {
+        writer.write<uint32_t>(journal.voxel_indices.at(voxel_with_information.voxel));
+        writer.write<FloatType>(voxel_with_information.information);
+      }
+    }
+    journal.writer->writeRecord(VIEWPOINT_ENTRIES_RECORD, writer.getPayload());
+    journal.num_viewpoint_entries = viewpoint_entries_.size();
+  }
+
+  // Motions between path entries that were computed since the last checkpoint
+  std::vector<const ViewpointMotion*> new_motions;
+  for (const ViewpointPath& viewpoint_path : viewpoint_paths_) {
+    for (std::size_t i = 0; i < viewpoint_path.entries.size(); ++i) {
+      for (std::size_t j = 0; j < i; ++j) {
+        const ViewpointIndexPair vip(viewpoint_path.entries[i].viewpoint_index,
+                                     viewpoint_path.entries[j].viewpoint_index);
+        if (journal.motions.count(vip) > 0) {
+          continue;
+        }
+        const auto it = viewpoint_graph_motions_.find(vip);
+        if (it != viewpoint_graph_motions_.end()) {
+          new_motions.push_back(&it->second);
+          journal.motions.insert(vip);
+        }
+      }
+    }
+  }
+  if (!new_motions.empty()) {
+    PayloadWriter writer;
+    writer.write<uint64_t>(new_motions.size());
+    for (const ViewpointMotion* motion : new_motions) {
+      const std::vector<uint64_t> viewpoint_indices(motion->viewpointIndices().begin(),
+                                                    motion->viewpointIndices().end());
+      writer.writeVector(viewpoint_indices);
+      for (const SE3Motion& se3_motion : motion->se3Motions()) {
+        writer.write<uint64_t>(se3_motion.poses().size());
+        for (const Pose& pose : se3_motion.poses()) {
+          writePose(pose, &writer);
+        }
+      }
+    }
+    journal.writer->writeRecord(MOTIONS_RECORD, writer.getPayload());
+  }
+
+  // New path entries and the information of the voxels they observe. Removed entries are recorded implicitly
+  // by the index of the first new entry.
+  for (std::size_t path_index = 0; path_index < viewpoint_paths_.size(); ++path_index) {
+    const ViewpointPath& viewpoint_path = viewpoint_paths_[path_index];
+    const ViewpointPathComputationData& comp_data = viewpoint_paths_data_[path_index];
+    const std::size_t first_entry_index = std::min(journal.num_path_entries[path_index], viewpoint_path.entries.size());
+    PayloadWriter writer;
+    writer.write<uint64_t>(path_index);
+    writer.write<uint64_t>(first_entry_index);
+    writer.write<uint64_t>(viewpoint_path.entries.size() - first_entry_index);
+    std::unordered_set<const VoxelType*> changed_voxels;
+    for (std::size_t i = first_entry_index; i < viewpoint_path.entries.size(); ++i) {
+      const ViewpointPathEntry& path_entry = viewpoint_path.entries[i];
+      writer.write<uint64_t>(path_entry.viewpoint_index);
+      writer.write<FloatType>(path_entry.local_information);
+      writer.write<FloatType>(path_entry.acc_information);
+      writer.write<FloatType>(path_entry.local_motion_distance);
+      writer.write<FloatType>(path_entry.acc_motion_distance);
+      writer.write<FloatType>(path_entry.local_objective);
+      writer.write<FloatType>(path_entry.acc_objective);
+      writer.write<uint8_t>(path_entry.mvs_viewpoint);
+      if (path_entry.mvs_viewpoint) {
+        for (const VoxelWithInformation& voxel_with_information
+            : viewpoint_entries_[path_entry.viewpoint_index].voxel_set) {
+          changed_voxels.insert(voxel_with_information.voxel);
+        }
+      }
+    }
+    writer.write<FloatType>(viewpoint_path.acc_information);
+    writer.write<FloatType>(viewpoint_path.acc_motion_distance);
+    writer.write<FloatType>(viewpoint_path.acc_objective);
+    writer.write<uint64_t>(comp_data.num_connected_entries);
+    const std::vector<uint64_t> order(viewpoint_path.order.begin(), viewpoint_path.order.end());
+    writer.writeVector(order);
+    // Current observed information of the voxels that the new entries could have changed
+    std::vector<std::pair<uint32_t, FloatType>> observed_voxels;
+    observed_voxels.reserve(changed_voxels.size());
+    for (const VoxelType* voxel : changed_voxels) {
+      const auto it = viewpoint_path.observed_voxel_map.find(voxel);
+      if (it != viewpoint_path.observed_voxel_map.end()) {
+        observed_voxels.emplace_back(journal.voxel_indices.at(voxel), it->second);
+      }
+    }
+    writer.write<uint64_t>(observed_voxels.size());
+    for (const auto& entry : observed_voxels) {
+      writer.write<uint32_t>(entry.first);
+      writer.write<FloatType>(entry.second);
+    }
+    journal.writer->writeRecord(PATH_RECORD, writer.getPayload());
+    journal.num_path_entries[path_index] = viewpoint_path.entries.size();
+  }
+
+  journal.writer->commit();
+  journal.timer.reset();
+  timer.printTimingMs("Writing viewpoint path checkpoint");
+}
+
+void ViewpointPlanner::applyViewpointPathCheckpoint(const std::vector<JournalFile::Record>& records,
+                                                    const std::vector<const VoxelType*>& voxels) {
+  const auto getVoxel = [&](const uint32_t voxel_index) {
+    if (voxel_index >= voxels.size()) {
+      throw BH_EXCEPTION("Invalid voxel index in viewpoint path journal");
+    }
+    return voxels[voxel_index];
+  };
+
+  for (const JournalFile::Record& record : records) {
+    PayloadReader reader(record.payload);
+    if (record.type == VIEWPOINT_ENTRIES_RECORD) {
+      const std::size_t first_index = reader.read<uint64_t>();
+      const std::size_t num_entries = reader.read<uint64_t>();
+      if (first_index != viewpoint_entries_.size()) {
+        throw BH_EXCEPTION("Viewpoint entries in viewpoint path journal do not match the viewpoint graph");
+      }
+      for (std::size_t i = 0; i < num_entries; ++i) {
+        const Pose pose = readPose<Pose>(&reader);
+        const FloatType total_information = reader.read<FloatType>();
+        const std::size_t num_voxels = reader.read<uint64_t>();
+        VoxelWithInformationSet voxel_set;
+        voxel_set.reserve(num_voxels);
+        for (std::size_t j = 0; j < num_voxels; ++j) {
+          const VoxelType* voxel = getVoxel(reader.read<uint32_t>());
+          const FloatType information = reader.read<FloatType>();
+          voxel_set.emplace(voxel, information);
+        }
+        addViewpointEntryWithoutLock(ViewpointEntry(getVirtualViewpoint(pose), total_information, std::move(voxel_set)));
+      }
+    }
+    else if (record.type == MOTIONS_RECORD) {
+      const std::size_t num_motions = reader.read<uint64_t>();
+      for (std::size_t i = 0; i < num_motions; ++i) {
+        const std::vector<uint64_t> indices = reader.readVector<uint64_t>();
+        std::vector<ViewpointEntryIndex> viewpoint_indices(indices.begin(), indices.end());
+        for (const ViewpointEntryIndex viewpoint_index : viewpoint_indices) {
+          if (viewpoint_index >= viewpoint_entries_.size()) {
+            throw BH_EXCEPTION("Invalid viewpoint index in viewpoint path journal");
+          }
+        }
+        ViewpointMotion::SE3MotionVector se3_motions;
+        for (std::size_t j = 0; j + 1 < viewpoint_indices.size(); ++j) {
+          const std::size_t num_poses = reader.read<uint64_t>();
+          SE3Motion::PoseVector poses;
+          poses.reserve(num_poses);
+          for (std::size_t k = 0; k < num_poses; ++k) {
+            poses.push_back(readPose<Pose>(&reader));
+          }
+          se3_motions.emplace_back(poses);
+        }
+        addViewpointMotion(ViewpointMotion(std::move(viewpoint_indices), std::move(se3_motions)));
+      }
+    }
+    else if (record.type == PATH_RECORD) {
+      const std::size_t path_index = reader.read<uint64_t>();
+      if (path_index >= viewpoint_paths_.size()) {
+        throw BH_EXCEPTION("Invalid path index in viewpoint path journal");
+      }
+      ViewpointPath& viewpoint_path = viewpoint_paths_[path_index];
+      ViewpointPathComputationData& comp_data = viewpoint_paths_data_[path_index];
+      const std::size_t first_entry_index = reader.read<uint64_t>();
+      const std::size_t num_new_entries = reader.read<uint64_t>();
+      if (first_entry_index > viewpoint_path.entries.size()) {
+        throw BH_EXCEPTION("Viewpoint path journal is missing path entries");
+      }
+      viewpoint_path.entries.resize(first_entry_index);
+      for (std::size_t i = 0; i < num_new_entries; ++i) {
+        ViewpointPathEntry path_entry;
+        path_entry.viewpoint_index = reader.read<uint64_t>();
+        if (path_entry.viewpoint_index >= viewpoint_entries_.size()) {
+          throw BH_EXCEPTION("Invalid viewpoint index in viewpoint path journal");
+        }
+        path_entry.local_information = reader.read<FloatType>();
+        path_entry.acc_information = reader.read<FloatType>();
+        path_entry.local_motion_distance = reader.read<FloatType>();
+        path_entry.acc_motion_distance = reader.read<FloatType>();
+        path_entry.local_objective = reader.read<FloatType>();
+        path_entry.acc_objective = reader.read<FloatType>();
+        path_entry.mvs_viewpoint = reader.read<uint8_t>() != 0;
+        path_entry.viewpoint = viewpoint_entries_[path_entry.viewpoint_index].viewpoint;
+        viewpoint_path.entries.push_back(std::move(path_entry));
+      }
+      viewpoint_path.acc_information = reader.read<FloatType>();
+      viewpoint_path.acc_motion_distance = reader.read<FloatType>();
+      viewpoint_path.acc_objective = reader.read<FloatType>();
+      comp_data.num_connected_entries = std::min<std::size_t>(reader.read<uint64_t>(), viewpoint_path.entries.size());
+      const std::vector<uint64_t> order = reader.readVector<uint64_t>();
+      viewpoint_path.order.assign(order.begin(), order.end());
+      const std::size_t num_observed_voxels = reader.read<uint64_t>();
+      for (std::size_t i = 0; i < num_observed_voxels; ++i) {
+        const VoxelType* voxel = getVoxel(reader.read<uint32_t>());
+        viewpoint_path.observed_voxel_map[voxel] = reader.read<FloatType>();
+      }
+    }
+    else {
+      std::cout << "WARNING: Ignoring unknown record type " << record.type << " in viewpoint path journal" << std::endl;
+    }
+  }
+}
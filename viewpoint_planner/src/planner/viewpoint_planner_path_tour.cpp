@@ -16,6 +16,7 @@
 #include <boost/heap/binomial_heap.hpp>
 #include <boost/heap/fibonacci_heap.hpp>
 #include <bh/algorithm.h>
+#include "tour_improver.h"
 
 using std::swap;
 
@@ -33,12 +34,12 @@ void ViewpointPlanner::computeViewpointTour(ViewpointPath* viewpoint_path,
     std::cout << "Unable to compute viewpoint path tour" << std::endl;
   }
 
-  if (options_.viewpoint_path_2opt_enable) {
-    // Improve solution with 2 Opt
+  if (options_.viewpoint_path_2opt_enable || options_.viewpoint_path_lk_enable) {
+    // Improve solution with 2 Opt or Lin-Kernighan style local search
     // Cannot use multiple threads due to offscreen rendering for sparse matching
     if (!viewpoint_path->order.empty()) {
       std::unique_lock<std::mutex> lock = acquireOpenGLLock();
-      improveViewpointTourWith2Opt(viewpoint_path, comp_data);
+      improveViewpointTour(viewpoint_path, comp_data);
       lock.unlock();
     }
   }
@@ -120,9 +121,11 @@ void ViewpointPlanner::computeViewpointTour(const bool use_manual_start_position
       std::cout << "Unable to compute tour for non-connected path branch " << i << std::endl;
     }
   }
+  // Motions between path entries are the expensive part so they are journaled before the tour improvement
+  writeViewpointPathCheckpoint();
 
-  if (options_.viewpoint_path_2opt_enable) {
-    //  // Improve solution with 2 Opt
+  if (options_.viewpoint_path_2opt_enable || options_.viewpoint_path_lk_enable) {
+    //  // Improve solution with 2 Opt or Lin-Kernighan style local search
     // Cannot use multiple threads due to offscreen rendering for sparse matching
     //#pragma omp parallel for
     for (std::size_t i = 0; i < viewpoint_paths_.size(); ++i) {
@@ -131,7 +134,7 @@ void ViewpointPlanner::computeViewpointTour(const bool use_manual_start_position
       if (viewpoint_path.order.empty()) {
         continue;
       }
-      improveViewpointTourWith2Opt(&viewpoint_path, &comp_data);
+      improveViewpointTour(&viewpoint_path, &comp_data);
     }
   }
 
@@ -198,6 +201,9 @@ void ViewpointPlanner::computeViewpointTour(const bool use_manual_start_position
   if (verbose) {
     reportViewpointPathsStats();
   }
+
+  const bool force_checkpoint = true;
+  writeViewpointPathCheckpoint(force_checkpoint);
 }
 
 ViewpointPlanner::ViewpointPathGraphWrapper ViewpointPlanner::createViewpointPathGraph(
@@ -618,6 +624,190 @@ void ViewpointPlanner::improveViewpointTourWith2Opt(
   }
 }
 
+void ViewpointPlanner::improveViewpointTour(
+    ViewpointPath* viewpoint_path, ViewpointPathComputationData* comp_data) {
+  if (!options_.viewpoint_path_lk_enable) {
+    improveViewpointTourWith2Opt(viewpoint_path, comp_data);
+    return;
+  }
+  if (!options_.viewpoint_path_lk_compare_with_2opt) {
+    improveViewpointTourWithLK(viewpoint_path);
+    return;
+  }
+
+  if (viewpoint_path->order.size() != viewpoint_path->entries.size()) {
+    std::cout << "WARNING: Viewpoint tour does not cover all path entries. Skipping tour improvement." << std::endl;
+    return;
+  }
+
+  // Run both methods on the same initial tour and keep the better tour. Both tours are compared on the
+  // cost matrix that LK optimizes (motion distances with penalized connections).
+  const std::vector<FloatType> cost_matrix = computeViewpointPathCostMatrix(
+      *viewpoint_path, options_.viewpoint_path_lk_check_sparse_matching);
+  const std::vector<std::size_t> initial_order = viewpoint_path->order;
+  bh::Timer timer;
+  improveViewpointTourWith2Opt(viewpoint_path, comp_data);
+  const double time_2opt = timer.getElapsedTime();
+  std::vector<std::size_t> order_2opt = std::move(viewpoint_path->order);
+  const FloatType tour_cost_2opt = computeTourCost(cost_matrix, order_2opt);
+
+  viewpoint_path->order = initial_order;
+  timer.reset();
+  improveViewpointTourWithLK(viewpoint_path, cost_matrix);
+  const double time_lk = timer.getElapsedTime();
+  const FloatType tour_cost_lk = computeTourCost(cost_matrix, viewpoint_path->order);
+
+  std::cout << "Tour improvement comparison on " << initial_order.size() << " viewpoints"
+            << " (initial tour cost " << computeTourCost(cost_matrix, initial_order) << "):" << std::endl;
+  std::cout << "  2 Opt: tour cost=" << tour_cost_2opt
+            << ", tour length=" << computeTourLength(*viewpoint_path, order_2opt)
+            << ", time=" << time_2opt << " s" << std::endl;
+  std::cout << "  LK:    tour cost=" << tour_cost_lk
+            << ", tour length=" << computeTourLength(*viewpoint_path, viewpoint_path->order)
+            << ", time=" << time_lk << " s" << std::endl;
+  if (tour_cost_2opt < tour_cost_lk) {
+    std::cout << "  Using 2 Opt tour" << std::endl;
+    viewpoint_path->order = std::move(order_2opt);
+  }
+}
+
+ViewpointPlanner::FloatType ViewpointPlanner::computeTourCost(
+    const std::vector<FloatType>& cost_matrix, const std::vector<size_t>& order) const {
+  const std::size_t num_entries = order.size();
+  BH_ASSERT(cost_matrix.size() == num_entries * num_entries);
+  FloatType tour_cost = 0;
+  for (std::size_t i = 0; i < order.size() && order.size() > 1; ++i) {
+    const std::size_t next_i = i + 1 < order.size() ? i + 1 : 0;
+    tour_cost += cost_matrix[order[i] * num_entries + order[next_i]];
+  }
+  return tour_cost;
+}
+
+std::vector<ViewpointPlanner::FloatType> ViewpointPlanner::computeViewpointPathCostMatrix(
+    const ViewpointPath& viewpoint_path, const bool penalize_non_sparse_matchable) const {
+  const std::size_t num_entries = viewpoint_path.entries.size();
+  std::vector<FloatType> cost_matrix(num_entries * num_entries, 0);
+  FloatType max_cost = 0;
+  std::vector<bool> has_motion(num_entries * num_entries, true);
+  for (std::size_t i = 0; i < num_entries; ++i) {
+    const ViewpointEntryIndex viewpoint_index1 = viewpoint_path.entries[i].viewpoint_index;
+    for (std::size_t j = i + 1; j < num_entries; ++j) {
+      const ViewpointEntryIndex viewpoint_index2 = viewpoint_path.entries[j].viewpoint_index;
+      if (hasViewpointMotion(viewpoint_index1, viewpoint_index2)) {
+        const FloatType dist = viewpoint_graph_.getWeightByNode(viewpoint_index1, viewpoint_index2);
+        cost_matrix[i * num_entries + j] = dist;
+        cost_matrix[j * num_entries + i] = dist;
+        max_cost = std::max(max_cost, dist);
+      }
+      else {
+        has_motion[i * num_entries + j] = false;
+        has_motion[j * num_entries + i] = false;
+      }
+    }
+  }
+
+  std::vector<bool> penalize(num_entries * num_entries, false);
+  for (std::size_t i = 0; i < penalize.size(); ++i) {
+    penalize[i] = !has_motion[i];
+  }
+  if (penalize_non_sparse_matchable) {
+    // Only connections with a motion have to be checked. Scores of precomputed pairs are taken from the sparse
+    // matchability graph and the remaining pairs are decided by the cached sketches (if enabled) or the exact IOU.
+    std::vector<std::pair<std::size_t, std::size_t>> check_pairs;
+    for (std::size_t i = 0; i < num_entries; ++i) {
+      for (std::size_t j = i + 1; j < num_entries; ++j) {
+        if (has_motion[i * num_entries + j]) {
+          check_pairs.emplace_back(i, j);
+        }
+      }
+    }
+    std::vector<ViewpointEntryIndex> viewpoint_indices;
+    for (const ViewpointPathEntry& entry : viewpoint_path.entries) {
+      viewpoint_indices.push_back(entry.viewpoint_index);
+    }
+    cacheVisibleVoxels(viewpoint_indices);
+    std::vector<char> matchable(check_pairs.size());
+    // Visible voxels are cached so the pairs can be checked in parallel
+#pragma omp parallel for schedule(dynamic, 64) if (!options_.sparse_matching_dump_voxel_images)
+    for (std::size_t k = 0; k < check_pairs.size(); ++k) {
+      const ViewpointEntryIndex viewpoint_index1 = viewpoint_path.entries[check_pairs[k].first].viewpoint_index;
+      const ViewpointEntryIndex viewpoint_index2 = viewpoint_path.entries[check_pairs[k].second].viewpoint_index;
+      matchable[k] = isSparseMatchable2(viewpoint_index1, viewpoint_index2) ? 1 : 0;
+    }
+    for (std::size_t k = 0; k < check_pairs.size(); ++k) {
+      if (!matchable[k]) {
+        penalize[check_pairs[k].first * num_entries + check_pairs[k].second] = true;
+      }
+    }
+  }
+
+  // Penalty is larger than any tour without penalized connections
+  const FloatType penalty = (max_cost + 1) * num_entries;
+  for (std::size_t i = 0; i < num_entries; ++i) {
+    for (std::size_t j = i + 1; j < num_entries; ++j) {
+      if (penalize[i * num_entries + j]) {
+        cost_matrix[i * num_entries + j] += penalty;
+        cost_matrix[j * num_entries + i] += penalty;
+      }
+    }
+  }
+  return cost_matrix;
+}
+
+void ViewpointPlanner::improveViewpointTourWithLK(ViewpointPath* viewpoint_path) {
+  if (viewpoint_path->order.size() != viewpoint_path->entries.size()) {
+    std::cout << "WARNING: Viewpoint tour does not cover all path entries. Skipping tour improvement." << std::endl;
+    return;
+  }
+  bh::Timer timer;
+  const std::vector<FloatType> cost_matrix = computeViewpointPathCostMatrix(
+      *viewpoint_path, options_.viewpoint_path_lk_check_sparse_matching);
+  std::cout << "Computing cost matrix for LK took " << timer.getElapsedTime() << " s" << std::endl;
+  improveViewpointTourWithLK(viewpoint_path, cost_matrix);
+}
+
+void ViewpointPlanner::improveViewpointTourWithLK(
+    ViewpointPath* viewpoint_path, const std::vector<FloatType>& cost_matrix) {
+  const bool verbose = true;
+
+  if (viewpoint_path->order.size() != viewpoint_path->entries.size()) {
+    std::cout << "WARNING: Viewpoint tour does not cover all path entries. Skipping tour improvement." << std::endl;
+    return;
+  }
+
+  using TourImproverType = viewpoint_planner::TourImprover<FloatType>;
+  TourImproverType::Options lk_options;
+  lk_options.num_candidate_neighbors = options_.viewpoint_path_lk_num_candidate_neighbors;
+  lk_options.max_segment_length = options_.viewpoint_path_lk_max_segment_length;
+  lk_options.num_trials = options_.viewpoint_path_lk_num_trials;
+  lk_options.max_kicks_per_trial = options_.viewpoint_path_lk_max_kicks_per_trial;
+  lk_options.max_time = options_.viewpoint_path_lk_max_time;
+  lk_options.rng_seed = random_.sampleUniformInt();
+
+  const FloatType initial_tour_length = computeTourLength(*viewpoint_path, viewpoint_path->order);
+  if (verbose) {
+    std::cout << "Improving tour with LK. Initial tour length: " << initial_tour_length << std::endl;
+  }
+
+  const TourImproverType tour_improver(lk_options, viewpoint_path->entries.size(), cost_matrix);
+  const TourImproverType::Result result = tour_improver.improve(viewpoint_path->order);
+  if (result.cost < result.initial_cost) {
+    viewpoint_path->order = result.tour;
+  }
+
+  if (verbose) {
+    const FloatType tour_length = computeTourLength(*viewpoint_path, viewpoint_path->order);
+    std::cout << "LK finished " << result.num_trials << " trials with " << result.num_kicks << " kicks and "
+              << result.num_improving_moves << " improving moves in " << result.elapsed_time << " s" << std::endl;
+    if (tour_length < initial_tour_length) {
+      std::cout << "Improved tour length from " << initial_tour_length << " to " << tour_length << std::endl;
+    }
+    else {
+      std::cout << "Unable to improve tour with LK" << std::endl;
+    }
+  }
+}
+
 void ViewpointPlanner::augmentViewpointPathWithSparseMatchingViewpoints(ViewpointPath* viewpoint_path) {
   ViewpointPath new_viewpoint_path(*viewpoint_path);
   if (viewpoint_path->order.size() > 1) {
@@ -10,6 +10,13 @@
 #include <bh/opengl/utils.h>
 
 std::unordered_set<size_t> ViewpointPlanner::getVisibleVoxels(const Viewpoint& viewpoint) const {
+  if (options_.sparse_matching_cpu_visible_voxels) {
+    return getVisibleVoxelsCpu(viewpoint);
+  }
+  return getVisibleVoxelsOpenGL(viewpoint);
+}
+
+std::unordered_set<size_t> ViewpointPlanner::getVisibleVoxelsOpenGL(const Viewpoint& viewpoint) const {
   ensureOctreeDrawerIsInitialized();
   auto drawing_handle = offscreen_opengl_->beginDrawing();
   const QMatrix4x4 pvm_matrix = offscreen_opengl_->getPvmMatrixFromPose(viewpoint.pose());
@@ -21,6 +28,48 @@ std::unordered_set<size_t> ViewpointPlanner::getVisibleVoxels(const Viewpoint& v
   return visible_voxels;
 }
 
+std::unordered_set<size_t> ViewpointPlanner::getVisibleVoxelsCpu(const Viewpoint& viewpoint) const {
+  ensureVisibleVoxelRaycasterIsInitialized();
+  // Same camera and clipping planes as the offscreen OpenGL context used for index rendering
+  const PinholeCamera sparse_matching_camera
+          = getVirtualCamera().getScaledCamera(options_.sparse_matching_virtual_camera_factor);
+  const FloatType near_plane = FloatType(0.5);
+  const FloatType far_plane = FloatType(1e5);
+  return visible_voxel_raycaster_->computeVisibleIndices(
+          viewpoint.pose().getTransformationWorldToImage(), sparse_matching_camera.intrinsics().topLeftCorner<3, 3>(),
+          sparse_matching_camera.width(), sparse_matching_camera.height(),
+          near_plane, far_plane);
+}
+
+void ViewpointPlanner::ensureVisibleVoxelRaycasterIsInitialized() const {
+  std::call_once(visible_voxel_raycaster_once_flag_, [this]() {
+    bh::Timer timer;
+    // Enumerate voxels in the same order as rendering::OcTreeDrawer so that the indices are the same
+    // as the index colors. Voxels are dilated like in rendering::VoxelDrawer.
+    const FloatType voxel_size_dilation = FloatType(0.01);
+    std::vector<VoxelIndexRaycaster<FloatType>::BoundingBoxType> voxel_bboxes;
+    for (auto it = getOctree()->begin_tree(options_.sparse_matching_render_tree_depth), end = getOctree()->end_tree();
+         it != end; ++it) {
+      if (!it.isLeaf()) {
+        continue;
+      }
+      if (it->getOccupancy() < options_.sparse_matching_occupancy_threshold) {
+        continue;
+      }
+      if (it->getObservationCount() < options_.sparse_matching_observation_count_threshold) {
+        continue;
+      }
+      const Vector3 center(it.getX(), it.getY(), it.getZ());
+      const FloatType size = it.getSize() + voxel_size_dilation;
+      voxel_bboxes.push_back(VoxelIndexRaycaster<FloatType>::BoundingBoxType::createFromCenterAndExtent(
+              center, Vector3(size, size, size)));
+    }
+    visible_voxel_raycaster_.reset(new VoxelIndexRaycaster<FloatType>(voxel_bboxes));
+    timer.printTiming("Building visible voxel raycaster");
+    std::cout << "Visible voxel raycaster has " << visible_voxel_raycaster_->numVoxels() << " voxels" << std::endl;
+  });
+}
+
 std::vector<ViewpointPlannerData::OccupiedTreeType::IntersectionResult>
 ViewpointPlanner::getRaycastHitVoxels(
     const Viewpoint& viewpoint, const bool remove_duplicates) const {
@@ -9,27 +9,179 @@
 #include "viewpoint_planner.h"
 #include "viewpoint_planner_serialization.h"
 #include <boost/serialization/deque.hpp>
+#include <boost/filesystem.hpp>
+#include <cmath>
+#include <cstring>
+#include <future>
+#include <limits>
+#include <bh/utilities.h>
+#include "chunked_file.h"
+
+namespace {
+
+const std::string kViewpointGraphMagic = "VPGRAPH1";
+const uint32_t kViewpointGraphVersion = 1;
+
+/// Sizes stored in the info chunk of a binary viewpoint graph
+struct ViewpointGraphInfo {
+  uint64_t num_real_viewpoints;
+  uint64_t num_viewpoints;
+  uint64_t num_graph_vertices;
+  uint64_t num_graph_edges;
+  uint64_t num_motions;
+  // Number of BVH nodes that voxel indices refer to
+  uint64_t num_voxels;
+  uint32_t float_size;
+  uint32_t index_size;
+};
+
+// Poses are stored as translation followed by quaternion coefficients (x, y, z, w)
+const std::size_t kPoseSize = 7;
+
+template <typename PoseT>
+void writePose(const PoseT& pose, typename PoseT::FloatType* out) {
+  for (std::size_t i = 0; i < 3; ++i) {
+    out[i] = pose.translation()(i);
+  }
+  for (std::size_t i = 0; i < 4; ++i) {
+    out[3 + i] = pose.quaternion().coeffs()(i);
+  }
+}
+
+template <typename PoseT>
+PoseT readPose(const typename PoseT::FloatType* in) {
+  using Vector3 = typename PoseT::Vector3;
+  using Quaternion = typename PoseT::Quaternion;
+  return PoseT(Vector3(in[0], in[1], in[2]), Quaternion(in[6], in[3], in[4], in[5]));
+}
+
+}
+
+PrecomputationKey ViewpointPlanner::computeViewpointGraphKey() const {
+  PrecomputationKey key("viewpoint_graph");
+  key.addKey(data_->getCacheKey())
+      .addValue(options_.virtual_camera_scale)
+      .addValue(options_.virtual_camera_width)
+      .addValue(options_.virtual_camera_height)
+      .addValue(options_.virtual_camera_focal_length)
+      .addValue(options_.raycast_min_range)
+      .addValue(options_.raycast_max_range)
+      .addValue(options_.incidence_ignore_dot_product_sign)
+      .addValue(options_.incidence_angle_threshold_degrees)
+      .addValue(options_.incidence_angle_inv_falloff_factor_degrees)
+      .addValue(options_.voxel_sensor_size_ratio_threshold)
+      .addValue(options_.voxel_sensor_size_ratio_inv_falloff_factor);
+  for (std::size_t i = 0; i < 3; ++i) {
+    key.addValue(options_.drone_bbox_min(i))
+        .addValue(options_.drone_bbox_max(i));
+  }
+  return key;
+}
 
 void ViewpointPlanner::saveViewpointGraph(const std::string& filename) const {
+  saveViewpointGraph(filename, options_.viewpoint_graph_binary_format);
+}
+
+void ViewpointPlanner::saveViewpointGraph(const std::string& filename, const bool binary_format) const {
   std::cout << "Writing viewpoint graph to " << filename << std::endl;
   std::cout << "Graph has " << viewpoint_graph_.numVertices() << " viewpoints"
       << " and " << viewpoint_graph_.numEdges() << " motions" << std::endl;
-  std::ofstream ofs(filename);
-  boost::archive::binary_oarchive oa(ofs);
-  ViewpointEntrySaver ves(viewpoint_entries_, data_->occupied_bvh_);
-  oa << num_real_viewpoints_;
-  oa << ves;
-  oa << stereo_viewpoint_indices_;
-  oa << stereo_viewpoint_computed_flags_;
-  oa << viewpoint_exploration_front_;
-  oa << viewpoint_graph_;
-  oa << viewpoint_graph_motions_;
+  PrecomputationKey::removeForArtifact(filename);
+  bh::Timer timer;
+  if (binary_format) {
+    saveViewpointGraphBinary(filename);
+  }
+  else {
+    saveViewpointGraphArchive(filename);
+  }
+  timer.printTimingMs("Writing viewpoint graph");
+  if (motion_planner_.getRoadmap().isBuilt()) {
+    motion_planner_.saveRoadmap(getMotionRoadmapFilename(filename));
+  }
+  // The matchability graph is keyed on all viewpoints so a graph of fewer viewpoints is not stored
+  if (!sparse_matchability_graph_.empty() && sparse_matchability_graph_.numVertices() == viewpoint_entries_.size()) {
+    saveSparseMatchabilityGraph(getSparseMatchabilityGraphFilename(filename));
+  }
+  else {
+    PrecomputationKey::removeForArtifact(getSparseMatchabilityGraphFilename(filename));
+  }
+  computeViewpointGraphKey().writeForArtifact(filename);
   std::cout << "Done" << std::endl;
 }
 
-void ViewpointPlanner::loadViewpointGraph(const std::string& filename) {
+bool ViewpointPlanner::loadViewpointGraph(const std::string& filename) {
+  return loadViewpointGraph(filename, options_.viewpoint_graph_check_key);
+}
+
+bool ViewpointPlanner::loadViewpointGraph(const std::string& filename, const bool check_key) {
   reset();
+  if (!boost::filesystem::exists(PrecomputationKey::getKeyFilename(filename))) {
+    std::cout << "WARNING: Viewpoint graph has no key. Cannot check whether it is up-to-date." << std::endl;
+  }
+  else if (!computeViewpointGraphKey().matchesArtifact(filename)) {
+    if (check_key) {
+      std::cout << "WARNING: Viewpoint graph was computed with different inputs. Ignoring it." << std::endl;
+      return false;
+    }
+    std::cout << "WARNING: Viewpoint graph was computed with different inputs. Loading it anyway." << std::endl;
+  }
   std::cout << "Loading viewpoint graph from " << filename << std::endl;
+  bh::Timer timer;
+  if (isBinaryViewpointGraphFile(filename)) {
+    loadViewpointGraphBinary(filename);
+  }
+  else {
+    loadViewpointGraphArchive(filename);
+  }
+  viewpoint_graph_components_valid_ = false;
+  timer.printTimingMs("Loading viewpoint graph");
+  std::cout << "Loaded viewpoint graph with " << viewpoint_entries_.size() << " viewpoints "
+      << " and " << viewpoint_graph_.numEdges() << " motions" << std::endl;
+  BH_ASSERT(viewpoint_entries_.size() == viewpoint_graph_.numVertices());
+  BH_ASSERT(viewpoint_graph_.numEdges() == viewpoint_graph_motions_.size());
+
+  const std::string roadmap_filename = getMotionRoadmapFilename(filename);
+  if (motion_planner_.options().enable_roadmap && boost::filesystem::exists(roadmap_filename)) {
+    motion_planner_.loadRoadmap(roadmap_filename);
+  }
+
+  const std::string matchability_graph_filename = getSparseMatchabilityGraphFilename(filename);
+  bool matchability_graph_loaded = false;
+  if (boost::filesystem::exists(matchability_graph_filename)) {
+    matchability_graph_loaded = loadSparseMatchabilityGraph(matchability_graph_filename);
+  }
+  if (!matchability_graph_loaded && options_.sparse_matching_graph_precompute) {
+    computeSparseMatchabilityGraph();
+  }
+
+  // Consistency check that viewpoint motion distances and graph edge weights are equal
+  for (ViewpointEntryIndex viewpoint_index = 0; viewpoint_index < viewpoint_entries_.size(); ++viewpoint_index) {
+    const auto edges = viewpoint_graph_.getEdges(viewpoint_index);
+    for (auto it = edges.begin(); it != edges.end(); ++it) {
+      const FloatType weight = it.weight();
+      const FloatType dist = getViewpointMotion(it.sourceNode(), it.targetNode()).distance();
+      if (!bh::isApproxEqual(weight, dist, FloatType(1e-2))) {
+        std::cout << "it.sourceNode()=" << it.sourceNode() << ", it.targetNode()=" << it.targetNode()
+            << ", weight=" << weight << ", dist=" << dist << std::endl;
+      }
+      BH_ASSERT(it.source() == viewpoint_index);
+      BH_ASSERT(it.sourceNode() == viewpoint_index);
+      BH_ASSERT(it.target() == it.targetNode());
+    }
+  }
+
+  // Motions of the loaded viewpoints are part of the graph file
+  viewpoint_motion_dirty_set_.clear();
+
+  std::cout << "Clearing observed voxels for previous camera viewpoints" << std::endl;
+  for (std::size_t i = 0; i < num_real_viewpoints_; ++i) {
+    ViewpointEntry& viewpoint_entry = viewpoint_entries_[i];
+    viewpoint_entry.voxel_set.clear();
+  }
+  return true;
+}
+
+void ViewpointPlanner::loadViewpointGraphArchive(const std::string& filename) {
   std::ifstream ifs(filename);
   boost::archive::binary_iarchive ia(ifs);
   std::size_t new_num_real_viewpoints;
@@ -42,7 +194,6 @@ void ViewpointPlanner::loadViewpointGraph(const std::string& filename) {
   ia >> viewpoint_exploration_front_;
   viewpoint_graph_.clear();
   ia >> viewpoint_graph_;
-  viewpoint_graph_components_valid_ = false;
   std::cout << "Regenerating approximate nearest neighbor index" << std::endl;
   viewpoint_ann_.clear();
   for (const ViewpointEntry& viewpoint_entry : viewpoint_entries_) {
@@ -63,32 +214,378 @@ void ViewpointPlanner::loadViewpointGraph(const std::string& filename) {
   }
   std::cout << "Loading motions" << std::endl;
   ia >> viewpoint_graph_motions_;
-  std::cout << "Loaded viewpoint graph with " << viewpoint_entries_.size() << " viewpoints "
-      << " and " << viewpoint_graph_.numEdges() << " motions" << std::endl;
-  BH_ASSERT(viewpoint_entries_.size() == viewpoint_graph_.numVertices());
-  BH_ASSERT(viewpoint_graph_.numEdges() == viewpoint_graph_motions_.size());
+}
 
-  // Consistency check that viewpoint motion distances and graph edge weights are equal
-  for (ViewpointEntryIndex viewpoint_index = 0; viewpoint_index < viewpoint_entries_.size(); ++viewpoint_index) {
-    const auto edges = viewpoint_graph_.getEdges(viewpoint_index);
-    for (auto it = edges.begin(); it != edges.end(); ++it) {
-      const FloatType weight = it.weight();
-      const FloatType dist = getViewpointMotion(it.sourceNode(), it.targetNode()).distance();
-      if (!bh::isApproxEqual(weight, dist, FloatType(1e-2))) {
-        std::cout << "it.sourceNode()=" << it.sourceNode() << ", it.targetNode()=" << it.targetNode()
-            << ", weight=" << weight << ", dist=" << dist << std::endl;
+void ViewpointPlanner::saveViewpointGraphArchive(const std::string& filename) const {
+  // A stale nearest neighbor index of a previous binary graph must not be picked up
+  boost::system::error_code error_code;
+  boost::filesystem::remove(getViewpointAnnFilename(filename), error_code);
+  std::ofstream ofs(filename);
+  boost::archive::binary_oarchive oa(ofs);
+  ViewpointEntrySaver ves(viewpoint_entries_, data_->occupied_bvh_);
+  oa << num_real_viewpoints_;
+  oa << ves;
+  oa << stereo_viewpoint_indices_;
+  oa << stereo_viewpoint_computed_flags_;
+  oa << viewpoint_exploration_front_;
+  oa << viewpoint_graph_;
+  oa << viewpoint_graph_motions_;
+}
+
+void ViewpointPlanner::saveViewpointGraphBinary(const std::string& filename) const {
+  const std::string ann_filename = getViewpointAnnFilename(filename);
+  boost::system::error_code error_code;
+  boost::filesystem::remove(ann_filename, error_code);
+
+  // Consistent ordering of BVH nodes (same as for the boost archive)
+  std::unordered_map<const VoxelType*, uint32_t> voxel_index_map;
+  uint32_t voxel_index = 0;
+  for (const VoxelType& node : data_->occupied_bvh_) {
+    voxel_index_map.emplace(&node, voxel_index);
+    ++voxel_index;
+  }
+  BH_ASSERT(voxel_index_map.size() < std::numeric_limits<uint32_t>::max());
+
+  ViewpointGraphInfo info;
+  std::memset(&info, 0, sizeof(info));
+  info.num_real_viewpoints = num_real_viewpoints_;
+  info.num_viewpoints = viewpoint_entries_.size();
+  info.num_graph_vertices = viewpoint_graph_.numVertices();
+  info.num_graph_edges = viewpoint_graph_.numEdges();
+  info.num_motions = viewpoint_graph_motions_.size();
+  info.num_voxels = voxel_index_map.size();
+  info.float_size = sizeof(FloatType);
+  info.index_size = sizeof(uint64_t);
+
+  ChunkedFileWriter writer(filename, kViewpointGraphMagic, kViewpointGraphVersion);
+  writer.writeValueChunk("INFO", info);
+
+  // Viewpoint entries
+  const std::size_t num_entries = viewpoint_entries_.size();
+  std::vector<FloatType> poses(num_entries * kPoseSize);
+  std::vector<FloatType> informations(num_entries);
+  std::vector<uint64_t> voxel_offsets(num_entries + 1, 0);
+  for (std::size_t i = 0; i < num_entries; ++i) {
+    voxel_offsets[i + 1] = voxel_offsets[i] + viewpoint_entries_[i].voxel_set.size();
+  }
+  std::vector<uint32_t> voxel_ids(voxel_offsets.back());
+  std::vector<FloatType> voxel_informations(voxel_offsets.back());
+#pragma omp parallel for schedule(dynamic, 64)
+  for (std::size_t i = 0; i < num_entries; ++i) {
+    const ViewpointEntry& entry = viewpoint_entries_[i];
+    writePose(entry.viewpoint.pose(), &poses[i * kPoseSize]);
+    informations[i] = entry.total_information;
+    std::size_t offset = voxel_offsets[i];
+    for (const VoxelWithInformation& voxel_with_information : entry.voxel_set) {
+      voxel_ids[offset] = voxel_index_map.at(voxel_with_information.voxel);
+      voxel_informations[offset] = voxel_with_information.information;
+      ++offset;
+    }
+  }
+  writer.writeChunk("POSES", poses);
+  writer.writeChunk("INFORM", informations);
+  writer.writeChunk("VXOFFS", voxel_offsets);
+  writer.writeChunk("VXIDS", voxel_ids);
+  writer.writeChunk("VXINFORM", voxel_informations);
+
+  const std::vector<uint64_t> stereo_indices(stereo_viewpoint_indices_.begin(), stereo_viewpoint_indices_.end());
+  const std::vector<uint8_t> stereo_flags(stereo_viewpoint_computed_flags_.begin(),
+                                          stereo_viewpoint_computed_flags_.end());
+  const std::vector<uint64_t> exploration_front(viewpoint_exploration_front_.begin(),
+                                                viewpoint_exploration_front_.end());
+  writer.writeChunk("STEREO", stereo_indices);
+  writer.writeChunk("STFLAGS", stereo_flags);
+  writer.writeChunk("EXPLORE", exploration_front);
+
+  // Graph vertices and edges
+  const ViewpointGraph::BoostGraph& boost_graph = viewpoint_graph_.boostGraph();
+  std::vector<uint64_t> graph_nodes;
+  graph_nodes.reserve(viewpoint_graph_.numVertices());
+  auto vertex_its = boost::vertices(boost_graph);
+  for (auto it = vertex_its.first; it != vertex_its.second; ++it) {
+    graph_nodes.push_back(viewpoint_graph_.getNode(*it));
+  }
+  std::vector<uint64_t> edge_nodes;
+  std::vector<FloatType> edge_weights;
+  edge_nodes.reserve(2 * viewpoint_graph_.numEdges());
+  edge_weights.reserve(viewpoint_graph_.numEdges());
+  auto edge_its = viewpoint_graph_.edges();
+  for (auto it = edge_its.first; it != edge_its.second; ++it) {
+    edge_nodes.push_back(viewpoint_graph_.getNode(boost::source(*it, boost_graph)));
+    edge_nodes.push_back(viewpoint_graph_.getNode(boost::target(*it, boost_graph)));
+    edge_weights.push_back(boost::get(boost::edge_weight, boost_graph, *it));
+  }
+  writer.writeChunk("GNODES", graph_nodes);
+  writer.writeChunk("GEDGES", edge_nodes);
+  writer.writeChunk("GWEIGHTS", edge_weights);
+
+  // Motions. Each motion has a list of viewpoint indices and one SE3 motion (a list of poses)
+  // between consecutive viewpoints.
+  std::vector<uint64_t> motion_keys;
+  std::vector<uint64_t> motion_viewpoint_offsets(1, 0);
+  std::vector<uint64_t> motion_viewpoint_indices;
+  std::vector<uint64_t> se3_motion_pose_offsets(1, 0);
+  std::vector<FloatType> se3_motion_poses;
+  motion_keys.reserve(2 * viewpoint_graph_motions_.size());
+  motion_viewpoint_offsets.reserve(viewpoint_graph_motions_.size() + 1);
+  for (const auto& entry : viewpoint_graph_motions_) {
+    const ViewpointMotion& motion = entry.second;
+    BH_ASSERT(motion.se3Motions().size() + 1 == motion.viewpointIndices().size());
+    motion_keys.push_back(entry.first.index1);
+    motion_keys.push_back(entry.first.index2);
+    motion_viewpoint_indices.insert(motion_viewpoint_indices.end(),
+                                    motion.viewpointIndices().begin(), motion.viewpointIndices().end());
+    motion_viewpoint_offsets.push_back(motion_viewpoint_indices.size());
+    for (const SE3Motion& se3_motion : motion.se3Motions()) {
+      for (const Pose& pose : se3_motion.poses()) {
+        se3_motion_poses.resize(se3_motion_poses.size() + kPoseSize);
+        writePose(pose, &se3_motion_poses[se3_motion_poses.size() - kPoseSize]);
       }
-      BH_ASSERT(it.source() == viewpoint_index);
-      BH_ASSERT(it.sourceNode() == viewpoint_index);
-      BH_ASSERT(it.target() == it.targetNode());
+      se3_motion_pose_offsets.push_back(se3_motion_poses.size() / kPoseSize);
     }
   }
+  writer.writeChunk("MKEYS", motion_keys);
+  writer.writeChunk("MVOFFS", motion_viewpoint_offsets);
+  writer.writeChunk("MVIDS", motion_viewpoint_indices);
+  writer.writeChunk("MPOFFS", se3_motion_pose_offsets);
+  writer.writeChunk("MPOSES", se3_motion_poses);
 
-  std::cout << "Clearing observed voxels for previous camera viewpoints" << std::endl;
-  for (std::size_t i = 0; i < num_real_viewpoints_; ++i) {
-    ViewpointEntry& viewpoint_entry = viewpoint_entries_[i];
-    viewpoint_entry.voxel_set.clear();
+  // Spatial indices
+  if (options_.viewpoint_count_grid_enable) {
+    writer.writeChunk("DENSITY", viewpoint_count_grid_.getValues());
+  }
+  writer.close();
+  if (!viewpoint_ann_.empty()) {
+    viewpoint_ann_.saveIndex(ann_filename);
+  }
+}
+
+void ViewpointPlanner::loadViewpointGraphBinary(const std::string& filename) {
+  const ChunkedFileReader reader(filename, kViewpointGraphMagic);
+  if (reader.getVersion() != kViewpointGraphVersion) {
+    throw BH_EXCEPTION("Unsupported viewpoint graph version " + std::to_string(reader.getVersion()));
+  }
+  const ViewpointGraphInfo info = reader.getValueChunk<ViewpointGraphInfo>("INFO");
+  BH_ASSERT(info.float_size == sizeof(FloatType));
+  BH_ASSERT(info.index_size == sizeof(uint64_t));
+  BH_ASSERT(info.num_real_viewpoints == num_real_viewpoints_);
+
+  std::vector<VoxelType*> voxels;
+  voxels.reserve(info.num_voxels);
+  for (VoxelType& node : data_->occupied_bvh_) {
+    voxels.push_back(&node);
+  }
+  BH_ASSERT(voxels.size() == info.num_voxels);
+
+  const std::size_t num_entries = info.num_viewpoints;
+  const ChunkedFile::Chunk<FloatType> poses = reader.getChunk<FloatType>("POSES", num_entries * kPoseSize);
+  const ChunkedFile::Chunk<FloatType> informations = reader.getChunk<FloatType>("INFORM", num_entries);
+  const ChunkedFile::Chunk<uint64_t> voxel_offsets = reader.getChunk<uint64_t>("VXOFFS", num_entries + 1);
+  const ChunkedFile::Chunk<uint32_t> voxel_ids = reader.getChunk<uint32_t>("VXIDS", voxel_offsets[num_entries]);
+  const ChunkedFile::Chunk<FloatType> voxel_informations
+      = reader.getChunk<FloatType>("VXINFORM", voxel_offsets[num_entries]);
+
+  // The nearest neighbor index is restored in the background while the entries are reconstructed
+  std::vector<Vector3> positions(num_entries);
+  for (std::size_t i = 0; i < num_entries; ++i) {
+    positions[i] = Vector3(poses[i * kPoseSize], poses[i * kPoseSize + 1], poses[i * kPoseSize + 2]);
+  }
+  const std::string ann_filename = getViewpointAnnFilename(filename);
+  std::future<void> ann_future = std::async(std::launch::async, [&]() {
+    bool ann_loaded = false;
+    if (!positions.empty() && boost::filesystem::exists(ann_filename)) {
+      try {
+        viewpoint_ann_.loadIndex(ann_filename, positions.begin(), positions.end());
+        ann_loaded = true;
+      }
+      catch (const std::exception& err) {
+        std::cout << "WARNING: Failed to load approximate nearest neighbor index: " << err.what() << std::endl;
+      }
+    }
+    if (!ann_loaded) {
+      std::cout << "Regenerating approximate nearest neighbor index" << std::endl;
+      viewpoint_ann_.clear();
+      if (!positions.empty()) {
+        viewpoint_ann_.initIndex(positions.begin(), positions.end());
+      }
+    }
+  });
+
+  const size_t entries_capacity = (size_t)std::ceil(1.25 * num_entries);
+  viewpoint_entries_.clear();
+  viewpoint_entries_.reserve(entries_capacity);
+  viewpoint_entries_.resize(num_entries);
+  bool valid_voxel_ids = true;
+#pragma omp parallel for schedule(dynamic, 64)
+  for (std::size_t i = 0; i < num_entries; ++i) {
+    ViewpointEntry& entry = viewpoint_entries_[i];
+    entry.viewpoint = Viewpoint(&virtual_camera_, readPose<Pose>(&poses[i * kPoseSize]));
+    entry.total_information = informations[i];
+    entry.voxel_set.reserve(voxel_offsets[i + 1] - voxel_offsets[i]);
+    for (std::size_t j = voxel_offsets[i]; j < voxel_offsets[i + 1]; ++j) {
+      if (voxel_ids[j] >= voxels.size()) {
+        valid_voxel_ids = false;
+        continue;
+      }
+      entry.voxel_set.emplace(voxels[voxel_ids[j]], voxel_informations[j]);
+    }
+  }
+  BH_ASSERT(valid_voxel_ids);
+
+  const ChunkedFile::Chunk<uint64_t> stereo_indices = reader.getChunk<uint64_t>("STEREO", num_entries);
+  const ChunkedFile::Chunk<uint8_t> stereo_flags = reader.getChunk<uint8_t>("STFLAGS", num_entries);
+  const ChunkedFile::Chunk<uint64_t> exploration_front = reader.getChunk<uint64_t>("EXPLORE");
+  stereo_viewpoint_indices_.assign(stereo_indices.begin(), stereo_indices.end());
+  stereo_viewpoint_computed_flags_.assign(stereo_flags.begin(), stereo_flags.end());
+  viewpoint_exploration_front_.assign(exploration_front.begin(), exploration_front.end());
+
+  // Motions are reconstructed in parallel and inserted afterwards
+  const std::size_t num_motions = info.num_motions;
+  const ChunkedFile::Chunk<uint64_t> motion_keys = reader.getChunk<uint64_t>("MKEYS", 2 * num_motions);
+  const ChunkedFile::Chunk<uint64_t> motion_viewpoint_offsets = reader.getChunk<uint64_t>("MVOFFS", num_motions + 1);
+  const ChunkedFile::Chunk<uint64_t> motion_viewpoint_indices
+      = reader.getChunk<uint64_t>("MVIDS", motion_viewpoint_offsets[num_motions]);
+  const std::size_t num_se3_motions = motion_viewpoint_indices.size() - num_motions;
+  const ChunkedFile::Chunk<uint64_t> se3_motion_pose_offsets
+      = reader.getChunk<uint64_t>("MPOFFS", num_se3_motions + 1);
+  const ChunkedFile::Chunk<FloatType> se3_motion_poses
+      = reader.getChunk<FloatType>("MPOSES", se3_motion_pose_offsets[num_se3_motions] * kPoseSize);
+  std::vector<ViewpointMotion> motions(num_motions);
+#pragma omp parallel for schedule(dynamic, 64)
+  for (std::size_t i = 0; i < num_motions; ++i) {
+    std::vector<ViewpointEntryIndex> viewpoint_indices(
+        motion_viewpoint_indices.begin() + motion_viewpoint_offsets[i],
+        motion_viewpoint_indices.begin() + motion_viewpoint_offsets[i + 1]);
+    // Motion i has one SE3 motion less than viewpoints, so the index of its first SE3 motion is known
+    const std::size_t se3_motion_begin = motion_viewpoint_offsets[i] - i;
+    ViewpointMotion::SE3MotionVector se3_motions;
+    se3_motions.reserve(viewpoint_indices.size() - 1);
+    for (std::size_t j = se3_motion_begin; j < se3_motion_begin + viewpoint_indices.size() - 1; ++j) {
+      SE3Motion::PoseVector se3_poses;
+      se3_poses.reserve(se3_motion_pose_offsets[j + 1] - se3_motion_pose_offsets[j]);
+      for (std::size_t k = se3_motion_pose_offsets[j]; k < se3_motion_pose_offsets[j + 1]; ++k) {
+        se3_poses.push_back(readPose<Pose>(&se3_motion_poses[k * kPoseSize]));
+      }
+      se3_motions.emplace_back(se3_poses);
+    }
+    motions[i] = ViewpointMotion(std::move(viewpoint_indices), std::move(se3_motions));
+  }
+  viewpoint_graph_motions_.clear();
+  viewpoint_graph_motions_.reserve(num_motions);
+  for (std::size_t i = 0; i < num_motions; ++i) {
+    viewpoint_graph_motions_.emplace(ViewpointIndexPair(motion_keys[2 * i], motion_keys[2 * i + 1]),
+                                     std::move(motions[i]));
+  }
+
+  viewpoint_graph_ = ViewpointGraph();
+  const ChunkedFile::Chunk<uint64_t> graph_nodes = reader.getChunk<uint64_t>("GNODES", info.num_graph_vertices);
+  const ChunkedFile::Chunk<uint64_t> edge_nodes = reader.getChunk<uint64_t>("GEDGES", 2 * info.num_graph_edges);
+  const ChunkedFile::Chunk<FloatType> edge_weights = reader.getChunk<FloatType>("GWEIGHTS", info.num_graph_edges);
+  for (const uint64_t node : graph_nodes) {
+    viewpoint_graph_.addNode(node);
+  }
+  for (std::size_t i = 0; i < edge_weights.size(); ++i) {
+    viewpoint_graph_.addEdgeByNode(edge_nodes[2 * i], edge_nodes[2 * i + 1], edge_weights[i], false);
+  }
+
+  if (options_.viewpoint_count_grid_enable) {
+    if (reader.hasChunk("DENSITY")
+        && reader.getChunk<size_t>("DENSITY").size() == viewpoint_count_grid_.getNumElements()) {
+      const ChunkedFile::Chunk<size_t> density = reader.getChunk<size_t>("DENSITY");
+      std::copy(density.begin(), density.end(), viewpoint_count_grid_.getValues().begin());
+    }
+    else {
+      std::cout << "Regenerating density field" << std::endl;
+      viewpoint_count_grid_.setAllValues(0);
+      for (const Vector3& viewpoint_position : positions) {
+        if (viewpoint_count_grid_.isInsideGrid(viewpoint_position)) {
+          viewpoint_count_grid_(viewpoint_position) += 1;
+        }
+        else {
+          std::cout << "WARNING: Loaded viewpoint outside of density grid" << std::endl;
+        }
+      }
+    }
+  }
+
+  ann_future.get();
+}
+
+std::string ViewpointPlanner::getViewpointAnnFilename(const std::string& viewpoint_graph_filename) {
+  return viewpoint_graph_filename + ".ann";
+}
+
+bool ViewpointPlanner::isBinaryViewpointGraphFile(const std::string& filename) {
+  return ChunkedFileReader::hasMagic(filename, kViewpointGraphMagic);
+}
+
+
+std::string ViewpointPlanner::getMotionRoadmapFilename(const std::string& viewpoint_graph_filename) {
+  return viewpoint_graph_filename + ".roadmap";
+}
+
+std::string ViewpointPlanner::getSparseMatchabilityGraphFilename(const std::string& viewpoint_graph_filename) {
+  return viewpoint_graph_filename + ".matchability";
+}
+
+PrecomputationKey ViewpointPlanner::computeSparseMatchabilityGraphKey() const {
+  const PinholeCamera sparse_matching_camera
+          = getVirtualCamera().getScaledCamera(options_.sparse_matching_virtual_camera_factor);
+  PrecomputationKey key("sparse_matchability_graph");
+  key.addKey(computeViewpointGraphKey())
+      .addValue(sparse_matching_camera.width())
+      .addValue(sparse_matching_camera.height())
+      .addValue(sparse_matching_camera.intrinsics()(0, 0))
+      .addValue(sparse_matching_camera.intrinsics()(1, 1))
+      .addValue(options_.sparse_matching_occupancy_threshold)
+      .addValue(options_.sparse_matching_observation_count_threshold)
+      .addValue(options_.sparse_matching_render_tree_depth)
+      .addValue(options_.sparse_matching_max_distance)
+      .addValue(sparse_matching_max_angular_distance_)
+      .addValue(viewpoint_entries_.size());
+  // Scores are stored per viewpoint index so the viewpoints have to be the same
+  for (const ViewpointEntry& viewpoint_entry : viewpoint_entries_) {
+    const Pose& pose = viewpoint_entry.viewpoint.pose();
+    for (std::size_t i = 0; i < 3; ++i) {
+      key.addValue(pose.getWorldPosition()(i));
+    }
+    for (std::size_t i = 0; i < 4; ++i) {
+      key.addValue(pose.quaternion().coeffs()(i));
+    }
+  }
+  return key;
+}
+
+void ViewpointPlanner::saveSparseMatchabilityGraphOfViewpointGraph(const std::string& viewpoint_graph_filename) const {
+  saveSparseMatchabilityGraph(getSparseMatchabilityGraphFilename(viewpoint_graph_filename));
+}
+
+void ViewpointPlanner::saveSparseMatchabilityGraph(const std::string& filename) const {
+  std::cout << "Writing sparse matchability graph to " << filename << std::endl;
+  computeSparseMatchabilityGraphKey().writeArtifact(filename, [&]() {
+    std::ofstream ofs(filename, std::ios::binary);
+    boost::archive::binary_oarchive oa(ofs);
+    oa << sparse_matchability_graph_;
+  });
+}
+
+bool ViewpointPlanner::loadSparseMatchabilityGraph(const std::string& filename) {
+  if (!computeSparseMatchabilityGraphKey().matchesArtifact(filename)) {
+    std::cout << "WARNING: Sparse matchability graph " << filename
+              << " was computed with different inputs. Discarding it." << std::endl;
+    return false;
+  }
+  std::cout << "Loading sparse matchability graph from " << filename << std::endl;
+  std::ifstream ifs(filename, std::ios::binary);
+  boost::archive::binary_iarchive ia(ifs);
+  ia >> sparse_matchability_graph_;
+  if (sparse_matchability_graph_.numVertices() > viewpoint_entries_.size()) {
+    std::cout << "WARNING: Sparse matchability graph has more viewpoints than the viewpoint graph. Discarding it." << std::endl;
+    sparse_matchability_graph_.clear();
+    return false;
   }
+  std::cout << "Loaded sparse matchability graph with " << sparse_matchability_graph_.numEdges() << " pairs" << std::endl;
+  return true;
 }
 
 void ViewpointPlanner::saveViewpointPath(const std::string& filename) const {
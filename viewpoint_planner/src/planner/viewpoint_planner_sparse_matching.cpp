@@ -35,6 +35,13 @@ bool ViewpointPlanner::isSparseMatchable2(
         const FloatType iou_threshold) const {
   const bool verbose = false;
 
+  // The intersection can not be larger than the smaller set
+  if (!options_.sparse_matching_dump_voxel_images
+      && VoxelSetSketchType::computeUpperBoundAverageSizeIoU(visible_voxels1.size(), visible_voxels2.size())
+         < iou_threshold) {
+    return false;
+  }
+
   const std::unordered_set<size_t> intersection_set
           = bh::computeSetIntersection(visible_voxels1, visible_voxels2);
 //  const std::unordered_set<size_t> union_set
@@ -138,8 +145,22 @@ bool ViewpointPlanner::isSparseMatchable2(
         const ViewpointEntryIndex viewpoint_index1,
         const ViewpointEntryIndex viewpoint_index2,
         const FloatType iou_threshold) const {
+  SparseMatchabilityGraphType::ScoreType score;
+  if (!options_.sparse_matching_dump_voxel_images
+      && sparse_matchability_graph_.find(viewpoint_index1, viewpoint_index2, &score)) {
+    return score >= iou_threshold;
+  }
   const Viewpoint& viewpoint1 = viewpoint_entries_[viewpoint_index1].viewpoint;
   const Viewpoint& viewpoint2 = viewpoint_entries_[viewpoint_index2].viewpoint;
+  if (options_.sparse_matching_voxels_sketch_size > 0 && !options_.sparse_matching_dump_voxel_images) {
+    bool matchable;
+    const bool decided = decideSparseMatchableWithSketches(
+            getCachedVisibleVoxelSketch(viewpoint_index1), getCachedVisibleVoxelSketch(viewpoint_index2),
+            iou_threshold, &matchable);
+    if (decided) {
+      return matchable;
+    }
+  }
   const std::unordered_set<size_t>& visible_voxels1 = getCachedVisibleVoxels(viewpoint_index1);
   const std::unordered_set<size_t>& visible_voxels2 = getCachedVisibleVoxels(viewpoint_index2);
   return isSparseMatchable2(viewpoint1, viewpoint2, visible_voxels1, visible_voxels2, iou_threshold);
@@ -165,6 +186,45 @@ bool ViewpointPlanner::isSparseMatchable2(
   return isSparseMatchable2(viewpoint1, viewpoint2, visible_voxels1, visible_voxels2, iou_threshold);
 }
 
+bool ViewpointPlanner::isSparseMatchable2(
+        const ViewpointEntryIndex viewpoint_index1,
+        const Viewpoint& viewpoint2,
+        const std::unordered_set<size_t>& visible_voxels2,
+        const VoxelSetSketchType& visible_voxels_sketch2) const {
+  const FloatType iou_threshold = options_.sparse_matching_voxels_iou_threshold;
+  if (visible_voxels_sketch2.numBins() > 0 && !options_.sparse_matching_dump_voxel_images) {
+    bool matchable;
+    const bool decided = decideSparseMatchableWithSketches(
+            getCachedVisibleVoxelSketch(viewpoint_index1), visible_voxels_sketch2, iou_threshold, &matchable);
+    if (decided) {
+      return matchable;
+    }
+  }
+  return isSparseMatchable2(viewpoint_index1, viewpoint2, visible_voxels2, iou_threshold);
+}
+
+bool ViewpointPlanner::decideSparseMatchableWithSketches(
+        const VoxelSetSketchType& sketch1, const VoxelSetSketchType& sketch2,
+        const FloatType iou_threshold, bool* matchable) const {
+  if (sketch1.numBins() == 0 || sketch1.numBins() != sketch2.numBins()) {
+    return false;
+  }
+  if (sketch1.upperBoundAverageSizeIoU(sketch2) < iou_threshold) {
+    *matchable = false;
+    return true;
+  }
+  const FloatType estimated_iou = sketch1.estimateAverageSizeIoU(sketch2);
+  if (estimated_iou < iou_threshold - options_.sparse_matching_voxels_sketch_margin) {
+    *matchable = false;
+    return true;
+  }
+  if (estimated_iou > iou_threshold + options_.sparse_matching_voxels_sketch_margin) {
+    *matchable = true;
+    return true;
+  }
+  return false;
+}
+
 bool ViewpointPlanner::isSparseMatchable2(
         const Viewpoint& viewpoint1, const Viewpoint& viewpoint2,
         const FloatType iou_threshold) const {
@@ -208,18 +268,29 @@ bool ViewpointPlanner::isSparseMatchable2(const Viewpoint& viewpoint1, const Vie
   return isSparseMatchable2(viewpoint1, viewpoint2, options_.sparse_matching_voxels_iou_threshold);
 }
 
-bool ViewpointPlanner::isSparsePointVisible(const Viewpoint& viewpoint, const Point3D& point3d) const {
+bool ViewpointPlanner::projectSparsePoint(
+        const Viewpoint& viewpoint, const Point3D& point3d,
+        Eigen::Vector2i* image_point, FloatType* point_depth) const {
   const Vector3 point3d_camera = viewpoint.projectWorldPointIntoCamera(point3d.getPosition());
-  const Eigen::Vector2i point2d = viewpoint.camera().projectPoint(point3d_camera).cast<int>();
   const bool behind_camera = point3d_camera(2) < 0;
   if (behind_camera) {
     return false;
   }
-  const bool projects_into_image = viewpoint.camera().isPointInViewport(point2d);
+  *image_point = viewpoint.camera().projectPoint(point3d_camera).cast<int>();
+  const bool projects_into_image = viewpoint.camera().isPointInViewport(*image_point);
   if (!projects_into_image) {
     return false;
   }
-  const FloatType point_depth = point3d_camera(2);
+  *point_depth = point3d_camera(2);
+  return true;
+}
+
+bool ViewpointPlanner::isSparsePointVisible(const Viewpoint& viewpoint, const Point3D& point3d) const {
+  Eigen::Vector2i point2d;
+  FloatType point_depth;
+  if (!projectSparsePoint(viewpoint, point3d, &point2d, &point_depth)) {
+    return false;
+  }
   BH_ASSERT(point_depth >= 0);
   const FloatType view_depth = computePoissonMeshDepth(viewpoint, point2d(0), point2d(1));
   const bool occluded = point_depth > view_depth + options_.sparse_matching_depth_tolerance;
@@ -276,13 +347,31 @@ std::unordered_map<Point3DId, ViewpointPlanner::Vector3> ViewpointPlanner::compu
     const Viewpoint& viewpoint,
     const SparseReconstruction::Point3DMapType::const_iterator first,
     const SparseReconstruction::Point3DMapType::const_iterator last) const {
-  std::unordered_map<Point3DId, ViewpointPlanner::Vector3> visible_sparse_points;
+  // Project all points first so that depths and normals can be looked up with a single render
+  std::vector<Point3DId> candidate_ids;
+  std::vector<Eigen::Vector2i> candidate_image_points;
+  std::vector<FloatType> candidate_depths;
   for (SparseReconstruction::Point3DMapType::const_iterator it = first; it != last; ++it) {
     const Point3D& point3d = it->second;
-    const bool visible = isSparsePointVisible(viewpoint, point3d);
-    if (visible) {
-      const Vector3 normal = computePoissonMeshNormalVector(viewpoint, point3d.getPosition());
-      visible_sparse_points.emplace(point3d.id, normal);
+    Eigen::Vector2i image_point;
+    FloatType point_depth;
+    if (projectSparsePoint(viewpoint, point3d, &image_point, &point_depth)) {
+      candidate_ids.push_back(point3d.id);
+      candidate_image_points.push_back(image_point);
+      candidate_depths.push_back(point_depth);
+    }
+  }
+  std::unordered_map<Point3DId, ViewpointPlanner::Vector3> visible_sparse_points;
+  if (candidate_ids.empty()) {
+    return visible_sparse_points;
+  }
+  std::vector<FloatType> view_depths;
+  std::vector<Vector3> normals;
+  computePoissonMeshDepthsAndNormalVectors(viewpoint, candidate_image_points, &view_depths, &normals);
+  for (size_t i = 0; i < candidate_ids.size(); ++i) {
+    const bool occluded = candidate_depths[i] > view_depths[i] + options_.sparse_matching_depth_tolerance;
+    if (!occluded) {
+      visible_sparse_points.emplace(candidate_ids[i], normals[i]);
     }
   }
   return visible_sparse_points;
@@ -308,12 +397,147 @@ const std::unordered_map<Point3DId, ViewpointPlanner::Vector3>& ViewpointPlanner
 
 const std::unordered_set<size_t>& ViewpointPlanner::getCachedVisibleVoxels(
         const ViewpointEntryIndex viewpoint_index) const {
-  std::lock_guard<std::mutex> lock(cached_visible_voxels_mutex_);
+  std::unique_lock<std::mutex> lock(cached_visible_voxels_mutex_);
   auto it = cached_visible_voxels_.find(viewpoint_index);
   if (it == cached_visible_voxels_.end()) {
     const Viewpoint& viewpoint = viewpoint_entries_[viewpoint_index].viewpoint;
+    if (options_.sparse_matching_cpu_visible_voxels) {
+      // The CPU backend is thread-safe so other threads can use the cache in the meantime
+      lock.unlock();
+      std::unordered_set<size_t> visible_voxels = getVisibleVoxels(viewpoint);
+      lock.lock();
+      std::tie(it, std::ignore) = cached_visible_voxels_.emplace(viewpoint_index, std::move(visible_voxels));
+    }
+    else {
 //    std::tie(it, std::ignore) = cached_visible_voxels_.emplace(viewpoint_index, getRaycastHitVoxelsSet(viewpoint));
-    std::tie(it, std::ignore) = cached_visible_voxels_.emplace(viewpoint_index, getVisibleVoxels(viewpoint));
+      std::tie(it, std::ignore) = cached_visible_voxels_.emplace(viewpoint_index, getVisibleVoxels(viewpoint));
+    }
+  }
+  return it->second;
+}
+
+void ViewpointPlanner::cacheVisibleVoxels(const std::vector<ViewpointEntryIndex>& viewpoint_indices) const {
+  std::vector<ViewpointEntryIndex> missing_indices;
+  {
+    std::lock_guard<std::mutex> lock(cached_visible_voxels_mutex_);
+    for (const ViewpointEntryIndex viewpoint_index : viewpoint_indices) {
+      if (cached_visible_voxels_.count(viewpoint_index) == 0) {
+        missing_indices.push_back(viewpoint_index);
+      }
+    }
+  }
+  if (missing_indices.empty()) {
+    return;
+  }
+  bh::Timer timer;
+  if (options_.sparse_matching_cpu_visible_voxels) {
+    ensureVisibleVoxelRaycasterIsInitialized();
+#pragma omp parallel for schedule(dynamic)
+    for (size_t i = 0; i < missing_indices.size(); ++i) {
+      getCachedVisibleVoxels(missing_indices[i]);
+    }
+  }
+  else {
+    // OpenGL context can only be used from a single thread
+    for (const ViewpointEntryIndex viewpoint_index : missing_indices) {
+      getCachedVisibleVoxels(viewpoint_index);
+    }
+  }
+  std::cout << "Computed visible voxels for " << missing_indices.size() << " viewpoints in "
+            << timer.getElapsedTime() << " s" << std::endl;
+}
+
+ViewpointPlanner::FloatType ViewpointPlanner::computeSparseMatchingVoxelsIoU(
+        const std::unordered_set<size_t>& visible_voxels1, const std::unordered_set<size_t>& visible_voxels2) {
+  const std::unordered_set<size_t>& smaller_set = visible_voxels1.size() <= visible_voxels2.size() ? visible_voxels1 : visible_voxels2;
+  const std::unordered_set<size_t>& larger_set = visible_voxels1.size() <= visible_voxels2.size() ? visible_voxels2 : visible_voxels1;
+  size_t intersection_size = 0;
+  for (const size_t voxel_index : smaller_set) {
+    if (larger_set.count(voxel_index) > 0) {
+      ++intersection_size;
+    }
+  }
+  if (intersection_size == 0) {
+    return 0;
+  }
+  // Same normalization as in isSparseMatchable2()
+  const size_t average_set_size = (visible_voxels1.size() + visible_voxels2.size()) / 2;
+  return intersection_size / (FloatType)average_set_size;
+}
+
+void ViewpointPlanner::computeSparseMatchabilityGraph() {
+  bh::Timer timer;
+  const size_t num_viewpoints = viewpoint_entries_.size();
+  std::cout << "Computing sparse matchability graph for " << num_viewpoints << " viewpoints" << std::endl;
+
+  // Collect candidate pairs within the sparse matching limits
+  std::vector<SparseMatchabilityGraphType::Edge> edges;
+  std::vector<bool> candidate_flags(num_viewpoints, false);
+  std::vector<ViewpointANN::IndexType> knn_indices;
+  std::vector<ViewpointANN::DistanceType> knn_distances;
+  const FloatType radius_square = options_.sparse_matching_max_distance * options_.sparse_matching_max_distance;
+  for (ViewpointEntryIndex viewpoint_index = 0; viewpoint_index < num_viewpoints; ++viewpoint_index) {
+    const Pose& pose = viewpoint_entries_[viewpoint_index].viewpoint.pose();
+    viewpoint_ann_.radiusSearch(pose.getWorldPosition(), radius_square, num_viewpoints, &knn_indices, &knn_distances);
+    for (const ViewpointANN::IndexType other_index : knn_indices) {
+      if (static_cast<ViewpointEntryIndex>(other_index) <= viewpoint_index) {
+        continue;
+      }
+      if (!isWithinSparseMatchingLimits(pose, viewpoint_entries_[other_index].viewpoint.pose())) {
+        continue;
+      }
+      edges.push_back(SparseMatchabilityGraphType::Edge { viewpoint_index, static_cast<ViewpointEntryIndex>(other_index), 0 });
+      candidate_flags[viewpoint_index] = true;
+      candidate_flags[other_index] = true;
+    }
+  }
+  std::cout << "Found " << edges.size() << " candidate pairs" << std::endl;
+
+  std::vector<ViewpointEntryIndex> candidate_indices;
+  for (ViewpointEntryIndex viewpoint_index = 0; viewpoint_index < num_viewpoints; ++viewpoint_index) {
+    if (candidate_flags[viewpoint_index]) {
+      candidate_indices.push_back(viewpoint_index);
+    }
+  }
+  cacheVisibleVoxels(candidate_indices);
+
+  // Visible voxels are cached so the scores can be computed in parallel
+#pragma omp parallel for schedule(dynamic, 64)
+  for (size_t i = 0; i < edges.size(); ++i) {
+    SparseMatchabilityGraphType::Edge& edge = edges[i];
+    edge.score = static_cast<SparseMatchabilityGraphType::ScoreType>(computeSparseMatchingVoxelsIoU(
+            getCachedVisibleVoxels(edge.index1), getCachedVisibleVoxels(edge.index2)));
+  }
+
+  sparse_matchability_graph_.build(num_viewpoints, std::move(edges));
+  size_t num_matchable = 0;
+  for (ViewpointEntryIndex viewpoint_index = 0; viewpoint_index < num_viewpoints; ++viewpoint_index) {
+    const SparseMatchabilityGraphType::ScoreType* scores = sparse_matchability_graph_.neighborScoresBegin(viewpoint_index);
+    for (size_t i = 0; i < sparse_matchability_graph_.numNeighbors(viewpoint_index); ++i) {
+      if (scores[i] >= options_.sparse_matching_voxels_iou_threshold) {
+        ++num_matchable;
+      }
+    }
+  }
+  std::cout << "Sparse matchability graph has " << sparse_matchability_graph_.numEdges() << " pairs of which "
+            << num_matchable / 2 << " are matchable" << std::endl;
+  timer.printTiming("Computing sparse matchability graph");
+}
+
+const ViewpointPlanner::SparseMatchabilityGraphType& ViewpointPlanner::getSparseMatchabilityGraph() const {
+  return sparse_matchability_graph_;
+}
+
+const ViewpointPlanner::VoxelSetSketchType& ViewpointPlanner::getCachedVisibleVoxelSketch(
+        const ViewpointEntryIndex viewpoint_index) const {
+  std::unique_lock<std::mutex> lock(cached_visible_voxels_mutex_);
+  auto it = cached_visible_voxel_sketches_.find(viewpoint_index);
+  if (it == cached_visible_voxel_sketches_.end()) {
+    lock.unlock();
+    const std::unordered_set<size_t>& visible_voxels = getCachedVisibleVoxels(viewpoint_index);
+    const VoxelSetSketchType sketch(visible_voxels, options_.sparse_matching_voxels_sketch_size);
+    lock.lock();
+    std::tie(it, std::ignore) = cached_visible_voxel_sketches_.emplace(viewpoint_index, sketch);
   }
   return it->second;
 }
@@ -0,0 +1,192 @@
+//==================================================
+// voxel_index_raycaster.h
+//
+//  Copyright (c) 2017 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: Oct 18, 2017
+//==================================================
+#pragma once
+
+#include <algorithm>
+#include <limits>
+#include <unordered_set>
+#include <vector>
+#include <bh/common.h>
+#include <bh/eigen.h>
+#include <bh/math/geometry.h>
+#include "../bvh/bvh.h"
+
+/// CPU replacement for rendering voxels with index colors and reading back the set of visible indices.
+///
+/// Voxels are axis-aligned boxes identified by their position in the list given on construction.
+/// For every pixel center a ray is cast through a BVH of the boxes and the box with the closest face
+/// between the near and far plane is taken. As with the OpenGL renderer backfaces are not culled,
+/// i.e. a box cut by the near plane is seen from the inside. All methods are const and thread-safe.
+template <typename FloatT>
+class VoxelIndexRaycaster {
+public:
+  using FloatType = FloatT;
+  USE_FIXED_EIGEN_TYPES(FloatType);
+  using BoundingBoxType = bh::BoundingBox3D<FloatType>;
+  using TreeType = bvh::Tree<std::size_t, FloatType>;
+  using NodeType = typename TreeType::NodeType;
+  using RayDataType = bh::RayData<FloatType>;
+
+  explicit VoxelIndexRaycaster(const std::vector<BoundingBoxType>& voxel_bboxes)
+  : indices_(voxel_bboxes.size()) {
+    std::vector<typename TreeType::ObjectWithBoundingBox> objects;
+    objects.reserve(voxel_bboxes.size());
+    for (std::size_t i = 0; i < voxel_bboxes.size(); ++i) {
+      indices_[i] = i;
+      typename TreeType::ObjectWithBoundingBox object;
+      object.bounding_box = voxel_bboxes[i];
+      object.object = &indices_[i];
+      objects.push_back(object);
+    }
+    if (!objects.empty()) {
+      tree_.build(std::move(objects), false);
+    }
+  }
+
+  VoxelIndexRaycaster(const VoxelIndexRaycaster& other) = delete;
+
+  VoxelIndexRaycaster& operator=(const VoxelIndexRaycaster& other) = delete;
+
+  std::size_t numVoxels() const {
+    return indices_.size();
+  }
+
+  /// Compute the set of voxel indices that are visible in at least one pixel.
+  ///
+  /// @param world_to_camera Transformation from world to camera coordinates (x right, y down, z forward)
+  /// @param intrinsics Pinhole camera matrix
+  std::unordered_set<std::size_t> computeVisibleIndices(
+          const Matrix3x4& world_to_camera, const Matrix3x3& intrinsics,
+          const std::size_t width, const std::size_t height,
+          const FloatType near_plane, const FloatType far_plane) const {
+    BH_ASSERT(near_plane > 0);
+    BH_ASSERT(far_plane > near_plane);
+    std::unordered_set<std::size_t> visible_indices;
+    if (tree_.getRoot() == nullptr || width == 0 || height == 0) {
+      return visible_indices;
+    }
+    const Matrix3x3 camera_to_world_rotation = world_to_camera.template leftCols<3>().transpose();
+    const Vector3 camera_position = - camera_to_world_rotation * world_to_camera.col(3);
+    const FloatType fx = intrinsics(0, 0);
+    const FloatType fy = intrinsics(1, 1);
+    const FloatType cx = intrinsics(0, 2);
+    const FloatType cy = intrinsics(1, 2);
+
+    std::vector<std::size_t> pixel_indices(width * height, kInvalidIndex);
+#pragma omp parallel for schedule(dynamic, 4)
+    for (std::size_t y = 0; y < height; ++y) {
+      std::vector<const NodeType*> stack;
+      for (std::size_t x = 0; x < width; ++x) {
+        // Camera rays have unit z component so that the ray coefficient is the depth like in the z-buffer
+        const Vector3 direction_camera((x + FloatType(0.5) - cx) / fx, (y + FloatType(0.5) - cy) / fy, 1);
+        RayDataType ray;
+        ray.origin = camera_position;
+        ray.direction = camera_to_world_rotation * direction_camera;
+        ray.inv_direction = ray.direction.cwiseInverse();
+        pixel_indices[y * width + x] = castRay(ray, near_plane, far_plane, &stack);
+      }
+    }
+
+    for (const std::size_t index : pixel_indices) {
+      if (index != kInvalidIndex) {
+        visible_indices.emplace(index);
+      }
+    }
+    return visible_indices;
+  }
+
+private:
+  static constexpr std::size_t kInvalidIndex = std::numeric_limits<std::size_t>::max();
+
+  /// Depth of the first box face along the ray between near and far plane
+  static bool computeFaceDepth(const BoundingBoxType& bbox, const RayDataType& ray,
+                               const FloatType near_plane, const FloatType far_plane, FloatType* depth) {
+    FloatType t_lower = std::numeric_limits<FloatType>::lowest();
+    FloatType t_upper = std::numeric_limits<FloatType>::max();
+    for (std::size_t i = 0; i < 3; ++i) {
+      const FloatType t0 = (bbox.getMinimum(i) - ray.origin(i)) * ray.inv_direction(i);
+      const FloatType t1 = (bbox.getMaximum(i) - ray.origin(i)) * ray.inv_direction(i);
+      t_lower = std::max(t_lower, std::min(t0, t1));
+      t_upper = std::min(t_upper, std::max(t0, t1));
+    }
+    if (t_upper < t_lower) {
+      return false;
+    }
+    if (t_lower >= near_plane && t_lower <= far_plane) {
+      *depth = t_lower;
+      return true;
+    }
+    if (t_lower < near_plane && t_upper >= near_plane && t_upper <= far_plane) {
+      *depth = t_upper;
+      return true;
+    }
+    return false;
+  }
+
+  std::size_t castRay(const RayDataType& ray, const FloatType near_plane, const FloatType far_plane,
+                      std::vector<const NodeType*>* stack) const {
+    std::size_t closest_index = kInvalidIndex;
+    FloatType closest_depth = far_plane;
+    stack->clear();
+    stack->push_back(tree_.getRoot());
+    while (!stack->empty()) {
+      const NodeType* node = stack->back();
+      stack->pop_back();
+      if (node->isLeaf()) {
+        FloatType depth;
+        if (computeFaceDepth(node->getBoundingBox(), ray, near_plane, closest_depth, &depth)) {
+          // Ties are resolved by the smaller index like the depth test when drawing in index order
+          const std::size_t index = *node->getObject();
+          if (depth < closest_depth || index < closest_index) {
+            closest_depth = depth;
+            closest_index = index;
+          }
+        }
+        continue;
+      }
+      // Inner nodes only need to overlap the ray segment between near plane and closest hit
+      const auto intersection = node->getBoundingBox().intersect(ray, near_plane, closest_depth);
+      if (!intersection.doesIntersect()) {
+        continue;
+      }
+      const NodeType* left_child = node->getLeftChild();
+      const NodeType* right_child = node->getRightChild();
+      // Push farther child first so that the closer one is traversed first
+      if (left_child != nullptr && right_child != nullptr) {
+        const FloatType left_t = entryDepth(left_child->getBoundingBox(), ray);
+        const FloatType right_t = entryDepth(right_child->getBoundingBox(), ray);
+        if (left_t < right_t) {
+          stack->push_back(right_child);
+          stack->push_back(left_child);
+        }
+        else {
+          stack->push_back(left_child);
+          stack->push_back(right_child);
+        }
+      }
+      else if (left_child != nullptr) {
+        stack->push_back(left_child);
+      }
+      else if (right_child != nullptr) {
+        stack->push_back(right_child);
+      }
+    }
+    return closest_index;
+  }
+
+  static FloatType entryDepth(const BoundingBoxType& bbox, const RayDataType& ray) {
+    const auto intersection = bbox.intersect(ray);
+    return intersection.doesIntersect() ? intersection.rayT() : std::numeric_limits<FloatType>::max();
+  }
+
+  std::vector<std::size_t> indices_;
+  TreeType tree_;
+};
+
+template <typename FloatT>
+constexpr std::size_t VoxelIndexRaycaster<FloatT>::kInvalidIndex;
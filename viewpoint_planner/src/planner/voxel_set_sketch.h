@@ -0,0 +1,107 @@
+//==================================================
+// voxel_set_sketch.h
+//
+//  Copyright (c) 2017 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: Oct 18, 2017
+//==================================================
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include <bh/common.h>
+
+/// One-permutation MinHash sketch of a set of voxel indices.
+///
+/// Each element is hashed once and assigned to one of num_bins bins, each bin keeps the minimum hash value.
+/// The fraction of equal non-empty bins estimates the Jaccard index of two sets with a standard error
+/// of about sqrt(J * (1 - J) / num_bins). Sketches can only be compared if they have the same number of bins.
+template <typename FloatT>
+class VoxelSetSketch {
+public:
+  using FloatType = FloatT;
+
+  VoxelSetSketch()
+  : set_size_(0) {}
+
+  template <typename SetT>
+  VoxelSetSketch(const SetT& set, const std::size_t num_bins)
+  : set_size_(set.size()), bins_(num_bins, kEmptyBin) {
+    BH_ASSERT(num_bins > 0);
+    for (const auto& element : set) {
+      const uint64_t hash = mixHash(static_cast<uint64_t>(element));
+      const std::size_t bin = hash % num_bins;
+      const uint64_t value = hash / num_bins;
+      if (value < bins_[bin]) {
+        bins_[bin] = value;
+      }
+    }
+  }
+
+  std::size_t setSize() const {
+    return set_size_;
+  }
+
+  std::size_t numBins() const {
+    return bins_.size();
+  }
+
+  /// Estimate of |A n B| / |A u B|
+  FloatType estimateJaccardIndex(const VoxelSetSketch& other) const {
+    BH_ASSERT(bins_.size() == other.bins_.size());
+    std::size_t num_matches = 0;
+    std::size_t num_non_empty = 0;
+    for (std::size_t i = 0; i < bins_.size(); ++i) {
+      if (bins_[i] == kEmptyBin && other.bins_[i] == kEmptyBin) {
+        continue;
+      }
+      ++num_non_empty;
+      if (bins_[i] == other.bins_[i]) {
+        ++num_matches;
+      }
+    }
+    if (num_non_empty == 0) {
+      return 0;
+    }
+    return num_matches / FloatType(num_non_empty);
+  }
+
+  /// Estimate of |A n B| / ((|A| + |B|) / 2), the overlap measure used for sparse matching
+  FloatType estimateAverageSizeIoU(const VoxelSetSketch& other) const {
+    const FloatType jaccard = estimateJaccardIndex(other);
+    return 2 * jaccard / (1 + jaccard);
+  }
+
+  /// Exact upper bound of |A n B| / ((|A| + |B|) / 2) given only the set sizes
+  FloatType upperBoundAverageSizeIoU(const VoxelSetSketch& other) const {
+    return computeUpperBoundAverageSizeIoU(set_size_, other.set_size_);
+  }
+
+  /// The average set size is rounded down like in the exact IoU computation of the planner
+  static FloatType computeUpperBoundAverageSizeIoU(const std::size_t size1, const std::size_t size2) {
+    const std::size_t average_size = (size1 + size2) / 2;
+    if (average_size == 0) {
+      return 0;
+    }
+    return std::min(size1, size2) / FloatType(average_size);
+  }
+
+private:
+  static constexpr uint64_t kEmptyBin = std::numeric_limits<uint64_t>::max();
+
+  /// 64-bit finalizer of splitmix64
+  static uint64_t mixHash(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+  }
+
+  std::size_t set_size_;
+  std::vector<uint64_t> bins_;
+};
+
+template <typename FloatT>
+constexpr uint64_t VoxelSetSketch<FloatT>::kEmptyBin;
@@ -3145,11 +3145,19 @@ ViewpointPlannerThread::Result ViewpointPlannerThread::runIteration() {
       bool result = planner_->generateNextViewpointEntry2();
       std::cout << "Result[" << i << "] -> " << result << std::endl;
     }
+    if (planner_->getOptions().viewpoint_motion_incremental) {
+      planner_->updateViewpointMotions();
+    }
     viewer_widget_->signalViewpointsChanged();
     return Result::CONTINUE;
   }
   else if (operation_ == VIEWPOINT_MOTIONS) {
-    planner_->computeViewpointMotions();
+    if (planner_->getOptions().viewpoint_motion_incremental) {
+      planner_->updateViewpointMotions();
+    }
+    else {
+      planner_->computeViewpointMotions();
+    }
     return Result::PAUSE;
   }
   else if (operation_ == VIEWPOINT_PATH) {
@@ -0,0 +1,135 @@
+//==================================================
+// test_distance_transform.cpp
+//
+//  Copyright (c) 2017 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: Oct 18, 2017
+//==================================================
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <tuple>
+#include <vector>
+#include "gtest/gtest.h"
+#include <src/planner/distance_transform.h>
+
+namespace {
+using FloatType = double;
+using size_t = std::size_t;
+using DistanceTransform = EuclideanDistanceTransform<FloatType>;
+
+const FloatType kInfinity = DistanceTransform::kInfinity;
+const FloatType kErrorTolerance = 1e-9;
+
+/// D(p) = min_q (f(q) + |p - q|^2) by checking all seeds
+std::vector<FloatType> computeBruteForceTransform(const std::vector<FloatType>& values,
+                                                  const size_t dim_x, const size_t dim_y, const size_t dim_z) {
+  std::vector<FloatType> result(values.size(), kInfinity);
+  for (size_t q = 0; q < values.size(); ++q) {
+    if (values[q] == kInfinity) {
+      continue;
+    }
+    const FloatType qx = q % dim_x;
+    const FloatType qy = (q / dim_x) % dim_y;
+    const FloatType qz = q / (dim_x * dim_y);
+    for (size_t p = 0; p < values.size(); ++p) {
+      const FloatType dx = FloatType(p % dim_x) - qx;
+      const FloatType dy = FloatType((p / dim_x) % dim_y) - qy;
+      const FloatType dz = FloatType(p / (dim_x * dim_y)) - qz;
+      result[p] = std::min(result[p], values[q] + dx * dx + dy * dy + dz * dz);
+    }
+  }
+  return result;
+}
+
+/// Grid with random seeds. Seeds carry a random squared offset if with_offsets is true and 0 otherwise.
+std::vector<FloatType> createRandomSeeds(const size_t num_cells, const FloatType seed_probability,
+                                         const bool with_offsets, std::mt19937& rnd) {
+  std::uniform_real_distribution<FloatType> uniform_dist(0, 1);
+  std::vector<FloatType> values(num_cells, kInfinity);
+  for (FloatType& value : values) {
+    if (uniform_dist(rnd) < seed_probability) {
+      value = with_offsets ? 4 * uniform_dist(rnd) : 0;
+    }
+  }
+  return values;
+}
+
+class DistanceTransformTest : public ::testing::TestWithParam<std::tuple<size_t, size_t, size_t>> {
+protected:
+  void checkAgainstBruteForce(const FloatType seed_probability, const bool with_offsets) {
+    size_t dim_x, dim_y, dim_z;
+    std::tie(dim_x, dim_y, dim_z) = GetParam();
+    std::mt19937 rnd(static_cast<std::mt19937::result_type>(dim_x * 10000 + dim_y * 100 + dim_z));
+    for (size_t i = 0; i < 5; ++i) {
+      std::vector<FloatType> values = createRandomSeeds(dim_x * dim_y * dim_z, seed_probability, with_offsets, rnd);
+      const std::vector<FloatType> expected_values = computeBruteForceTransform(values, dim_x, dim_y, dim_z);
+      DistanceTransform::transformSquared(&values, dim_x, dim_y, dim_z);
+      for (size_t p = 0; p < values.size(); ++p) {
+        if (expected_values[p] == kInfinity) {
+          ASSERT_EQ(values[p], kInfinity) << "Cell " << p;
+        }
+        else {
+          ASSERT_NEAR(values[p], expected_values[p], kErrorTolerance) << "Cell " << p;
+        }
+      }
+    }
+  }
+};
+
+TEST_P(DistanceTransformTest, SparseSeedsMatchBruteForce) {
+  checkAgainstBruteForce(0.02, false);
+}
+
+TEST_P(DistanceTransformTest, DenseSeedsMatchBruteForce) {
+  checkAgainstBruteForce(0.3, false);
+}
+
+TEST_P(DistanceTransformTest, SeedOffsetsMatchBruteForce) {
+  checkAgainstBruteForce(0.1, true);
+}
+
+INSTANTIATE_TEST_CASE_P(GridDimensions, DistanceTransformTest, ::testing::Values(
+    std::make_tuple(1, 1, 1),
+    std::make_tuple(16, 1, 1),
+    std::make_tuple(1, 9, 13),
+    std::make_tuple(7, 5, 9),
+    std::make_tuple(12, 12, 12),
+    std::make_tuple(20, 3, 17)));
+
+TEST(DistanceTransformBasicTest, SingleSeedGivesParabola) {
+  const size_t n = 11;
+  std::vector<FloatType> f(n, kInfinity);
+  f[3] = 0;
+  std::vector<FloatType> d(n);
+  std::vector<size_t> v;
+  std::vector<FloatType> z;
+  DistanceTransform::transformLine(f.data(), d.data(), n, &v, &z);
+  for (size_t q = 0; q < n; ++q) {
+    EXPECT_EQ(d[q], (FloatType(q) - 3) * (FloatType(q) - 3));
+  }
+}
+
+TEST(DistanceTransformBasicTest, NoSeedsStayInfinite) {
+  const size_t dim = 6;
+  std::vector<FloatType> values(dim * dim * dim, kInfinity);
+  DistanceTransform::transformSquared(&values, dim, dim, dim);
+  for (const FloatType value : values) {
+    EXPECT_EQ(value, kInfinity);
+  }
+}
+
+TEST(DistanceTransformBasicTest, TransformScalesAndClamps) {
+  const size_t dim_x = 10;
+  std::vector<FloatType> values(dim_x, kInfinity);
+  values[0] = 0;
+  const FloatType grid_increment = 0.5;
+  const FloatType max_distance = 3;
+  DistanceTransform::transform(&values, dim_x, 1, 1, grid_increment, max_distance);
+  for (size_t x = 0; x < dim_x; ++x) {
+    EXPECT_NEAR(values[x], std::min(grid_increment * x, max_distance), kErrorTolerance);
+  }
+}
+
+}
@@ -0,0 +1,129 @@
+//==================================================
+// test_journal_file.cpp
+//
+//  Copyright (c) 2017 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: Oct 18, 2017
+//==================================================
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+#include <boost/filesystem.hpp>
+#include <src/planner/journal_file.h>
+
+namespace {
+using size_t = std::size_t;
+
+const std::string kMagic = "TESTJRNL";
+const uint32_t kVersion = 3;
+const std::string kHeaderData = "header data";
+const size_t kNumCheckpoints = 3;
+const size_t kNumRecordsPerCheckpoint = 4;
+
+class JournalFileTest : public ::testing::Test {
+protected:
+  virtual void SetUp() {
+    filename = (boost::filesystem::temp_directory_path()
+        / boost::filesystem::unique_path("test_journal_file_%%%%-%%%%-%%%%")).string();
+    JournalFileWriter writer(filename, kMagic, kVersion, kHeaderData);
+    for (size_t i = 0; i < kNumCheckpoints; ++i) {
+      writeCheckpoint(&writer, i);
+      checkpoint_sizes.push_back(boost::filesystem::file_size(filename));
+    }
+  }
+
+  virtual void TearDown() {
+    boost::system::error_code error_code;
+    boost::filesystem::remove(filename, error_code);
+  }
+
+  static std::string getPayload(const size_t checkpoint, const size_t record) {
+    JournalFile::PayloadWriter payload_writer;
+    payload_writer.write<uint64_t>(checkpoint);
+    payload_writer.writeVector(std::vector<uint32_t>(record + 1, static_cast<uint32_t>(record)));
+    return payload_writer.getPayload();
+  }
+
+  static void writeCheckpoint(JournalFileWriter* writer, const size_t checkpoint) {
+    for (size_t record = 0; record < kNumRecordsPerCheckpoint; ++record) {
+      writer->writeRecord(static_cast<uint32_t>(record), getPayload(checkpoint, record));
+    }
+    writer->commit();
+  }
+
+  /// Read all checkpoints and check their content. Returns the number of checkpoints.
+  size_t readAndCheckCheckpoints(uint64_t* committed_size) const {
+    JournalFileReader reader(filename, kMagic);
+    EXPECT_EQ(reader.getVersion(), kVersion);
+    EXPECT_EQ(reader.getHeaderData(), kHeaderData);
+    std::vector<JournalFile::Record> records;
+    size_t num_checkpoints = 0;
+    while (reader.readCheckpoint(&records)) {
+      EXPECT_EQ(records.size(), kNumRecordsPerCheckpoint);
+      for (size_t record = 0; record < records.size(); ++record) {
+        EXPECT_EQ(records[record].type, record);
+        EXPECT_EQ(records[record].payload, getPayload(num_checkpoints, record));
+      }
+      ++num_checkpoints;
+    }
+    EXPECT_TRUE(records.empty());
+    *committed_size = reader.getCommittedSize();
+    return num_checkpoints;
+  }
+
+  std::string filename;
+  std::vector<uint64_t> checkpoint_sizes;
+};
+
+TEST_F(JournalFileTest, ReadsAllCommittedCheckpoints) {
+  uint64_t committed_size;
+  EXPECT_EQ(readAndCheckCheckpoints(&committed_size), kNumCheckpoints);
+  EXPECT_EQ(committed_size, checkpoint_sizes.back());
+}
+
+TEST_F(JournalFileTest, RecoversFromTruncatedTail) {
+  // Cut the last checkpoint at every possible byte
+  for (uint64_t size = checkpoint_sizes[kNumCheckpoints - 2]; size < checkpoint_sizes.back(); ++size) {
+    boost::filesystem::resize_file(filename, size);
+    uint64_t committed_size;
+    ASSERT_EQ(readAndCheckCheckpoints(&committed_size), kNumCheckpoints - 1) << "Truncated to " << size << " bytes";
+    ASSERT_EQ(committed_size, checkpoint_sizes[kNumCheckpoints - 2]);
+  }
+}
+
+TEST_F(JournalFileTest, ContinuesAfterTruncatedTail) {
+  const uint64_t truncated_size = (checkpoint_sizes[kNumCheckpoints - 2] + checkpoint_sizes.back()) / 2;
+  boost::filesystem::resize_file(filename, truncated_size);
+  uint64_t committed_size;
+  ASSERT_EQ(readAndCheckCheckpoints(&committed_size), kNumCheckpoints - 1);
+  {
+    JournalFileWriter writer(filename, committed_size);
+    writeCheckpoint(&writer, kNumCheckpoints - 1);
+  }
+  EXPECT_EQ(boost::filesystem::file_size(filename), checkpoint_sizes.back());
+  EXPECT_EQ(readAndCheckCheckpoints(&committed_size), kNumCheckpoints);
+}
+
+TEST_F(JournalFileTest, StopsAtCorruptRecord) {
+  // Flip a byte in the last payload of the last checkpoint (just before its commit record)
+  {
+    std::fstream fs(filename, std::ios::binary | std::ios::in | std::ios::out);
+    // The commit record is a record header (type, reserved, size, checksum) without payload
+    const uint64_t commit_record_size = 2 * sizeof(uint32_t) + 2 * sizeof(uint64_t);
+    fs.seekg(checkpoint_sizes.back() - commit_record_size - 1);
+    const char byte = static_cast<char>(fs.get());
+    fs.seekp(checkpoint_sizes.back() - commit_record_size - 1);
+    fs.put(static_cast<char>(~byte));
+  }
+  uint64_t committed_size;
+  EXPECT_EQ(readAndCheckCheckpoints(&committed_size), kNumCheckpoints - 1);
+  EXPECT_EQ(committed_size, checkpoint_sizes[kNumCheckpoints - 2]);
+}
+
+TEST_F(JournalFileTest, RejectsWrongMagic) {
+  EXPECT_THROW(JournalFileReader(filename, "OTHERMAG"), JournalFile::Error);
+}
+
+}
@@ -0,0 +1,127 @@
+//==================================================
+// test_occupancy_map_snapshot.cpp
+//
+//  Copyright (c) 2017 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: Oct 18, 2017
+//==================================================
+
+#include <fstream>
+#include <random>
+#include "gtest/gtest.h"
+#include <boost/filesystem.hpp>
+#include <src/octree/occupancy_map.h>
+#include <src/octree/occupancy_map_snapshot.h>
+
+namespace {
+using size_t = std::size_t;
+using OccupancyMapType = OccupancyMapSnapshot::OccupancyMapType;
+using NodeIndex = OccupancyMapSnapshot::NodeIndex;
+
+const double kResolution = 0.2;
+const size_t kNumOccupiedVoxels = 5000;
+const float kExtent = 10;
+
+class OccupancyMapSnapshotTest : public ::testing::Test {
+protected:
+  virtual void SetUp() {
+    filename = (boost::filesystem::temp_directory_path()
+        / boost::filesystem::unique_path("test_occupancy_map_snapshot_%%%%-%%%%-%%%%")).string();
+    std::mt19937 rnd(0);
+    std::uniform_real_distribution<float> position_dist(-kExtent, kExtent);
+    std::uniform_real_distribution<float> occupancy_dist(0, 1);
+    std::uniform_int_distribution<int> count_dist(0, 50);
+    tree.reset(new OccupancyMapType(kResolution));
+    // Lazy evaluation keeps inner nodes from being pruned
+    const bool lazy_eval = true;
+    for (size_t i = 0; i < kNumOccupiedVoxels; ++i) {
+      const octomap::OcTreeKey key = tree->coordToKey(
+          octomap::point3d(position_dist(rnd), position_dist(rnd), position_dist(rnd)));
+      tree->setNodeOccupancyAndObservationCount(key, occupancy_dist(rnd), count_dist(rnd), lazy_eval);
+    }
+    for (auto it = tree->begin_tree(); it != tree->end_tree(); ++it) {
+      it->setWeight(occupancy_dist(rnd));
+      it->setObservationCountSum(static_cast<size_t>(count_dist(rnd)) * 1000);
+    }
+    OccupancyMapSnapshot::write(*tree, filename);
+  }
+
+  virtual void TearDown() {
+    boost::system::error_code error_code;
+    boost::filesystem::remove(filename, error_code);
+  }
+
+  void checkSnapshot(const OccupancyMapSnapshot& snapshot) const {
+    ASSERT_EQ(snapshot.getNumNodes(), tree->size());
+    EXPECT_EQ(snapshot.getNumLeafNodes(), tree->getNumLeafNodes());
+    EXPECT_EQ(snapshot.getTreeDepth(), tree->getTreeDepth());
+    EXPECT_EQ(snapshot.getResolution(), tree->getResolution());
+    for (auto it = tree->begin_tree(); it != tree->end_tree(); ++it) {
+      const NodeIndex node = snapshot.search(it.getKey(), it.getDepth());
+      ASSERT_NE(node, OccupancyMapSnapshot::kInvalidNode);
+      EXPECT_EQ(snapshot.isLeaf(node), it.isLeaf());
+      EXPECT_EQ(snapshot.getOccupancy(node), it->getOccupancy());
+      EXPECT_EQ(snapshot.getObservationCount(node), it->getObservationCount());
+      EXPECT_EQ(snapshot.getWeight(node), it->getWeight());
+      EXPECT_EQ(snapshot.getObservationCountSum(node), it->getObservationCountSum());
+    }
+  }
+
+  std::string filename;
+  std::unique_ptr<OccupancyMapType> tree;
+};
+
+TEST_F(OccupancyMapSnapshotTest, MemoryMappedRoundTrip) {
+  const bool use_mmap = true;
+  const OccupancyMapSnapshot snapshot(filename, use_mmap);
+  checkSnapshot(snapshot);
+}
+
+TEST_F(OccupancyMapSnapshotTest, ReadRoundTrip) {
+  const bool use_mmap = false;
+  const OccupancyMapSnapshot snapshot(filename, use_mmap);
+  EXPECT_FALSE(snapshot.isMemoryMapped());
+  checkSnapshot(snapshot);
+}
+
+TEST_F(OccupancyMapSnapshotTest, ConvertsBackToOccupancyMap) {
+  const OccupancyMapSnapshot snapshot(filename);
+  const std::unique_ptr<OccupancyMapType> converted_tree = snapshot.toOccupancyMap();
+  ASSERT_EQ(converted_tree->size(), tree->size());
+  // Both trees have the same structure so they are traversed in the same order
+  auto converted_it = converted_tree->begin_tree();
+  for (auto it = tree->begin_tree(); it != tree->end_tree(); ++it, ++converted_it) {
+    ASSERT_TRUE(converted_it != converted_tree->end_tree());
+    ASSERT_EQ(converted_it.getKey(), it.getKey());
+    ASSERT_EQ(converted_it.getDepth(), it.getDepth());
+    EXPECT_EQ(converted_it.isLeaf(), it.isLeaf());
+    EXPECT_EQ(converted_it->getOccupancy(), it->getOccupancy());
+    EXPECT_EQ(converted_it->getObservationCount(), it->getObservationCount());
+    EXPECT_EQ(converted_it->getWeight(), it->getWeight());
+    EXPECT_EQ(converted_it->getObservationCountSum(), it->getObservationCountSum());
+  }
+  EXPECT_TRUE(converted_it == converted_tree->end_tree());
+}
+
+TEST_F(OccupancyMapSnapshotTest, RejectsTruncatedFile) {
+  boost::filesystem::resize_file(filename, boost::filesystem::file_size(filename) - 1);
+  EXPECT_THROW(OccupancyMapSnapshot snapshot(filename), OccupancyMapSnapshot::Error);
+  const bool use_mmap = false;
+  EXPECT_THROW(OccupancyMapSnapshot snapshot(filename, use_mmap), OccupancyMapSnapshot::Error);
+}
+
+TEST(OccupancyMapSnapshotEmptyTest, EmptyTreeRoundTrip) {
+  const std::string filename = (boost::filesystem::temp_directory_path()
+      / boost::filesystem::unique_path("test_occupancy_map_snapshot_%%%%-%%%%-%%%%")).string();
+  const OccupancyMapType tree(kResolution);
+  OccupancyMapSnapshot::write(tree, filename);
+  {
+    const OccupancyMapSnapshot snapshot(filename);
+    EXPECT_EQ(snapshot.getNumNodes(), 0u);
+    EXPECT_EQ(snapshot.getRoot(), OccupancyMapSnapshot::kInvalidNode);
+    EXPECT_EQ(snapshot.toOccupancyMap()->size(), 0u);
+  }
+  boost::filesystem::remove(filename);
+}
+
+}
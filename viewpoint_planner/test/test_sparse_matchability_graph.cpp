@@ -0,0 +1,126 @@
+//==================================================
+// test_sparse_matchability_graph.cpp
+//
+//  Copyright (c) 2017 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: Oct 18, 2017
+//==================================================
+
+#include <map>
+#include <random>
+#include <sstream>
+#include <utility>
+#include "gtest/gtest.h"
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
+#include <src/planner/sparse_matchability_graph.h>
+
+namespace {
+using FloatType = float;
+using size_t = std::size_t;
+using GraphType = SparseMatchabilityGraph<FloatType>;
+using Edge = GraphType::Edge;
+using ScoreType = GraphType::ScoreType;
+
+const size_t kNumVertices = 200;
+const size_t kNumEdges = 2000;
+
+class SparseMatchabilityGraphTest : public ::testing::Test {
+protected:
+  virtual void SetUp() {
+    std::mt19937 rnd(0);
+    std::uniform_int_distribution<size_t> index_dist(0, kNumVertices - 1);
+    std::uniform_real_distribution<ScoreType> score_dist(0, 1);
+    // Every pair is added in both orientations and some pairs several times with different scores
+    for (size_t i = 0; i < kNumEdges; ++i) {
+      const size_t index1 = index_dist(rnd);
+      const size_t index2 = index_dist(rnd);
+      if (index1 == index2) {
+        continue;
+      }
+      edges.push_back(Edge { index1, index2, score_dist(rnd) });
+      if (i % 3 == 0) {
+        edges.push_back(Edge { index2, index1, score_dist(rnd) });
+      }
+    }
+    for (const Edge& edge : edges) {
+      const std::pair<size_t, size_t> key(std::min(edge.index1, edge.index2), std::max(edge.index1, edge.index2));
+      auto it = expected_scores.find(key);
+      if (it == expected_scores.end() || it->second < edge.score) {
+        expected_scores[key] = edge.score;
+      }
+    }
+    graph.build(kNumVertices, edges);
+  }
+
+  void checkGraph(const GraphType& graph) const {
+    EXPECT_EQ(graph.numVertices(), kNumVertices);
+    EXPECT_EQ(graph.numEdges(), expected_scores.size());
+    for (size_t index1 = 0; index1 < kNumVertices; ++index1) {
+      for (size_t index2 = 0; index2 < kNumVertices; ++index2) {
+        const auto it = expected_scores.find(std::make_pair(std::min(index1, index2), std::max(index1, index2)));
+        ScoreType score = -1;
+        const bool found = graph.find(index1, index2, &score);
+        if (it == expected_scores.end()) {
+          EXPECT_FALSE(found) << "Pair " << index1 << ", " << index2;
+        }
+        else {
+          ASSERT_TRUE(found) << "Pair " << index1 << ", " << index2;
+          EXPECT_EQ(score, it->second);
+        }
+      }
+    }
+  }
+
+  std::vector<Edge> edges;
+  std::map<std::pair<size_t, size_t>, ScoreType> expected_scores;
+  GraphType graph;
+};
+
+TEST_F(SparseMatchabilityGraphTest, DuplicateEdgesKeepHighestScore) {
+  checkGraph(graph);
+}
+
+TEST_F(SparseMatchabilityGraphTest, NeighborsAreSortedAndConsistent) {
+  size_t num_neighbors = 0;
+  for (size_t index = 0; index < kNumVertices; ++index) {
+    const uint32_t* neighbors = graph.neighborsBegin(index);
+    const ScoreType* scores = graph.neighborScoresBegin(index);
+    ASSERT_EQ(static_cast<size_t>(graph.neighborsEnd(index) - neighbors), graph.numNeighbors(index));
+    for (size_t i = 0; i < graph.numNeighbors(index); ++i) {
+      if (i > 0) {
+        EXPECT_LT(neighbors[i - 1], neighbors[i]);
+      }
+      ScoreType score;
+      ASSERT_TRUE(graph.find(index, neighbors[i], &score));
+      EXPECT_EQ(scores[i], score);
+    }
+    num_neighbors += graph.numNeighbors(index);
+  }
+  EXPECT_EQ(num_neighbors, 2 * graph.numEdges());
+}
+
+TEST_F(SparseMatchabilityGraphTest, OutOfRangeAndEmptyLookups) {
+  ScoreType score;
+  EXPECT_FALSE(graph.find(kNumVertices, 0, &score));
+  EXPECT_FALSE(graph.find(0, kNumVertices + 10, &score));
+  const GraphType empty_graph;
+  EXPECT_TRUE(empty_graph.empty());
+  EXPECT_FALSE(empty_graph.find(0, 1, &score));
+}
+
+TEST_F(SparseMatchabilityGraphTest, SerializationRoundTrip) {
+  std::stringstream stream;
+  {
+    boost::archive::binary_oarchive oa(stream);
+    oa << graph;
+  }
+  GraphType loaded_graph;
+  {
+    boost::archive::binary_iarchive ia(stream);
+    ia >> loaded_graph;
+  }
+  checkGraph(loaded_graph);
+}
+
+}
@@ -0,0 +1,111 @@
+//==================================================
+// test_tour_improver.cpp
+//
+//  Copyright (c) 2017 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: Oct 18, 2017
+//==================================================
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <random>
+#include "gtest/gtest.h"
+#include <src/planner/tour_improver.h>
+
+namespace {
+using FloatType = double;
+using size_t = std::size_t;
+using TourImprover = viewpoint_planner::TourImprover<FloatType>;
+using Tour = TourImprover::Tour;
+
+const size_t kNumInstances = 20;
+const FloatType kCostTolerance = 1e-6;
+
+/// Euclidean cost matrix of random points in the unit square
+std::vector<FloatType> createRandomCostMatrix(const size_t num_nodes, std::mt19937& rnd) {
+  std::uniform_real_distribution<FloatType> uniform_dist(0, 1);
+  std::vector<FloatType> xs(num_nodes);
+  std::vector<FloatType> ys(num_nodes);
+  for (size_t i = 0; i < num_nodes; ++i) {
+    xs[i] = uniform_dist(rnd);
+    ys[i] = uniform_dist(rnd);
+  }
+  std::vector<FloatType> cost_matrix(num_nodes * num_nodes);
+  for (size_t i = 0; i < num_nodes; ++i) {
+    for (size_t j = 0; j < num_nodes; ++j) {
+      cost_matrix[i * num_nodes + j] = std::hypot(xs[i] - xs[j], ys[i] - ys[j]);
+    }
+  }
+  return cost_matrix;
+}
+
+/// Optimal tour cost by enumerating all tours that start at node 0
+FloatType computeOptimalTourCost(const TourImprover& improver, const size_t num_nodes) {
+  Tour tour(num_nodes);
+  std::iota(tour.begin(), tour.end(), 0);
+  FloatType best_cost = improver.computeTourCost(tour);
+  while (std::next_permutation(tour.begin() + 1, tour.end())) {
+    best_cost = std::min(best_cost, improver.computeTourCost(tour));
+  }
+  return best_cost;
+}
+
+bool isPermutation(Tour tour, const size_t num_nodes) {
+  std::sort(tour.begin(), tour.end());
+  for (size_t i = 0; i < tour.size(); ++i) {
+    if (tour[i] != i) {
+      return false;
+    }
+  }
+  return tour.size() == num_nodes;
+}
+
+class TourImproverBruteForceTest : public ::testing::TestWithParam<size_t> {
+};
+
+TEST_P(TourImproverBruteForceTest, FindsOptimalTourOfSmallInstances) {
+  const size_t num_nodes = GetParam();
+  std::mt19937 rnd(static_cast<std::mt19937::result_type>(num_nodes));
+  TourImprover::Options options;
+  options.num_trials = 4;
+  options.max_kicks_per_trial = 200;
+  options.max_time = 0;
+  for (size_t instance = 0; instance < kNumInstances; ++instance) {
+    const std::vector<FloatType> cost_matrix = createRandomCostMatrix(num_nodes, rnd);
+    const TourImprover improver(options, num_nodes, cost_matrix);
+    Tour initial_tour(num_nodes);
+    std::iota(initial_tour.begin(), initial_tour.end(), 0);
+    std::shuffle(initial_tour.begin(), initial_tour.end(), rnd);
+
+    const TourImprover::Result result = improver.improve(initial_tour);
+    ASSERT_TRUE(isPermutation(result.tour, num_nodes));
+    EXPECT_NEAR(result.cost, improver.computeTourCost(result.tour), kCostTolerance);
+    EXPECT_LE(result.cost, result.initial_cost + kCostTolerance);
+    EXPECT_NEAR(result.cost, computeOptimalTourCost(improver, num_nodes), kCostTolerance)
+        << "Instance " << instance << " with " << num_nodes << " nodes";
+  }
+}
+
+INSTANTIATE_TEST_CASE_P(SmallInstances, TourImproverBruteForceTest, ::testing::Values(3, 5, 6, 7, 8, 9));
+
+TEST(TourImproverTest, KeepsOptimalTour) {
+  // Nodes on a circle in order are an optimal tour
+  const size_t num_nodes = 12;
+  std::vector<FloatType> cost_matrix(num_nodes * num_nodes);
+  for (size_t i = 0; i < num_nodes; ++i) {
+    for (size_t j = 0; j < num_nodes; ++j) {
+      const FloatType angle_i = 2 * M_PI * i / num_nodes;
+      const FloatType angle_j = 2 * M_PI * j / num_nodes;
+      cost_matrix[i * num_nodes + j] = std::hypot(
+          std::cos(angle_i) - std::cos(angle_j), std::sin(angle_i) - std::sin(angle_j));
+    }
+  }
+  const TourImprover improver(TourImprover::Options(), num_nodes, cost_matrix);
+  Tour tour(num_nodes);
+  std::iota(tour.begin(), tour.end(), 0);
+  const TourImprover::Result result = improver.improve(tour);
+  EXPECT_NEAR(result.cost, result.initial_cost, kCostTolerance);
+}
+
+}
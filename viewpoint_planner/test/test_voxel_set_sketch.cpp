@@ -0,0 +1,121 @@
+//==================================================
+// test_voxel_set_sketch.cpp
+//
+//  Copyright (c) 2017 Benjamin Hepp.
+//  Author: Benjamin Hepp
+//  Created on: Oct 18, 2017
+//==================================================
+
+#include <cmath>
+#include <random>
+#include <unordered_set>
+#include <vector>
+#include "gtest/gtest.h"
+#include <src/planner/voxel_set_sketch.h>
+
+namespace {
+using FloatType = double;
+using size_t = std::size_t;
+using SketchType = VoxelSetSketch<FloatType>;
+using VoxelSet = std::unordered_set<size_t>;
+
+const size_t kNumBins = 256;
+const size_t kNumRandomPairs = 200;
+// Allowed deviation from the exact value in standard errors
+const FloatType kMaxStandardErrors = 4;
+
+/// Two sets with the given sizes that share num_shared elements
+void createSets(const size_t size1, const size_t size2, const size_t num_shared, std::mt19937_64& rnd,
+                VoxelSet* set1, VoxelSet* set2) {
+  set1->clear();
+  set2->clear();
+  while (set1->size() < num_shared) {
+    const size_t element = rnd();
+    set1->insert(element);
+    set2->insert(element);
+  }
+  while (set1->size() < size1) {
+    set1->insert(rnd());
+  }
+  while (set2->size() < size2) {
+    const size_t element = rnd();
+    if (set1->count(element) == 0) {
+      set2->insert(element);
+    }
+  }
+}
+
+FloatType computeExactAverageSizeIoU(const size_t size1, const size_t size2, const size_t num_shared) {
+  return 2 * num_shared / FloatType(size1 + size2);
+}
+
+/// Bound of the estimation error of the average size IoU (Dice coefficient) derived from the
+/// standard error of the Jaccard estimate sqrt(J * (1 - J) / num_bins) and dDice / dJ = 2 / (1 + J)^2.
+FloatType computeMaxAverageSizeIoUError(const size_t size1, const size_t size2, const size_t num_shared) {
+  const FloatType jaccard = num_shared / FloatType(size1 + size2 - num_shared);
+  const FloatType jaccard_std_error = std::sqrt(jaccard * (1 - jaccard) / kNumBins);
+  const FloatType dice_std_error = 2 / ((1 + jaccard) * (1 + jaccard)) * jaccard_std_error;
+  // The bins make the estimate discrete so allow for one bin of deviation as well
+  return kMaxStandardErrors * dice_std_error + 2.0 / kNumBins;
+}
+
+TEST(VoxelSetSketchTest, IdenticalSets) {
+  std::mt19937_64 rnd(0);
+  VoxelSet set1;
+  VoxelSet set2;
+  createSets(1000, 1000, 1000, rnd, &set1, &set2);
+  const SketchType sketch1(set1, kNumBins);
+  const SketchType sketch2(set2, kNumBins);
+  EXPECT_EQ(sketch1.estimateJaccardIndex(sketch2), 1);
+  EXPECT_EQ(sketch1.estimateAverageSizeIoU(sketch2), 1);
+  EXPECT_EQ(sketch1.upperBoundAverageSizeIoU(sketch2), 1);
+}
+
+TEST(VoxelSetSketchTest, EmptySets) {
+  const SketchType empty_sketch(VoxelSet(), kNumBins);
+  const SketchType other_empty_sketch(VoxelSet(), kNumBins);
+  EXPECT_EQ(empty_sketch.setSize(), 0u);
+  EXPECT_EQ(empty_sketch.estimateAverageSizeIoU(other_empty_sketch), 0);
+  EXPECT_EQ(empty_sketch.upperBoundAverageSizeIoU(other_empty_sketch), 0);
+  const SketchType sketch(VoxelSet { 1, 2, 3 }, kNumBins);
+  EXPECT_EQ(empty_sketch.estimateAverageSizeIoU(sketch), 0);
+}
+
+TEST(VoxelSetSketchTest, DisjointSets) {
+  std::mt19937_64 rnd(1);
+  VoxelSet set1;
+  VoxelSet set2;
+  createSets(2000, 3000, 0, rnd, &set1, &set2);
+  const SketchType sketch1(set1, kNumBins);
+  const SketchType sketch2(set2, kNumBins);
+  EXPECT_LE(sketch1.estimateAverageSizeIoU(sketch2), computeMaxAverageSizeIoUError(2000, 3000, 0));
+}
+
+TEST(VoxelSetSketchTest, AverageSizeIoUEstimateIsWithinErrorBound) {
+  std::mt19937_64 rnd(2);
+  std::uniform_int_distribution<size_t> size_dist(500, 5000);
+  FloatType sum_error = 0;
+  for (size_t i = 0; i < kNumRandomPairs; ++i) {
+    const size_t size1 = size_dist(rnd);
+    const size_t size2 = size_dist(rnd);
+    const size_t num_shared = std::uniform_int_distribution<size_t>(0, std::min(size1, size2))(rnd);
+    VoxelSet set1;
+    VoxelSet set2;
+    createSets(size1, size2, num_shared, rnd, &set1, &set2);
+    const SketchType sketch1(set1, kNumBins);
+    const SketchType sketch2(set2, kNumBins);
+
+    const FloatType exact = computeExactAverageSizeIoU(size1, size2, num_shared);
+    const FloatType estimate = sketch1.estimateAverageSizeIoU(sketch2);
+    EXPECT_NEAR(estimate, exact, computeMaxAverageSizeIoUError(size1, size2, num_shared))
+        << "Sizes " << size1 << ", " << size2 << " with " << num_shared << " shared elements";
+    EXPECT_EQ(estimate, sketch2.estimateAverageSizeIoU(sketch1));
+    // The size bound used to skip pairs must never be below the exact value
+    EXPECT_GE(sketch1.upperBoundAverageSizeIoU(sketch2), exact - 1e-12);
+    sum_error += estimate - exact;
+  }
+  // The estimate has no noticeable bias
+  EXPECT_LT(std::abs(sum_error / kNumRandomPairs), 0.01);
+}
+
+}